@@ -780,6 +780,12 @@ GAtChat *at_util_open_device(struct ofono_modem *modem, const char *key,
 	syntax = g_at_syntax_new_gsm_permissive();
 	chat = g_at_chat_new(channel, syntax);
 	g_at_syntax_unref(syntax);
+
+	/* A tty opened here is a plain fd, let GAtIO use readv/writev */
+	if (chat != NULL)
+		g_at_io_set_unix_fd(g_at_chat_get_io(chat),
+					g_io_channel_unix_get_fd(channel));
+
 	g_io_channel_unref(channel);
 
 	if (chat == NULL)
@@ -43,6 +43,11 @@
 typedef void (*qmi_message_func_t)(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data);
 
+#define QMI_BUFFER_SIZE		4096
+#define QMI_DEFAULT_WINDOW	8	/* Requests in flight per client */
+#define QMI_WRITE_BATCH		16	/* Requests written per wakeup */
+#define QMI_READ_BATCH		8	/* Reads per wakeup */
+
 struct discovery {
 	qmi_destroy_func_t destroy;
 };
@@ -62,8 +67,12 @@ struct qmi_device {
 	guint read_watch;
 	guint write_watch;
 	GQueue *req_queue;
-	GQueue *control_queue;
-	GQueue *service_queue;
+	GHashTable *pending;		/* Requests written, by __request_key */
+	GHashTable *in_flight;		/* Written requests, by __client_key */
+	uint8_t window[256];		/* By service type, 0 for the default */
+	unsigned char rbuf[QMI_BUFFER_SIZE];
+	unsigned int rbuf_len;
+	gint64 created;
 	GQueue *discovery_queue;
 	uint8_t next_control_tid;
 	uint16_t next_service_tid;
@@ -106,10 +115,13 @@ struct qmi_result {
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint16_t tlv_index[256];	/* TLV offset + 1 by type, 0 if none */
 };
 
 struct qmi_request {
 	uint16_t tid;
+	uint8_t service;
 	uint8_t client;
 	void *buf;
 	size_t len;
@@ -187,6 +199,7 @@ static struct qmi_request *__request_alloc(uint8_t service,
 
 	req->buf = g_malloc(req->len);
 
+	req->service = service;
 	req->client = client;
 
 	hdr = req->buf;
@@ -220,6 +233,26 @@ static void __request_free(gpointer data, gpointer user_data)
 	g_free(req);
 }
 
+static void __request_destroy(gpointer data)
+{
+	__request_free(data, NULL);
+}
+
+/*
+ * Control and service transaction ids are allocated independently, and
+ * responses echo the service and client of their request.
+ */
+static gpointer __request_key(uint8_t service, uint8_t client, uint16_t tid)
+{
+	return GUINT_TO_POINTER((guint) service << 24 |
+				(guint) client << 16 | tid);
+}
+
+static gpointer __client_key(uint8_t service, uint8_t client)
+{
+	return GUINT_TO_POINTER(service | client << 8);
+}
+
 static gint __request_compare(gconstpointer a, gconstpointer b)
 {
 	const struct qmi_request *req = a;
@@ -642,40 +675,87 @@ static void __debug_device(struct qmi_device *device,
 	device->debug_func(strbuf, device->debug_data);
 }
 
+static bool __request_can_send(struct qmi_device *device,
+					const struct qmi_request *req)
+{
+	unsigned int window = device->window[req->service];
+	gpointer in_flight;
+
+	if (!window)
+		window = QMI_DEFAULT_WINDOW;
+
+	in_flight = g_hash_table_lookup(device->in_flight,
+				__client_key(req->service, req->client));
+
+	return GPOINTER_TO_UINT(in_flight) < window;
+}
+
+static void __request_sent(struct qmi_device *device,
+					struct qmi_request *req)
+{
+	gpointer key = __request_key(req->service, req->client, req->tid);
+	gpointer client = __client_key(req->service, req->client);
+	unsigned int in_flight;
+
+	/* A transaction id that wrapped around replaces its stale request */
+	if (!g_hash_table_contains(device->pending, key)) {
+		in_flight = GPOINTER_TO_UINT(g_hash_table_lookup(
+						device->in_flight, client));
+		g_hash_table_replace(device->in_flight, client,
+						GUINT_TO_POINTER(in_flight + 1));
+	}
+
+	g_hash_table_replace(device->pending, key, req);
+}
+
+/*
+ * Writes every queued request whose client has room in its window, each
+ * QMUX frame with a write of its own since the character device hands
+ * one write to the modem as one message.  Requests of a client that has
+ * a full window keep their order and wait for a response to free a slot.
+ */
 static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
 	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
 	struct qmi_request *req;
 	ssize_t bytes_written;
+	unsigned int written = 0;
+	GList *list, *next;
 
-	req = g_queue_pop_head(device->req_queue);
-	if (!req)
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
-	bytes_written = write(device->fd, req->buf, req->len);
-	if (bytes_written < 0)
-		return FALSE;
+	for (list = g_queue_peek_head_link(device->req_queue); list;
+							list = next) {
+		next = list->next;
+		req = list->data;
 
-	__hexdump('>', req->buf, bytes_written,
-				device->debug_func, device->debug_data);
+		if (!__request_can_send(device, req))
+			continue;
 
-	__debug_msg(' ', req->buf, bytes_written,
+		if (written == QMI_WRITE_BATCH)
+			return TRUE;
+
+		bytes_written = write(device->fd, req->buf, req->len);
+		if (bytes_written < 0)
+			return errno == EAGAIN || errno == EINTR;
+
+		g_queue_delete_link(device->req_queue, list);
+
+		__hexdump('>', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
 
-	hdr = req->buf;
+		__debug_msg(' ', req->buf, bytes_written,
+				device->debug_func, device->debug_data);
 
-	if (hdr->service == QMI_SERVICE_CONTROL)
-		g_queue_push_tail(device->control_queue, req);
-	else
-		g_queue_push_tail(device->service_queue, req);
+		__request_sent(device, req);
 
-	g_free(req->buf);
-	req->buf = NULL;
+		g_free(req->buf);
+		req->buf = NULL;
 
-	if (g_queue_get_length(device->req_queue) > 0)
-		return TRUE;
+		written += 1;
+	}
 
 	return FALSE;
 }
@@ -697,6 +777,36 @@ static void wakeup_writer(struct qmi_device *device)
 				can_write_data, device, write_watch_destroy);
 }
 
+static struct qmi_request *__request_take(struct qmi_device *device,
+					uint8_t service, uint8_t client,
+					uint16_t tid)
+{
+	gpointer key = __request_key(service, client, tid);
+	gpointer client_key = __client_key(service, client);
+	struct qmi_request *req;
+	unsigned int in_flight;
+
+	req = g_hash_table_lookup(device->pending, key);
+	if (!req)
+		return NULL;
+
+	g_hash_table_steal(device->pending, key);
+
+	in_flight = GPOINTER_TO_UINT(g_hash_table_lookup(device->in_flight,
+								client_key));
+	if (in_flight > 1)
+		g_hash_table_replace(device->in_flight, client_key,
+						GUINT_TO_POINTER(in_flight - 1));
+	else
+		g_hash_table_remove(device->in_flight, client_key);
+
+	/* A slot in the window of the client just opened up */
+	if (!g_queue_is_empty(device->req_queue))
+		wakeup_writer(device);
+
+	return req;
+}
+
 static uint16_t __request_submit(struct qmi_device *device,
 				struct qmi_request *req)
 {
@@ -761,6 +871,7 @@ static void handle_indication(struct qmi_device *device,
 	result.message = message;
 	result.data = data;
 	result.length = length;
+	result.indexed = false;
 
 	if (client_id == 0xff) {
 		g_hash_table_foreach(device->service_list,
@@ -789,7 +900,6 @@ static void handle_packet(struct qmi_device *device,
 		const struct qmi_control_hdr *control = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		/* Ignore control messages with client identifier */
 		if (hdr->client != 0x00)
@@ -810,19 +920,13 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = __request_take(device, hdr->service, hdr->client, tid);
+		if (!req)
 			return;
-
-		req = list->data;
-
-		g_queue_delete_link(device->control_queue, list);
 	} else {
 		const struct qmi_service_hdr *service = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		msg = buf + QMI_SERVICE_HDR_SIZE;
 
@@ -839,14 +943,9 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = __request_take(device, hdr->service, hdr->client, tid);
+		if (!req)
 			return;
-
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
 	}
 
 	if (req->callback)
@@ -855,52 +954,77 @@ static void handle_packet(struct qmi_device *device,
 	__request_free(req, NULL);
 }
 
-static gboolean received_data(GIOChannel *channel, GIOCondition cond,
-							gpointer user_data)
+/*
+ * Handles every complete frame in the receive buffer and keeps what is
+ * left of a frame split across reads for the next one.
+ */
+static void handle_frames(struct qmi_device *device)
 {
-	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
-	unsigned char buf[2048];
-	ssize_t bytes_read;
-	uint16_t offset;
+	const struct qmi_mux_hdr *hdr;
+	unsigned int offset = 0;
 
-	if (cond & G_IO_NVAL)
-		return FALSE;
+	while (device->rbuf_len - offset >= QMI_MUX_HDR_SIZE) {
+		unsigned int len;
 
-	bytes_read = read(device->fd, buf, sizeof(buf));
-	if (bytes_read < 0)
-		return TRUE;
+		hdr = (void *) (device->rbuf + offset);
 
-	__hexdump('<', buf, bytes_read,
-				device->debug_func, device->debug_data);
+		/* Check for fixed frame and flags value */
+		if (hdr->frame != 0x01 || hdr->flags != 0x80) {
+			offset = device->rbuf_len;
+			break;
+		}
 
-	offset = 0;
+		len = GUINT16_FROM_LE(hdr->length) + 1;
 
-	while (offset < bytes_read) {
-		uint16_t len;
+		if (len > sizeof(device->rbuf)) {
+			__debug_device(device, "frame of %u bytes dropped",
+									len);
+			offset = device->rbuf_len;
+			break;
+		}
 
-		/* Check if QMI mux header fits into packet */
-		if (bytes_read - offset < QMI_MUX_HDR_SIZE)
+		/* Wait for the rest of the frame */
+		if (device->rbuf_len - offset < len)
 			break;
 
-		hdr = (void *) (buf + offset);
+		__debug_msg(' ', device->rbuf + offset, len,
+				device->debug_func, device->debug_data);
 
-		/* Check for fixed frame and flags value */
-		if (hdr->frame != 0x01 || hdr->flags != 0x80)
-			break;
+		handle_packet(device, hdr,
+				device->rbuf + offset + QMI_MUX_HDR_SIZE);
 
-		len = GUINT16_FROM_LE(hdr->length) + 1;
+		offset += len;
+	}
+
+	device->rbuf_len -= offset;
+	memmove(device->rbuf, device->rbuf + offset, device->rbuf_len);
+}
 
-		/* Check that packet size matches frame size */
-		if (bytes_read - offset < len)
+static gboolean received_data(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct qmi_device *device = user_data;
+	ssize_t bytes_read;
+	unsigned int reads;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	/* Handle what the modem queued up before going back to the loop */
+	for (reads = 0; reads < QMI_READ_BATCH; reads++) {
+		unsigned char *buf = device->rbuf + device->rbuf_len;
+
+		bytes_read = read(device->fd, buf,
+				sizeof(device->rbuf) - device->rbuf_len);
+		if (bytes_read <= 0)
 			break;
 
-		__debug_msg(' ', buf + offset, len,
+		__hexdump('<', buf, bytes_read,
 				device->debug_func, device->debug_data);
 
-		handle_packet(device, hdr, buf + offset + QMI_MUX_HDR_SIZE);
+		device->rbuf_len += bytes_read;
 
-		offset += len;
+		handle_frames(device);
 	}
 
 	return TRUE;
@@ -950,6 +1074,7 @@ struct qmi_device *qmi_device_new(int fd)
 	__debug_device(device, "device %p new", device);
 
 	device->ref_count = 1;
+	device->created = g_get_monotonic_time();
 
 	device->fd = fd;
 	device->close_on_unref = false;
@@ -979,8 +1104,9 @@ struct qmi_device *qmi_device_new(int fd)
 	g_io_channel_unref(device->io);
 
 	device->req_queue = g_queue_new();
-	device->control_queue = g_queue_new();
-	device->service_queue = g_queue_new();
+	device->pending = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, __request_destroy);
+	device->in_flight = g_hash_table_new(g_direct_hash, g_direct_equal);
 	device->discovery_queue = g_queue_new();
 
 	device->service_list = g_hash_table_new_full(g_direct_hash,
@@ -1012,11 +1138,8 @@ void qmi_device_unref(struct qmi_device *device)
 
 	__debug_device(device, "device %p free", device);
 
-	g_queue_foreach(device->control_queue, __request_free, NULL);
-	g_queue_free(device->control_queue);
-
-	g_queue_foreach(device->service_queue, __request_free, NULL);
-	g_queue_free(device->service_queue);
+	g_hash_table_destroy(device->pending);
+	g_hash_table_destroy(device->in_flight);
 
 	g_queue_foreach(device->req_queue, __request_free, NULL);
 	g_queue_free(device->req_queue);
@@ -1057,6 +1180,21 @@ void qmi_device_set_debug(struct qmi_device *device,
 	device->debug_data = user_data;
 }
 
+bool qmi_device_set_window(struct qmi_device *device, uint8_t type,
+							uint8_t window)
+{
+	if (!device)
+		return false;
+
+	device->window[type] = window;
+
+	/* A larger window can let queued requests go */
+	if (!g_queue_is_empty(device->req_queue))
+		wakeup_writer(device);
+
+	return true;
+}
+
 void qmi_device_set_close_on_unref(struct qmi_device *device, bool do_close)
 {
 	if (!device)
@@ -1106,6 +1244,55 @@ static const void *tlv_get(const void *data, uint16_t size,
 	return NULL;
 }
 
+/*
+ * Records where the first TLV of each type starts, in one pass, so that
+ * the qmi_result_get_*() calls a driver makes on a result are O(1).
+ */
+static void result_index_tlvs(struct qmi_result *result)
+{
+	const void *ptr = result->data;
+	uint16_t len = result->length;
+
+	memset(result->tlv_index, 0, sizeof(result->tlv_index));
+	result->indexed = true;
+
+	while (len > QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = ptr;
+		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
+
+		if (!result->tlv_index[tlv->type])
+			result->tlv_index[tlv->type] = ptr - result->data + 1;
+
+		/* Nothing past a truncated TLV can be trusted */
+		if (tlv_length > len - QMI_TLV_HDR_SIZE)
+			break;
+
+		ptr += QMI_TLV_HDR_SIZE + tlv_length;
+		len -= QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *result_tlv_get(struct qmi_result *result, uint8_t type,
+							uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+	uint16_t offset;
+
+	if (!result->indexed)
+		result_index_tlvs(result);
+
+	offset = result->tlv_index[type];
+	if (!offset)
+		return NULL;
+
+	tlv = result->data + offset - 1;
+
+	if (length)
+		*length = GUINT16_FROM_LE(tlv->length);
+
+	return tlv->value;
+}
+
 bool qmi_device_get_service_version(struct qmi_device *device, uint8_t type,
 					uint16_t *major, uint16_t *minor)
 {
@@ -1239,6 +1426,10 @@ done:
 	device->version_list = list;
 	device->version_count = count;
 
+	DBG("discovery done after %" G_GINT64_FORMAT " ms, %u services",
+			(g_get_monotonic_time() - device->created) / 1000,
+			count);
+
 	if (data->func)
 		data->func(data->user_data);
 
@@ -1263,16 +1454,9 @@ static gboolean discover_reply(gpointer user_data)
 		if (list) {
 			req = list->data;
 			g_queue_delete_link(device->req_queue, list);
-		} else {
-			list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-
-			if (list) {
-				req = list->data;
-				g_queue_delete_link(device->control_queue,
-								list);
-			}
-		}
+		} else
+			req = __request_take(device, QMI_SERVICE_CONTROL,
+								0x00, tid);
 	}
 
 	if (data->func)
@@ -1807,7 +1991,7 @@ const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -1818,7 +2002,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -1834,7 +2018,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1853,7 +2037,7 @@ bool qmi_result_get_int16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1874,7 +2058,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1896,7 +2080,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1918,7 +2102,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2013,6 +2197,9 @@ static void service_create_callback(uint16_t message, uint16_t length,
 	__debug_device(device, "service created [client=%d,type=%d]",
 					service->client_id, service->type);
 
+	DBG("service %d ready after %" G_GINT64_FORMAT " ms", service->type,
+			(g_get_monotonic_time() - device->created) / 1000);
+
 	hash_id = service->type | (service->client_id << 8);
 
 	g_hash_table_replace(device->service_list,
@@ -2255,8 +2442,9 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	result.message = message;
 	result.data = buffer;
 	result.length = length;
+	result.indexed = false;
 
-	result_code = tlv_get(buffer, length, 0x02, &len);
+	result_code = result_tlv_get(&result, 0x02, &len);
 	if (!result_code)
 		goto done;
 
@@ -2338,14 +2526,10 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 
 		g_queue_delete_link(device->req_queue, list);
 	} else {
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = __request_take(device, service->type,
+						service->client_id, tid);
+		if (!req)
 			return false;
-
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
 	}
 
 	service_send_free(req->user_data);
@@ -2355,7 +2539,7 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	return true;
 }
 
-static GQueue *remove_client(GQueue *queue, uint8_t client)
+static GQueue *remove_client(GQueue *queue, uint8_t service, uint8_t client)
 {
 	GQueue *new_queue;
 	GList *list;
@@ -2371,7 +2555,8 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 
 		req = list->data;
 
-		if (!req->client || req->client != client) {
+		if (!req->client || req->service != service ||
+						req->client != client) {
 			g_queue_push_tail_link(new_queue, list);
 			continue;
 		}
@@ -2386,6 +2571,21 @@ static GQueue *remove_client(GQueue *queue, uint8_t client)
 	return new_queue;
 }
 
+static gboolean remove_pending_client(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	struct qmi_request *req = value;
+	struct qmi_service *service = user_data;
+
+	if (!req->client || req->service != service->type ||
+					req->client != service->client_id)
+		return FALSE;
+
+	service_send_free(req->user_data);
+
+	return TRUE;
+}
+
 bool qmi_service_cancel_all(struct qmi_service *service)
 {
 	struct qmi_device *device;
@@ -2400,11 +2600,13 @@ bool qmi_service_cancel_all(struct qmi_service *service)
 	if (!device)
 		return false;
 
-	device->req_queue = remove_client(device->req_queue,
+	device->req_queue = remove_client(device->req_queue, service->type,
 						service->client_id);
 
-	device->service_queue = remove_client(device->service_queue,
-							service->client_id);
+	g_hash_table_foreach_remove(device->pending, remove_pending_client,
+								service);
+	g_hash_table_remove(device->in_flight,
+			__client_key(service->type, service->client_id));
 
 	return true;
 }
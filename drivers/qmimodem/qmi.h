@@ -82,6 +82,8 @@ void qmi_device_set_debug(struct qmi_device *device,
 				qmi_debug_func_t func, void *user_data);
 
 void qmi_device_set_close_on_unref(struct qmi_device *device, bool do_close);
+bool qmi_device_set_window(struct qmi_device *device, uint8_t type,
+							uint8_t window);
 
 bool qmi_device_discover(struct qmi_device *device, qmi_discover_func_t func,
 				void *user_data, qmi_destroy_func_t destroy);
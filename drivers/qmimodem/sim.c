@@ -919,6 +919,9 @@ static int qmi_sim_probe(struct ofono_sim *sim,
 
 	ofono_sim_set_data(sim, data);
 
+	/* UIM requests are independent, the modem queues them for us */
+	ofono_sim_set_max_file_ops(sim, 4);
+
 	qmi_service_create_shared(device, QMI_SERVICE_DMS,
 						create_dms_cb, sim, NULL);
 
@@ -1597,6 +1597,9 @@ static int ril_sim_probe(struct ofono_sim *sim, unsigned int vendor,
 
 	ofono_sim_set_data(sim, sd);
 
+	/* rild matches SIM_IO replies by serial, several can be pending */
+	ofono_sim_set_max_file_ops(sim, 4);
+
 	/*
 	 * TODO: analyze if capability check is needed
 	 * and/or timer should be adjusted.
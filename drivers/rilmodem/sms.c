@@ -450,9 +450,6 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 
 	/* TODO: if (mms) { ... } */
 
-	parcel_init(&rilp);
-	parcel_w_int32(&rilp, 2);	/* Number of strings */
-
 	/*
 	 * SMSC address:
 	 *
@@ -461,12 +458,6 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 	 * of a zero-length string.
 	 */
 	smsc_len = pdu_len - tpdu_len;
-	/* TODO: encode SMSC & write to parcel */
-	if (smsc_len > 1)
-		ofono_error("SMSC address specified (smsc_len %d); "
-				"NOT-IMPLEMENTED", smsc_len);
-
-	parcel_w_string(&rilp, NULL); /* SMSC address; NULL == default */
 
 	/*
 	 * TPDU:
@@ -476,6 +467,17 @@ static void ril_cmgs(struct ofono_sms *sms, const unsigned char *pdu,
 	 *  parcel_w_string() encodes utf8 -> utf16
 	 */
 	encode_hex_own_buf(pdu + smsc_len, tpdu_len, 0, hexbuf);
+
+	parcel_init_sized(&rilp, PARCEL_SIZE_INT32 + parcel_size_string(NULL) +
+					parcel_size_string(hexbuf));
+	parcel_w_int32(&rilp, 2);	/* Number of strings */
+
+	/* TODO: encode SMSC & write to parcel */
+	if (smsc_len > 1)
+		ofono_error("SMSC address specified (smsc_len %d); "
+				"NOT-IMPLEMENTED", smsc_len);
+
+	parcel_w_string(&rilp, NULL); /* SMSC address; NULL == default */
 	parcel_w_string(&rilp, hexbuf);
 
 	g_ril_append_print_buf(sd->ril, "(%s)", hexbuf);
@@ -680,6 +682,9 @@ static int ril_sms_probe(struct ofono_sms *sms, unsigned int vendor,
 
 	ofono_sms_set_data(sms, data);
 
+	/* Each SEND_SMS reply carries its serial, so submits can overlap */
+	ofono_sms_set_tx_window(sms, 4);
+
 	g_idle_add(ril_delayed_register, sms);
 
 	return 0;
@@ -41,6 +41,10 @@
 #define COMMAND_FLAG_EXPECT_PDU			0x1
 #define COMMAND_FLAG_EXPECT_SHORT_PROMPT	0x2
 
+#define LINE_CHUNK_SIZE		4096
+#define LINE_ALIGN(size) \
+	(((size) + sizeof(gpointer) - 1) & ~(sizeof(gpointer) - 1))
+
 struct at_chat;
 static void chat_wakeup_writer(struct at_chat *chat);
 
@@ -73,6 +77,25 @@ typedef gboolean (*node_remove_func)(struct at_notify_node *node,
 struct at_notify {
 	GSList *nodes;
 	gboolean pdu;
+	guint hits;				/* Lines dispatched */
+};
+
+struct notify_trie {
+	char c;
+	struct at_notify *notify;		/* Prefix ending here, if any */
+	struct notify_trie *child;		/* Next character */
+	struct notify_trie *next;		/* Sibling */
+};
+
+/*
+ * Response lines of the command in progress live in a chain of chunks
+ * together with the list nodes that link them, and are all released at
+ * once when the command finishes.
+ */
+struct line_chunk {
+	struct line_chunk *next;
+	gsize size;				/* Usable bytes after header */
+	gsize used;
 };
 
 struct at_chat {
@@ -84,6 +107,8 @@ struct at_chat {
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
 	GHashTable *notify_list;		/* List of notification reg */
+	struct notify_trie *notify_trie;	/* notify_list by prefix */
+	gboolean notify_trie_dirty;		/* Rebuild before matching */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	guint read_so_far;			/* Number of bytes processed */
@@ -92,6 +117,9 @@ struct at_chat {
 	gpointer debug_data;			/* Data to pass to debug func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
 	GSList *response_lines;			/* char * lines of the response */
+	struct line_chunk *line_arena;		/* Storage of response_lines */
+	char *line_buf;				/* Lines split by the wrap */
+	gsize line_buf_size;
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -170,6 +198,76 @@ static gint at_command_compare_by_id(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
+static void notify_trie_free(struct notify_trie *node)
+{
+	struct notify_trie *next;
+
+	while (node) {
+		next = node->next;
+		notify_trie_free(node->child);
+		g_free(node);
+		node = next;
+	}
+}
+
+static struct notify_trie *notify_trie_step(struct notify_trie *node, char c)
+{
+	for (; node; node = node->next)
+		if (node->c == c)
+			return node;
+
+	return NULL;
+}
+
+static void notify_trie_insert(struct notify_trie **children,
+				const char *prefix, struct at_notify *notify)
+{
+	struct notify_trie *node;
+
+	while (TRUE) {
+		node = notify_trie_step(*children, *prefix);
+
+		if (node == NULL) {
+			node = g_new0(struct notify_trie, 1);
+			node->c = *prefix;
+			node->next = *children;
+			*children = node;
+		}
+
+		if (*++prefix == '\0') {
+			node->notify = notify;
+			return;
+		}
+
+		children = &node->child;
+	}
+}
+
+/*
+ * Unsolicited lines are matched by walking a trie of the registered
+ * prefixes, so the cost depends on the length of the line's prefix and
+ * not on how many prefixes are registered.  The trie is rebuilt lazily,
+ * the next time a line needs matching after a prefix was added or removed.
+ */
+static void at_chat_build_notify_trie(struct at_chat *chat)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (chat->notify_trie_dirty == FALSE)
+		return;
+
+	notify_trie_free(chat->notify_trie);
+	chat->notify_trie = NULL;
+
+	g_hash_table_iter_init(&iter, chat->notify_list);
+
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		notify_trie_insert(&chat->notify_trie, key, value);
+
+	chat->notify_trie_dirty = FALSE;
+}
+
 static gboolean at_chat_unregister_all(struct at_chat *chat,
 					gboolean mark_only,
 					node_remove_func func,
@@ -222,8 +320,10 @@ static gboolean at_chat_unregister_all(struct at_chat *chat,
 			g_slist_free_1(t);
 		}
 
-		if (notify->nodes == NULL)
+		if (notify->nodes == NULL) {
 			g_hash_table_iter_remove(&iter);
+			chat->notify_trie_dirty = TRUE;
+		}
 	}
 
 	return TRUE;
@@ -317,6 +417,68 @@ static void free_terminator(gpointer pointer)
 	info = NULL;
 }
 
+static void line_arena_free(struct line_chunk *chunk)
+{
+	struct line_chunk *next;
+
+	while (chunk) {
+		next = chunk->next;
+		g_free(chunk);
+		chunk = next;
+	}
+}
+
+/* Keep one regular sized chunk around for the next command */
+static void line_arena_reset(struct at_chat *chat)
+{
+	struct line_chunk *chunk = chat->line_arena;
+
+	if (chunk == NULL)
+		return;
+
+	line_arena_free(chunk->next);
+	chunk->next = NULL;
+	chunk->used = 0;
+
+	if (chunk->size == LINE_CHUNK_SIZE)
+		return;
+
+	g_free(chunk);
+	chat->line_arena = NULL;
+}
+
+static gboolean line_arena_append(struct at_chat *chat, const char *line)
+{
+	struct line_chunk *chunk = chat->line_arena;
+	gsize len = strlen(line) + 1;
+	gsize needed = LINE_ALIGN(sizeof(GSList) + len);
+	GSList *node;
+
+	if (chunk == NULL || chunk->size - chunk->used < needed) {
+		gsize size = MAX(needed, LINE_CHUNK_SIZE);
+
+		chunk = g_try_malloc(sizeof(struct line_chunk) + size);
+		if (chunk == NULL)
+			return FALSE;
+
+		chunk->next = chat->line_arena;
+		chunk->size = size;
+		chunk->used = 0;
+		chat->line_arena = chunk;
+	}
+
+	node = (GSList *) ((char *) (chunk + 1) + chunk->used);
+	chunk->used += needed;
+
+	node->data = node + 1;
+	memcpy(node->data, line, len);
+
+	node->next = chat->response_lines;
+	chat->response_lines = node;
+
+	return TRUE;
+}
+
 static void chat_cleanup(struct at_chat *chat)
 {
 	struct at_command *c;
@@ -329,10 +491,17 @@ static void chat_cleanup(struct at_chat *chat)
 	chat->command_queue = NULL;
 
 	/* Cleanup any response lines we have pending */
-	g_slist_free_full(chat->response_lines, g_free);
 	chat->response_lines = NULL;
+	line_arena_free(chat->line_arena);
+	chat->line_arena = NULL;
+
+	g_free(chat->line_buf);
+	chat->line_buf = NULL;
+	chat->line_buf_size = 0;
 
 	/* Cleanup registered notifications */
+	notify_trie_free(chat->notify_trie);
+	chat->notify_trie = NULL;
 	g_hash_table_destroy(chat->notify_list);
 	chat->notify_list = NULL;
 
@@ -387,26 +556,39 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 
 static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 {
-	GHashTableIter iter;
+	struct notify_trie *node;
 	struct at_notify *notify;
-	gpointer key, value;
 	gboolean ret = FALSE;
 	GAtResult result;
+	const char *p;
+
+	at_chat_build_notify_trie(chat);
 
-	g_hash_table_iter_init(&iter, chat->notify_list);
 	result.lines = 0;
 	result.final_or_pdu = 0;
 
 	chat->in_notify = TRUE;
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		notify = value;
+	/*
+	 * Callbacks can register new prefixes, which only marks the trie
+	 * dirty, and unregistering is deferred while in_notify is set, so
+	 * the trie stays intact for the duration of the walk.
+	 */
+	for (node = chat->notify_trie, p = line; *p; p++) {
+		node = notify_trie_step(node, *p);
+		if (node == NULL)
+			break;
+
+		notify = node->notify;
+		node = node->child;
 
-		if (!g_str_has_prefix(line, key))
+		if (notify == NULL)
 			continue;
 
+		notify->hits += 1;
+
 		if (notify->pdu) {
-			chat->pdu_notify = line;
+			chat->pdu_notify = g_strdup(line);
 
 			if (chat->syntax->set_hint)
 				chat->syntax->set_hint(chat->syntax,
@@ -426,7 +608,6 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 
 	if (ret) {
 		g_slist_free(result.lines);
-		g_free(line);
 
 		at_chat_unregister_all(chat, FALSE, node_is_destroyed, NULL);
 	}
@@ -462,9 +643,8 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 		cmd->callback(ok, &result, cmd->user_data);
 	}
 
-	g_slist_free_full(response_lines, g_free);
+	line_arena_reset(p);
 
-	g_free(final);
 	at_command_destroy(cmd);
 }
 
@@ -554,7 +734,7 @@ out:
 		p->syntax->set_hint(p->syntax, hint);
 
 	if (cmd->listing && (cmd->flags & COMMAND_FLAG_EXPECT_PDU)) {
-		p->pdu_notify = line;
+		p->pdu_notify = g_strdup(line);
 		return TRUE;
 	}
 
@@ -567,9 +747,8 @@ out:
 		cmd->listing(&result, cmd->user_data);
 
 		g_slist_free(result.lines);
-		g_free(line);
 	} else
-		p->response_lines = g_slist_prepend(p->response_lines, line);
+		line_arena_append(p, line);
 
 	return TRUE;
 }
@@ -584,7 +763,7 @@ static void have_line(struct at_chat *p, char *str)
 
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2))
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -604,34 +783,30 @@ static void have_line(struct at_chat *p, char *str)
 			return;
 	}
 
-	if (at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
 	/* No matches & no commands active, ignore line */
-	g_free(str);
+	at_chat_match_notify(p, str);
 }
 
 static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 {
-	GHashTableIter iter;
+	struct notify_trie *node;
 	struct at_notify *notify;
-	char *prefix;
-	gpointer key, value;
 	gboolean called = FALSE;
+	const char *c;
 
-	p->in_notify = TRUE;
+	at_chat_build_notify_trie(p);
 
-	g_hash_table_iter_init(&iter, p->notify_list);
+	p->in_notify = TRUE;
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		prefix = key;
-		notify = value;
+	for (node = p->notify_trie, c = p->pdu_notify; *c; c++) {
+		node = notify_trie_step(node, *c);
+		if (node == NULL)
+			break;
 
-		if (!g_str_has_prefix(p->pdu_notify, prefix))
-			continue;
+		notify = node->notify;
+		node = node->child;
 
-		if (!notify->pdu)
+		if (notify == NULL || !notify->pdu)
 			continue;
 
 		g_slist_foreach(notify->nodes, at_notify_call_callback, result);
@@ -680,11 +855,15 @@ static void have_pdu(struct at_chat *p, char *pdu)
 error:
 	g_free(p->pdu_notify);
 	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
 }
 
+/*
+ * Returns the next line, NUL terminated in place inside the ring buffer
+ * unless it happens to straddle the wrap point, in which case it is put
+ * together in line_buf.  Either way the line is only borrowed: it stays
+ * valid until the handler for it returns, and anything that needs it
+ * for longer has to make a copy.
+ */
 static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
 {
 	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
@@ -715,12 +894,34 @@ static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	line = g_try_new(char, line_length + 1);
-	if (line == NULL) {
+	/*
+	 * The terminator has already been consumed by the syntax, so it
+	 * can be overwritten.  The bytes stay put after the drain, nothing
+	 * writes into the ring buffer while the line is being handled.
+	 */
+	if (pos < p->read_so_far && (strip_front >= (int) wrap ||
+				strip_front + line_length <= (int) wrap)) {
+		line = (char *) ring_buffer_read_ptr(rbuf, strip_front);
+		*buf = '\0';
+
 		ring_buffer_drain(rbuf, p->read_so_far);
-		return NULL;
+
+		return line;
+	}
+
+	if ((gsize) line_length + 1 > p->line_buf_size) {
+		line = g_try_realloc(p->line_buf, line_length + 1);
+		if (line == NULL) {
+			ring_buffer_drain(rbuf, p->read_so_far);
+			return NULL;
+		}
+
+		p->line_buf = line;
+		p->line_buf_size = line_length + 1;
 	}
 
+	line = p->line_buf;
+
 	ring_buffer_drain(rbuf, strip_front);
 	ring_buffer_read(rbuf, line, line_length);
 	ring_buffer_drain(rbuf, p->read_so_far - strip_front - line_length);
@@ -1093,6 +1294,7 @@ static struct at_notify *at_notify_create(struct at_chat *chat,
 	notify->pdu = pdu;
 
 	g_hash_table_insert(chat->notify_list, key, notify);
+	chat->notify_trie_dirty = TRUE;
 
 	return notify;
 }
@@ -1257,8 +1459,10 @@ static gboolean at_chat_unregister(struct at_chat *chat, gboolean mark_only,
 		at_notify_node_destroy(node, NULL);
 		notify->nodes = g_slist_remove(notify->nodes, node);
 
-		if (notify->nodes == NULL)
+		if (notify->nodes == NULL) {
 			g_hash_table_iter_remove(&iter);
+			chat->notify_trie_dirty = TRUE;
+		}
 
 		return TRUE;
 	}
@@ -1633,3 +1837,20 @@ gboolean g_at_chat_unregister_all(GAtChat *chat)
 					node_compare_by_group,
 					GUINT_TO_POINTER(chat->group));
 }
+
+guint g_at_chat_get_notify_hits(GAtChat *chat, const char *prefix)
+{
+	struct at_notify *notify;
+
+	if (chat == NULL || prefix == NULL)
+		return 0;
+
+	if (chat->parent->notify_list == NULL)
+		return 0;
+
+	notify = g_hash_table_lookup(chat->parent->notify_list, prefix);
+	if (notify == NULL)
+		return 0;
+
+	return notify->hits;
+}
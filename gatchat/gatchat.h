@@ -166,6 +166,13 @@ guint g_at_chat_register(GAtChat *chat, const char *prefix,
 gboolean g_at_chat_unregister(GAtChat *chat, guint id);
 gboolean g_at_chat_unregister_all(GAtChat *chat);
 
+/*!
+ * Returns how many unsolicited lines have been dispatched to the handlers
+ * registered for prefix.  The count is shared by all clones of the chat
+ * and starts from zero again once the last handler for prefix is removed.
+ */
+guint g_at_chat_get_notify_hits(GAtChat *chat, const char *prefix);
+
 gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 					guint timeout, guint msec);
 
@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
@@ -40,6 +41,8 @@
 
 #define BUFFER_SIZE	(2 * 2048)
 #define MAX_BUFFERS	64	/* Maximum number of in-flight write buffers */
+#define MAX_POOLED	4	/* Drained write buffers kept for reuse */
+#define MAX_IOVEC	32	/* Write buffer segments flushed per writev */
 #define HDLC_OVERHEAD	256	/* Rough estimate of HDLC protocol overhead */
 
 #define HDLC_FLAG	0x7e	/* Flag sequence */
@@ -51,16 +54,26 @@
 
 #define HDLC_FCS(fcs, c) crc_ccitt_byte(fcs, c)
 
+/* Word-at-a-time helpers for scanning 8 octets in one step */
+#define WORD_ONES	0x0101010101010101ULL
+#define WORD_HIGHS	0x8080808080808080ULL
+
+#define WORD_HAS_ZERO(v)	(((v) - WORD_ONES) & ~(v) & WORD_HIGHS)
+#define WORD_HAS_BYTE(v, c)	WORD_HAS_ZERO((v) ^ (WORD_ONES * (c)))
+#define WORD_HAS_LESS(v, n)	(((v) - WORD_ONES * (n)) & ~(v) & WORD_HIGHS)
+
 #define GUARD_TIMEOUT	1000	/* Pause time before and after '+++' sequence */
 
 struct _GAtHDLC {
 	gint ref_count;
 	GAtIO *io;
 	GQueue *write_queue;	/* Write buffer queue */
+	GQueue *buffer_pool;	/* Drained write buffers */
 	unsigned char *decode_buffer;
 	guint decode_offset;
 	guint16 decode_fcs;
 	gboolean decode_escape;
+	gboolean decode_overflow;
 	guint32 xmit_accm[8];
 	guint32 recv_accm;
 	GAtReceiveFunc receive_func;
@@ -242,34 +255,76 @@ static gboolean check_escape(GAtHDLC *hdlc, struct ring_buffer *rbuf)
 	return TRUE;
 }
 
-static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+/*
+ * Returns the length of the leading run of octets that can be copied into
+ * the decode buffer as-is: anything but the flag, the control escape or a
+ * control character that the receive ACCM tells us to drop.
+ */
+static unsigned int hdlc_plain_run(const unsigned char *buf,
+					unsigned int len, guint32 accm)
 {
-	GAtHDLC *hdlc = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
 	unsigned int pos = 0;
+	unsigned int end;
+	guint64 v;
 
-	/*
-	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
-	 * we read a data.
-	 */
-	if (hdlc->suspend_source > 0) {
-		g_source_remove(hdlc->suspend_source);
-		hdlc->suspend_source = 0;
-		g_timer_start(hdlc->timer);
-	} else if (hdlc->timer) {
-		gboolean escaping = check_escape(hdlc, rbuf);
+	while (pos < len) {
+		if (pos + 8 <= len) {
+			memcpy(&v, buf + pos, 8);
+
+			if (!WORD_HAS_BYTE(v, HDLC_FLAG) &&
+					!WORD_HAS_BYTE(v, HDLC_ESCAPE) &&
+					(accm == 0 || !WORD_HAS_LESS(v, 0x20))) {
+				pos += 8;
+				continue;
+			}
+		}
 
-		g_timer_start(hdlc->timer);
+		end = MIN(pos + 8, len);
 
-		if (escaping)
-			return;
+		for (; pos < end; pos++) {
+			unsigned char c = buf[pos];
+
+			if (c == HDLC_FLAG || c == HDLC_ESCAPE)
+				return pos;
+
+			if (c < 0x20 && (accm & (1 << c)))
+				return pos;
+		}
 	}
 
-	hdlc_record(hdlc, TRUE, buf, wrap);
+	return len;
+}
 
-	hdlc->in_read_handler = TRUE;
+static inline void hdlc_decode_append(GAtHDLC *hdlc,
+					const unsigned char *data,
+					unsigned int len)
+{
+	if (hdlc->decode_overflow)
+		return;
+
+	/* Frame does not fit, drop it once the closing flag arrives */
+	if (hdlc->decode_offset + len > BUFFER_SIZE) {
+		hdlc->decode_overflow = TRUE;
+		return;
+	}
+
+	memcpy(hdlc->decode_buffer + hdlc->decode_offset, data, len);
+	hdlc->decode_offset += len;
+	hdlc->decode_fcs = crc_ccitt(hdlc->decode_fcs, data, len);
+}
+
+/*
+ * Decodes one contiguous segment of the read buffer and returns the number
+ * of octets consumed.  Less than len is returned if decoding has to stop,
+ * either because NO CARRIER was detected or because the receive callback
+ * destroyed us.
+ */
+static unsigned int hdlc_decode(GAtHDLC *hdlc, const unsigned char *buf,
+							unsigned int len)
+{
+	unsigned int pos = 0;
+	unsigned int run;
+	unsigned char c;
 
 	while (pos < len) {
 		/*
@@ -279,47 +334,88 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		 * ACFC is enabled.
 		 */
 		if (hdlc->no_carrier_detect &&
-				hdlc->decode_offset == 0 && *buf == '\r')
+				hdlc->decode_offset == 0 && buf[pos] == '\r')
 			break;
 
 		if (hdlc->decode_escape == TRUE) {
-			unsigned char val = *buf ^ HDLC_TRANS;
-
-			hdlc->decode_buffer[hdlc->decode_offset++] = val;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, val);
+			c = buf[pos++] ^ HDLC_TRANS;
 
+			hdlc_decode_append(hdlc, &c, 1);
 			hdlc->decode_escape = FALSE;
-		} else if (*buf == HDLC_ESCAPE) {
+			continue;
+		}
+
+		run = hdlc_plain_run(buf + pos, len - pos, hdlc->recv_accm);
+		if (run > 0) {
+			hdlc_decode_append(hdlc, buf + pos, run);
+			pos += run;
+			continue;
+		}
+
+		if (buf[pos] == HDLC_ESCAPE) {
 			hdlc->decode_escape = TRUE;
-		} else if (*buf == HDLC_FLAG) {
+		} else if (buf[pos] == HDLC_FLAG) {
 			if (hdlc->receive_func && hdlc->decode_offset > 2 &&
+					hdlc->decode_overflow == FALSE &&
 					hdlc->decode_fcs == HDLC_GOODFCS) {
 				hdlc->receive_func(hdlc->decode_buffer,
 							hdlc->decode_offset - 2,
 							hdlc->receive_data);
 
 				if (hdlc->destroyed)
-					goto out;
+					break;
 			}
 
 			hdlc->decode_fcs = HDLC_INITFCS;
 			hdlc->decode_offset = 0;
-		} else if (*buf >= 0x20 ||
-					(hdlc->recv_accm & (1 << *buf)) == 0) {
-			hdlc->decode_buffer[hdlc->decode_offset++] = *buf;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, *buf);
+			hdlc->decode_overflow = FALSE;
 		}
 
-		buf++;
+		/* Control characters in the receive ACCM are dropped */
 		pos++;
+	}
 
-		if (pos == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, pos);
-			hdlc_record(hdlc, TRUE, buf, len - wrap);
-		}
+	return pos;
+}
+
+static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
+{
+	GAtHDLC *hdlc = user_data;
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int pos;
+
+	/*
+	 * We delete the the paused_timeout_cb or hdlc_suspend as soons as
+	 * we read a data.
+	 */
+	if (hdlc->suspend_source > 0) {
+		g_source_remove(hdlc->suspend_source);
+		hdlc->suspend_source = 0;
+		g_timer_start(hdlc->timer);
+	} else if (hdlc->timer) {
+		gboolean escaping = check_escape(hdlc, rbuf);
+
+		g_timer_start(hdlc->timer);
+
+		if (escaping)
+			return;
+	}
+
+	hdlc_record(hdlc, TRUE, buf, wrap);
+
+	hdlc->in_read_handler = TRUE;
+
+	pos = hdlc_decode(hdlc, buf, wrap);
+
+	if (pos == wrap && len > wrap) {
+		buf = ring_buffer_read_ptr(rbuf, pos);
+		hdlc_record(hdlc, TRUE, buf, len - wrap);
+
+		pos += hdlc_decode(hdlc, buf, len - wrap);
 	}
 
-out:
 	ring_buffer_drain(rbuf, pos);
 
 	hdlc->in_read_handler = FALSE;
@@ -344,6 +440,7 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	hdlc->decode_fcs = HDLC_INITFCS;
 	hdlc->decode_offset = 0;
 	hdlc->decode_escape = FALSE;
+	hdlc->decode_overflow = FALSE;
 
 	hdlc->xmit_accm[0] = ~0U;
 	hdlc->xmit_accm[3] = 0x60000000; /* 0x7d, 0x7e */
@@ -359,6 +456,8 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 
 	g_queue_push_tail(hdlc->write_queue, write_buffer);
 
+	hdlc->buffer_pool = g_queue_new();
+
 	hdlc->decode_buffer = g_try_malloc(BUFFER_SIZE);
 	if (!hdlc->decode_buffer)
 		goto error;
@@ -374,6 +473,9 @@ error:
 	if (hdlc->write_queue)
 		g_queue_free(hdlc->write_queue);
 
+	if (hdlc->buffer_pool)
+		g_queue_free(hdlc->buffer_pool);
+
 	if (write_buffer)
 		ring_buffer_free(write_buffer);
 
@@ -438,9 +540,15 @@ void g_at_hdlc_unref(GAtHDLC *hdlc)
 
 	g_queue_free(hdlc->write_queue);
 
+	while ((write_buffer = g_queue_pop_head(hdlc->buffer_pool)))
+		ring_buffer_free(write_buffer);
+
+	g_queue_free(hdlc->buffer_pool);
+
 	g_free(hdlc->decode_buffer);
 
-	g_timer_destroy(hdlc->timer);
+	if (hdlc->timer)
+		g_timer_destroy(hdlc->timer);
 
 	if (hdlc->in_read_handler)
 		hdlc->destroyed = TRUE;
@@ -467,39 +575,97 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 	hdlc->receive_data = user_data;
 }
 
+static struct ring_buffer *hdlc_buffer_get(GAtHDLC *hdlc)
+{
+	struct ring_buffer *buffer = g_queue_pop_head(hdlc->buffer_pool);
+
+	if (buffer)
+		return buffer;
+
+	return ring_buffer_new(BUFFER_SIZE);
+}
+
+static void hdlc_buffer_put(GAtHDLC *hdlc, struct ring_buffer *buffer)
+{
+	if (g_queue_get_length(hdlc->buffer_pool) >= MAX_POOLED) {
+		ring_buffer_free(buffer);
+		return;
+	}
+
+	ring_buffer_reset(buffer);
+	g_queue_push_head(hdlc->buffer_pool, buffer);
+}
+
 static gboolean can_write_data(gpointer data)
 {
 	GAtHDLC *hdlc = data;
+	struct iovec iov[MAX_IOVEC];
+	struct ring_buffer *write_buffer;
 	unsigned int len;
-	unsigned char *buf;
+	unsigned int wrap;
 	gsize bytes_written;
-	struct ring_buffer* write_buffer;
+	gsize remaining;
+	GList *l;
+	int n = 0;
+	int i;
+
+	/* Gather every queued buffer, both halves if it wraps */
+	for (l = hdlc->write_queue->head; l && n < MAX_IOVEC - 1; l = l->next) {
+		write_buffer = l->data;
+
+		len = ring_buffer_len(write_buffer);
+		if (len == 0)
+			continue;
+
+		wrap = ring_buffer_len_no_wrap(write_buffer);
+
+		iov[n].iov_base = ring_buffer_read_ptr(write_buffer, 0);
+		iov[n].iov_len = wrap;
+		n++;
+
+		if (len > wrap) {
+			iov[n].iov_base = ring_buffer_read_ptr(write_buffer,
+								wrap);
+			iov[n].iov_len = len - wrap;
+			n++;
+		}
+	}
 
-	/* Write data out from the head of the queue */
-	write_buffer = g_queue_peek_head(hdlc->write_queue);
+	if (n == 0)
+		return FALSE;
 
-	len = ring_buffer_len_no_wrap(write_buffer);
-	buf = ring_buffer_read_ptr(write_buffer, 0);
+	bytes_written = g_at_io_writev(hdlc->io, iov, n);
 
-	bytes_written = g_at_io_write(hdlc->io, (gchar *) buf, len);
-	hdlc_record(hdlc, FALSE, buf, bytes_written);
-	ring_buffer_drain(write_buffer, bytes_written);
+	for (i = 0, remaining = bytes_written; i < n && remaining; i++) {
+		len = MIN(iov[i].iov_len, remaining);
 
-	if (ring_buffer_len(write_buffer) > 0)
-		return TRUE;
+		hdlc_record(hdlc, FALSE, iov[i].iov_base, len);
+		remaining -= len;
+	}
 
-	/* All data in current buffer is written, free it
-	 * unless it's the last buffer in the queue.
+	/*
+	 * Drain what was written.  Fully written buffers are recycled,
+	 * except for the last one in the queue.
 	 */
-	if ((ring_buffer_len(write_buffer) == 0) &&
-			(g_queue_get_length(hdlc->write_queue) > 1)) {
-		write_buffer = g_queue_pop_head(hdlc->write_queue);
-		ring_buffer_free(write_buffer);
-		write_buffer = g_queue_peek_head(hdlc->write_queue);
-	}
+	remaining = bytes_written;
 
-	if (ring_buffer_len(write_buffer) > 0)
-		return TRUE;
+	while ((write_buffer = g_queue_peek_head(hdlc->write_queue))) {
+		len = MIN((gsize) ring_buffer_len(write_buffer), remaining);
+
+		ring_buffer_drain(write_buffer, len);
+		remaining -= len;
+
+		if (ring_buffer_len(write_buffer) > 0)
+			return TRUE;
+
+		if (g_queue_get_length(hdlc->write_queue) == 1) {
+			ring_buffer_reset(write_buffer);
+			return FALSE;
+		}
+
+		g_queue_pop_head(hdlc->write_queue);
+		hdlc_buffer_put(hdlc, write_buffer);
+	}
 
 	return FALSE;
 }
@@ -530,112 +696,102 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 
 #define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
 
-gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+static inline unsigned char *hdlc_put(const guint32 *xmit_accm,
+					unsigned char *buf, unsigned char c)
+{
+	if (NEED_ESCAPE(xmit_accm, c)) {
+		*buf++ = HDLC_ESCAPE;
+		*buf++ = c ^ HDLC_TRANS;
+	} else
+		*buf++ = c;
+
+	return buf;
+}
+
+/* Exact size of the escaped frame, including FCS and both flags */
+static unsigned int hdlc_encoded_size(GAtHDLC *hdlc,
+					const unsigned char *data, gsize size)
 {
-	struct ring_buffer* write_buffer = g_queue_peek_tail(hdlc->write_queue);
+	guint16 fcs = crc_ccitt(HDLC_INITFCS, data, size) ^ HDLC_INITFCS;
+	unsigned int len = size + 4;
+	gsize i;
 
-	unsigned int avail = ring_buffer_avail(write_buffer);
-	unsigned int wrap = ring_buffer_avail_no_wrap(write_buffer);
+	for (i = 0; i < size; i++)
+		if (NEED_ESCAPE(hdlc->xmit_accm, data[i]))
+			len++;
+
+	if (NEED_ESCAPE(hdlc->xmit_accm, (fcs & 0xff)))
+		len++;
+
+	if (NEED_ESCAPE(hdlc->xmit_accm, (fcs >> 8)))
+		len++;
+
+	return len;
+}
+
+gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+{
+	struct ring_buffer *write_buffer = g_queue_peek_tail(hdlc->write_queue);
+	unsigned char *start;
 	unsigned char *buf;
-	unsigned char tail[2];
-	unsigned int i = 0;
+	unsigned int need;
 	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
+	gsize i;
+
+	/*
+	 * Frames are always encoded into contiguous space.  Assume the
+	 * worst case of every octet being escaped, and only count the
+	 * escapes for the rare frame where that would not fit.
+	 */
+	need = 2 * (size + 2) + 2;
+
+	if (need > BUFFER_SIZE) {
+		need = hdlc_encoded_size(hdlc, data, size);
 
-	if (avail < size + HDLC_OVERHEAD) {
+		if (need > BUFFER_SIZE)
+			return FALSE;
+	}
+
+	if (ring_buffer_len(write_buffer) == 0)
+		ring_buffer_reset(write_buffer);
+
+	if ((unsigned int) ring_buffer_avail_no_wrap(write_buffer) < need) {
 		if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS)
 			return FALSE;	/* Too many pending buffers */
 
-		write_buffer = ring_buffer_new(BUFFER_SIZE);
+		write_buffer = hdlc_buffer_get(hdlc);
 		if (write_buffer == NULL)
 			return FALSE;
 
 		g_queue_push_tail(hdlc->write_queue, write_buffer);
-
-		avail = ring_buffer_avail(write_buffer);
-		wrap = ring_buffer_avail_no_wrap(write_buffer);
 	}
 
-	i = 0;
-	buf = ring_buffer_write_ptr(write_buffer, 0);
+	start = buf = ring_buffer_write_ptr(write_buffer, 0);
 
 	if (hdlc->start_frame_marker == TRUE) {
 		/* Protocol requires 0x7e as start marker */
-		if (pos + 1 > avail)
-			return FALSE;
-
 		*buf++ = HDLC_FLAG;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
 	} else if (hdlc->wakeup_sent == FALSE) {
 		/* Write an initial 0x7e as wakeup character */
 		*buf++ = HDLC_FLAG;
-		pos++;
 
 		hdlc->wakeup_sent = TRUE;
 	}
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
+	/* Escape and checksum in the same pass */
+	for (i = 0; i < size; i++) {
+		fcs = HDLC_FCS(fcs, data[i]);
+		buf = hdlc_put(hdlc->xmit_accm, buf, data[i]);
 	}
 
-	if (i < size)
-		return FALSE;
-
 	fcs ^= HDLC_INITFCS;
-	tail[0] = fcs & 0xff;
-	tail[1] = fcs >> 8;
-
-	i = 0;
-
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
-
-		buf++;
-		pos++;
-
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
-
-	if (i < sizeof(tail))
-		return FALSE;
-
-	if (pos + 1 > avail)
-		return FALSE;
+	buf = hdlc_put(hdlc->xmit_accm, buf, fcs & 0xff);
+	buf = hdlc_put(hdlc->xmit_accm, buf, fcs >> 8);
 
 	/* Add 0x7e as end marker */
-	*buf = HDLC_FLAG;
-	pos++;
+	*buf++ = HDLC_FLAG;
 
-	ring_buffer_write_advance(write_buffer, pos);
+	ring_buffer_write_advance(write_buffer, buf - start);
 
 	g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
 
@@ -36,11 +36,15 @@
 #include "gatio.h"
 #include "gatutil.h"
 
+#define BUFFER_SIZE	8192
+#define MAX_BUFFER_SIZE	(32 * BUFFER_SIZE)
+
 struct _GAtIO {
 	gint ref_count;				/* Ref count */
 	guint read_watch;			/* GSource read id, 0 if no */
 	guint write_watch;			/* GSource write id, 0 if no */
 	GIOChannel *channel;			/* comms channel */
+	int fd;					/* fd for vectored I/O */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	struct ring_buffer *buf;		/* Current read buffer */
@@ -72,6 +76,7 @@ static void read_watcher_destroy_notify(gpointer user_data)
 	io->read_data = NULL;
 
 	io->channel = NULL;
+	io->fd = -1;
 
 	if (io->destroyed)
 		g_free(io);
@@ -79,14 +84,93 @@ static void read_watcher_destroy_notify(gpointer user_data)
 		io->user_disconnect(io->user_disconnect_data);
 }
 
+static gboolean grow_buffer(GAtIO *io)
+{
+	unsigned int size = ring_buffer_capacity(io->buf);
+
+	if (size >= MAX_BUFFER_SIZE)
+		return FALSE;
+
+	return ring_buffer_grow(io->buf, size * 2) > (int) size;
+}
+
+/*
+ * Reads straight into the free space of the ring buffer, both halves at
+ * once if it wraps.  Returns the number of bytes read, 0 on EOF or a
+ * negative errno.
+ */
+static gssize read_vectored(GAtIO *io)
+{
+	struct iovec iov[2];
+	unsigned int avail = ring_buffer_avail(io->buf);
+	unsigned int wrap = ring_buffer_avail_no_wrap(io->buf);
+	gssize rbytes;
+	int n = 1;
+
+	iov[0].iov_base = ring_buffer_write_ptr(io->buf, 0);
+	iov[0].iov_len = wrap;
+
+	if (avail > wrap) {
+		iov[1].iov_base = ring_buffer_write_ptr(io->buf, wrap);
+		iov[1].iov_len = avail - wrap;
+		n = 2;
+	}
+
+	do {
+		rbytes = readv(io->fd, iov, n);
+	} while (rbytes < 0 && errno == EINTR);
+
+	if (rbytes < 0)
+		return -errno;
+
+	if (io->debugf) {
+		gsize first = MIN((gsize) rbytes, wrap);
+
+		g_at_util_debug_chat(TRUE, iov[0].iov_base, first,
+					io->debugf, io->debug_data);
+
+		if ((gsize) rbytes > first)
+			g_at_util_debug_chat(TRUE, iov[1].iov_base,
+						rbytes - first,
+						io->debugf, io->debug_data);
+	}
+
+	return rbytes;
+}
+
+static gssize read_channel(GAtIO *io)
+{
+	unsigned char *buf = ring_buffer_write_ptr(io->buf, 0);
+	gsize toread = ring_buffer_avail_no_wrap(io->buf);
+	GIOStatus status;
+	gsize rbytes = 0;
+
+	status = g_io_channel_read_chars(io->channel, (char *) buf,
+						toread, &rbytes, NULL);
+
+	if (io->debugf)
+		g_at_util_debug_chat(TRUE, (char *) buf, rbytes,
+					io->debugf, io->debug_data);
+
+	if (rbytes > 0)
+		return rbytes;
+
+	switch (status) {
+	case G_IO_STATUS_AGAIN:
+		return -EAGAIN;
+	case G_IO_STATUS_NORMAL:
+	case G_IO_STATUS_EOF:
+		return 0;
+	default:
+		return -EIO;
+	}
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
-	unsigned char *buf;
 	GAtIO *io = data;
-	GIOStatus status;
-	gsize rbytes;
-	gsize toread;
+	gssize rbytes = -EAGAIN;
 	gsize total_read = 0;
 	guint read_count = 0;
 
@@ -94,29 +178,24 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 		return FALSE;
 
 	/* Regardless of condition, try to read all the data available */
-	do {
-		toread = ring_buffer_avail_no_wrap(io->buf);
-
-		if (toread == 0)
+	while (read_count < io->max_read_attempts) {
+		/* Sustained load, make room instead of waiting for a wakeup */
+		if (ring_buffer_avail(io->buf) == 0 && !grow_buffer(io))
 			break;
 
-		rbytes = 0;
-		buf = ring_buffer_write_ptr(io->buf, 0);
-
-		status = g_io_channel_read_chars(channel, (char *) buf,
-							toread, &rbytes, NULL);
-		g_at_util_debug_chat(TRUE, (char *)buf, rbytes,
-					io->debugf, io->debug_data);
+		if (io->fd >= 0)
+			rbytes = read_vectored(io);
+		else
+			rbytes = read_channel(io);
 
 		read_count++;
 
-		total_read += rbytes;
-
-		if (rbytes > 0)
-			ring_buffer_write_advance(io->buf, rbytes);
+		if (rbytes <= 0)
+			break;
 
-	} while (status == G_IO_STATUS_NORMAL && rbytes > 0 &&
-					read_count < io->max_read_attempts);
+		total_read += rbytes;
+		ring_buffer_write_advance(io->buf, rbytes);
+	}
 
 	if (total_read > 0 && io->read_handler)
 		io->read_handler(io->buf, io->read_data);
@@ -124,11 +203,11 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 	if (cond & (G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
-	if (read_count > 0 && rbytes == 0 && status != G_IO_STATUS_AGAIN)
+	if (rbytes == 0 || (rbytes < 0 && rbytes != -EAGAIN))
 		return FALSE;
 
-	/* We're overflowing the buffer, shutdown the socket */
-	if (ring_buffer_avail(io->buf) == 0)
+	/* Nothing could be consumed, grow or shutdown the socket */
+	if (ring_buffer_avail(io->buf) == 0 && !grow_buffer(io))
 		return FALSE;
 
 	return TRUE;
@@ -153,6 +232,49 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 	return bytes_written;
 }
 
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt)
+{
+	gsize bytes_written = 0;
+	gsize remaining;
+	ssize_t ret;
+	int i;
+
+	if (io->fd < 0) {
+		/* Not a plain fd, e.g. a GAtMux channel */
+		for (i = 0; i < iovcnt; i++) {
+			gsize written = g_at_io_write(io, iov[i].iov_base,
+							iov[i].iov_len);
+
+			bytes_written += written;
+
+			if (written < iov[i].iov_len)
+				break;
+		}
+
+		return bytes_written;
+	}
+
+	ret = writev(io->fd, iov, iovcnt);
+	if (ret < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			g_source_remove(io->read_watch);
+
+		return 0;
+	}
+
+	bytes_written = ret;
+
+	for (i = 0, remaining = bytes_written; i < iovcnt && remaining; i++) {
+		gsize len = MIN(iov[i].iov_len, remaining);
+
+		g_at_util_debug_chat(FALSE, iov[i].iov_base, len,
+					io->debugf, io->debug_data);
+		remaining -= len;
+	}
+
+	return bytes_written;
+}
+
 static void write_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
@@ -204,7 +326,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		io->use_write_watch = FALSE;
 	}
 
-	io->buf = ring_buffer_new(8192);
+	io->buf = ring_buffer_new(BUFFER_SIZE);
 
 	if (!io->buf)
 		goto error;
@@ -213,6 +335,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		goto error;
 
 	io->channel = channel;
+	io->fd = -1;
 	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 				received_data, io,
@@ -378,6 +501,19 @@ gboolean g_at_io_set_debug(GAtIO *io, GAtDebugFunc func, gpointer user_data)
 	return TRUE;
 }
 
+/*
+ * The caller knows @fd to be the plain descriptor behind the channel, as
+ * opposed to e.g. a GAtMux channel, so it can be read and written with
+ * readv() and writev() directly.
+ */
+void g_at_io_set_unix_fd(GAtIO *io, int fd)
+{
+	if (io == NULL || io->read_watch == 0)
+		return;
+
+	io->fd = fd;
+}
+
 void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 				gpointer user_data)
 {
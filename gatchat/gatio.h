@@ -26,6 +26,8 @@
 extern "C" {
 #endif
 
+#include <sys/uio.h>
+
 #include "gat.h"
 
 struct _GAtIO;
@@ -41,6 +43,7 @@ GAtIO *g_at_io_new(GIOChannel *channel);
 GAtIO *g_at_io_new_blocking(GIOChannel *channel);
 
 GIOChannel *g_at_io_get_channel(GAtIO *io);
+void g_at_io_set_unix_fd(GAtIO *io, int fd);
 
 GAtIO *g_at_io_ref(GAtIO *io);
 void g_at_io_unref(GAtIO *io);
@@ -55,6 +58,7 @@ void g_at_io_set_write_done(GAtIO *io, GAtDisconnectFunc func,
 void g_at_io_drain_ring_buffer(GAtIO *io, guint len);
 
 gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count);
+gsize g_at_io_writev(GAtIO *io, const struct iovec *iov, int iovcnt);
 
 gboolean g_at_io_set_disconnect_function(GAtIO *io,
 			GAtDisconnectFunc disconnect, gpointer user_data);
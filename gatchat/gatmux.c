@@ -86,10 +86,12 @@ struct _GAtMux {
 	gpointer debug_data;			/* Data to pass to debug func */
 	GAtMuxChannel *dlcs[MAX_CHANNELS];	/* DLCs opened by the MUX */
 	guint8 newdata[BITMAP_SIZE];		/* Channels that got new data */
+	guint8 ready[MAX_CHANNELS];		/* Those channels, in order */
+	int num_ready;				/* Entries of ready in use */
 	const GAtMuxDriver *driver;		/* Driver functions */
 	void *driver_data;			/* Driver data */
-	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
-	int buf_used;				/* Bytes of buf being used */
+	struct ring_buffer *buf;		/* Buffer on the main mux */
+	guint8 frame[MUX_BUFFER_SIZE];		/* Frames split by the wrap */
 	gboolean shutdown;
 };
 
@@ -225,13 +227,49 @@ static void dispatch_sources(GAtMuxChannel *channel, GIOCondition condition)
 	g_slist_free_full(refs, (GDestroyNotify) g_source_unref);
 }
 
+/*
+ * Hands every complete frame in the ring buffer to the driver where it
+ * lies.  Only when a frame straddles the end of the ring is it copied,
+ * along with whatever follows it, so that the driver sees it in one piece.
+ */
+static void feed_ring_buffer(GAtMux *mux)
+{
+	struct ring_buffer *buf = mux->buf;
+	int len, wrap, nread;
+
+	while ((len = ring_buffer_len_no_wrap(buf)) > 0) {
+		nread = mux->driver->feed_data(mux,
+					ring_buffer_read_ptr(buf, 0), len);
+		ring_buffer_drain(buf, nread);
+
+		if (nread == len)
+			continue;
+
+		len -= nread;
+		wrap = ring_buffer_len(buf) - len;
+
+		/* Wait for the rest of the frame */
+		if (wrap == 0)
+			break;
+
+		memcpy(mux->frame, ring_buffer_read_ptr(buf, 0), len);
+		memcpy(mux->frame + len, ring_buffer_read_ptr(buf, len), wrap);
+
+		nread = mux->driver->feed_data(mux, mux->frame, len + wrap);
+		ring_buffer_drain(buf, nread);
+
+		break;
+	}
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 							gpointer data)
 {
 	GAtMux *mux = data;
 	int i;
-	GIOStatus status;
+	GIOStatus status = G_IO_STATUS_NORMAL;
 	gsize bytes_read;
+	gsize total = 0;
 	gboolean buffer_full = FALSE;
 
 	if (cond & G_IO_NVAL)
@@ -239,40 +277,47 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 	debug(mux, "received data");
 
-	bytes_read = 0;
-	status = g_io_channel_read_chars(mux->channel, mux->buf + mux->buf_used,
-					sizeof(mux->buf) - mux->buf_used,
-					&bytes_read, NULL);
+	/* Read straight into the ring, a second time past the wrap */
+	for (i = 0; i < 2; i++) {
+		int avail = ring_buffer_avail_no_wrap(mux->buf);
 
-	mux->buf_used += bytes_read;
+		if (avail == 0)
+			break;
 
-	if (bytes_read > 0 && mux->driver->feed_data) {
-		int nread;
+		bytes_read = 0;
+		status = g_io_channel_read_chars(mux->channel,
+				(gchar *) ring_buffer_write_ptr(mux->buf, 0),
+				avail, &bytes_read, NULL);
 
-		memset(mux->newdata, 0, BITMAP_SIZE);
+		ring_buffer_write_advance(mux->buf, bytes_read);
+		total += bytes_read;
 
-		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
-		mux->buf_used -= nread;
+		if (status != G_IO_STATUS_NORMAL || bytes_read < (gsize) avail)
+			break;
+	}
 
-		if (mux->buf_used > 0)
-			memmove(mux->buf, mux->buf + nread, mux->buf_used);
+	if (total > 0 && mux->driver->feed_data) {
+		memset(mux->newdata, 0, BITMAP_SIZE);
+		mux->num_ready = 0;
 
 		g_at_mux_ref(mux);
 
-		for (i = 1; i <= MAX_CHANNELS; i++) {
-			int offset = i / 8;
-			int bit = i % 8;
+		feed_ring_buffer(mux);
 
-			if (!(mux->newdata[offset] & (1 << bit)))
+		/* Only visit the channels that got data, in arrival order */
+		for (i = 0; i < mux->num_ready; i++) {
+			GAtMuxChannel *dlc = mux->dlcs[mux->ready[i] - 1];
+
+			/* Closed by a source of a channel dispatched earlier */
+			if (dlc == NULL)
 				continue;
 
-			debug(mux, "dispatching sources for channel: %p",
-				mux->dlcs[i-1]);
+			debug(mux, "dispatching sources for channel: %p", dlc);
 
-			dispatch_sources(mux->dlcs[i-1], G_IO_IN);
+			dispatch_sources(dlc, G_IO_IN);
 		}
 
-		buffer_full = mux->buf_used == sizeof(mux->buf);
+		buffer_full = ring_buffer_avail(mux->buf) == 0;
 
 		g_at_mux_unref(mux);
 	}
@@ -397,7 +442,11 @@ void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
 	offset = dlc / 8;
 	bit = dlc % 8;
 
-	mux->newdata[offset] |= 1 << bit;
+	if (!(mux->newdata[offset] & (1 << bit))) {
+		mux->newdata[offset] |= 1 << bit;
+		mux->ready[mux->num_ready++] = dlc;
+	}
+
 	channel->condition |= G_IO_IN;
 }
 
@@ -615,6 +664,12 @@ GAtMux *g_at_mux_new(GIOChannel *channel, const GAtMuxDriver *driver)
 	if (mux == NULL)
 		return NULL;
 
+	mux->buf = ring_buffer_new(MUX_BUFFER_SIZE);
+	if (mux->buf == NULL) {
+		g_free(mux);
+		return NULL;
+	}
+
 	mux->ref_count = 1;
 	mux->driver = driver;
 	mux->shutdown = TRUE;
@@ -650,6 +705,7 @@ void g_at_mux_unref(GAtMux *mux)
 		if (mux->driver->remove)
 			mux->driver->remove(mux);
 
+		ring_buffer_free(mux->buf);
 		g_free(mux);
 	}
 }
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <net/if.h>
 #ifdef __NuttX__
 #include <nuttx/net/ioctl.h>
@@ -114,20 +115,67 @@ void g_at_rawip_unref(GAtRawIP *rawip)
 	g_free(rawip);
 }
 
+/* Sets up iov to cover len bytes at the start of rbuf, returns its count */
+static int ring_buffer_iov(struct ring_buffer *rbuf, unsigned int len,
+							struct iovec *iov)
+{
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+
+	iov[0].iov_base = ring_buffer_read_ptr(rbuf, 0);
+	iov[0].iov_len = MIN(len, wrap);
+
+	if (len <= wrap)
+		return 1;
+
+	iov[1].iov_base = ring_buffer_read_ptr(rbuf, wrap);
+	iov[1].iov_len = len - wrap;
+
+	return 2;
+}
+
+/*
+ * Returns the length of the IP packet at the start of rbuf, 0 if its
+ * header is not all there yet or -1 if the data is not an IP packet.
+ */
+static int ip_packet_len(struct ring_buffer *rbuf)
+{
+	unsigned int avail = ring_buffer_len(rbuf);
+	unsigned char hdr[6];
+	unsigned int i;
+
+	if (avail < sizeof(hdr))
+		return 0;
+
+	for (i = 0; i < sizeof(hdr); i++)
+		hdr[i] = *ring_buffer_read_ptr(rbuf, i);
+
+	switch (hdr[0] >> 4) {
+	case 4:
+		if ((hdr[0] & 0x0f) < 5 || (hdr[2] << 8 | hdr[3]) < 20)
+			return -1;
+
+		return hdr[2] << 8 | hdr[3];
+	case 6:
+		return (hdr[4] << 8 | hdr[5]) + 40;
+	}
+
+	return -1;
+}
+
 static gboolean can_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
-	unsigned int len;
-	unsigned char *buf;
+	struct iovec iov[2];
 	gsize bytes_written;
+	int n;
 
 	if (rawip->write_buffer == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->write_buffer);
-	buf = ring_buffer_read_ptr(rawip->write_buffer, 0);
+	n = ring_buffer_iov(rawip->write_buffer,
+				ring_buffer_len(rawip->write_buffer), iov);
 
-	bytes_written = g_at_io_write(rawip->io, (gchar *) buf, len);
+	bytes_written = g_at_io_writev(rawip->io, iov, n);
 	ring_buffer_drain(rawip->write_buffer, bytes_written);
 
 	if (ring_buffer_len(rawip->write_buffer) > 0)
@@ -138,23 +186,43 @@ static gboolean can_write_data(gpointer data)
 	return FALSE;
 }
 
+/*
+ * A tun device takes one packet per write, so the stream from the modem
+ * is cut along the lengths in the IP headers.  Each packet goes out with
+ * one writev() even when it wraps around the end of the ring buffer.
+ * Returns TRUE if the tun device could not take everything there was.
+ */
+static gboolean tun_write_packets(GAtRawIP *rawip, struct ring_buffer *rbuf)
+{
+	struct iovec iov[2];
+	int len, n;
+
+	while ((len = ip_packet_len(rbuf)) != 0) {
+		/* Not an IP packet, pass on whatever is there as it is */
+		if (len < 0)
+			len = ring_buffer_len(rbuf);
+		else if (len > ring_buffer_len(rbuf))
+			break;
+
+		n = ring_buffer_iov(rbuf, len, iov);
+
+		if (g_at_io_writev(rawip->tun_io, iov, n) == 0)
+			return TRUE;
+
+		ring_buffer_drain(rbuf, len);
+	}
+
+	return FALSE;
+}
+
 static gboolean tun_write_data(gpointer data)
 {
 	GAtRawIP *rawip = data;
-	unsigned int len;
-	unsigned char *buf;
-	gsize bytes_written;
 
 	if (rawip->tun_write_buffer == NULL)
 		return FALSE;
 
-	len = ring_buffer_len_no_wrap(rawip->tun_write_buffer);
-	buf = ring_buffer_read_ptr(rawip->tun_write_buffer, 0);
-
-	bytes_written = g_at_io_write(rawip->tun_io, (gchar *) buf, len);
-	ring_buffer_drain(rawip->tun_write_buffer, bytes_written);
-
-	if (ring_buffer_len(rawip->tun_write_buffer) > 0)
+	if (tun_write_packets(rawip, rawip->tun_write_buffer))
 		return TRUE;
 
 	rawip->tun_write_buffer = NULL;
@@ -166,6 +234,14 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtRawIP *rawip = user_data;
 
+	/* Already waiting for the tun device to drain */
+	if (rawip->tun_write_buffer != NULL)
+		return;
+
+	/* The tun device hardly ever pushes back, skip the write watch */
+	if (!tun_write_packets(rawip, rbuf))
+		return;
+
 	rawip->tun_write_buffer = rbuf;
 
 	g_at_io_set_write_handler(rawip->tun_io, tun_write_data, rawip);
@@ -175,8 +251,15 @@ static void tun_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtRawIP *rawip = user_data;
 
+	if (rawip->write_buffer != NULL)
+		return;
+
 	rawip->write_buffer = rbuf;
 
+	/* Try right away, the write watch only covers what the tty refused */
+	if (!can_write_data(rawip))
+		return;
+
 	g_at_io_set_write_handler(rawip->io, can_write_data, rawip);
 }
 
@@ -209,10 +292,17 @@ static void create_tun(GAtRawIP *rawip)
 	}
 
 	rawip->tun_io = g_at_io_new(channel);
+	g_at_io_set_unix_fd(rawip->tun_io, fd);
 
 	g_io_channel_unref(channel);
 }
 
+static void start_io(GAtRawIP *rawip)
+{
+	g_at_io_set_read_handler(rawip->io, new_bytes, rawip);
+	g_at_io_set_read_handler(rawip->tun_io, tun_bytes, rawip);
+}
+
 void g_at_rawip_open(GAtRawIP *rawip)
 {
 	if (rawip == NULL)
@@ -223,8 +313,21 @@ void g_at_rawip_open(GAtRawIP *rawip)
 	if (rawip->tun_io == NULL)
 		return;
 
-	g_at_io_set_read_handler(rawip->io, new_bytes, rawip);
-	g_at_io_set_read_handler(rawip->tun_io, tun_bytes, rawip);
+	start_io(rawip);
+}
+
+/*
+ * Like g_at_rawip_open(), but on a tun device, or anything else taking
+ * one packet per write, that is set up already.
+ */
+void g_at_rawip_open_from_io(GAtRawIP *rawip, GAtIO *tun_io)
+{
+	if (rawip == NULL || tun_io == NULL)
+		return;
+
+	rawip->tun_io = g_at_io_ref(tun_io);
+
+	start_io(rawip);
 }
 
 void g_at_rawip_shutdown(GAtRawIP *rawip)
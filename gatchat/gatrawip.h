@@ -40,6 +40,7 @@ GAtRawIP *g_at_rawip_ref(GAtRawIP *rawip);
 void g_at_rawip_unref(GAtRawIP *rawip);
 
 void g_at_rawip_open(GAtRawIP *rawip);
+void g_at_rawip_open_from_io(GAtRawIP *rawip, GAtIO *tun_io);
 void g_at_rawip_shutdown(GAtRawIP *rawip);
 
 const char *g_at_rawip_get_interface(GAtRawIP *rawip);
@@ -44,6 +44,7 @@
 #include "ppp.h"
 
 #define MAX_PACKET 1500
+#define MAX_READ_PACKETS 16	/* Packets read from the tun per wakeup */
 
 struct ppp_net {
 	GAtPPP *ppp;
@@ -110,20 +111,28 @@ static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
 {
 	struct ppp_net *net = (struct ppp_net *) userdata;
-	GIOStatus status;
+	GIOStatus status = G_IO_STATUS_NORMAL;
 	gsize bytes_read;
 	gchar *buf = (gchar *) net->ppp_packet->info;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
 	if (cond & G_IO_IN) {
-		/* leave space to add PPP protocol field */
-		status = g_io_channel_read_chars(channel, buf, net->mtu,
+		/* Each read is one packet, take what queued up meanwhile */
+		for (i = 0; i < MAX_READ_PACKETS; i++) {
+			/* leave space to add PPP protocol field */
+			status = g_io_channel_read_chars(channel, buf, net->mtu,
 							&bytes_read, NULL);
-		if (bytes_read > 0)
-			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
-					bytes_read);
+			if (bytes_read > 0)
+				ppp_transmit(net->ppp,
+						(guint8 *) net->ppp_packet,
+						bytes_read);
+
+			if (status != G_IO_STATUS_NORMAL)
+				break;
+		}
 
 		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
 			return FALSE;
@@ -186,7 +195,7 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
 	g_io_channel_set_buffered(channel, FALSE);
@@ -69,6 +69,39 @@ struct ring_buffer *ring_buffer_new(unsigned int size)
 	return buffer;
 }
 
+int ring_buffer_grow(struct ring_buffer *buf, unsigned int size)
+{
+	unsigned int real_size = buf->size;
+	unsigned int len = buf->in - buf->out;
+	unsigned int offset = buf->out & buf->mask;
+	unsigned int end = MIN(len, buf->size - offset);
+	unsigned char *buffer;
+
+	while (real_size < size && real_size < MAX_SIZE)
+		real_size = real_size << 1;
+
+	if (real_size == buf->size)
+		return buf->size;
+
+	buffer = g_slice_alloc(real_size);
+	if (buffer == NULL)
+		return buf->size;
+
+	/* Unwrap the contents to the start of the new storage */
+	memcpy(buffer, buf->buffer + offset, end);
+	memcpy(buffer + end, buf->buffer, len - end);
+
+	g_slice_free1(buf->size, buf->buffer);
+
+	buf->buffer = buffer;
+	buf->size = real_size;
+	buf->mask = real_size - 1;
+	buf->out = 0;
+	buf->in = len;
+
+	return real_size;
+}
+
 int ring_buffer_write(struct ring_buffer *buf, const void *data,
 			unsigned int len)
 {
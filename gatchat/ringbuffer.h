@@ -36,6 +36,14 @@ void ring_buffer_free(struct ring_buffer *buf);
  */
 int ring_buffer_capacity(struct ring_buffer *buf);
 
+/*!
+ * Grows the capacity of the ring buffer to at least size, preserving its
+ * contents.  Pointers previously obtained from the buffer become invalid.
+ * Returns the resulting capacity, which is unchanged if the buffer is
+ * already at its maximum size or the allocation failed
+ */
+int ring_buffer_grow(struct ring_buffer *buf, unsigned int size);
+
 /*!
  * Resets the ring buffer, all data inside the buffer is lost
  */
@@ -32,6 +32,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <unistd.h>
@@ -57,8 +58,44 @@ struct ril_request {
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	GList *link;				/* Link in command_queue */
+	gboolean sent;				/* Writing has started */
+	gint64 sent_time;			/* When it was fully written */
+	GList *wheel_link;			/* Link in its deadline slot */
+	guint deadline;				/* Wheel tick it expires on */
 };
 
+/* Requests rild has not answered after this many seconds are reported */
+#define RIL_REQUEST_DEADLINE	60
+#define RIL_WHEEL_SLOTS		64
+
+/*
+ * Response latency per request id, in log2 buckets of milliseconds: the
+ * first bucket counts responses under 1 ms, bucket i those under 2^i ms.
+ */
+#define RIL_LATENCY_BUCKETS	16
+#define RIL_LATENCY_REPORT	64
+
+struct ril_latency {
+	guint count;
+	gint64 total;
+	gint64 max;
+	guint buckets[RIL_LATENCY_BUCKETS];
+};
+
+/*
+ * A ril_msg along with the buffer its data is gathered into when a record
+ * straddles the wrap point of the ring buffer.  Entries are recycled.
+ */
+struct ril_msg_entry {
+	struct ril_msg msg;
+	gchar *scratch;
+	gsize scratch_size;
+};
+
+#define RIL_MSG_POOL_SIZE	4
+#define RIL_MSG_SCRATCH_SIZE	1024
+
 struct ril_notify_node {
 	guint id;
 	guint gid;
@@ -80,13 +117,20 @@ struct ril_s {
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
-	GQueue *out_queue;			/* Commands sent/been sent */
+	GQueue *command_queue;			/* Requests not answered yet */
+	GHashTable *pending;			/* Same requests, by serial */
+	GList *write_link;			/* First request not written */
 	guint req_bytes_written;		/* bytes written from req */
+	GList *wheel[RIL_WHEEL_SLOTS];		/* Requests by deadline */
+	guint wheel_tick;			/* Seconds the wheel has run */
+	guint wheel_count;			/* Requests on the wheel */
+	GHashTable *latency;			/* ril_latency by request id */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
-	guint read_so_far;			/* Number of bytes processed */
+	guint skip_bytes;			/* Oversized record left */
+	struct ril_msg_entry *msg_pool[RIL_MSG_POOL_SIZE];
+	guint msg_pool_len;			/* Recycled ril_msg entries */
 	gboolean suspended;			/* Are we suspended? */
 	gboolean debug;
 	gboolean trace;
@@ -302,8 +346,137 @@ static void ril_request_destroy(struct ril_request *req)
 	g_free(req);
 }
 
+static gboolean ril_wheel_tick(gpointer user_data)
+{
+	struct ril_s *p = user_data;
+	struct ril_request *req;
+	GList *l, *next;
+	guint slot;
+
+	p->wheel_tick += 1;
+	slot = p->wheel_tick % RIL_WHEEL_SLOTS;
+
+	for (l = p->wheel[slot]; l; l = next) {
+		next = l->next;
+		req = l->data;
+
+		if (req->deadline != p->wheel_tick)
+			continue;
+
+		ofono_error("[%d,%04d] %s: no reply from rild after %d s",
+				p->slot, req->id,
+				request_id_to_string(p, req->req),
+				RIL_REQUEST_DEADLINE);
+
+		p->wheel[slot] = g_list_delete_link(p->wheel[slot], l);
+		req->wheel_link = NULL;
+		p->wheel_count -= 1;
+	}
+
+	if (p->wheel_count > 0)
+		return TRUE;
+
+	p->timeout_source = 0;
+
+	return FALSE;
+}
+
+static void ril_deadline_arm(struct ril_s *p, struct ril_request *req)
+{
+	guint slot;
+
+	req->deadline = p->wheel_tick + RIL_REQUEST_DEADLINE;
+	slot = req->deadline % RIL_WHEEL_SLOTS;
+
+	p->wheel[slot] = g_list_prepend(p->wheel[slot], req);
+	req->wheel_link = p->wheel[slot];
+	p->wheel_count += 1;
+
+	if (p->timeout_source == 0)
+		p->timeout_source = g_timeout_add_seconds(1, ril_wheel_tick, p);
+}
+
+static void ril_deadline_disarm(struct ril_s *p, struct ril_request *req)
+{
+	guint slot = req->deadline % RIL_WHEEL_SLOTS;
+
+	if (req->wheel_link == NULL)
+		return;
+
+	p->wheel[slot] = g_list_delete_link(p->wheel[slot], req->wheel_link);
+	req->wheel_link = NULL;
+	p->wheel_count -= 1;
+}
+
+/* Takes a request out of the queue, the serial index and the wheel */
+static void ril_request_unlink(struct ril_s *p, struct ril_request *req)
+{
+	if (p->write_link == req->link)
+		p->write_link = req->link->next;
+
+	g_queue_delete_link(p->command_queue, req->link);
+	req->link = NULL;
+
+	g_hash_table_remove(p->pending, GINT_TO_POINTER(req->id));
+	ril_deadline_disarm(p, req);
+}
+
+static void ril_latency_trace(struct ril_s *p, int req,
+					const struct ril_latency *lat)
+{
+	char buckets[RIL_LATENCY_BUCKETS * 11 + 1];
+	int len = 0;
+	int i;
+
+	if (p->trace == FALSE || lat->count == 0)
+		return;
+
+	for (i = 0; i < RIL_LATENCY_BUCKETS; i++)
+		len += snprintf(buckets + len, sizeof(buckets) - len, " %u",
+					lat->buckets[i]);
+
+	RIL_TRACE(p, "[%d] %s latency: %u replies, avg %u us, max %u us, "
+			"log2 ms buckets:%s", p->slot,
+			request_id_to_string(p, req), lat->count,
+			(unsigned int) (lat->total / lat->count),
+			(unsigned int) lat->max, buckets);
+}
+
+static void ril_latency_record(struct ril_s *p, struct ril_request *req)
+{
+	struct ril_latency *lat;
+	gint64 elapsed = g_get_monotonic_time() - req->sent_time;
+	gint64 ms = elapsed / 1000;
+	int bucket = 0;
+
+	lat = g_hash_table_lookup(p->latency, GINT_TO_POINTER(req->req));
+	if (lat == NULL) {
+		lat = g_new0(struct ril_latency, 1);
+		g_hash_table_insert(p->latency, GINT_TO_POINTER(req->req), lat);
+	}
+
+	while (ms > 0 && bucket < RIL_LATENCY_BUCKETS - 1) {
+		ms >>= 1;
+		bucket += 1;
+	}
+
+	lat->buckets[bucket] += 1;
+	lat->count += 1;
+	lat->total += elapsed;
+
+	if (elapsed > lat->max)
+		lat->max = elapsed;
+
+	if (lat->count % RIL_LATENCY_REPORT == 0)
+		ril_latency_trace(p, req->req, lat);
+}
+
 static void ril_cleanup(struct ril_s *p)
 {
+	GHashTableIter iter;
+	gpointer key, value;
+	int i;
+
 	/* Cleanup pending commands */
 
 	if (p->command_queue) {
@@ -311,9 +484,28 @@ static void ril_cleanup(struct ril_s *p)
 		p->command_queue = NULL;
 	}
 
-	if (p->out_queue) {
-		g_queue_free(p->out_queue);
-		p->out_queue = NULL;
+	p->write_link = NULL;
+
+	if (p->pending) {
+		g_hash_table_destroy(p->pending);
+		p->pending = NULL;
+	}
+
+	for (i = 0; i < RIL_WHEEL_SLOTS; i++) {
+		g_list_free(p->wheel[i]);
+		p->wheel[i] = NULL;
+	}
+
+	p->wheel_count = 0;
+
+	if (p->latency) {
+		g_hash_table_iter_init(&iter, p->latency);
+
+		while (g_hash_table_iter_next(&iter, &key, &value))
+			ril_latency_trace(p, GPOINTER_TO_INT(key), value);
+
+		g_hash_table_destroy(p->latency);
+		p->latency = NULL;
 	}
 
 	/* Cleanup registered notifications */
@@ -351,60 +543,39 @@ static void io_disconnect(gpointer user_data)
 
 static void handle_response(struct ril_s *p, struct ril_msg *message)
 {
-	guint count = g_queue_get_length(p->command_queue);
 	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
-
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
-
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
 
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
-
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
-
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	req = g_hash_table_lookup(p->pending,
+					GINT_TO_POINTER(message->serial_no));
+	if (req == NULL || req->sent == FALSE) {
+		ofono_error("No matching request for reply: %s serial_no: %d!",
+			request_id_to_string(p, message->req),
+			message->serial_no);
+		return;
+	}
 
-			len = g_queue_get_length(p->out_queue);
+	message->req = req->req;
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+			p->slot, message->serial_no,
+			request_id_to_string(p, message->req),
+			ril_error_to_string(message->error));
 
-			ril_request_destroy(req);
+	ril_request_unlink(p, req);
+	ril_latency_record(p, req);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			break;
-		}
-	}
+	ril_request_destroy(req);
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed)
+		return;
 
+	if (p->command_queue && g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -456,186 +627,261 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 
 static void dispatch(struct ril_s *p, struct ril_msg *message)
 {
-	int32_t *unsolicited_field, *id_num_field;
-	gchar *bufp = message->buf;
-	gchar *datap;
-	gsize data_len;
-
-	/* This could be done with a struct/union... */
-	unsolicited_field = (int32_t *) (void *) bufp;
-	if (*unsolicited_field)
-		message->unsolicited = TRUE;
+	if (message->unsolicited == TRUE)
+		handle_unsol_req(p, message);
 	else
-		message->unsolicited = FALSE;
+		handle_response(p, message);
+}
 
-	bufp += 4;
+static struct ril_msg_entry *ril_msg_get(struct ril_s *p)
+{
+	struct ril_msg_entry *entry;
 
-	id_num_field = (int32_t *) (void *) bufp;
-	if (message->unsolicited) {
-		message->req = (int) *id_num_field;
+	if (p->msg_pool_len > 0)
+		entry = p->msg_pool[--p->msg_pool_len];
+	else
+		entry = g_new0(struct ril_msg_entry, 1);
 
-		/*
-		 * A RIL Unsolicited Event is two UINT32 fields ( unsolicited,
-		 * and req/ev ), so subtract the length of the header from the
-		 * overall length to calculate the length of the Event Data.
-		 */
-		data_len = message->buf_len - 8;
-	} else {
-		message->serial_no = (int) *id_num_field;
+	memset(&entry->msg, 0, sizeof(entry->msg));
 
-		bufp += 4;
-		message->error = *((int32_t *) (void *) bufp);
+	return entry;
+}
 
-		/*
-		 * A RIL Solicited Response is three UINT32 fields ( unsolicied,
-		 * serial_no and error ), so subtract the length of the header
-		 * from the overall length to calculate the length of the Event
-		 * Data.
-		 */
-		data_len = message->buf_len - 12;
+static void ril_msg_free(struct ril_msg_entry *entry)
+{
+	g_free(entry->scratch);
+	g_free(entry);
+}
+
+static void ril_msg_put(struct ril_s *p, struct ril_msg_entry *entry)
+{
+	if (p->destroyed || p->msg_pool_len == RIL_MSG_POOL_SIZE) {
+		ril_msg_free(entry);
+		return;
 	}
 
-	/* advance to start of data.. */
-	bufp += 4;
+	p->msg_pool[p->msg_pool_len++] = entry;
+}
 
-	/*
-	 * Now, use buffer for event data if present
-	 */
-	if (data_len) {
-		datap = g_try_malloc(data_len);
-		if (datap == NULL)
-			goto error;
+static void ril_free(struct ril_s *p)
+{
+	while (p->msg_pool_len > 0)
+		ril_msg_free(p->msg_pool[--p->msg_pool_len]);
 
-		/* Copy event bytes from message->buf into new buffer */
-		memcpy(datap, bufp, data_len);
+	g_free(p);
+}
 
-		/* Free buffer that includes header */
-		g_free(message->buf);
+/*
+ * Describes len bytes starting offset bytes into the readable part of the
+ * ring buffer, as one segment or as two when they straddle the wrap point.
+ * Returns the number of segments used.
+ */
+static int record_iov(struct ring_buffer *rbuf, unsigned int offset,
+				unsigned int len, struct iovec *iov)
+{
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
 
-		/* ...and replace with new buffer */
-		message->buf = datap;
-		message->buf_len = data_len;
-	} else {
-		/* Free buffer that includes header */
-		g_free(message->buf);
+	iov[0].iov_base = ring_buffer_read_ptr(rbuf, offset);
 
-		/* To know if there was no data when parsing */
-		message->buf = NULL;
-		message->buf_len = 0;
+	if (offset >= wrap || offset + len <= wrap) {
+		iov[0].iov_len = len;
+		return 1;
 	}
 
-	if (message->unsolicited == TRUE)
-		handle_unsol_req(p, message);
-	else
-		handle_response(p, message);
+	iov[0].iov_len = wrap - offset;
+	iov[1].iov_base = ring_buffer_read_ptr(rbuf, wrap);
+	iov[1].iov_len = len - iov[0].iov_len;
 
-error:
-	g_free(message->buf);
-	g_free(message);
+	return 2;
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+static void iov_copy(const struct iovec *iov, int n, size_t offset,
+							void *dst, size_t len)
 {
-	struct ril_msg *message;
-	unsigned message_len, plen;
+	unsigned char *d = dst;
+	size_t chunk;
+	int i;
+
+	for (i = 0; i < n && len > 0; i++) {
+		if (offset >= iov[i].iov_len) {
+			offset -= iov[i].iov_len;
+			continue;
+		}
 
-	/* First four bytes are length in TCP byte order (Big Endian) */
-	plen = ntohl(*((uint32_t *) (void *) bytes));
-	bytes += 4;
+		chunk = MIN(len, iov[i].iov_len - offset);
+		memcpy(d, (unsigned char *) iov[i].iov_base + offset, chunk);
 
-	/*
-	 * TODO: Verify that 8k is the max message size from rild.
-	 *
-	 * This condition shouldn't happen.  If it does
-	 * there are three options:
-	 *
-	 * 1) Exit; ofono will restart via DBus (this is what we do now)
-	 * 2) Consume the bytes & continue
-	 * 3) force a disconnect
-	 */
-	if (plen > GRIL_BUFFER_SIZE - 4) {
-		ofono_error("ERROR RIL parcel bigger than buffer (%u), exiting",
-				plen);
-		exit(1);
+		d += chunk;
+		len -= chunk;
+		offset = 0;
 	}
+}
+
+/*
+ * Returns a pointer to len bytes at offset within the record, in place when
+ * they are contiguous and suitably aligned for the parcel readers, or else
+ * gathered into the scratch buffer of the entry.
+ */
+static gchar *record_data(struct ril_msg_entry *entry, const struct iovec *iov,
+				int n, size_t offset, size_t len)
+{
+	gchar *data = NULL;
+
+	if (offset + len <= iov[0].iov_len)
+		data = (gchar *) iov[0].iov_base + offset;
+	else if (n == 2 && offset >= iov[0].iov_len)
+		data = (gchar *) iov[1].iov_base + offset - iov[0].iov_len;
+
+	if (data != NULL && ((uintptr_t) data & (sizeof(int32_t) - 1)) == 0)
+		return data;
+
+	if (entry->scratch_size < len) {
+		g_free(entry->scratch);
+		entry->scratch_size = MAX(len, RIL_MSG_SCRATCH_SIZE);
+		entry->scratch = g_malloc(entry->scratch_size);
+	}
+
+	iov_copy(iov, n, offset, entry->scratch, len);
+
+	return entry->scratch;
+}
+
+/*
+ * Parses the plen byte record that follows the length field at the head of
+ * the ring buffer, without taking it out of the buffer.  The data of the
+ * returned message points into the ring buffer whenever possible, so the
+ * record must not be drained before the message has been dispatched.
+ */
+static struct ril_msg_entry *read_fixed_record(struct ril_s *p,
+						struct ring_buffer *rbuf,
+						unsigned int plen)
+{
+	struct ril_msg_entry *entry;
+	struct ril_msg *message;
+	struct iovec iov[2];
+	int32_t header[3];
+	unsigned int header_len;
+	int n;
 
 	/*
-	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
+	 * A RIL Unsolicited Event starts with two UINT32 fields (unsolicited
+	 * and req/ev), a RIL Solicited Response with three (unsolicited,
+	 * serial_no and error).
 	 */
+	if (plen < 2 * sizeof(int32_t))
+		return NULL;
+
+	n = record_iov(rbuf, 4, plen, iov);
+	iov_copy(iov, n, 0, header, 2 * sizeof(int32_t));
 
-	message_len = *len - 4;
-	if (message_len < plen)
+	header_len = header[0] ? 2 * sizeof(int32_t) : sizeof(header);
+	if (plen < header_len)
 		return NULL;
 
-	message = g_malloc(sizeof(struct ril_msg));
+	entry = ril_msg_get(p);
+	message = &entry->msg;
 
-	/* allocate ril_msg->buffer */
-	message->buf_len = plen;
-	message->buf = g_malloc(plen);
+	if (header[0]) {
+		message->unsolicited = TRUE;
+		message->req = header[1];
+	} else {
+		iov_copy(iov, n, 0, header, sizeof(header));
+
+		message->unsolicited = FALSE;
+		message->serial_no = header[1];
+		message->error = header[2];
+	}
 
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
+	/* A NULL buffer tells parsers that there was no data */
+	message->buf_len = plen - header_len;
+	if (message->buf_len)
+		message->buf = record_data(entry, iov, n, header_len,
+							message->buf_len);
 
-	/* Indicate to caller size of record we extracted */
-	*len = plen + 4;
-	return message;
+	return entry;
+}
+
+static gboolean grow_buffer(struct ring_buffer *rbuf, unsigned int size)
+{
+	if (size > GRIL_MAX_BUFFER_SIZE)
+		return FALSE;
+
+	return ring_buffer_grow(rbuf, size) >= (int) size;
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
 	struct ril_s *p = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	guchar *buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
+	struct ril_msg_entry *entry;
+	struct iovec iov[2];
+	unsigned int len;
+	uint32_t plen;
+	int n;
 
 	p->in_read_handler = TRUE;
 
-	while (p->suspended == FALSE && (p->read_so_far < len)) {
-		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
+	while (p->suspended == FALSE && p->destroyed == FALSE) {
+		len = ring_buffer_len(rbuf);
+
+		/* Throw away what is left of a record we could not buffer */
+		if (p->skip_bytes > 0) {
+			unsigned int skip = MIN(len, p->skip_bytes);
+
+			ring_buffer_drain(rbuf, skip);
+			p->skip_bytes -= skip;
 
-		if (rbytes < 4) {
-			DBG("Not enough bytes for header length: len: %d", len);
-			return;
+			if (p->skip_bytes > 0)
+				break;
+
+			continue;
 		}
 
+		if (len < 4)
+			break;
+
+		/* First four bytes are length in TCP byte order (Big Endian) */
+		n = record_iov(rbuf, 0, 4, iov);
+		iov_copy(iov, n, 0, &plen, 4);
+		plen = ntohl(plen);
+
 		/*
-		 * This function attempts to read the next full length
-		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
+		 * Large responses, such as long cell info lists, do not fit
+		 * the default buffer.  Make room for the whole record as soon
+		 * as its length is known, and only drop it if it is beyond
+		 * any reasonable size.
 		 */
-		message = read_fixed_record(p, buf, &rbytes);
+		if (plen > GRIL_MAX_BUFFER_SIZE - 4 ||
+				(plen + 4 > (unsigned int)
+					ring_buffer_capacity(rbuf) &&
+				grow_buffer(rbuf, plen + 4) == FALSE)) {
+			ofono_error("RIL parcel bigger than buffer (%u), "
+					"dropping it", plen);
+			p->skip_bytes = plen + 4;
+			continue;
+		}
 
-		/* wait for the rest of the record... */
-		if (message == NULL)
+		/* Wait for the rest of the record... */
+		if (len - 4 < plen)
 			break;
 
-		buf += rbytes;
-		p->read_so_far += rbytes;
-
-		/* TODO: need to better understand how wrap works! */
-		if (p->read_so_far == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
-			wrap = len;
+		entry = read_fixed_record(p, rbuf, plen);
+		if (entry == NULL) {
+			ofono_error("Malformed RIL parcel (%u bytes), dropping "
+					"it", plen);
+			ring_buffer_drain(rbuf, plen + 4);
+			continue;
 		}
 
-		dispatch(p, message);
+		dispatch(p, &entry->msg);
+		ril_msg_put(p, entry);
 
-		ring_buffer_drain(rbuf, p->read_so_far);
-
-		len -= p->read_so_far;
-		wrap -= p->read_so_far;
-		p->read_so_far = 0;
+		ring_buffer_drain(rbuf, plen + 4);
 	}
 
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
-		g_free(p);
+		ril_free(p);
 }
 
 /*
@@ -647,73 +893,16 @@ static gboolean can_write_data(gpointer data)
 {
 	struct ril_s *ril = data;
 	struct ril_request *req;
-	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
-
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
-		return FALSE;
-
-	/* if the whole request was not written */
-	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
-		req = g_queue_peek_head(ril->command_queue);
-		if (req == NULL)
-			return FALSE;
+	gsize bytes_written, towrite;
 
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-		goto out;
-	}
-
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
-		if (req == NULL)
-			return FALSE;
-
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
-
-		if (written == FALSE)
-			break;
-	}
-
-	/* watcher fired though requests already written */
-	if (written == TRUE)
+	/* Watcher fired though all requests were already written */
+	if (ril->write_link == NULL)
 		return FALSE;
 
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-out:
-	len = req->data_len;
+	req = ril->write_link->data;
+	req->sent = TRUE;
 
-	towrite = len - ril->req_bytes_written;
+	towrite = req->data_len - ril->req_bytes_written;
 
 #ifdef WRITE_SCHEDULER_DEBUG
 	if (towrite > 5)
@@ -730,10 +919,15 @@ out:
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
 
-	return FALSE;
+	ril->req_bytes_written = 0;
+	ril->write_link = ril->write_link->next;
+
+	req->sent_time = g_get_monotonic_time();
+	ril_deadline_arm(ril, req);
+
+	/* Keep writing the requests queued meanwhile, rild pipelines them */
+	return ril->write_link != NULL;
 }
 
 static void ril_wakeup_writer(struct ril_s *ril)
@@ -780,7 +974,7 @@ static void ril_unref(struct ril_s *ril)
 	if (ril->in_read_handler)
 		ril->destroyed = TRUE;
 	else
-		g_free(ril);
+		ril_free(ril);
 }
 
 static gboolean node_compare_by_group(struct ril_notify_node *node,
@@ -886,11 +1080,9 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
-	ril->out_queue = g_queue_new();
-	if (ril->out_queue == NULL) {
-		ofono_error("create_ril: Couldn't create out_queue.");
-		goto error;
-	}
+	ril->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+	ril->latency = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, g_free);
 
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
@@ -931,38 +1123,26 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
 	struct ril_request *req;
-	gboolean sent;
+	GList *l, *next;
 
 	if (ril->command_queue == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
+	for (l = g_queue_peek_head_link(ril->command_queue); l; l = next) {
+		next = l->next;
+		req = l->data;
+
+		if (req->id == 0 || req->gid != group)
 			continue;
-		}
 
 		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
 
-		if (sent)
+		/* The reply to a request already sent still has to be read */
+		if (req->sent)
 			continue;
 
-		g_queue_remove(ril->command_queue, req);
+		ril_request_unlink(ril, req);
 		ril_request_destroy(req);
 	}
 }
@@ -1157,6 +1337,11 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 	p->next_cmd_id++;
 
 	g_queue_push_tail(p->command_queue, r);
+	r->link = g_queue_peek_tail_link(p->command_queue);
+	g_hash_table_insert(p->pending, GINT_TO_POINTER(r->id), r);
+
+	if (p->write_link == NULL)
+		p->write_link = r->link;
 
 	ril_wakeup_writer(p);
 
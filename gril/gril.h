@@ -40,7 +40,8 @@ typedef struct _GRil GRil;
 /*
  * This struct represents an entire RIL message read
  * from the command socket.  It can hold responses or
- * unsolicited requests from RILD.
+ * unsolicited requests from RILD.  Both the message and its
+ * buffer are only valid for the duration of the callback.
  */
 struct ril_msg {
 	gchar *buf;
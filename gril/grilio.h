@@ -30,6 +30,7 @@ extern "C" {
 #include "gfunc.h"
 
 #define GRIL_BUFFER_SIZE 8192
+#define GRIL_MAX_BUFFER_SIZE (32 * GRIL_BUFFER_SIZE)
 
 struct _GRilIO;
 
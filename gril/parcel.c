@@ -46,25 +46,77 @@
 
 typedef uint16_t char16_t;
 
+size_t parcel_size_string(const char *str)
+{
+	if (str == NULL)
+		return sizeof(int32_t);
+
+	/* UTF-8 never needs fewer bytes than UTF-16 needs code units */
+	return sizeof(int32_t) + PAD_SIZE((strlen(str) + 1) * sizeof(char16_t));
+}
+
+size_t parcel_size_raw(size_t len)
+{
+	return sizeof(int32_t) + PAD_SIZE(len);
+}
+
 void parcel_init(struct parcel *p)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	p->data = p->small;
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
+	p->capacity = sizeof(p->small);
 	p->offset = 0;
 	p->malformed = 0;
 }
 
+/*
+ * Like parcel_init(), but with room for at least size bytes, so that a
+ * large request whose size is known up front is allocated only once.
+ */
+void parcel_init_sized(struct parcel *p, size_t size)
+{
+	parcel_init(p);
+
+	if (size <= p->capacity)
+		return;
+
+	p->data = g_malloc(size);
+	p->capacity = size;
+}
+
+/* Makes room for at least size more bytes at the current offset */
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t needed = p->offset + size;
+	size_t capacity = p->capacity;
+
+	if (needed <= capacity)
+		return;
+
+	/*
+	 * Grow geometrically so that appending stays linear overall.  Parcels
+	 * set up by g_ril_init_parcel() may be empty, with nothing to double.
+	 */
+	capacity = MAX(capacity, PARCEL_SMALL_SIZE);
+
+	while (capacity < needed)
+		capacity *= 2;
+
+	if (p->data == p->small) {
+		p->data = g_malloc(capacity);
+		memcpy(p->data, p->small, p->size);
+	} else
+		p->data = g_realloc(p->data, capacity);
+
+	p->capacity = capacity;
 }
 
 void parcel_free(struct parcel *p)
 {
-	g_free(p->data);
+	if (p->data != p->small)
+		g_free(p->data);
+
+	p->data = NULL;
 	p->size = 0;
 	p->capacity = 0;
 	p->offset = 0;
@@ -90,79 +142,74 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
+	parcel_grow(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
 
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
-		}
-	}
 	return 0;
 }
 
+/* Zeroes the padding after len bytes at the offset and skips past it all */
+static void parcel_w_padded(struct parcel *p, size_t len)
+{
+	size_t padded = PAD_SIZE(len);
+
+	memset(p->data + p->offset + len, 0, padded - len);
+	p->offset += padded;
+	p->size += padded;
+}
+
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
-	size_t len;
-	size_t gs16_size;
+	char16_t *out;
+	int32_t len16 = 0;
+	const char *s;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
-
-	if (parcel_w_int32(p, gs16_len) == -1)
-		return -1;
-
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	parcel_grow(p, parcel_size_string(str));
+
+	/* Convert straight into the parcel, behind the length */
+	out = (char16_t *) (void *) (p->data + p->offset + sizeof(int32_t));
+
+	for (s = str; *s; s = g_utf8_next_char(s)) {
+		gunichar c;
+
+		/* Most strings sent to RILD are plain ASCII */
+		while ((unsigned char) (*s - 1) < 0x7f)
+			out[len16++] = *s++;
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
+		if (*s == '\0')
 			break;
 
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
+		c = g_utf8_get_char_validated(s, -1);
+
+		if (c == (gunichar) -1 || c == (gunichar) -2) {
+			ofono_error("%s: wrong UTF8 coding", __func__);
+			parcel_w_int32(p, -1);
+			return -1;
+		}
+
+		if (c < 0x10000) {
+			out[len16++] = c;
+			continue;
 		}
+
+		c -= 0x10000;
+		out[len16++] = 0xd800 | (c >> 10);
+		out[len16++] = 0xdc00 | (c & 0x3ff);
 	}
 
-	g_free(gs16);
+	out[len16] = 0;
+
+	parcel_w_int32(p, len16);
+	parcel_w_padded(p, (len16 + 1) * sizeof(char16_t));
+
 	return 0;
 }
 
@@ -227,42 +274,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 		return 0;
 	}
 
+	parcel_grow(p, parcel_size_raw(len));
 	parcel_w_int32(p, len);
 
-	for (;;) {
-		//Calculate the padded length for 4-byte alignment
-		size_t padded = PAD_SIZE(len);
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += padded;
-			p->size += padded;
-
-			//Endianness processing
-			if (padded != len) {
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	memcpy(p->data + p->offset, data, len);
+	parcel_w_padded(p, len);
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
-		}
-	}
 	return 0;
 }
 
@@ -25,12 +25,20 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+/*
+ * Parcels built by parcel_init() start out in a buffer of this size that
+ * is part of the parcel itself, so that typical requests, which are built
+ * in a struct parcel on the stack, are assembled without a heap allocation.
+ */
+#define PARCEL_SMALL_SIZE 256
+
 struct parcel {
 	char *data;
 	size_t offset;
 	size_t capacity;
 	size_t size;
 	int malformed;
+	char small[PARCEL_SMALL_SIZE] __attribute__((aligned(4)));
 };
 
 struct parcel_str_array {
@@ -38,7 +46,13 @@ struct parcel_str_array {
 	char *str[];
 };
 
+/* Upper bounds on the space values take in a parcel, for parcel_init_sized */
+#define PARCEL_SIZE_INT32 sizeof(int32_t)
+size_t parcel_size_string(const char *str);
+size_t parcel_size_raw(size_t len);
+
 void parcel_init(struct parcel *p);
+void parcel_init_sized(struct parcel *p, size_t size);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
@@ -49,6 +49,10 @@ struct ofono_debug_desc {
 	unsigned int flags;
 } __attribute__((aligned(8)));
 
+extern void ofono_debug_trace(struct ofono_debug_desc *desc,
+					const char *format, ...)
+				__attribute__((format(printf, 2, 3)));
+
 /**
  * DBG:
  * @fmt: format string
@@ -64,7 +68,7 @@ struct ofono_debug_desc {
 		.file = __FILE__, .flags = OFONO_DEBUG_FLAG_DEFAULT, \
 	}; \
 	if (__ofono_debug_desc.flags & OFONO_DEBUG_FLAG_PRINT) \
-		ofono_debug("%s:%s() " fmt, \
+		ofono_debug_trace(&__ofono_debug_desc, "%s:%s() " fmt, \
 					__FILE__, __FUNCTION__ , ## arg); \
 } while (0)
 #else
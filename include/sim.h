@@ -278,6 +278,7 @@ void *ofono_sim_get_data(struct ofono_sim *sim);
 void ofono_sim_set_card_slot_count(struct ofono_sim *sim, unsigned int val);
 void ofono_sim_set_active_card_slot(struct ofono_sim *sim,
 					unsigned int val);
+void ofono_sim_set_max_file_ops(struct ofono_sim *sim, unsigned int max);
 
 const char *ofono_sim_get_imsi(struct ofono_sim *sim);
 const char *ofono_sim_get_mcc(struct ofono_sim *sim);
@@ -89,6 +89,7 @@ void ofono_sms_remove(struct ofono_sms *sms);
 
 void ofono_sms_set_data(struct ofono_sms *sms, void *data);
 void *ofono_sms_get_data(struct ofono_sms *sms);
+void ofono_sms_set_tx_window(struct ofono_sms *sms, unsigned int window);
 
 #ifdef __cplusplus
 }
@@ -209,6 +209,297 @@ void ofono_dbus_dict_append_dict(DBusMessageIter *dict, const char *key,
 	dbus_message_iter_close_container(dict, &entry);
 }
 
+/*
+ * PropertyChanged signals of properties that change at a high rate, like
+ * the signal strength, are throttled per object, interface and property.
+ * The first change goes out right away, changes within the interval that
+ * follows are merged and only the latest value is sent once it is over.
+ * An interval of 0 merges the changes within a main loop iteration.  The
+ * state is kept until the interface goes away, so that an idle property
+ * costs no timers.
+ */
+struct property_limit {
+	char *interface;
+	char *name;
+	unsigned int interval;
+};
+
+struct property_changes {
+	char *path;
+	char *interface;
+	GSList *properties;
+	guint source;
+};
+
+struct property_change {
+	const struct property_limit *limit;
+	DBusMessage *signal;	/* The latest change, not sent yet */
+	gint64 sent;
+};
+
+static GSList *property_limits;
+static GHashTable *property_changes;
+
+static struct property_limit *find_property_limit(const char *interface,
+							const char *name)
+{
+	GSList *l;
+
+	for (l = property_limits; l; l = l->next) {
+		struct property_limit *limit = l->data;
+
+		if (g_str_equal(limit->name, name) &&
+				g_str_equal(limit->interface, interface))
+			return limit;
+	}
+
+	return NULL;
+}
+
+static void property_change_free(gpointer data)
+{
+	struct property_change *change = data;
+
+	if (change->signal)
+		dbus_message_unref(change->signal);
+
+	g_free(change);
+}
+
+static void property_changes_free(gpointer data)
+{
+	struct property_changes *changes = data;
+
+	if (changes->source)
+		g_source_remove(changes->source);
+
+	g_slist_free_full(changes->properties, property_change_free);
+	g_free(changes->path);
+	g_free(changes->interface);
+	g_free(changes);
+}
+
+static gint64 property_change_due(const struct property_change *change)
+{
+	return change->sent + change->limit->interval * 1000LL;
+}
+
+static gboolean send_property_changes(gpointer user_data);
+
+static void schedule_property_changes(struct property_changes *changes)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 next = G_MAXINT64;
+	GSList *l;
+
+	if (changes->source) {
+		g_source_remove(changes->source);
+		changes->source = 0;
+	}
+
+	for (l = changes->properties; l; l = l->next) {
+		struct property_change *change = l->data;
+
+		if (change->signal == NULL)
+			continue;
+
+		if (change->limit->interval == 0)
+			next = now;
+		else
+			next = MIN(next, property_change_due(change));
+	}
+
+	if (next == G_MAXINT64)
+		return;
+
+	if (next <= now)
+		changes->source = g_idle_add(send_property_changes, changes);
+	else
+		changes->source = g_timeout_add((next - now + 999) / 1000,
+						send_property_changes, changes);
+}
+
+static gboolean send_property_changes(gpointer user_data)
+{
+	struct property_changes *changes = user_data;
+	DBusConnection *conn = ofono_dbus_get_connection();
+	gint64 now = g_get_monotonic_time();
+	GSList *l;
+
+	for (l = changes->properties; l; l = l->next) {
+		struct property_change *change = l->data;
+
+		if (change->signal == NULL)
+			continue;
+
+		if (change->limit->interval > 0 &&
+					property_change_due(change) > now)
+			continue;
+
+		g_dbus_send_message(conn, change->signal);
+		change->signal = NULL;
+		change->sent = now;
+	}
+
+	changes->source = 0;
+	schedule_property_changes(changes);
+
+	return FALSE;
+}
+
+static gboolean flush_property_limit(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	struct property_changes *changes = value;
+	const struct property_limit *limit = user_data;
+	GSList *l;
+
+	for (l = changes->properties; l; l = l->next) {
+		struct property_change *change = l->data;
+
+		if (change->limit != limit)
+			continue;
+
+		if (change->signal) {
+			g_dbus_send_message(ofono_dbus_get_connection(),
+						change->signal);
+			change->signal = NULL;
+		}
+
+		changes->properties = g_slist_delete_link(changes->properties,
+									l);
+		property_change_free(change);
+		break;
+	}
+
+	if (changes->properties == NULL)
+		return TRUE;
+
+	schedule_property_changes(changes);
+
+	return FALSE;
+}
+
+/*
+ * Sets how long, in milliseconds, changes of a property are merged before
+ * they are signalled again.  A negative interval sends every change right
+ * away, which is what properties without a limit do.
+ */
+void __ofono_dbus_set_property_interval(const char *interface,
+					const char *name, int interval)
+{
+	struct property_limit *limit = find_property_limit(interface, name);
+
+	if (interval < 0) {
+		if (limit == NULL)
+			return;
+
+		/* Pending changes point at the limit, send them now */
+		if (property_changes)
+			g_hash_table_foreach_remove(property_changes,
+							flush_property_limit,
+							limit);
+
+		property_limits = g_slist_remove(property_limits, limit);
+		g_free(limit->interface);
+		g_free(limit->name);
+		g_free(limit);
+		return;
+	}
+
+	if (limit == NULL) {
+		limit = g_new0(struct property_limit, 1);
+		limit->interface = g_strdup(interface);
+		limit->name = g_strdup(name);
+		property_limits = g_slist_prepend(property_limits, limit);
+	}
+
+	limit->interval = interval;
+}
+
+/*
+ * Sends a PropertyChanged signal for the property name, or holds it back
+ * if the property is throttled.  Takes ownership of the signal.
+ */
+gboolean __ofono_dbus_send_property_changed(DBusConnection *conn,
+						DBusMessage *signal,
+						const char *name)
+{
+	const char *path = dbus_message_get_path(signal);
+	const char *interface = dbus_message_get_interface(signal);
+	struct property_limit *limit;
+	struct property_changes *changes;
+	struct property_change *change = NULL;
+	gint64 now;
+	char *key;
+	GSList *l;
+
+	limit = find_property_limit(interface, name);
+	if (limit == NULL || property_changes == NULL)
+		return g_dbus_send_message(conn, signal);
+
+	key = g_strconcat(path, " ", interface, NULL);
+	changes = g_hash_table_lookup(property_changes, key);
+
+	if (changes == NULL) {
+		changes = g_new0(struct property_changes, 1);
+		changes->path = g_strdup(path);
+		changes->interface = g_strdup(interface);
+		g_hash_table_insert(property_changes, key, changes);
+	} else
+		g_free(key);
+
+	for (l = changes->properties; l; l = l->next) {
+		struct property_change *c = l->data;
+
+		if (c->limit == limit) {
+			change = c;
+			break;
+		}
+	}
+
+	now = g_get_monotonic_time();
+
+	if (change == NULL) {
+		change = g_new0(struct property_change, 1);
+		change->limit = limit;
+		change->sent = now - limit->interval * 1000LL;
+		changes->properties = g_slist_append(changes->properties,
+								change);
+	}
+
+	/* Quiet for a whole interval, nothing to merge this with */
+	if (limit->interval > 0 && change->signal == NULL &&
+					property_change_due(change) <= now) {
+		change->sent = now;
+		return g_dbus_send_message(conn, signal);
+	}
+
+	if (change->signal)
+		dbus_message_unref(change->signal);
+
+	change->signal = signal;
+
+	if (changes->source == 0 || limit->interval == 0)
+		schedule_property_changes(changes);
+
+	return TRUE;
+}
+
+/* Drops the held back changes of an interface that is going away */
+void __ofono_dbus_discard_property_changes(const char *path,
+						const char *interface)
+{
+	char *key;
+
+	if (property_changes == NULL)
+		return;
+
+	key = g_strconcat(path, " ", interface, NULL);
+	g_hash_table_remove(property_changes, key);
+	g_free(key);
+}
+
 int ofono_dbus_signal_property_changed(DBusConnection *conn,
 					const char *path,
 					const char *interface,
@@ -231,7 +522,7 @@ int ofono_dbus_signal_property_changed(DBusConnection *conn,
 
 	append_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return __ofono_dbus_send_property_changed(conn, signal, name);
 }
 
 int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
@@ -257,7 +548,7 @@ int ofono_dbus_signal_array_property_changed(DBusConnection *conn,
 
 	append_array_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return __ofono_dbus_send_property_changed(conn, signal, name);
 }
 
 int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
@@ -283,7 +574,7 @@ int ofono_dbus_signal_dict_property_changed(DBusConnection *conn,
 
 	append_dict_variant(&iter, type, value);
 
-	return g_dbus_send_message(conn, signal);
+	return __ofono_dbus_send_property_changed(conn, signal, name);
 }
 
 DBusMessage *__ofono_error_invalid_args(DBusMessage *msg)
@@ -489,6 +780,19 @@ int __ofono_dbus_init(DBusConnection *conn)
 {
 	dbus_gsm_set_connection(conn);
 
+	property_changes = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, property_changes_free);
+
+	/* Reported by some modems several times a second */
+	__ofono_dbus_set_property_interval(OFONO_NETWORK_REGISTRATION_INTERFACE,
+						"Strength", 1000);
+	__ofono_dbus_set_property_interval(OFONO_NETWORK_REGISTRATION_INTERFACE,
+						"CellId", 0);
+	__ofono_dbus_set_property_interval(OFONO_NETWORK_REGISTRATION_INTERFACE,
+						"LocationAreaCode", 0);
+	__ofono_dbus_set_property_interval(OFONO_NETMON_INTERFACE,
+						"CellList", 1000);
+
 	return 0;
 }
 
@@ -496,6 +800,20 @@ void __ofono_dbus_cleanup(void)
 {
 	DBusConnection *conn = ofono_dbus_get_connection();
 
+	if (property_changes) {
+		g_hash_table_destroy(property_changes);
+		property_changes = NULL;
+	}
+
+	while (property_limits) {
+		struct property_limit *limit = property_limits->data;
+
+		property_limits = g_slist_remove(property_limits, limit);
+		g_free(limit->interface);
+		g_free(limit->name);
+		g_free(limit);
+	}
+
 	if (conn == NULL || !dbus_connection_get_is_connected(conn))
 		return;
 
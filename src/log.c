@@ -28,7 +28,10 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <syslog.h>
 #ifdef __GLIBC__
 #include <execinfo.h>
@@ -40,6 +43,598 @@
 static const char *program_exec;
 static const char *program_path;
 
+/*
+ * With tracing enabled, debug messages are not formatted and sent to
+ * syslog as they happen.  Each one becomes a fixed size record holding
+ * the format pointer and the raw arguments, in a ring per subsystem, and
+ * only gets formatted when the rings are dumped.  String arguments are
+ * copied into the record, except the file and function names of DBG,
+ * which are literals.  Everything runs on the main loop, so records are
+ * claimed with a plain increment and never locked.
+ */
+#define TRACE_RING_SIZE		512	/* Records per ring, power of two */
+#define TRACE_MAX_RINGS		32
+#define TRACE_MAX_ARGS		12
+
+/*
+ * Shared by all string arguments of a record, including their
+ * terminators.  Strings are copied in order and cut silently once it is
+ * full, later ones come out empty.
+ */
+#define TRACE_STRINGS_SIZE	136
+
+/*
+ * Ring of a DBG site, kept above the public flags of its descriptor
+ * together with the generation of the rings it was looked up in, so
+ * that a site logging again after the rings got recreated looks it up
+ * again.
+ */
+#define DEBUG_FLAG_RING_SHIFT	8
+#define DEBUG_FLAG_RING_MASK	0xff
+#define DEBUG_FLAG_GEN_SHIFT	16
+#define DEBUG_FLAG_GEN_MAX	0xffff
+
+union trace_arg {
+	long long i;
+	unsigned long long u;
+	double d;
+	const void *p;
+};
+
+struct trace_record {
+	const char *format;
+	unsigned long long time;
+	unsigned int seq;
+	int err;
+	union trace_arg args[TRACE_MAX_ARGS];
+	char strings[TRACE_STRINGS_SIZE];
+};
+
+struct trace_ring {
+	char *name;
+	struct trace_record *records;
+	unsigned int head;
+};
+
+enum trace_length {
+	TRACE_LENGTH_NONE,
+	TRACE_LENGTH_HH,
+	TRACE_LENGTH_H,
+	TRACE_LENGTH_L,
+	TRACE_LENGTH_LL,
+	TRACE_LENGTH_J,
+	TRACE_LENGTH_Z,
+	TRACE_LENGTH_T,
+	TRACE_LENGTH_LONG_DOUBLE,
+};
+
+struct trace_spec {
+	const char *start;
+	enum trace_length length;
+	int width_star;
+	int precision_star;
+	int precision;
+	ofono_bool_t positional;
+	char conv;
+};
+
+static struct trace_ring trace_rings[TRACE_MAX_RINGS];
+static unsigned int trace_num_rings;
+static unsigned int trace_generation;
+static unsigned int trace_seq;
+
+/*
+ * Parses the conversion specification starting after the '%' at p,
+ * returns a pointer to its conversion character.
+ */
+static const char *trace_parse_spec(const char *p, struct trace_spec *spec)
+{
+	spec->start = p;
+	spec->length = TRACE_LENGTH_NONE;
+	spec->width_star = FALSE;
+	spec->precision_star = FALSE;
+	spec->precision = -1;
+	spec->positional = FALSE;
+
+	while (*p != '\0' && strchr("-+ #0'I", *p) != NULL)
+		p++;
+
+	if (*p == '*') {
+		spec->width_star = TRUE;
+		p++;
+	}
+
+	while (*p >= '0' && *p <= '9')
+		p++;
+
+	if (*p == '$') {
+		spec->positional = TRUE;
+		p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		spec->precision = 0;
+
+		if (*p == '*') {
+			spec->precision_star = TRUE;
+			p++;
+		}
+
+		while (*p >= '0' && *p <= '9')
+			spec->precision = spec->precision * 10 + *p++ - '0';
+	}
+
+	switch (*p) {
+	case 'h':
+		if (p[1] == 'h') {
+			spec->length = TRACE_LENGTH_HH;
+			p++;
+		} else
+			spec->length = TRACE_LENGTH_H;
+
+		p++;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			spec->length = TRACE_LENGTH_LL;
+			p++;
+		} else
+			spec->length = TRACE_LENGTH_L;
+
+		p++;
+		break;
+	case 'q':
+		spec->length = TRACE_LENGTH_LL;
+		p++;
+		break;
+	case 'j':
+		spec->length = TRACE_LENGTH_J;
+		p++;
+		break;
+	case 'z':
+	case 'Z':
+		spec->length = TRACE_LENGTH_Z;
+		p++;
+		break;
+	case 't':
+		spec->length = TRACE_LENGTH_T;
+		p++;
+		break;
+	case 'L':
+		spec->length = TRACE_LENGTH_LONG_DOUBLE;
+		p++;
+		break;
+	}
+
+	spec->conv = *p;
+
+	return p;
+}
+
+/*
+ * Stores the arguments of format in rec.  The first nstatic string
+ * arguments are kept by reference.  Returns FALSE if the format uses
+ * something a record can not hold, the message is then formatted right
+ * away instead.
+ */
+static ofono_bool_t trace_capture(struct trace_record *rec,
+					const char *format,
+					unsigned int nstatic, va_list ap)
+{
+	struct trace_spec spec;
+	unsigned int n = 0;
+	unsigned int nstrings = 0;
+	unsigned int used = 0;
+	unsigned int len;
+	const char *p;
+	const char *s;
+
+	for (p = format; *p != '\0'; p++) {
+		if (*p != '%')
+			continue;
+
+		p = trace_parse_spec(p + 1, &spec);
+
+		if (spec.conv == '%' || spec.conv == 'm')
+			continue;
+
+		if (spec.positional || spec.length == TRACE_LENGTH_LONG_DOUBLE)
+			return FALSE;
+
+		if (n + spec.width_star + spec.precision_star >=
+							TRACE_MAX_ARGS)
+			return FALSE;
+
+		if (spec.width_star)
+			rec->args[n++].i = va_arg(ap, int);
+
+		if (spec.precision_star) {
+			rec->args[n].i = va_arg(ap, int);
+			spec.precision = rec->args[n++].i;
+		}
+
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			switch (spec.length) {
+			case TRACE_LENGTH_HH:
+				rec->args[n].i = (signed char) va_arg(ap, int);
+				break;
+			case TRACE_LENGTH_H:
+				rec->args[n].i = (short) va_arg(ap, int);
+				break;
+			case TRACE_LENGTH_L:
+				rec->args[n].i = va_arg(ap, long);
+				break;
+			case TRACE_LENGTH_LL:
+				rec->args[n].i = va_arg(ap, long long);
+				break;
+			case TRACE_LENGTH_J:
+				rec->args[n].i = va_arg(ap, intmax_t);
+				break;
+			case TRACE_LENGTH_Z:
+				rec->args[n].i = va_arg(ap, ssize_t);
+				break;
+			case TRACE_LENGTH_T:
+				rec->args[n].i = va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				rec->args[n].i = va_arg(ap, int);
+				break;
+			}
+
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			switch (spec.length) {
+			case TRACE_LENGTH_HH:
+				rec->args[n].u = (unsigned char)
+							va_arg(ap, unsigned int);
+				break;
+			case TRACE_LENGTH_H:
+				rec->args[n].u = (unsigned short)
+							va_arg(ap, unsigned int);
+				break;
+			case TRACE_LENGTH_L:
+				rec->args[n].u = va_arg(ap, unsigned long);
+				break;
+			case TRACE_LENGTH_LL:
+				rec->args[n].u = va_arg(ap,
+							unsigned long long);
+				break;
+			case TRACE_LENGTH_J:
+				rec->args[n].u = va_arg(ap, uintmax_t);
+				break;
+			case TRACE_LENGTH_Z:
+				rec->args[n].u = va_arg(ap, size_t);
+				break;
+			case TRACE_LENGTH_T:
+				rec->args[n].u = va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				rec->args[n].u = va_arg(ap, unsigned int);
+				break;
+			}
+
+			break;
+		case 'c':
+			if (spec.length != TRACE_LENGTH_NONE)
+				return FALSE;
+
+			rec->args[n].i = va_arg(ap, int);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			rec->args[n].d = va_arg(ap, double);
+			break;
+		case 'p':
+			rec->args[n].p = va_arg(ap, void *);
+			break;
+		case 's':
+			if (spec.length != TRACE_LENGTH_NONE)
+				return FALSE;
+
+			s = va_arg(ap, const char *);
+
+			if (s == NULL || nstrings++ < nstatic) {
+				rec->args[n].p = s;
+				break;
+			}
+
+			/* The precision may be all there is to terminate s */
+			len = TRACE_STRINGS_SIZE - used - 1;
+
+			if (spec.precision >= 0 &&
+					(unsigned int) spec.precision < len)
+				len = spec.precision;
+
+			len = strnlen(s, len);
+			memcpy(rec->strings + used, s, len);
+			rec->strings[used + len] = '\0';
+			rec->args[n].p = rec->strings + used;
+
+			used = MIN(used + len + 1, TRACE_STRINGS_SIZE - 1);
+
+			break;
+		default:
+			return FALSE;
+		}
+
+		n++;
+	}
+
+	rec->format = format;
+
+	return TRUE;
+}
+
+static void trace_record(struct trace_ring *ring, unsigned int nstatic,
+					const char *format, va_list ap)
+{
+	struct trace_record *rec;
+	struct timespec ts;
+	int err = errno;
+	va_list copy;
+
+	rec = &ring->records[ring->head++ & (TRACE_RING_SIZE - 1)];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->time = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+	rec->seq = trace_seq++;
+	rec->err = err;
+
+	va_copy(copy, ap);
+
+	if (trace_capture(rec, format, nstatic, copy) == FALSE) {
+		errno = err;
+		vsnprintf(rec->strings, sizeof(rec->strings), format, ap);
+		rec->format = "%s";
+		rec->args[0].p = rec->strings;
+	}
+
+	va_end(copy);
+
+	errno = err;
+}
+
+static void trace_ring_new(char *name)
+{
+	struct trace_ring *ring = &trace_rings[trace_num_rings++];
+
+	ring->name = name;
+	ring->records = g_new0(struct trace_record, TRACE_RING_SIZE);
+	ring->head = 0;
+}
+
+/* One ring per source directory, the first one takes everything else */
+static unsigned int trace_ring_lookup(const char *file)
+{
+	const char *slash = file ? strrchr(file, '/') : NULL;
+	unsigned int len;
+	unsigned int i;
+
+	if (slash == NULL)
+		return 0;
+
+	len = slash - file;
+
+	for (i = 1; i < trace_num_rings; i++) {
+		if (strncmp(trace_rings[i].name, file, len) == 0 &&
+					trace_rings[i].name[len] == '\0')
+			return i;
+	}
+
+	if (trace_num_rings == TRACE_MAX_RINGS)
+		return 0;
+
+	trace_ring_new(g_strndup(file, len));
+
+	return i;
+}
+
+static void trace_append(char *buf, size_t size, size_t *len,
+						const char *format, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (*len >= size - 1)
+		return;
+
+	va_start(ap, format);
+	ret = vsnprintf(buf + *len, size - *len, format, ap);
+	va_end(ap);
+
+	if (ret > 0)
+		*len = MIN(*len + ret, size - 1);
+}
+
+/* Formats rec the way vsyslog() would have done when it was recorded */
+static void trace_format(const struct trace_record *rec, char *buf,
+								size_t size)
+{
+	struct trace_spec spec;
+	const union trace_arg *arg = rec->args;
+	char fmt[64];
+	size_t flen;
+	size_t len = 0;
+	const char *p;
+	const char *q;
+
+	buf[0] = '\0';
+
+	for (p = rec->format; *p != '\0'; p++) {
+		if (*p != '%') {
+			q = strchr(p, '%');
+
+			if (q == NULL)
+				q = p + strlen(p);
+
+			trace_append(buf, size, &len, "%.*s", (int) (q - p), p);
+			p = q - 1;
+			continue;
+		}
+
+		p = trace_parse_spec(p + 1, &spec);
+
+		if (spec.conv == '%') {
+			trace_append(buf, size, &len, "%%");
+			continue;
+		}
+
+		if (spec.conv == 'm') {
+			trace_append(buf, size, &len, "%s",
+						strerror(rec->err));
+			continue;
+		}
+
+		/* Rebuild the conversion with the stars filled in */
+		flen = 0;
+		fmt[flen++] = '%';
+
+		for (q = spec.start; q < p && flen < sizeof(fmt) - 24; q++) {
+			if (*q == '*' && q[-1] == '.') {
+				if (arg->i < 0)
+					flen--;
+				else
+					flen += sprintf(fmt + flen, "%lld",
+								arg->i);
+				arg++;
+			} else if (*q == '*') {
+				flen += sprintf(fmt + flen, "%lld", arg->i);
+				arg++;
+			} else if (strchr("hlqjzZtL", *q) == NULL)
+				fmt[flen++] = *q;
+		}
+
+		if (strchr("diuoxX", spec.conv) != NULL) {
+			fmt[flen++] = 'l';
+			fmt[flen++] = 'l';
+		}
+
+		fmt[flen++] = spec.conv;
+		fmt[flen] = '\0';
+
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			trace_append(buf, size, &len, fmt, arg->i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			trace_append(buf, size, &len, fmt, arg->u);
+			break;
+		case 'c':
+			trace_append(buf, size, &len, fmt, (int) arg->i);
+			break;
+		case 's':
+		case 'p':
+			trace_append(buf, size, &len, fmt, arg->p);
+			break;
+		default:
+			trace_append(buf, size, &len, fmt, arg->d);
+			break;
+		}
+
+		arg++;
+	}
+}
+
+/*
+ * Writes every record still in the rings to fd, or to syslog if fd is
+ * negative, oldest first across all rings.
+ */
+void __ofono_log_trace_dump(int fd)
+{
+	unsigned int next[TRACE_MAX_RINGS];
+	const struct trace_record *rec;
+	struct trace_ring *ring;
+	unsigned int oldest_seq = 0;
+	char buf[1024];
+	unsigned int i;
+	int oldest;
+
+	if (trace_num_rings == 0)
+		return;
+
+	for (i = 0; i < trace_num_rings; i++) {
+		ring = &trace_rings[i];
+		next[i] = ring->head > TRACE_RING_SIZE ?
+					ring->head - TRACE_RING_SIZE : 0;
+	}
+
+	while (TRUE) {
+		oldest = -1;
+
+		for (i = 0; i < trace_num_rings; i++) {
+			ring = &trace_rings[i];
+
+			if (next[i] == ring->head)
+				continue;
+
+			rec = &ring->records[next[i] & (TRACE_RING_SIZE - 1)];
+
+			if (oldest < 0 || (int) (rec->seq - oldest_seq) < 0) {
+				oldest = i;
+				oldest_seq = rec->seq;
+			}
+		}
+
+		if (oldest < 0)
+			break;
+
+		ring = &trace_rings[oldest];
+		rec = &ring->records[next[oldest]++ & (TRACE_RING_SIZE - 1)];
+		trace_format(rec, buf, sizeof(buf));
+
+		if (fd < 0)
+			syslog(LOG_INFO, "[%s %llu.%06llu] %s", ring->name,
+					rec->time / 1000000,
+					rec->time % 1000000, buf);
+		else
+			dprintf(fd, "[%s %llu.%06llu] %s\n", ring->name,
+					rec->time / 1000000,
+					rec->time % 1000000, buf);
+	}
+}
+
+/*
+ * Keeps debug messages in memory from now on, until dumped with
+ * __ofono_log_trace_dump().  Info messages go to both.
+ */
+void __ofono_log_trace_enable(void)
+{
+	if (trace_num_rings > 0)
+		return;
+
+	/* Never 0, which is what every descriptor starts with */
+	trace_generation = trace_generation % DEBUG_FLAG_GEN_MAX + 1;
+
+	trace_ring_new(g_strdup("ofonod"));
+}
+
+/* Drops whatever is in the rings, debug messages go to syslog again */
+void __ofono_log_trace_disable(void)
+{
+	while (trace_num_rings > 0) {
+		struct trace_ring *ring = &trace_rings[--trace_num_rings];
+
+		g_free(ring->name);
+		g_free(ring->records);
+	}
+}
+
 /**
  * ofono_info:
  * @format: format string
@@ -53,6 +648,14 @@ void ofono_info(const char *format, ...)
 
 	va_start(ap, format);
 
+	if (trace_num_rings > 0) {
+		va_list copy;
+
+		va_copy(copy, ap);
+		trace_record(&trace_rings[0], 0, format, copy);
+		va_end(copy);
+	}
+
 	vsyslog(LOG_INFO, format, ap);
 
 	va_end(ap);
@@ -110,7 +713,49 @@ void ofono_debug(const char *format, ...)
 
 	va_start(ap, format);
 
-	vsyslog(LOG_INFO, format, ap);
+	if (trace_num_rings > 0)
+		trace_record(&trace_rings[0], 0, format, ap);
+	else
+		vsyslog(LOG_INFO, format, ap);
+
+	va_end(ap);
+}
+
+/**
+ * ofono_debug_trace:
+ * @desc: debug descriptor of the call site
+ * @format: format string, starting with the file and function name
+ * @varargs: list of arguments
+ *
+ * Output debug message of a DBG call site. When tracing, the message
+ * ends up in the ring of the source directory of the call site.
+ */
+void ofono_debug_trace(struct ofono_debug_desc *desc,
+					const char *format, ...)
+{
+	unsigned int ring;
+	va_list ap;
+
+	va_start(ap, format);
+
+	if (trace_num_rings == 0) {
+		vsyslog(LOG_INFO, format, ap);
+		va_end(ap);
+		return;
+	}
+
+	if (desc->flags >> DEBUG_FLAG_GEN_SHIFT == trace_generation) {
+		ring = (desc->flags >> DEBUG_FLAG_RING_SHIFT) &
+							DEBUG_FLAG_RING_MASK;
+	} else {
+		ring = trace_ring_lookup(desc->file);
+		desc->flags &= (1U << DEBUG_FLAG_RING_SHIFT) - 1;
+		desc->flags |= ring << DEBUG_FLAG_RING_SHIFT |
+				trace_generation << DEBUG_FLAG_GEN_SHIFT;
+	}
+
+	/* __FILE__ and __FUNCTION__ from DBG */
+	trace_record(&trace_rings[ring], 2, format, ap);
 
 	va_end(ap);
 }
@@ -225,6 +870,8 @@ static void signal_handler(int signo)
 {
 	ofono_error("Aborting (signal %d) [%s]", signo, program_exec);
 
+	__ofono_log_trace_dump(-1);
+
 	print_backtrace(2);
 
 	exit(EXIT_FAILURE);
@@ -337,4 +984,6 @@ void __ofono_log_cleanup(void)
 #endif
 
 	g_strfreev(enabled);
+
+	__ofono_log_trace_disable();
 }
@@ -35,6 +35,7 @@
 #include <ell/ell.h>
 
 #include "ofono.h"
+#include "storage.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -84,6 +85,9 @@ static gboolean signal_handler(GIOChannel *channel, GIOCondition cond,
 
 		__terminated = 1;
 		break;
+	case SIGUSR1:
+		__ofono_log_trace_dump(-1);
+		break;
 	}
 
 	return TRUE;
@@ -99,6 +103,7 @@ static guint setup_signalfd(void)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
 
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
 		perror("Failed to set signal mask");
@@ -137,6 +142,7 @@ static gchar *option_debug = NULL;
 static gchar *option_plugin = NULL;
 static gchar *option_noplugin = NULL;
 static gboolean option_detach = TRUE;
+static gboolean option_trace = FALSE;
 static gboolean option_version = FALSE;
 
 static gboolean parse_debug(const char *key, const char *value,
@@ -170,6 +176,8 @@ static GOptionEntry options[] = {
 	{ "nodetach", 'n', G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_detach,
 				"Don't run as daemon in background" },
+	{ "trace", 't', 0, G_OPTION_ARG_NONE, &option_trace,
+				"Keep debug output in memory, dump on SIGUSR1" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
 	{ NULL },
@@ -207,6 +215,7 @@ int main(int argc, char **argv)
 	DBusError error;
 	guint signal;
 	struct ell_event_source *source;
+	struct storage_sync_stats sync_stats;
 	int retry_round = 0;
 
 	context = g_option_context_new(NULL);
@@ -258,6 +267,9 @@ int main(int argc, char **argv)
 
 	__ofono_log_init(argv[0], option_debug, option_detach);
 
+	if (option_trace == TRUE)
+		__ofono_log_trace_enable();
+
 	dbus_error_init(&error);
 
 	while (true) {
@@ -307,6 +319,11 @@ int main(int argc, char **argv)
 
 	__ofono_modemwatch_cleanup();
 
+	storage_flush();
+	storage_get_sync_stats(&sync_stats);
+	DBG("settings synced %u times, %u writes, %u saved",
+			sync_stats.syncs, sync_stats.writes, sync_stats.saved);
+
 	g_dbus_detach_object_manager(conn);
 
 	__ofono_dbus_cleanup();
@@ -145,6 +145,26 @@ static void append_properties(char *dds, char *dcs, char *dss, DBusMessageIter *
 	ofono_dbus_dict_append(dict, "SmsSlot", DBUS_TYPE_STRING, &dss);
 }
 
+static void append_storage_stats(DBusMessageIter *dict)
+{
+	struct storage_sync_stats stats;
+	const void *entries[7];
+	const void **stats_dict = entries;
+
+	storage_get_sync_stats(&stats);
+
+	entries[0] = "Syncs";
+	entries[1] = &stats.syncs;
+	entries[2] = "Writes";
+	entries[3] = &stats.writes;
+	entries[4] = "Saved";
+	entries[5] = &stats.saved;
+	entries[6] = NULL;
+
+	ofono_dbus_dict_append_dict(dict, "StorageStatistics",
+					DBUS_TYPE_UINT32, &stats_dict);
+}
+
 static DBusMessage *manager_set_property(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
@@ -255,6 +275,7 @@ static DBusMessage *manager_get_properties(DBusConnection *conn,
 					OFONO_PROPERTIES_ARRAY_SIGNATURE,
 					&dict);
 	append_properties(manager->data_slot, manager->voicecall_slot, manager->sms_slot, &dict);
+	append_storage_stats(&dict);
 	dbus_message_iter_close_container(&iter, &dict);
 
 	return reply;
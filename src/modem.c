@@ -3042,6 +3042,9 @@ static void modem_unregister(struct ofono_modem *modem)
 
 	modem->driver = NULL;
 
+	/* Settings of the atoms gone with the modem are written out now */
+	storage_flush();
+
 	emit_modem_removed(modem);
 	call_modemwatches(modem, FALSE);
 
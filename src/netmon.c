@@ -214,7 +214,7 @@ void ofono_netmon_serving_cell_notify(struct ofono_netmon *netmon,
 	}
 
 	dbus_message_iter_close_container(&iter, &array);
-	g_dbus_send_message(conn, signal);
+	__ofono_dbus_send_property_changed(conn, signal, key);
 }
 
 static void serving_cell_info_callback(const struct ofono_error *error,
@@ -534,6 +534,7 @@ static void netmon_unregister(struct ofono_atom *atom)
 
 	ofono_modem_remove_interface(modem, OFONO_NETMON_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_NETMON_INTERFACE);
+	__ofono_dbus_discard_property_changes(path, OFONO_NETMON_INTERFACE);
 }
 
 static void netmon_remove(struct ofono_atom *atom)
@@ -2484,6 +2484,8 @@ static void netreg_unregister(struct ofono_atom *atom)
 					OFONO_NETWORK_REGISTRATION_INTERFACE);
 	ofono_modem_remove_interface(modem,
 					OFONO_NETWORK_REGISTRATION_INTERFACE);
+	__ofono_dbus_discard_property_changes(path,
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
 
 	if (netreg->signal_strength_data) {
 		if (netreg->signal_strength_data->gw_signal_strength) {
@@ -43,6 +43,9 @@ int __ofono_log_init(const char *program, const char *debug,
 void __ofono_log_cleanup(void);
 void __ofono_log_enable(struct ofono_debug_desc *start,
 					struct ofono_debug_desc *stop);
+void __ofono_log_trace_enable(void);
+void __ofono_log_trace_disable(void);
+void __ofono_log_trace_dump(int fd);
 
 #include <ofono/dbus.h>
 
@@ -77,6 +80,14 @@ DBusMessage *__ofono_error_from_error(const struct ofono_error *error,
 
 void __ofono_dbus_pending_reply(DBusMessage **msg, DBusMessage *reply);
 
+void __ofono_dbus_set_property_interval(const char *interface,
+					const char *name, int interval);
+gboolean __ofono_dbus_send_property_changed(DBusConnection *conn,
+						DBusMessage *signal,
+						const char *name);
+void __ofono_dbus_discard_property_changes(const char *path,
+						const char *interface);
+
 struct ofono_watchlist_item {
 	unsigned int id;
 	void *notify;
@@ -139,6 +139,9 @@ struct ofono_sim {
 	unsigned int active_card_slot;
 	unsigned int pending_active_card_slot;
 
+	unsigned int max_file_ops;
+	gint64 init_time;
+
 	GSList *aid_sessions;
 	GSList *aid_list;
 	char *impi;
@@ -2189,6 +2192,20 @@ static void sim_set_ready(struct ofono_sim *sim)
 
 	sim->state = OFONO_SIM_STATE_READY;
 
+	if (sim->init_time) {
+		struct sim_fs_stats stats;
+
+		sim_fs_get_stats(sim->simfs, &stats);
+
+		DBG("SIM ready after %" G_GINT64_FORMAT " ms, %u file ops, "
+			"%u from cache, %u requests, up to %u at once",
+			(g_get_monotonic_time() - sim->init_time) / 1000,
+			stats.ops, stats.cached, stats.requests,
+			stats.max_active);
+
+		sim->init_time = 0;
+	}
+
 	sim_fs_check_version(sim->simfs);
 
 	call_state_watches(sim);
@@ -2246,6 +2263,8 @@ static void discover_apps_cb(const struct ofono_error *error,
 			 * the FS structure so the ISIM EF's can be accessed.
 			 */
 			sim->simfs_isim = sim_fs_new(sim, sim->driver);
+			sim_fs_set_max_active(sim->simfs_isim,
+						sim->max_file_ops);
 			sim->isim_context = ofono_sim_context_create_isim(
 					sim);
 			/* attempt to get the NAI from EFimpi */
@@ -2690,19 +2709,6 @@ static void sim_initialize_after_pin(struct ofono_sim *sim)
 			sim_cphs_information_read_cb, sim);
 }
 
-static void sim_efli_read_cb(int ok, int length, int record,
-				const unsigned char *data,
-				int record_length, void *userdata)
-{
-	struct ofono_sim *sim = userdata;
-
-	if (!ok)
-		return;
-
-	sim->efli = g_memdup2(data, length);
-	sim->efli_length = length;
-}
-
 /* Detect whether the file is in EFli format, as opposed to 51.011 EFlp */
 static gboolean sim_efli_format(const unsigned char *ef, int length)
 {
@@ -2878,6 +2884,26 @@ skip_efpl:
 	sim->language_prefs_update = false;
 }
 
+static void sim_efli_read_cb(int ok, int length, int record,
+				const unsigned char *data,
+				int record_length, void *userdata)
+{
+	struct ofono_sim *sim = userdata;
+
+	if (ok) {
+		sim->efli = g_memdup2(data, length);
+		sim->efli_length = length;
+	}
+
+	/*
+	 * EFpl is parsed against EFli, so only ask for it once EFli is in,
+	 * as the two reads could otherwise complete in any order
+	 */
+	ofono_sim_read(sim->early_context, SIM_EFPL_FILEID,
+			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
+			sim_efpl_read_cb, sim);
+}
+
 static void sim_iccid_read_cb(int ok, int length, int record,
 				const unsigned char *data,
 				int record_length, void *userdata)
@@ -2935,10 +2961,6 @@ static void sim_efli_efpl_changed(int id, void *userdata)
 	ofono_sim_read(sim->early_context, SIM_EFLI_FILEID,
 			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
 			sim_efli_read_cb, sim);
-
-	ofono_sim_read(sim->early_context, SIM_EFPL_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_efpl_read_cb, sim);
 }
 
 static void sim_initialize(struct ofono_sim *sim)
@@ -2972,6 +2994,8 @@ static void sim_initialize(struct ofono_sim *sim)
 	if (sim->early_context == NULL)
 		sim->early_context = ofono_sim_context_create(sim);
 
+	sim->init_time = g_get_monotonic_time();
+
 	/* Grab the EFiccid which is always available */
 	ofono_sim_read(sim->early_context, SIM_EF_ICCID_FILEID,
 			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
@@ -2995,9 +3019,7 @@ static void sim_initialize(struct ofono_sim *sim)
 	ofono_sim_add_file_watch(sim->early_context, SIM_EFLI_FILEID,
 					sim_efli_efpl_changed, sim, NULL);
 
-	ofono_sim_read(sim->early_context, SIM_EFPL_FILEID,
-			OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
-			sim_efpl_read_cb, sim);
+	/* EFpl itself is read once EFli is in */
 	ofono_sim_add_file_watch(sim->early_context, SIM_EFPL_FILEID,
 					sim_efli_efpl_changed, sim, NULL);
 }
@@ -4137,6 +4159,7 @@ void ofono_sim_register(struct ofono_sim *sim)
 	sim->refresh_watches = __ofono_watchlist_new(g_free);
 	sim->spn_watches = __ofono_watchlist_new(g_free);
 	sim->simfs = sim_fs_new(sim, sim->driver);
+	sim_fs_set_max_active(sim->simfs, sim->max_file_ops);
 
 	ofono_sim_add_state_watch(sim, sim_ready, sim, NULL);
 
@@ -4559,6 +4582,24 @@ void ofono_sim_set_card_slot_count(struct ofono_sim *sim, unsigned int val)
 		sim->card_slot_count = val;
 }
 
+/*
+ * Lets the SIM file system keep up to @max file operations in flight with
+ * the driver, rather than waiting for each one to complete.
+ */
+void ofono_sim_set_max_file_ops(struct ofono_sim *sim, unsigned int max)
+{
+	if (sim == NULL)
+		return;
+
+	sim->max_file_ops = max;
+
+	if (sim->simfs)
+		sim_fs_set_max_active(sim->simfs, max);
+
+	if (sim->simfs_isim)
+		sim_fs_set_max_active(sim->simfs_isim, max);
+}
+
 void ofono_sim_set_active_card_slot(struct ofono_sim *sim, unsigned int val)
 {
 	if (sim)
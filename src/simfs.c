@@ -27,6 +27,7 @@
 #include <stdio.h>
 
 #include <glib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
@@ -45,16 +46,26 @@
 #define SIM_CACHE_BASEPATH STORAGEDIR "/%s-%i"
 #define SIM_CACHE_VERSION SIM_CACHE_BASEPATH "/version"
 #define SIM_CACHE_PATH SIM_CACHE_BASEPATH "/%04x"
-#define SIM_CACHE_HEADER_SIZE 39
+#define SIM_CACHE_HEADER_SIZE 43
+#define SIM_CACHE_CHECKSUM_OFFSET 39
 #define SIM_FILE_INFO_SIZE 7
 #define SIM_IMAGE_CACHE_BASEPATH STORAGEDIR "/%s-%i/images"
 #define SIM_IMAGE_CACHE_PATH SIM_IMAGE_CACHE_BASEPATH "/%d.xpm"
 
-#define SIM_FS_VERSION 2
+#define SIM_FS_VERSION 3
 
-static gboolean sim_fs_op_next(gpointer user_data);
-static gboolean sim_fs_op_read_record(gpointer user);
-static gboolean sim_fs_op_read_block(gpointer user_data);
+/*
+ * Operations wait in op_q until they can be started.  Up to max_active of
+ * them are in flight at once, as long as they are reads of different
+ * files; writes have the SIM to themselves.  When several may be in
+ * flight, the queue is ordered by priority, otherwise it is kept in the
+ * order the requests were made.
+ */
+enum sim_fs_priority {
+	SIM_FS_PRIORITY_HIGH,	/* Needed before the SIM is usable */
+	SIM_FS_PRIORITY_NORMAL,
+	SIM_FS_PRIORITY_BULK,	/* Phonebook, messages and images */
+};
 
 struct sim_fs_op {
 	int id;
@@ -73,6 +84,13 @@ struct sim_fs_op {
 	gboolean is_read;
 	void *userdata;
 	struct ofono_sim_context *context;
+	struct sim_fs *fs;
+	enum sim_fs_priority priority;
+	char *cache_path;		/* Where the cache is written back */
+	unsigned char *cache;		/* Header and contents of the EF */
+	size_t cache_len;
+	gboolean cache_mapped;		/* mmap()ed from the file */
+	gboolean cache_dirty;
 };
 
 struct ofono_sim_context {
@@ -83,8 +101,10 @@ struct ofono_sim_context {
 struct sim_fs {
 	GQueue *op_q;
 	gint op_source;
-	unsigned char bitmap[32];
-	int fd;
+	GSList *active;
+	unsigned int num_active;
+	unsigned int max_active;
+	struct sim_fs_stats stats;
 	struct ofono_sim *sim;
 	const struct ofono_sim_driver *driver;
 	GSList *contexts;
@@ -93,10 +113,20 @@ struct sim_fs {
 	unsigned int watch_id;
 };
 
+static void sim_fs_op_start(struct sim_fs_op *op);
+static void sim_fs_op_read_record(struct sim_fs_op *op);
+static void sim_fs_op_read_block(struct sim_fs_op *op);
+
 static void sim_fs_op_free(gpointer pointer)
 {
 	struct sim_fs_op *node = pointer;
 
+	if (node->cache_mapped)
+		munmap(node->cache, node->cache_len);
+	else
+		g_free(node->cache);
+
+	g_free(node->cache_path);
 	g_free(node->buffer);
 	g_free(node->pin2);
 	g_free(node);
@@ -121,6 +151,9 @@ void sim_fs_free(struct sim_fs *fs)
 		fs->op_q = NULL;
 	}
 
+	g_slist_free_full(fs->active, sim_fs_op_free);
+	fs->active = NULL;
+
 	while (fs->contexts)
 		sim_fs_context_free(fs->contexts->data);
 
@@ -146,11 +179,25 @@ struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 
 	fs->sim = sim;
 	fs->driver = driver;
-	fs->fd = -1;
+	fs->max_active = 1;
 
 	return fs;
 }
 
+/*
+ * Allows up to @max file operations to be in flight with the driver at
+ * once, for drivers that don't need their requests serialized.
+ */
+void sim_fs_set_max_active(struct sim_fs *fs, unsigned int max)
+{
+	fs->max_active = max ? max : 1;
+}
+
+void sim_fs_get_stats(struct sim_fs *fs, struct sim_fs_stats *stats)
+{
+	*stats = fs->stats;
+}
+
 struct ofono_sim_context *sim_fs_context_new(struct sim_fs *fs)
 {
 	struct ofono_sim_context *context =
@@ -185,29 +232,35 @@ struct ofono_sim_context *sim_fs_context_new_with_aid(struct sim_fs *fs,
 void sim_fs_context_free(struct ofono_sim_context *context)
 {
 	struct sim_fs *fs = context->fs;
-	int n = 0;
 	struct sim_fs_op *op;
+	GList *l;
+	GList *next;
+	GSList *k;
 
 	if (fs->op_q) {
-		while ((op = g_queue_peek_nth(fs->op_q, n)) != NULL) {
-			if (op->context != context) {
-				n += 1;
-				continue;
-			}
+		for (l = fs->op_q->head; l; l = next) {
+			next = l->next;
+			op = l->data;
 
-			if (n == 0) {
-				op->cb = NULL;
-				op->context = NULL;
-
-				n += 1;
+			if (op->context != context)
 				continue;
-			}
 
 			sim_fs_op_free(op);
-			g_queue_remove(fs->op_q, op);
+			g_queue_delete_link(fs->op_q, l);
 		}
 	}
 
+	/* Operations in flight finish, but without calling back */
+	for (k = fs->active; k; k = k->next) {
+		op = k->data;
+
+		if (op->context != context)
+			continue;
+
+		op->cb = NULL;
+		op->context = NULL;
+	}
+
 	if (context->file_watches)
 		__ofono_watchlist_free(context->file_watches);
 
@@ -267,97 +320,154 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 }
 
-static void sim_fs_end_current(struct sim_fs *fs)
+static guint32 fnv1a(guint32 hash, const unsigned char *data, size_t len)
 {
-	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
+	while (len--)
+		hash = (hash ^ *data++) * 16777619U;
 
-	if (g_queue_get_length(fs->op_q) > 0)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
-	else if (fs->watch_id) /* release the session if no pending reads */
-		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
-
-	if (fs->fd != -1) {
-		L_TFR(close(fs->fd));
-		fs->fd = -1;
-	}
+	return hash;
+}
 
-	memset(fs->bitmap, 0, sizeof(fs->bitmap));
+/* Covers the whole cache file except for the checksum itself */
+static guint32 cache_checksum(const unsigned char *cache, size_t len)
+{
+	guint32 hash = fnv1a(2166136261U, cache, SIM_CACHE_CHECKSUM_OFFSET);
 
-	sim_fs_op_free(op);
+	return fnv1a(hash, cache + SIM_CACHE_HEADER_SIZE,
+			len - SIM_CACHE_HEADER_SIZE);
 }
 
-static void sim_fs_op_error(struct sim_fs *fs)
+static gboolean cache_has_block(struct sim_fs_op *op, int block)
 {
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	if (op->cache == NULL)
+		return FALSE;
 
-	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return;
-	}
+	return (op->cache[SIM_FILE_INFO_SIZE + block / 8] >> block % 8) & 1;
+}
 
-	if (op->info_only == TRUE)
-		((sim_fs_read_info_cb_t) op->cb)
-			(0, 0, 0, 0, op->userdata);
-	else if (op->is_read == TRUE)
-		((ofono_sim_file_read_cb_t) op->cb)
-			(0, 0, 0, 0, 0, op->userdata);
-	else
-		((ofono_sim_file_write_cb_t) op->cb)
-			(0, op->current, op->userdata);
+/* Returns @len bytes of the cached EF at @offset, if the cache has them */
+static const unsigned char *cache_data(struct sim_fs_op *op, size_t offset,
+					size_t len)
+{
+	if (op->cache == NULL ||
+			SIM_CACHE_HEADER_SIZE + offset + len > op->cache_len)
+		return NULL;
 
-	sim_fs_end_current(fs);
+	return op->cache + SIM_CACHE_HEADER_SIZE + offset;
 }
 
-static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
+static gboolean cache_block(struct sim_fs_op *op, int block, int block_len,
 				const unsigned char *data, int num_bytes)
 {
-	int offset;
-	int bit;
-	ssize_t r;
-	unsigned char b;
+	size_t offset = block * block_len;
 
-	if (fs->fd == -1)
+	if (op->cache == NULL)
 		return FALSE;
 
-	if (lseek(fs->fd, block * block_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-		return FALSE;
+	/* Blocks added to a mapped cache file go to a copy of it */
+	if (op->cache_mapped) {
+		size_t len = MAX(op->cache_len,
+				(size_t) SIM_CACHE_HEADER_SIZE + op->length);
+		unsigned char *copy = g_try_malloc0(len);
+
+		if (copy == NULL)
+			return FALSE;
 
-	r = L_TFR(write(fs->fd, data, num_bytes));
+		memcpy(copy, op->cache, op->cache_len);
+		munmap(op->cache, op->cache_len);
+
+		op->cache = copy;
+		op->cache_len = len;
+		op->cache_mapped = FALSE;
+	}
 
-	if (r != num_bytes)
+	if (SIM_CACHE_HEADER_SIZE + offset + num_bytes > op->cache_len)
 		return FALSE;
 
+	memcpy(op->cache + SIM_CACHE_HEADER_SIZE + offset, data, num_bytes);
+
 	/* update present bit for this block */
-	offset = block / 8;
-	bit = block % 8;
+	op->cache[SIM_FILE_INFO_SIZE + block / 8] |= 1 << block % 8;
+	op->cache_dirty = TRUE;
 
-	/* lseek to correct byte (skip file info) */
-	if (lseek(fs->fd, offset + SIM_FILE_INFO_SIZE,
-				SEEK_SET) == (off_t) -1)
-		return FALSE;
+	return TRUE;
+}
+
+/* Writes the cache file back in one go, if anything was added to it */
+static void cache_write(struct sim_fs_op *op)
+{
+	guint32 checksum;
 
-	b = fs->bitmap[offset];
-	b |= 1 << bit;
+	if (op->cache_dirty == FALSE || op->cache_path == NULL)
+		return;
 
-	r = L_TFR(write(fs->fd, &b, sizeof(b)));
+	checksum = cache_checksum(op->cache, op->cache_len);
+	op->cache[SIM_CACHE_CHECKSUM_OFFSET] = checksum >> 24;
+	op->cache[SIM_CACHE_CHECKSUM_OFFSET + 1] = checksum >> 16;
+	op->cache[SIM_CACHE_CHECKSUM_OFFSET + 2] = checksum >> 8;
+	op->cache[SIM_CACHE_CHECKSUM_OFFSET + 3] = checksum;
 
-	if (r != sizeof(b))
-		return FALSE;
+	if (write_file(op->cache, op->cache_len, SIM_CACHE_MODE,
+					"%s", op->cache_path) < 0)
+		DBG("Error writing cache file for fileid %04x", op->id);
 
-	fs->bitmap[offset] = b;
+	op->cache_dirty = FALSE;
+}
 
-	return TRUE;
+static gboolean sim_fs_op_next(gpointer user_data);
+
+static void sim_fs_schedule(struct sim_fs *fs)
+{
+	if (fs->op_source == 0 && fs->op_q && fs->op_q->length > 0)
+		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+}
+
+static void sim_fs_op_end(struct sim_fs_op *op)
+{
+	struct sim_fs *fs = op->fs;
+
+	cache_write(op);
+
+	fs->active = g_slist_remove(fs->active, op);
+	fs->num_active -= 1;
+	fs->stats.ops += 1;
+
+	if (fs->op_q && fs->op_q->length > 0)
+		sim_fs_schedule(fs);
+	else if (fs->num_active == 0 && fs->watch_id)
+		/* release the session if no pending reads */
+		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
+
+	sim_fs_op_free(op);
+}
+
+static void sim_fs_op_error(struct sim_fs_op *op)
+{
+	if (op->cb == NULL) {
+		sim_fs_op_end(op);
+		return;
+	}
+
+	if (op->info_only == TRUE)
+		((sim_fs_read_info_cb_t) op->cb)
+			(0, 0, 0, 0, op->userdata);
+	else if (op->is_read == TRUE)
+		((ofono_sim_file_read_cb_t) op->cb)
+			(0, 0, 0, 0, 0, op->userdata);
+	else
+		((ofono_sim_file_write_cb_t) op->cb)
+			(0, op->current, op->userdata);
+
+	sim_fs_op_end(op);
 }
 
 static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 	ofono_sim_file_write_cb_t cb = op->cb;
 
 	if (cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 		return;
 	}
 
@@ -366,15 +476,14 @@ static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
 	else
 		cb(0, op->current, op->userdata);
 
-	sim_fs_end_current(fs);
+	sim_fs_op_end(op);
 }
 
 static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 					const unsigned char *data, int len,
 					void *user)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = user;
 	int start_block;
 	int end_block;
 	int bufoff;
@@ -382,7 +491,7 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 	int tocopy;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
@@ -404,10 +513,10 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 				bufoff, dataoff, tocopy);
 
 	memcpy(op->buffer + bufoff, data + dataoff, tocopy);
-	cache_block(fs, op->current, 256, data, len);
+	cache_block(op, op->current, 256, data, len);
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 		return;
 	}
 
@@ -419,71 +528,68 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
-	} else {
-		fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
-	}
+		sim_fs_op_end(op);
+	} else
+		sim_fs_op_read_block(op);
 }
 
-static gboolean sim_fs_op_read_block(gpointer user_data)
+static void sim_fs_op_read_block(struct sim_fs_op *op)
 {
-	struct sim_fs *fs = user_data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	int start_block;
+	struct sim_fs *fs = op->fs;
+	const unsigned char *data;
 	int end_block;
+	int block;
 	unsigned short read_bytes;
 
-	fs->op_source = 0;
-
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
+		sim_fs_op_end(op);
+		return;
 	}
 
-	start_block = op->offset / 256;
 	end_block = (op->offset + (op->num_bytes - 1)) / 256;
 
-	if (op->current == start_block) {
+	for (block = op->current; block <= end_block; block++)
+		if (!cache_has_block(op, block))
+			break;
+
+	/* Everything is cached, hand it out without copying */
+	if (block > end_block && op->buffer == NULL)
+		data = cache_data(op, op->offset, op->num_bytes);
+	else
+		data = NULL;
+
+	if (data != NULL) {
+		ofono_sim_file_read_cb_t cb = op->cb;
+
+		cb(1, op->num_bytes, 0, data, op->record_length, op->userdata);
+
+		sim_fs_op_end(op);
+		return;
+	}
+
+	if (op->buffer == NULL) {
 		op->buffer = g_try_new0(unsigned char, op->num_bytes);
 
 		if (op->buffer == NULL) {
-			sim_fs_op_error(fs);
-			return FALSE;
+			sim_fs_op_error(op);
+			return;
 		}
 	}
 
-	while (fs->fd != -1 && op->current <= end_block) {
-		int offset = op->current / 8;
-		int bit = 1 << op->current % 8;
-		int bufoff;
-		int seekoff;
-		int toread;
+	/* Copy the cached blocks in one go, the rest comes from the SIM */
+	if (block > op->current) {
+		int start = MAX(op->current * 256, op->offset);
+		int end = MIN(block * 256, op->offset + op->num_bytes);
 
-		if ((fs->bitmap[offset] & bit) == 0)
-			break;
+		DBG("bufoff: %d, cacheoff: %d, tocopy: %d",
+				start - op->offset, start, end - start);
 
-		if (op->current == start_block) {
-			bufoff = 0;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256 +
-				op->offset % 256;
-			toread = MIN(256 - op->offset % 256, op->num_bytes);
-		} else {
-			bufoff = (op->current - start_block) * 256 -
-					op->offset % 256;
-			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256;
-			toread = MIN(256, op->num_bytes - bufoff);
+		data = cache_data(op, start, end - start);
+		if (data != NULL) {
+			memcpy(op->buffer + start - op->offset, data,
+					end - start);
+			op->current = block;
 		}
-
-		DBG("bufoff: %d, seekoff: %d, toread: %d",
-				bufoff, seekoff, toread);
-
-		if (lseek(fs->fd, seekoff, SEEK_SET) == (off_t) -1)
-			break;
-
-		if (L_TFR(read(fs->fd, op->buffer + bufoff, toread)) != toread)
-			break;
-
-		op->current += 1;
 	}
 
 	if (op->current > end_block) {
@@ -492,133 +598,123 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		cb(1, op->num_bytes, 0, op->buffer,
 				op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
-
-		return FALSE;
+		sim_fs_op_end(op);
+		return;
 	}
 
 	if (fs->driver->read_file_transparent == NULL) {
-		sim_fs_op_error(fs);
-		return FALSE;
+		sim_fs_op_error(op);
+		return;
 	}
 
+	fs->stats.requests += 1;
 	read_bytes = MIN(op->length - op->current * 256, 256);
 	fs->driver->read_file_transparent(fs->sim, op->id,
 						op->current * 256,
 						read_bytes,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_read_block_cb, fs);
-
-	return FALSE;
+						sim_fs_op_read_block_cb, op);
 }
 
 static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
 					const unsigned char *data, int len,
 					void *user)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = user;
 	int total = op->length / op->record_length;
 	ofono_sim_file_read_cb_t cb = op->cb;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	cache_block(fs, op->current - 1, op->record_length,
+	cache_block(op, op->current - 1, op->record_length,
 			data, op->record_length);
 
 	if (cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 		return;
 	}
 
 	cb(1, op->length, op->current, data, op->record_length, op->userdata);
 
 	if (op->current < total) {
+		/* Ask for the next record right away */
 		op->current += 1;
-		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+		sim_fs_op_read_record(op);
 	} else {
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 	}
 }
 
-static gboolean sim_fs_op_read_record(gpointer user)
+static void sim_fs_op_read_record(struct sim_fs_op *op)
 {
-	struct sim_fs *fs = user;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs *fs = op->fs;
 	const struct ofono_sim_driver *driver = fs->driver;
 	int total = op->length / op->record_length;
-	unsigned char buf[256];
-
-	fs->op_source = 0;
+	const unsigned char *data;
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
+		sim_fs_op_end(op);
+		return;
 	}
 
-	while (fs->fd != -1 && op->current <= total) {
-		int offset = (op->current - 1) / 8;
-		int bit = 1 << ((op->current - 1) % 8);
+	while (op->current <= total && cache_has_block(op, op->current - 1)) {
 		ofono_sim_file_read_cb_t cb = op->cb;
 
-		if ((fs->bitmap[offset] & bit) == 0)
+		data = cache_data(op, (op->current - 1) * op->record_length,
+					op->record_length);
+		if (data == NULL)
 			break;
 
-		if (lseek(fs->fd, (op->current - 1) * op->record_length +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-			break;
+		cb(1, op->length, op->current,
+				data, op->record_length, op->userdata);
 
-		if (L_TFR(read(fs->fd, buf, op->record_length)) !=
-				op->record_length)
+		/* The context may have gone away from the callback */
+		if (op->cb == NULL)
 			break;
 
-		cb(1, op->length, op->current,
-				buf, op->record_length, op->userdata);
-
 		op->current += 1;
 	}
 
-	if (op->current > total) {
-		sim_fs_end_current(fs);
-
-		return FALSE;
+	if (op->cb == NULL || op->current > total) {
+		sim_fs_op_end(op);
+		return;
 	}
 
 	switch (op->structure) {
 	case OFONO_SIM_FILE_STRUCTURE_FIXED:
 		if (driver->read_file_linear == NULL) {
-			sim_fs_op_error(fs);
-			return FALSE;
+			sim_fs_op_error(op);
+			return;
 		}
 
+		fs->stats.requests += 1;
 		driver->read_file_linear(fs->sim, op->id, op->current,
 						op->record_length,
 						NULL, 0,
-						sim_fs_op_retrieve_cb, fs);
+						sim_fs_op_retrieve_cb, op);
 		break;
 	case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
 		if (driver->read_file_cyclic == NULL) {
-			sim_fs_op_error(fs);
-			return FALSE;
+			sim_fs_op_error(op);
+			return;
 		}
 
+		fs->stats.requests += 1;
 		driver->read_file_cyclic(fs->sim, op->id, op->current,
 						op->record_length,
 						NULL, 0,
-						sim_fs_op_retrieve_cb, fs);
+						sim_fs_op_retrieve_cb, op);
 		break;
 	default:
 		ofono_error("Unrecognized file structure, this can't happen");
 	}
-
-	return FALSE;
 }
 
-static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
+static void sim_fs_op_cache_fileinfo(struct sim_fs_op *op,
 					const struct ofono_error *error,
 					int length,
 					enum ofono_sim_file_structure structure,
@@ -626,15 +722,14 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 					const unsigned char access[3],
 					unsigned char file_status)
 {
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs *fs = op->fs;
 	const char *imsi = ofono_sim_get_imsi(fs->sim);
 	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
 	enum sim_file_access update;
 	enum sim_file_access invalidate;
 	enum sim_file_access rehabilitate;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	unsigned char *fileinfo;
 	gboolean cache;
-	char *path;
 
 	/* TS 11.11, Section 9.3 */
 	update = file_access_condition_decode(access[0] & 0xf);
@@ -652,7 +747,10 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN || cache == FALSE)
 		return;
 
-	memset(fileinfo, 0, SIM_CACHE_HEADER_SIZE);
+	/* Built up in memory, the file is written when the read is done */
+	fileinfo = g_try_malloc0(SIM_CACHE_HEADER_SIZE + length);
+	if (fileinfo == NULL)
+		return;
 
 	fileinfo[0] = error->type;
 	fileinfo[1] = length >> 8;
@@ -662,19 +760,11 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	fileinfo[5] = record_length & 0xff;
 	fileinfo[6] = file_status;
 
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-	fs->fd = L_TFR(open(path, O_WRONLY | O_CREAT | O_TRUNC, SIM_CACHE_MODE));
-	g_free(path);
-
-	if (fs->fd == -1)
-		return;
-
-	if (L_TFR(write(fs->fd, fileinfo, SIM_CACHE_HEADER_SIZE)) ==
-			SIM_CACHE_HEADER_SIZE)
-		return;
-
-	L_TFR(close(fs->fd));
-	fs->fd = -1;
+	op->cache = fileinfo;
+	op->cache_len = SIM_CACHE_HEADER_SIZE + length;
+	op->cache_mapped = FALSE;
+	op->cache_dirty = TRUE;
+	op->cache_path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
 }
 
 static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
@@ -684,49 +774,31 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 				unsigned char file_status,
 				void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	sim_fs_op_cache_fileinfo(fs, error, length, structure, record_length,
+	sim_fs_op_cache_fileinfo(op, error, length, structure, record_length,
 					access, file_status);
 
 	if (structure != op->structure) {
 		ofono_error("Requested file structure differs from SIM: %x",
 				op->id);
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 		return;
 	}
 
 	op->structure = structure;
 	op->length = length;
 
-	if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
-		if (op->num_bytes == 0)
-			op->num_bytes = op->length;
-
-		op->record_length = length;
-		op->current = op->offset / 256;
-
-		if (op->info_only == FALSE)
-			fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
-	} else {
-		op->record_length = record_length;
-		op->current = 1;
-
-		if (op->info_only == FALSE)
-			fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
-	}
-
 	if (op->info_only == TRUE) {
 		/*
 		 * It's an info-only request, so there is no need to request
@@ -734,22 +806,39 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 		 */
 		sim_fs_read_info_cb_t cb = op->cb;
 
+		if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+			op->record_length = length;
+		else
+			op->record_length = record_length;
+
 		cb(1, file_status, op->length,
 			op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
+	} else if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
+		if (op->num_bytes == 0)
+			op->num_bytes = op->length;
+
+		op->record_length = length;
+		op->current = op->offset / 256;
+		sim_fs_op_read_block(op);
+	} else {
+		op->record_length = record_length;
+		op->current = 1;
+		sim_fs_op_read_record(op);
 	}
 }
 
-static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
+static gboolean sim_fs_op_check_cached(struct sim_fs_op *op)
 {
+	struct sim_fs *fs = op->fs;
 	const char *imsi = ofono_sim_get_imsi(fs->sim);
 	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	char *path;
 	int fd;
-	ssize_t len;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	struct stat st;
+	unsigned char *fileinfo;
+	guint32 checksum;
 	int error_type;
 	int file_length;
 	enum ofono_sim_file_structure structure;
@@ -764,8 +853,7 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 	if (path == NULL)
 		return FALSE;
 
-	fd = L_TFR(open(path, O_RDWR));
-	g_free(path);
+	fd = L_TFR(open(path, O_RDONLY));
 
 	if (fd == -1) {
 		if (errno != ENOENT)
@@ -773,13 +861,33 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 					"fileid %04x, IMSI %s",
 					errno, op->id, imsi);
 
+		g_free(path);
+		return FALSE;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < SIM_CACHE_HEADER_SIZE) {
+		L_TFR(close(fd));
+		g_free(path);
+		return FALSE;
+	}
+
+	fileinfo = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	L_TFR(close(fd));
+
+	if (fileinfo == MAP_FAILED) {
+		g_free(path);
 		return FALSE;
 	}
 
-	len = L_TFR(read(fd, fileinfo, SIM_CACHE_HEADER_SIZE));
+	checksum = (fileinfo[SIM_CACHE_CHECKSUM_OFFSET] << 24) |
+			(fileinfo[SIM_CACHE_CHECKSUM_OFFSET + 1] << 16) |
+			(fileinfo[SIM_CACHE_CHECKSUM_OFFSET + 2] << 8) |
+			fileinfo[SIM_CACHE_CHECKSUM_OFFSET + 3];
 
-	if (len != SIM_CACHE_HEADER_SIZE)
+	if (checksum != cache_checksum(fileinfo, st.st_size)) {
+		DBG("Bad checksum in cache file for fileid %04x", op->id);
 		goto error;
+	}
 
 	error_type = fileinfo[0];
 	file_length = (fileinfo[1] << 8) | fileinfo[2];
@@ -795,13 +903,15 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 
 	op->length = file_length;
 	op->record_length = record_length;
-	memcpy(fs->bitmap, fileinfo + SIM_FILE_INFO_SIZE,
-			SIM_CACHE_HEADER_SIZE - SIM_FILE_INFO_SIZE);
-	fs->fd = fd;
+	op->cache = fileinfo;
+	op->cache_len = st.st_size;
+	op->cache_mapped = TRUE;
+	op->cache_path = path;
+	fs->stats.cached += 1;
 
 	if (error_type != OFONO_ERROR_TYPE_NO_ERROR ||
 			structure != op->structure) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return TRUE;
 	}
 
@@ -815,41 +925,43 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 		cb(1, file_status, op->length,
 			op->record_length, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 	} else if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
 		if (op->num_bytes == 0)
 			op->num_bytes = op->length;
 
 		op->current = op->offset / 256;
-		fs->op_source = g_idle_add(sim_fs_op_read_block, fs);
+		sim_fs_op_read_block(op);
 	} else {
 		op->current = 1;
-		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+		sim_fs_op_read_record(op);
 	}
 
 	return TRUE;
 
 error:
-	L_TFR(close(fd));
+	munmap(fileinfo, st.st_size);
+	g_free(path);
 	return FALSE;
 }
 
 static void sim_fs_read_session_cb(const struct ofono_error *error,
 		const unsigned char *sdata, int length, void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
 	ofono_sim_file_read_cb_t cb;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
 	cb = op->cb;
-	cb(TRUE, length, 0, sdata, length, op->userdata);
 
-	sim_fs_end_current(fs);
+	if (cb)
+		cb(TRUE, length, 0, sdata, length, op->userdata);
+
+	sim_fs_op_end(op);
 }
 
 static void session_read_info_cb(const struct ofono_error *error,
@@ -860,44 +972,51 @@ static void session_read_info_cb(const struct ofono_error *error,
 					unsigned char file_status,
 					void *data)
 {
-	struct sim_fs *fs = data;
-	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct sim_fs_op *op = data;
+	struct sim_fs *fs = op->fs;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	sim_fs_op_cache_fileinfo(fs, error, filelength, structure, recordlength,
-			access, file_status);
+	sim_fs_op_cache_fileinfo(op, error, filelength, structure,
+					recordlength, access, file_status);
+
+	if (op->cb == NULL) {
+		sim_fs_op_end(op);
+		return;
+	}
 
 	if (op->info_only) {
 		sim_fs_read_info_cb_t cb = op->cb;
 
 		cb(1, file_status, filelength, recordlength, op->userdata);
 
-		sim_fs_end_current(fs);
+		sim_fs_op_end(op);
 		return;
 	}
 
+	fs->stats.requests += 1;
+
 	if (op->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT) {
 		if (!fs->driver->session_read_binary) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return;
 		}
 
 		fs->driver->session_read_binary(fs->sim, fs->session_id,
 				op->id, op->offset, filelength, op->path,
-				op->path_len, sim_fs_read_session_cb, fs);
+				op->path_len, sim_fs_read_session_cb, op);
 	} else {
 		if (!fs->driver->session_read_record) {
-			sim_fs_op_error(fs);
+			sim_fs_op_error(op);
 			return;
 		}
 
 		fs->driver->session_read_record(fs->sim, fs->session_id,
 				op->id, op->offset, recordlength, op->path,
-				op->path_len, sim_fs_read_session_cb, fs);
+				op->path_len, sim_fs_read_session_cb, op);
 	}
 }
 
@@ -914,89 +1033,222 @@ static void get_session_cb(ofono_bool_t active, int session_id,
 	struct sim_fs *fs = data;
 	struct sim_fs_op *op;
 
+	/* Session operations are never in flight more than one at a time */
+	if (fs->active == NULL)
+		return;
+
+	op = fs->active->data;
+
 	if (!active) {
-		sim_fs_op_error(fs);
+		sim_fs_op_error(op);
 		return;
 	}
 
-	op = g_queue_peek_head(fs->op_q);
-
 	fs->session_id = session_id;
+	fs->stats.requests += 1;
 
 	fs->driver->session_read_info(fs->sim, session_id, op->id, op->path,
-			op->path_len, session_read_info_cb, fs);
+			op->path_len, session_read_info_cb, op);
 }
 
-static gboolean sim_fs_op_next(gpointer user_data)
+static void sim_fs_op_start(struct sim_fs_op *op)
 {
-	struct sim_fs *fs = user_data;
+	struct sim_fs *fs = op->fs;
 	const struct ofono_sim_driver *driver = fs->driver;
-	struct sim_fs_op *op;
-
-	fs->op_source = 0;
-
-	if (fs->op_q == NULL)
-		return FALSE;
-
-	op = g_queue_peek_head(fs->op_q);
 
 	if (op->cb == NULL) {
-		sim_fs_end_current(fs);
-		return FALSE;
+		sim_fs_op_end(op);
+		return;
 	}
 
 	if (op->is_read == TRUE) {
-		if (sim_fs_op_check_cached(fs))
-			return FALSE;
+		if (sim_fs_op_check_cached(op))
+			return;
 
 		if (!fs->session) {
+			fs->stats.requests += 1;
 			driver->read_file_info(fs->sim, op->id,
 						op->path_len ? op->path : NULL,
 						op->path_len,
-						sim_fs_op_info_cb, fs);
+						sim_fs_op_info_cb, op);
 		} else {
-			if (fs->watch_id)
+			if (fs->watch_id) {
+				fs->stats.requests += 1;
 				fs->driver->session_read_info(fs->sim,
 						fs->session_id, op->id,
 						op->path, op->path_len,
-						session_read_info_cb, fs);
-			else
+						session_read_info_cb, op);
+			} else
 				fs->watch_id = __ofono_sim_add_session_watch(
 						fs->session, get_session_cb,
 						fs, session_destroy_cb);
 		}
 	} else {
+		fs->stats.requests += 1;
+
 		switch (op->structure) {
 		case OFONO_SIM_FILE_STRUCTURE_TRANSPARENT:
 			driver->write_file_transparent(fs->sim, op->id, 0,
 					op->length, op->buffer,
-					NULL, 0, sim_fs_op_write_cb, fs);
+					NULL, 0, sim_fs_op_write_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_FIXED:
 			driver->write_file_linear(fs->sim, op->id, op->current,
 					op->length, op->buffer,
-					NULL, 0, op->pin2, sim_fs_op_write_cb, fs);
+					NULL, 0, op->pin2, sim_fs_op_write_cb, op);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
 			driver->write_file_cyclic(fs->sim, op->id,
 					op->length, op->buffer,
-					NULL, 0, sim_fs_op_write_cb, fs);
+					NULL, 0, sim_fs_op_write_cb, op);
 			break;
 		default:
 			ofono_error("Unrecognized file structure, "
 					"this can't happen");
 		}
+	}
+}
+
+/* Whether @op can go ahead with what is in flight at the moment */
+static gboolean sim_fs_op_can_start(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	GSList *l;
+
+	if (fs->num_active == 0)
+		return TRUE;
+
+	/* One session read at a time, writes have the SIM to themselves */
+	if (fs->session || op->is_read == FALSE)
+		return FALSE;
 
-		g_free(op->buffer);
-		op->buffer = NULL;
+	if (fs->num_active >= fs->max_active)
+		return FALSE;
+
+	for (l = fs->active; l; l = l->next) {
+		struct sim_fs_op *active = l->data;
 
-		g_free(op->pin2);
-		op->pin2 = NULL;
+		if (active->is_read == FALSE || active->id == op->id)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean sim_fs_op_next(gpointer user_data)
+{
+	struct sim_fs *fs = user_data;
+	struct sim_fs_op *op;
+
+	fs->op_source = 0;
+
+	while (fs->op_q && (op = g_queue_peek_head(fs->op_q))) {
+		if (!sim_fs_op_can_start(fs, op))
+			break;
+
+		g_queue_pop_head(fs->op_q);
+		fs->active = g_slist_prepend(fs->active, op);
+		fs->num_active += 1;
+
+		if (fs->num_active > fs->stats.max_active)
+			fs->stats.max_active = fs->num_active;
+
+		/*
+		 * Starting an operation may complete it from the cache, in
+		 * which case it schedules the next one by itself.
+		 */
+		sim_fs_op_start(op);
+
+		if (fs->op_source) {
+			g_source_remove(fs->op_source);
+			fs->op_source = 0;
+		}
 	}
 
 	return FALSE;
 }
 
+static enum sim_fs_priority sim_fs_file_priority(int id)
+{
+	switch (id) {
+	case SIM_EF_ICCID_FILEID:
+	case SIM_EFPL_FILEID:
+	case SIM_EFLI_FILEID:
+	case SIM_EFIMSI_FILEID:
+	case SIM_EFAD_FILEID:
+	case SIM_EFPHASE_FILEID:
+	case SIM_EFUST_FILEID:
+	case SIM_EFEST_FILEID:
+	case SIM_EFSPN_FILEID:
+	case SIM_EFECC_FILEID:
+		return SIM_FS_PRIORITY_HIGH;
+	case SIM_EFADN_FILEID:
+	case SIM_EFSMS_FILEID:
+	case SIM_EFEXT1_FILEID:
+	case SIM_EFIMG_FILEID:
+		return SIM_FS_PRIORITY_BULK;
+	}
+
+	/* Phonebook and image instance files under DF_PHONEBOOK / DF_GRAPHICS */
+	if ((id & 0xff00) == 0x4f00)
+		return SIM_FS_PRIORITY_BULK;
+
+	return SIM_FS_PRIORITY_NORMAL;
+}
+
+static struct sim_fs_op *sim_fs_op_new(struct ofono_sim_context *context,
+					int id)
+{
+	struct sim_fs_op *op;
+
+	op = g_try_new0(struct sim_fs_op, 1);
+	if (op == NULL)
+		return NULL;
+
+	op->id = id;
+	op->context = context;
+	op->fs = context->fs;
+	op->priority = sim_fs_file_priority(id);
+
+	return op;
+}
+
+/*
+ * Queues @op behind every operation of the same or a higher priority, and
+ * behind anything else already queued for the same file.  Writes keep
+ * their place in the order the requests were made, and so does everything
+ * for drivers doing one operation at a time.
+ */
+static void sim_fs_op_queue(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	GList *l;
+
+	if (fs->op_q == NULL)
+		fs->op_q = g_queue_new();
+
+	if (fs->max_active == 1) {
+		g_queue_push_tail(fs->op_q, op);
+		sim_fs_schedule(fs);
+		return;
+	}
+
+	for (l = fs->op_q->tail; l; l = l->prev) {
+		struct sim_fs_op *queued = l->data;
+
+		if (queued->priority <= op->priority || queued->id == op->id)
+			break;
+
+		if (queued->is_read == FALSE || op->is_read == FALSE)
+			break;
+	}
+
+	if (l)
+		g_queue_insert_after(fs->op_q, l, op);
+	else
+		g_queue_push_head(fs->op_q, op);
+
+	sim_fs_schedule(fs);
+}
+
 int sim_fs_read_info(struct ofono_sim_context *context, int id,
 			enum ofono_sim_file_structure expected_type,
 			const unsigned char *path, unsigned int pth_len,
@@ -1014,27 +1266,19 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 	if (fs->driver->read_file_info == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
 	op->cb = cb;
 	op->userdata = data;
 	op->is_read = TRUE;
 	op->info_only = TRUE;
-	op->context = context;
 	memcpy(op->path, path, pth_len);
 	op->path_len = pth_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1074,14 +1318,10 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 		}
 	}
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
 	op->cb = cb;
 	op->userdata = data;
@@ -1089,15 +1329,11 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 	op->offset = offset;
 	op->num_bytes = num_bytes;
 	op->info_only = FALSE;
-	op->context = context;
 	if (path != NULL)
 		memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1128,29 +1364,21 @@ int sim_fs_read_record(struct ofono_sim_context *context, int id,
 		return -ENOSYS;
 	}
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->structure = expected_type;
 	op->cb = cb;
 	op->userdata = data;
 	op->is_read = TRUE;
 	op->info_only = FALSE;
-	op->context = context;
 	op->record_length = record_length;
 	op->current = record;
 	memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1188,14 +1416,10 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	if (fn == NULL)
 		return -ENOSYS;
 
-	if (fs->op_q == NULL)
-		fs->op_q = g_queue_new();
-
-	op = g_try_new0(struct sim_fs_op, 1);
+	op = sim_fs_op_new(context, id);
 	if (op == NULL)
 		return -ENOMEM;
 
-	op->id = id;
 	op->cb = cb;
 	op->userdata = userdata;
 	op->is_read = FALSE;
@@ -1203,13 +1427,9 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	op->structure = structure;
 	op->length = length;
 	op->current = record;
-	op->context = context;
 	op->pin2 = g_strdup(pin2);
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1338,6 +1558,22 @@ void sim_fs_check_version(struct sim_fs *fs)
 	write_file(&version, 1, SIM_CACHE_MODE, SIM_CACHE_VERSION, imsi, phase);
 }
 
+/* Keeps reads in flight from writing back what was just flushed */
+static void sim_fs_drop_pending_cache(struct sim_fs *fs, int id)
+{
+	GSList *l;
+
+	for (l = fs->active; l; l = l->next) {
+		struct sim_fs_op *op = l->data;
+
+		if (id != -1 && op->id != id)
+			continue;
+
+		g_free(op->cache_path);
+		op->cache_path = NULL;
+	}
+}
+
 void sim_fs_cache_flush(struct sim_fs *fs)
 {
 	const char *imsi = ofono_sim_get_imsi(fs->sim);
@@ -1348,6 +1584,8 @@ void sim_fs_cache_flush(struct sim_fs *fs)
 
 	g_free(path);
 
+	sim_fs_drop_pending_cache(fs, -1);
+
 	if (len > 0) {
 		/* Remove all file ids */
 		while (len--) {
@@ -1367,6 +1605,8 @@ void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
 	char *path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
 
+	sim_fs_drop_pending_cache(fs, id);
+
 	remove(path);
 	g_free(path);
 }
@@ -21,6 +21,13 @@
 
 struct sim_fs;
 
+struct sim_fs_stats {
+	unsigned int ops;		/* Operations completed */
+	unsigned int requests;		/* Requests sent to the driver */
+	unsigned int cached;		/* Reads served from the cache */
+	unsigned int max_active;	/* Most operations in flight at once */
+};
+
 typedef void (*sim_fs_read_info_cb_t)(int ok, unsigned char file_status,
 					int total_length, int record_length,
 					void *userdata);
@@ -28,6 +35,8 @@ typedef void (*sim_fs_read_info_cb_t)(int ok, unsigned char file_status,
 struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 				const struct ofono_sim_driver *driver);
 struct ofono_sim_context *sim_fs_context_new(struct sim_fs *fs);
+void sim_fs_set_max_active(struct sim_fs *fs, unsigned int max);
+void sim_fs_get_stats(struct sim_fs *fs, struct sim_fs_stats *stats);
 
 struct ofono_sim_context *sim_fs_context_new_with_aid(struct sim_fs *fs,
 		unsigned char *aid);
@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -40,6 +41,10 @@ struct sim_eons {
 	GSList *opl_list;
 	gboolean pnn_valid;
 	int pnn_max;
+	/* Index of the OPL compiled by sim_eons_optimize() */
+	GHashTable *opl_exact;
+	GSList *opl_wildcards;
+	GHashTable *lookups;
 };
 
 struct spdi_operator {
@@ -53,8 +58,33 @@ struct opl_operator {
 	guint16 lac_tac_low;
 	guint16 lac_tac_high;
 	guint8 id;
+	unsigned int pos;
 };
 
+/*
+ * A LAC/TAC range with the first OPL record, in file order, covering it.
+ * The ranges of a bucket are sorted and don't overlap.
+ */
+struct opl_range {
+	guint16 low;
+	guint16 high;
+	const struct opl_operator *opl;
+};
+
+/* The OPL records of one PLMN, or of one wildcard PLMN pattern */
+struct opl_bucket {
+	char mcc[OFONO_MAX_MCC_LENGTH + 1];
+	char mnc[OFONO_MAX_MNC_LENGTH + 1];
+	/* First record for the whole PLMN, whatever the LAC */
+	const struct opl_operator *whole;
+	GArray *pending;
+	struct opl_range *ranges;
+	unsigned int num_ranges;
+};
+
+#define EONS_PLMN_KEY_LEN (OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 2)
+#define EONS_LOOKUPS_MAX 64
+
 #define MF	1
 #define DF	2
 #define EF	4
@@ -1092,6 +1122,33 @@ static struct opl_operator *opl_operator_alloc(const guint8 *record)
 	return oper;
 }
 
+static void opl_bucket_free(gpointer data)
+{
+	struct opl_bucket *bucket = data;
+
+	if (bucket->pending)
+		g_array_free(bucket->pending, TRUE);
+
+	g_free(bucket->ranges);
+	g_free(bucket);
+}
+
+static void sim_eons_drop_index(struct sim_eons *eons)
+{
+	if (eons->opl_exact) {
+		g_hash_table_destroy(eons->opl_exact);
+		eons->opl_exact = NULL;
+	}
+
+	g_slist_free_full(eons->opl_wildcards, opl_bucket_free);
+	eons->opl_wildcards = NULL;
+
+	if (eons->lookups) {
+		g_hash_table_destroy(eons->lookups);
+		eons->lookups = NULL;
+	}
+}
+
 void sim_eons_add_opl_record(struct sim_eons *eons,
 				const guint8 *contents, int length)
 {
@@ -1105,11 +1162,215 @@ void sim_eons_add_opl_record(struct sim_eons *eons,
 	}
 
 	eons->opl_list = g_slist_prepend(eons->opl_list, oper);
+
+	sim_eons_drop_index(eons);
+}
+
+static gboolean opl_plmn_is_wildcard(const struct opl_operator *opl)
+{
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+		if (opl->mcc[i] == 'b')
+			return TRUE;
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+		if (opl->mnc[i] == 'b')
+			return TRUE;
+
+	return FALSE;
 }
 
+/* 'b' stands for any digit in the PLMN of an OPL record */
+static gboolean opl_plmn_match(const char *opl_mcc, const char *opl_mnc,
+				const char *mcc, const char *mnc)
+{
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+		if (mcc[i] != opl_mcc[i] && !(opl_mcc[i] == 'b' && mcc[i]))
+			return FALSE;
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+		if (mnc[i] != opl_mnc[i] && !(opl_mnc[i] == 'b' && mnc[i]))
+			return FALSE;
+
+	return TRUE;
+}
+
+static struct opl_bucket *opl_bucket_new(const struct opl_operator *opl)
+{
+	struct opl_bucket *bucket = g_new0(struct opl_bucket, 1);
+
+	memcpy(bucket->mcc, opl->mcc, sizeof(bucket->mcc));
+	memcpy(bucket->mnc, opl->mnc, sizeof(bucket->mnc));
+	bucket->pending = g_array_new(FALSE, FALSE,
+					sizeof(const struct opl_operator *));
+
+	return bucket;
+}
+
+static struct opl_bucket *opl_bucket_find_wildcard(struct sim_eons *eons,
+						const struct opl_operator *opl)
+{
+	GSList *l;
+	struct opl_bucket *bucket;
+
+	for (l = eons->opl_wildcards; l; l = l->next) {
+		bucket = l->data;
+
+		if (!memcmp(bucket->mcc, opl->mcc, sizeof(bucket->mcc)) &&
+				!memcmp(bucket->mnc, opl->mnc,
+					sizeof(bucket->mnc)))
+			return bucket;
+	}
+
+	bucket = opl_bucket_new(opl);
+	eons->opl_wildcards = g_slist_prepend(eons->opl_wildcards, bucket);
+
+	return bucket;
+}
+
+static int guint32_compare(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *) a;
+	guint32 y = *(const guint32 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Splits the possibly overlapping LAC ranges of a bucket at every range
+ * boundary, and keeps for each piece the first record in file order
+ * covering it.  Adjacent pieces won by the same record are merged.
+ */
+static void opl_bucket_compile(struct opl_bucket *bucket)
+{
+	const struct opl_operator **records =
+				(const struct opl_operator **)
+				bucket->pending->data;
+	unsigned int count = bucket->pending->len;
+	guint32 *bounds;
+	unsigned int num_bounds = 0;
+	unsigned int i, j;
+
+	if (count == 0)
+		goto done;
+
+	bounds = g_new(guint32, count * 2);
+
+	for (i = 0; i < count; i++) {
+		bounds[num_bounds++] = records[i]->lac_tac_low;
+		bounds[num_bounds++] = records[i]->lac_tac_high + 1;
+	}
+
+	qsort(bounds, num_bounds, sizeof(guint32), guint32_compare);
+
+	bucket->ranges = g_new(struct opl_range, num_bounds);
+
+	for (i = 0; i + 1 < num_bounds; i++) {
+		const struct opl_operator *first = NULL;
+		struct opl_range *last;
+
+		if (bounds[i] == bounds[i + 1])
+			continue;
+
+		for (j = 0; j < count; j++) {
+			if (records[j]->lac_tac_low > bounds[i] ||
+					records[j]->lac_tac_high < bounds[i])
+				continue;
+
+			if (first == NULL || records[j]->pos < first->pos)
+				first = records[j];
+		}
+
+		if (first == NULL)
+			continue;
+
+		last = bucket->num_ranges ?
+			&bucket->ranges[bucket->num_ranges - 1] : NULL;
+
+		if (last && last->opl == first && last->high + 1 == bounds[i]) {
+			last->high = bounds[i + 1] - 1;
+			continue;
+		}
+
+		last = &bucket->ranges[bucket->num_ranges++];
+		last->low = bounds[i];
+		last->high = bounds[i + 1] - 1;
+		last->opl = first;
+	}
+
+	g_free(bounds);
+
+done:
+	g_array_free(bucket->pending, TRUE);
+	bucket->pending = NULL;
+}
+
+static void opl_bucket_compile_foreach(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	opl_bucket_compile(value);
+}
+
+/*
+ * Compiles the OPL into a table of the exact PLMNs and a short list of
+ * the wildcard PLMN patterns, so that a lookup is a hash probe and a
+ * binary search over the LAC ranges instead of a walk over all records.
+ */
 void sim_eons_optimize(struct sim_eons *eons)
 {
+	GSList *l;
+	unsigned int pos = 0;
+
 	eons->opl_list = g_slist_reverse(eons->opl_list);
+
+	sim_eons_drop_index(eons);
+
+	eons->opl_exact = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, opl_bucket_free);
+	eons->lookups = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
+
+	for (l = eons->opl_list; l; l = l->next) {
+		struct opl_operator *opl = l->data;
+		struct opl_bucket *bucket;
+
+		opl->pos = pos++;
+
+		if (opl_plmn_is_wildcard(opl))
+			bucket = opl_bucket_find_wildcard(eons, opl);
+		else {
+			char key[EONS_PLMN_KEY_LEN];
+
+			snprintf(key, sizeof(key), "%s/%s", opl->mcc, opl->mnc);
+			bucket = g_hash_table_lookup(eons->opl_exact, key);
+
+			if (bucket == NULL) {
+				bucket = opl_bucket_new(opl);
+				g_hash_table_insert(eons->opl_exact,
+							g_strdup(key), bucket);
+			}
+		}
+
+		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe) {
+			if (bucket->whole == NULL)
+				bucket->whole = opl;
+
+			continue;
+		}
+
+		if (opl->lac_tac_low > opl->lac_tac_high)
+			continue;
+
+		g_array_append_val(bucket->pending, opl);
+	}
+
+	g_hash_table_foreach(eons->opl_exact, opl_bucket_compile_foreach, NULL);
+
+	for (l = eons->opl_wildcards; l; l = l->next)
+		opl_bucket_compile(l->data);
 }
 
 void sim_eons_free(struct sim_eons *eons)
@@ -1124,59 +1385,134 @@ void sim_eons_free(struct sim_eons *eons)
 
 	g_free(eons->pnn_list);
 
+	sim_eons_drop_index(eons);
 	g_slist_free_full(eons->opl_list, g_free);
 
 	g_free(eons);
 }
 
-static const struct sim_eons_operator_info *
-	sim_eons_lookup_common(struct sim_eons *eons,
-				const char *mcc, const char *mnc,
-				gboolean have_lac, guint16 lac)
+static const struct opl_operator *opl_bucket_lookup(
+					const struct opl_bucket *bucket,
+					gboolean have_lac, guint16 lac,
+					const struct opl_operator *best)
+{
+	const struct opl_operator *found = bucket->whole;
+	unsigned int low = 0;
+	unsigned int high = bucket->num_ranges;
+
+	while (have_lac && low < high) {
+		unsigned int mid = (low + high) / 2;
+		const struct opl_range *range = &bucket->ranges[mid];
+
+		if (lac < range->low)
+			high = mid;
+		else if (lac > range->high)
+			low = mid + 1;
+		else {
+			if (found == NULL || range->opl->pos < found->pos)
+				found = range->opl;
+
+			break;
+		}
+	}
+
+	if (found == NULL)
+		return best;
+
+	if (best == NULL || found->pos < best->pos)
+		return found;
+
+	return best;
+}
+
+/* The OPL has not been compiled yet, walk it as loaded so far */
+static const struct opl_operator *opl_list_lookup(struct sim_eons *eons,
+						const char *mcc,
+						const char *mnc,
+						gboolean have_lac, guint16 lac)
 {
 	GSList *l;
 	const struct opl_operator *opl;
-	int i;
 
 	for (l = eons->opl_list; l; l = l->next) {
 		opl = l->data;
 
-		for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
-			if (mcc[i] != opl->mcc[i] &&
-					!(opl->mcc[i] == 'b' && mcc[i]))
-				break;
-		if (i < OFONO_MAX_MCC_LENGTH)
-			continue;
-
-		for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
-			if (mnc[i] != opl->mnc[i] &&
-					!(opl->mnc[i] == 'b' && mnc[i]))
-				break;
-		if (i < OFONO_MAX_MNC_LENGTH)
+		if (!opl_plmn_match(opl->mcc, opl->mnc, mcc, mnc))
 			continue;
 
 		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe)
-			break;
+			return opl;
 
 		if (have_lac == FALSE)
 			continue;
 
 		if ((lac >= opl->lac_tac_low) && (lac <= opl->lac_tac_high))
-			break;
+			return opl;
 	}
 
-	if (l == NULL)
-		return NULL;
-
-	opl = l->data;
+	return NULL;
+}
 
+static const struct sim_eons_operator_info *opl_to_pnn(
+						struct sim_eons *eons,
+						const struct opl_operator *opl)
+{
 	/* 0 is not a valid record id */
-	if (opl->id == 0)
+	if (opl == NULL || opl->id == 0)
 		return NULL;
 
 	return &eons->pnn_list[opl->id - 1];
 }
 
+static const struct sim_eons_operator_info *
+	sim_eons_lookup_common(struct sim_eons *eons,
+				const char *mcc, const char *mnc,
+				gboolean have_lac, guint16 lac)
+{
+	char plmn_key[EONS_PLMN_KEY_LEN];
+	char lookup_key[EONS_PLMN_KEY_LEN + 8];
+	const struct opl_operator *opl = NULL;
+	const struct opl_bucket *bucket;
+	const struct sim_eons_operator_info *info;
+	gpointer value;
+	GSList *l;
+
+	if (eons->opl_exact == NULL)
+		return opl_to_pnn(eons, opl_list_lookup(eons, mcc, mnc,
+							have_lac, lac));
+
+	snprintf(plmn_key, sizeof(plmn_key), "%.*s/%.*s",
+			OFONO_MAX_MCC_LENGTH, mcc, OFONO_MAX_MNC_LENGTH, mnc);
+	snprintf(lookup_key, sizeof(lookup_key), "%s/%d", plmn_key,
+			have_lac ? lac : -1);
+
+	/* Answers are kept until the OPL is reloaded */
+	if (g_hash_table_lookup_extended(eons->lookups, lookup_key,
+						NULL, &value))
+		return value;
+
+	bucket = g_hash_table_lookup(eons->opl_exact, plmn_key);
+	if (bucket)
+		opl = opl_bucket_lookup(bucket, have_lac, lac, opl);
+
+	for (l = eons->opl_wildcards; l; l = l->next) {
+		bucket = l->data;
+
+		if (opl_plmn_match(bucket->mcc, bucket->mnc, mcc, mnc))
+			opl = opl_bucket_lookup(bucket, have_lac, lac, opl);
+	}
+
+	info = opl_to_pnn(eons, opl);
+
+	if (g_hash_table_size(eons->lookups) >= EONS_LOOKUPS_MAX)
+		g_hash_table_remove_all(eons->lookups);
+
+	g_hash_table_insert(eons->lookups, g_strdup(lookup_key),
+						(gpointer) info);
+
+	return info;
+}
+
 const struct sim_eons_operator_info *sim_eons_lookup(struct sim_eons *eons,
 						const char *mcc,
 						const char *mnc)
@@ -43,6 +43,7 @@ enum sim_fileid {
 	SIM_EFSST_FILEID =			0x6F38, /* same as EFust */
 	SIM_EFADN_FILEID =			0x6F3A,
 	SIM_EFFDN_FILEID =			0x6F3B,
+	SIM_EFSMS_FILEID =			0x6F3C,
 	SIM_EFMSISDN_FILEID =			0x6F40,
 	SIM_EFSMSP_FILEID =			0x6F42,
 	SIM_EFCBMI_FILEID =			0x6F45,
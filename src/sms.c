@@ -51,9 +51,13 @@
 #define NETWORK_TIMEOUT 332
 
 static gboolean tx_next(gpointer user_data);
+static gboolean tx_write_to_sim(gpointer user_data);
 static void message_sent_cb(struct ofono_sms *sms,
 			const struct ofono_uuid *uuid,
 			const struct ofono_error *error, void *data);
+static void sms_status_report_notify(struct ofono_sms *sms,
+					const struct ofono_uuid *uuid,
+					gboolean delivered);
 
 static GSList *g_drivers = NULL;
 
@@ -72,6 +76,11 @@ struct ofono_sms {
 	GQueue *txq;
 	unsigned long tx_counter;
 	guint tx_source;
+	unsigned int tx_window;
+	unsigned int tx_pending;
+	GSList *tx_submits;
+	GQueue *simq;
+	guint sim_source;
 	struct ofono_message_waiting *mw;
 	unsigned int mw_watch;
 	ofono_bool_t registered;
@@ -92,16 +101,27 @@ struct ofono_sms {
 	struct ofono_watchlist *datagram_handlers;
 };
 
+enum pending_pdu_state {
+	PENDING_PDU_QUEUED = 0,
+	PENDING_PDU_SUBMITTED,
+	PENDING_PDU_SENT,
+};
+
 struct pending_pdu {
 	unsigned char pdu[176];
 	int tpdu_len;
 	int pdu_len;
+	enum pending_pdu_state state;
 };
 
 struct tx_queue_entry {
 	struct pending_pdu *pdus;
 	unsigned char num_pdus;
 	unsigned char cur_pdu;
+	unsigned char sent_pdus;
+	unsigned char pending_pdus;
+	gboolean failed;
+	struct ofono_error error;
 	struct sms_address receiver;
 	struct ofono_uuid uuid;
 	unsigned int retry;
@@ -112,6 +132,13 @@ struct tx_queue_entry {
 	unsigned long id;
 };
 
+/* One submit handed to the driver, several may be in flight at once */
+struct tx_submit {
+	struct ofono_sms *sms;
+	struct tx_queue_entry *entry;
+	unsigned char pdu;
+};
+
 static gboolean uuid_equal(gconstpointer v1, gconstpointer v2)
 {
 	return memcmp(v1, v2, OFONO_SHA1_UUID_LEN) == 0;
@@ -391,6 +418,33 @@ static void set_sca(struct ofono_sms *sms,
 						DBUS_TYPE_STRING, &value);
 }
 
+static void append_assembly_stats(const struct sms_assembly_stats *stats,
+					DBusMessageIter *dict)
+{
+	dbus_uint32_t latency_max = stats->latency_max;
+	dbus_uint32_t latency_average = 0;
+	const void *entries[11];
+	const void **stats_dict = entries;
+
+	if (stats->completed)
+		latency_average = stats->latency_total / stats->completed;
+
+	entries[0] = "Completed";
+	entries[1] = &stats->completed;
+	entries[2] = "Expired";
+	entries[3] = &stats->expired;
+	entries[4] = "Evicted";
+	entries[5] = &stats->evicted;
+	entries[6] = "AverageLatency";
+	entries[7] = &latency_average;
+	entries[8] = "MaxLatency";
+	entries[9] = &latency_max;
+	entries[10] = NULL;
+
+	ofono_dbus_dict_append_dict(dict, "AssemblyStatistics",
+					DBUS_TYPE_UINT32, &stats_dict);
+}
+
 static DBusMessage *generate_get_properties_reply(struct ofono_sms *sms,
 							DBusMessage *msg)
 {
@@ -425,6 +479,9 @@ static DBusMessage *generate_get_properties_reply(struct ofono_sms *sms,
 	alphabet = sms_alphabet_to_string(sms->alphabet);
 	ofono_dbus_dict_append(&dict, "Alphabet", DBUS_TYPE_STRING, &alphabet);
 
+	if (sms->assembly)
+		append_assembly_stats(&sms->assembly->stats, &dict);
+
 	dbus_message_iter_close_container(&iter, &dict);
 
 	return reply;
@@ -730,18 +787,58 @@ done:
 	tx_queue_entry_destroy(entry);
 }
 
+static void tx_schedule(struct ofono_sms *sms)
+{
+	if (sms->tx_source > 0)
+		return;
+
+	if (sms->tx_pending >= sms->tx_window)
+		return;
+
+	if (g_queue_get_length(sms->txq) == 0)
+		return;
+
+	sms->tx_source = g_timeout_add(0, tx_next, sms);
+}
+
+static void tx_retry(struct ofono_sms *sms, struct tx_queue_entry *entry,
+					unsigned char index)
+{
+	entry->pdus[index].state = PENDING_PDU_QUEUED;
+
+	if (index < entry->cur_pdu)
+		entry->cur_pdu = index;
+
+	/* Nothing else goes out until the retry is due */
+	if (sms->tx_source > 0)
+		g_source_remove(sms->tx_source);
+
+	sms->tx_source = g_timeout_add_seconds(entry->retry * 2, tx_next, sms);
+}
+
 static void tx_finished(const struct ofono_error *error, int mr, void *data)
 {
-	struct ofono_sms *sms = data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_submit *submit = data;
+	struct ofono_sms *sms = submit->sms;
+	struct tx_queue_entry *entry = submit->entry;
+	unsigned char index = submit->pdu;
 	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
 	enum message_state tx_state;
 	struct ofono_uuid entry_uuid;
+	struct ofono_error entry_error;
+	gboolean delivered;
 	int op_code = OFONO_OPERATOR_UNKNOW;
 
-	ofono_debug("tx_finished %p", entry);
+	ofono_debug("tx_finished %p pdu %u", entry, index);
 
-	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
+	sms->tx_submits = g_slist_remove(sms->tx_submits, submit);
+	g_free(submit);
+
+	sms->tx_pending -= 1;
+	entry->pending_pdus -= 1;
+
+	if (sms->tx_pending == 0)
+		sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	if (ok == FALSE) {
 		/* Retry again when back in online mode */
@@ -749,18 +846,21 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 
 		tx_state = MESSAGE_STATE_FAILED;
 
+		if (entry->failed)
+			goto failed;
+
 		/* Retry done only for Network Timeout failure */
 		if (error->type == OFONO_ERROR_TYPE_CMS &&
 				error->error != NETWORK_TIMEOUT)
-			goto next_q;
+			goto failed;
 
 		if (!(entry->flags & OFONO_SMS_SUBMIT_FLAG_RETRY))
-			goto next_q;
+			goto failed;
 
 		/* Retry when the current signal is good and ims registration is successful */
 		if (!sms_in_good_coverage(sms) || !sms_ims_in_service(sms)) {
 			ofono_debug("network status is not good, giving up retrying ! \n");
-			goto next_q;
+			goto failed;
 		}
 
 		entry->retry += 1;
@@ -768,45 +868,77 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 		if (entry->retry < TXQ_MAX_RETRIES) {
 			ofono_debug("Sending failed, retry in %d secs",
 					entry->retry * 2);
-			sms->tx_source = g_timeout_add_seconds(entry->retry * 2,
-								tx_next, sms);
+			tx_retry(sms, entry, index);
 			return;
 		}
 
 		ofono_debug("Max retries reached, giving up");
+
+failed:
+		if (entry->failed == FALSE) {
+			entry->failed = TRUE;
+			entry->error = *error;
+		}
+
+		/* The submits still in flight have to come back first */
+		if (entry->pending_pdus > 0)
+			return;
+
 		goto next_q;
 	}
 
 	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_EXPOSE_DBUS)
 		sms_tx_backup_remove(sms->imsi, entry->id, entry->flags,
 						ofono_uuid_to_str(&entry->uuid),
-						entry->cur_pdu);
+						index);
 
-	entry->cur_pdu += 1;
+	entry->pdus[index].state = PENDING_PDU_SENT;
+	entry->sent_pdus += 1;
 	entry->retry = 0;
 
-	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR)
-		status_report_assembly_add_fragment(sms->sr_assembly,
+	/*
+	 * With several submits in flight the MRs, and even the status
+	 * reports, may come back in any order
+	 */
+	if ((entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR) &&
+			status_report_assembly_add_fragment(sms->sr_assembly,
 							entry->uuid.uuid,
 							&entry->receiver,
 							mr, time(NULL),
-							entry->num_pdus);
+							entry->num_pdus,
+							&delivered))
+		sms_status_report_notify(sms, &entry->uuid, delivered);
 
-	if (entry->cur_pdu < entry->num_pdus) {
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	if (entry->failed) {
+		if (entry->pending_pdus > 0)
+			return;
+
+		tx_state = MESSAGE_STATE_FAILED;
+		goto next_q;
+	}
+
+	if (entry->sent_pdus < entry->num_pdus) {
+		tx_schedule(sms);
 		return;
 	}
 
 	tx_state = MESSAGE_STATE_SENT;
 
 next_q:
+	/* The entry is freed below, keep what is reported from it */
+	if (entry->failed) {
+		entry_error = entry->error;
+		error = &entry_error;
+		ok = FALSE;
+	}
+
 	memcpy(&entry_uuid, &entry->uuid, sizeof(entry->uuid));
-	sms_tx_queue_remove_entry(sms, g_queue_peek_head_link(sms->txq),
+	sms_tx_queue_remove_entry(sms, g_queue_find(sms->txq, entry),
 					tx_state);
 
 	if (g_queue_peek_head(sms->txq)) {
 		ofono_debug("Scheduling next");
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+		tx_schedule(sms);
 	}
 
 	if (ok == FALSE) {
@@ -827,46 +959,122 @@ next_q:
 	message_sent_cb(sms, &entry_uuid, error, sms->pending);
 }
 
-static void tx_write_to_sim_finish(const struct ofono_error *error, void *data)
+static gboolean tx_has_queued(GList *l, struct tx_queue_entry *entry,
+					unsigned char from)
 {
-	DBG("tx_write_to_sim_finish result: %d", error->type == OFONO_ERROR_TYPE_NO_ERROR);
+	unsigned char i;
+
+	for (i = from; i < entry->num_pdus; i++)
+		if (entry->pdus[i].state == PENDING_PDU_QUEUED)
+			return TRUE;
+
+	return l->next != NULL;
 }
 
-static gboolean tx_next(gpointer user_data)
+static void tx_submit(struct ofono_sms *sms, GList *l,
+					struct tx_queue_entry *entry,
+					unsigned char index)
 {
-	struct ofono_sms *sms = user_data;
+	struct pending_pdu *pdu = &entry->pdus[index];
+	struct tx_submit *submit;
 	int send_mms = 0;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
-	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
 
-	ofono_debug("tx_next: %p", entry);
+	/* Keep the link up while anything, here or further on, is left */
+	if (tx_has_queued(l, entry, index + 1))
+		send_mms = 1;
 
-	sms->tx_source = 0;
+	ofono_debug("tx_next: %p pdu %u", entry, index);
 
-	if (g_queue_get_length(sms->txq) > 1
-			|| (entry->num_pdus - entry->cur_pdu) > 1)
-		send_mms = 1;
+	submit = g_new0(struct tx_submit, 1);
+	submit->sms = sms;
+	submit->entry = entry;
+	submit->pdu = index;
+	sms->tx_submits = g_slist_prepend(sms->tx_submits, submit);
 
+	pdu->state = PENDING_PDU_SUBMITTED;
+	entry->cur_pdu = index + 1;
+	entry->pending_pdus += 1;
+	sms->tx_pending += 1;
 	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
 	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-				send_mms, tx_finished, sms);
+				send_mms, tx_finished, submit);
+}
+
+static gboolean tx_next(gpointer user_data)
+{
+	struct ofono_sms *sms = user_data;
+	GList *l;
+	unsigned char i;
+
+	sms->tx_source = 0;
+
+	/*
+	 * Fill the window in queue order, the PDUs of an entry in order
+	 * and across entries.  With a window of one this is the classic
+	 * one submit at a time.
+	 */
+	for (l = g_queue_peek_head_link(sms->txq); l; l = l->next) {
+		struct tx_queue_entry *entry = l->data;
+
+		if (entry->failed)
+			continue;
+
+		for (i = entry->cur_pdu; i < entry->num_pdus; i++) {
+			if (sms->tx_pending >= sms->tx_window)
+				return FALSE;
+
+			if (entry->pdus[i].state != PENDING_PDU_QUEUED)
+				continue;
+
+			tx_submit(sms, l, entry, i);
+
+			/* The driver may have answered right away */
+			if (sms->tx_source > 0 ||
+					g_queue_find(sms->txq, entry) == NULL)
+				return FALSE;
+		}
+	}
 
 	return FALSE;
 }
 
+static void tx_write_to_sim_finish(const struct ofono_error *error, void *data)
+{
+	struct ofono_sms *sms = data;
+	struct tx_queue_entry *entry = g_queue_peek_head(sms->simq);
+	gboolean ok = error->type == OFONO_ERROR_TYPE_NO_ERROR;
+
+	DBG("tx_write_to_sim_finish result: %d", ok);
+
+	/* For entries on the simq cur_pdu is the PDU being written */
+	entry->cur_pdu += 1;
+
+	if (ok && entry->cur_pdu < entry->num_pdus) {
+		sms->sim_source = g_timeout_add(0, tx_write_to_sim, sms);
+		return;
+	}
+
+	g_queue_pop_head(sms->simq);
+	tx_queue_entry_destroy(entry);
+
+	if (!g_queue_is_empty(sms->simq))
+		sms->sim_source = g_timeout_add(0, tx_write_to_sim, sms);
+}
+
 static gboolean tx_write_to_sim(gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
-	struct tx_queue_entry *entry = g_queue_peek_head(sms->txq);
+	struct tx_queue_entry *entry = g_queue_peek_head(sms->simq);
 	struct pending_pdu *pdu = &entry->pdus[entry->cur_pdu];
 
-	DBG("tx_write_to_sim: %p", entry);
+	DBG("tx_write_to_sim: %p pdu %u", entry, entry->cur_pdu);
 
-	sms->tx_source = 0;
+	sms->sim_source = 0;
 
-	sms->driver->sms_write_to_sim(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
-                                 				0, tx_write_to_sim_finish, sms);
+	sms->driver->sms_write_to_sim(sms, pdu->pdu, pdu->pdu_len,
+					pdu->tpdu_len, 0,
+					tx_write_to_sim_finish, sms);
 
 	return FALSE;
 }
@@ -895,7 +1103,7 @@ static void netreg_status_watch(int status, int lac, int ci, int tech,
 	if (sms->tx_source > 0)
 		return;
 
-	if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
+	if (sms->tx_pending >= sms->tx_window)
 		return;
 
 	if (g_queue_get_length(sms->txq))
@@ -1528,16 +1736,14 @@ int __ofono_sms_txq_cancel(struct ofono_sms *sms, const struct ofono_uuid *uuid)
 
 	entry = l->data;
 
-	if (entry == g_queue_peek_head(sms->txq)) {
-		/*
-		 * Fail if any pdu was already transmitted or if we are
-		 * waiting the answer from driver.
-		 */
-		if (entry->cur_pdu > 0)
-			return -EPERM;
+	/*
+	 * Fail if any pdu was already transmitted or if we are
+	 * waiting the answer from driver.
+	 */
+	if (entry->sent_pdus > 0 || entry->pending_pdus > 0)
+		return -EPERM;
 
-		if (sms->flags & MESSAGE_MANAGER_FLAG_TXQ_ACTIVE)
-			return -EPERM;
+	if (entry == g_queue_peek_head(sms->txq)) {
 		/*
 		 * Make sure we don't call tx_next() if there are no entries
 		 * and that next entry doesn't have to wait a 'retry time'
@@ -1905,22 +2111,17 @@ static void handle_deliver(struct ofono_sms *sms, const struct sms *incoming)
 	g_slist_free(l);
 }
 
-static void handle_sms_status_report(struct ofono_sms *sms,
-						const struct sms *incoming)
+static void sms_status_report_notify(struct ofono_sms *sms,
+					const struct ofono_uuid *uuid,
+					gboolean delivered)
 {
 	struct ofono_modem *modem = __ofono_atom_get_modem(sms->atom);
-	gboolean delivered;
-	struct ofono_uuid uuid;
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(sms->atom);
 	DBusMessage *signal;
 	DBusMessageIter iter;
 	const char *signal_name = "StatusReportMessage";
 
-	if (status_report_assembly_report(sms->sr_assembly, incoming, uuid.uuid,
-						&delivered) == FALSE)
-		return;
-
 	signal = dbus_message_new_signal(path, OFONO_MESSAGE_MANAGER_INTERFACE,
 						signal_name);
 
@@ -1933,11 +2134,24 @@ static void handle_sms_status_report(struct ofono_sms *sms,
 
 	g_dbus_send_message(conn, signal);
 
-	__ofono_history_sms_send_status(modem, &uuid, time(NULL),
+	__ofono_history_sms_send_status(modem, uuid, time(NULL),
 			delivered ? OFONO_HISTORY_SMS_STATUS_DELIVERED :
 			OFONO_HISTORY_SMS_STATUS_DELIVER_FAILED);
 }
 
+static void handle_sms_status_report(struct ofono_sms *sms,
+						const struct sms *incoming)
+{
+	gboolean delivered;
+	struct ofono_uuid uuid;
+
+	if (status_report_assembly_report(sms->sr_assembly, incoming, uuid.uuid,
+						&delivered) == FALSE)
+		return;
+
+	sms_status_report_notify(sms, &uuid, delivered);
+}
+
 
 static inline gboolean handle_mwi(struct ofono_sms *sms, struct sms *s)
 {
@@ -2220,12 +2434,27 @@ static void sms_remove(struct ofono_atom *atom)
 	if (sms->driver && sms->driver->remove)
 		sms->driver->remove(sms);
 
+	/* The driver is gone, its callbacks for these won't come anymore */
+	g_slist_free_full(sms->tx_submits, g_free);
+	sms->tx_submits = NULL;
+
 	if (sms->tx_source) {
 		g_source_remove(sms->tx_source);
 		sms->tx_source = 0;
 	}
 
+	if (sms->sim_source) {
+		g_source_remove(sms->sim_source);
+		sms->sim_source = 0;
+	}
+
 	if (sms->assembly) {
+		struct sms_assembly_stats *stats = &sms->assembly->stats;
+
+		DBG("assembled %u, expired %u, evicted %u, latency max %lus",
+			stats->completed, stats->expired, stats->evicted,
+			stats->latency_max);
+
 		sms_assembly_free(sms->assembly);
 		sms->assembly = NULL;
 	}
@@ -2234,6 +2463,13 @@ static void sms_remove(struct ofono_atom *atom)
 		g_queue_foreach(sms->txq, tx_queue_entry_destroy_foreach, NULL);
 		g_queue_free(sms->txq);
 		sms->txq = NULL;
+		sms->tx_pending = 0;
+	}
+
+	if (sms->simq) {
+		g_queue_foreach(sms->simq, tx_queue_entry_destroy_foreach, NULL);
+		g_queue_free(sms->simq);
+		sms->simq = NULL;
 	}
 
 	if (sms->settings) {
@@ -2292,6 +2528,8 @@ struct ofono_sms *ofono_sms_create(struct ofono_modem *modem,
 	sms->sca.type = 129;
 	sms->ref = 1;
 	sms->txq = g_queue_new();
+	sms->tx_window = 1;
+	sms->simq = g_queue_new();
 	sms->messages = g_hash_table_new(uuid_hash, uuid_equal);
 
 	sms->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_SMS,
@@ -2329,6 +2567,7 @@ static void mw_watch(struct ofono_atom *atom,
 static void sms_load_settings(struct ofono_sms *sms, const char *imsi)
 {
 	GError *error;
+	int limit;
 
 	sms->settings = storage_open(imsi, SETTINGS_STORE);
 
@@ -2381,6 +2620,19 @@ static void sms_load_settings(struct ofono_sms *sms, const char *imsi)
 		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
 					"Alphabet", sms->alphabet);
 	}
+
+	error = NULL;
+	limit = g_key_file_get_integer(sms->settings, SETTINGS_GROUP,
+					"AssemblyMemoryLimit", &error);
+
+	if (error || limit < 0) {
+		g_clear_error(&error);
+		limit = SMS_ASSEMBLY_DEFAULT_LIMIT;
+		g_key_file_set_integer(sms->settings, SETTINGS_GROUP,
+					"AssemblyMemoryLimit", limit);
+	}
+
+	sms_assembly_set_limit(sms->assembly, limit);
 }
 
 static void bearer_init_callback(const struct ofono_error *error, void *data)
@@ -2528,6 +2780,21 @@ void *ofono_sms_get_data(struct ofono_sms *sms)
 	return sms->driver_data;
 }
 
+/*
+ * Lets a driver whose modem accepts several submits at once keep up to
+ * @window PDUs in flight, across the segments of a message and across
+ * queued messages.  The default of one waits for each submit to finish.
+ */
+void ofono_sms_set_tx_window(struct ofono_sms *sms, unsigned int window)
+{
+	if (sms == NULL || window == 0)
+		return;
+
+	DBG("%u", window);
+
+	sms->tx_window = window;
+}
+
 unsigned short __ofono_sms_get_next_ref(struct ofono_sms *sms)
 {
 	return sms->ref;
@@ -2572,8 +2839,8 @@ int __ofono_sms_txq_submit(struct ofono_sms *sms, GSList *list,
 
 	sms->pending = dbus_message_ref(msg);
 
-	if (g_queue_get_length(sms->txq) == 1)
-		sms->tx_source = g_timeout_add(0, tx_next, sms);
+	if (g_queue_get_length(sms->txq) == 1 || sms->tx_window > 1)
+		tx_schedule(sms);
 
 	if (uuid)
 		memcpy(uuid, &entry->uuid, sizeof(*uuid));
@@ -2622,6 +2889,9 @@ int __ofono_sms_txq_write_to_sim(struct ofono_sms *sms, GSList *list,
 		time_to_sms_scts(date, &s->deliver.scts);
 	}
 
+	if (sms->driver->sms_write_to_sim == NULL)
+		return -ENOTSUP;
+
 	entry = tx_queue_entry_new(list, flags);
 	if (entry == NULL)
 		return -ENOMEM;
@@ -2634,9 +2904,10 @@ int __ofono_sms_txq_write_to_sim(struct ofono_sms *sms, GSList *list,
 	}
 	entry->id = sms->tx_counter++;
 
-	g_queue_push_tail(sms->txq, entry);
-	if (g_queue_get_length(sms->txq) == 1)
-		sms->tx_source = g_timeout_add(0, tx_write_to_sim, sms);
+	/* Kept apart from the txq, nothing here is ever submitted */
+	g_queue_push_tail(sms->simq, entry);
+	if (g_queue_get_length(sms->simq) == 1)
+		sms->sim_source = g_timeout_add(0, tx_write_to_sim, sms);
 
 	return 0;
 }
@@ -44,15 +44,24 @@
 
 #define SMS_BACKUP_MODE 0600
 #define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
 
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
 #define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
 
 #define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+
+/*
+ * Fragments and queued PDUs are backed up as records of a single journal,
+ * the directories above are only read to import backups from old versions.
+ */
+#define SMS_JOURNAL_STORE "sms_journal"
+#define SMS_JOURNAL_ASSEMBLY "assembly/"
+#define SMS_JOURNAL_ASSEMBLY_NODE SMS_JOURNAL_ASSEMBLY "%s-%i-%i/"
+#define SMS_JOURNAL_ASSEMBLY_KEY SMS_JOURNAL_ASSEMBLY_NODE "%03i"
+#define SMS_JOURNAL_TX "tx/"
+#define SMS_JOURNAL_TX_ENTRY SMS_JOURNAL_TX "%s-%lu/"
+#define SMS_JOURNAL_TX_KEY SMS_JOURNAL_TX_ENTRY "%03i"
+#define SMS_JOURNAL_KEY_MAX 64
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -2480,77 +2489,254 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 				assembly->imsi,
 				dir->d_name, segments[i]->d_name);
 		r = stat(path, &segment_stat);
-		g_free(path);
-
-		if (r != 0)
-			continue;
 
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
+		/* Move the fragment over to the journal */
+		if (r == 0)
+			sms_assembly_add_fragment_backup(assembly, &segment,
 						segment_stat.st_mtime,
-						&addr, ref, max, seq, FALSE);
+						&addr, ref, max, seq, TRUE);
+
+		unlink(path);
+		g_free(path);
 	}
 
 	for (i = 0; i < len; i++)
 		free(segments[i]);
 
 	free(segments);
+
+	path = g_strdup_printf(SMS_BACKUP_PATH "/%s", assembly->imsi,
+				dir->d_name);
+	rmdir(path);
+	g_free(path);
+}
+
+static void sms_assembly_load_record(const char *key,
+					const unsigned char *data, size_t len,
+					void *user_data)
+{
+	struct sms_assembly *assembly = user_data;
+	struct sms_address addr;
+	DECLARE_SMS_ADDR_STR(straddr);
+	struct sms segment;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	time_t ts;
+
+	if (sscanf(key, SMS_JOURNAL_ASSEMBLY SMS_ADDR_FMT "-%hu-%hhu/%hhu",
+				straddr, &ref, &max, &seq) < 4)
+		return;
+
+	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
+		return;
+
+	if (len < 8)
+		return;
+
+	ts = l_get_le64(data);
+
+	if (!sms_deserialize(data + 8, &segment, len - 8))
+		return;
+
+	sms_assembly_add_fragment_backup(assembly, &segment, ts,
+						&addr, ref, max, seq, FALSE);
 }
 
 static gboolean sms_assembly_store(struct sms_assembly *assembly,
 				struct sms_assembly_node *node,
-				const struct sms *sms, guint8 seq)
+				const struct sms *sms, guint8 seq, time_t ts)
 {
-	unsigned char buf[177];
+	unsigned char buf[8 + 177];
+	char key[SMS_JOURNAL_KEY_MAX];
 	int len;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return FALSE;
 
-	len = sms_serialize(buf, sms);
+	l_put_le64(ts, buf);
+	len = sms_serialize(buf + 8, sms) + 8;
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	snprintf(key, sizeof(key), SMS_JOURNAL_ASSEMBLY_KEY, straddr,
+				node->ref, node->max_fragments, seq);
 
-	return TRUE;
+	return storage_journal_put(assembly->journal, key, buf, len);
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
-	int seq;
+	char prefix[SMS_JOURNAL_KEY_MAX];
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
+	snprintf(prefix, sizeof(prefix), SMS_JOURNAL_ASSEMBLY_NODE, straddr,
+				node->ref, node->max_fragments);
 
-		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
+	storage_journal_remove_prefix(assembly->journal, prefix);
+}
+
+static guint assembly_node_hash(gconstpointer v)
+{
+	const struct sms_assembly_node *node = v;
+
+	return g_str_hash(node->addr.address) ^ (node->ref << 8) ^
+			(node->addr.number_type << 4) ^
+			node->addr.numbering_plan;
+}
+
+static gboolean assembly_node_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
+
+	if (a->ref != b->ref)
+		return FALSE;
+
+	if (a->addr.number_type != b->addr.number_type)
+		return FALSE;
+
+	if (a->addr.numbering_plan != b->addr.numbering_plan)
+		return FALSE;
+
+	return strcmp(a->addr.address, b->addr.address) == 0;
+}
+
+static size_t assembly_node_size(const struct sms_assembly_node *node)
+{
+	return sizeof(struct sms_assembly_node) +
+		node->num_fragments * (sizeof(struct sms) + sizeof(GSList));
+}
+
+static void assembly_heap_set(GPtrArray *heap, unsigned int i,
+				struct sms_assembly_node *node)
+{
+	g_ptr_array_index(heap, i) = node;
+	node->heap_index = i;
+}
+
+static void assembly_heap_up(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = g_ptr_array_index(heap, i);
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		struct sms_assembly_node *p = g_ptr_array_index(heap, parent);
+
+		if (p->ts <= node->ts)
+			break;
+
+		assembly_heap_set(heap, i, p);
+		i = parent;
+	}
+
+	assembly_heap_set(heap, i, node);
+}
+
+static void assembly_heap_down(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = g_ptr_array_index(heap, i);
+
+	while (2 * i + 1 < heap->len) {
+		unsigned int child = 2 * i + 1;
+		struct sms_assembly_node *c = g_ptr_array_index(heap, child);
+
+		if (child + 1 < heap->len) {
+			struct sms_assembly_node *r =
+				g_ptr_array_index(heap, child + 1);
+
+			if (r->ts < c->ts) {
+				child += 1;
+				c = r;
+			}
 		}
+
+		if (node->ts <= c->ts)
+			break;
+
+		assembly_heap_set(heap, i, c);
+		i = child;
 	}
 
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	assembly_heap_set(heap, i, node);
+}
+
+static void assembly_heap_push(GPtrArray *heap, struct sms_assembly_node *node)
+{
+	g_ptr_array_add(heap, node);
+	node->heap_index = heap->len - 1;
+	assembly_heap_up(heap, node->heap_index);
+}
+
+static void assembly_heap_remove(GPtrArray *heap,
+					struct sms_assembly_node *node)
+{
+	unsigned int i = node->heap_index;
+	struct sms_assembly_node *last;
+
+	last = g_ptr_array_remove_index(heap, heap->len - 1);
+
+	if (last == node)
+		return;
+
+	/* Move the last node into the hole and restore the heap order */
+	assembly_heap_set(heap, i, last);
+	assembly_heap_down(heap, i);
+	assembly_heap_up(heap, last->heap_index);
+}
+
+/* Forgets about the node and its backup, the fragments are left alone */
+static void sms_assembly_unlink(struct sms_assembly *assembly,
+					struct sms_assembly_node *node)
+{
+	sms_assembly_backup_free(assembly, node);
+
+	g_hash_table_remove(assembly->assembly_table, node);
+	assembly_heap_remove(assembly->expiry_heap, node);
+	assembly->pending_bytes -= assembly_node_size(node);
+}
+
+static void sms_assembly_drop(struct sms_assembly *assembly,
+				struct sms_assembly_node *node)
+{
+	sms_assembly_unlink(assembly, node);
+
+	g_slist_free_full(node->fragment_list, g_free);
+	g_free(node);
+}
+
+/*
+ * Evicts the incomplete messages that have been pending the longest until
+ * the memory they take fits the limit.  The node given in keep, if any, is
+ * the one currently being assembled and is never evicted.
+ */
+static void sms_assembly_evict(struct sms_assembly *assembly,
+				struct sms_assembly_node *keep)
+{
+	GPtrArray *heap = assembly->expiry_heap;
+
+	if (assembly->limit == 0 || assembly->pending_bytes <= assembly->limit)
+		return;
+
+	if (keep)
+		assembly_heap_remove(heap, keep);
+
+	while (assembly->pending_bytes > assembly->limit && heap->len > 0) {
+		sms_assembly_drop(assembly, g_ptr_array_index(heap, 0));
+		assembly->stats.evicted += 1;
+	}
+
+	if (keep)
+		assembly_heap_push(heap, keep);
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
@@ -2560,17 +2746,26 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 	struct dirent **entries;
 	int len;
 
+	ret->assembly_table = g_hash_table_new(assembly_node_hash,
+						assembly_node_equal);
+	ret->expiry_heap = g_ptr_array_new();
+	ret->limit = SMS_ASSEMBLY_DEFAULT_LIMIT;
+
 	if (imsi) {
 		ret->imsi = imsi;
+		ret->journal = storage_journal_open(imsi, SMS_JOURNAL_STORE);
 
 		/* Restore state from backup */
+		storage_journal_foreach(ret->journal, SMS_JOURNAL_ASSEMBLY,
+					sms_assembly_load_record, ret);
 
 		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
 		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
 
-		if (len < 0)
+		if (len < 0) {
+			g_free(path);
 			return ret;
+		}
 
 		while (len--) {
 			sms_assembly_load(ret, entries[len]);
@@ -2578,6 +2773,9 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 		}
 
 		free(entries);
+
+		rmdir(path);
+		g_free(path);
 	}
 
 	return ret;
@@ -2585,19 +2783,35 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
+	unsigned int i;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	for (i = 0; i < assembly->expiry_heap->len; i++) {
+		struct sms_assembly_node *node =
+			g_ptr_array_index(assembly->expiry_heap, i);
 
 		g_slist_free_full(node->fragment_list, g_free);
 		g_free(node);
 	}
 
-	g_slist_free(assembly->assembly_list);
+	g_ptr_array_free(assembly->expiry_heap, TRUE);
+	g_hash_table_destroy(assembly->assembly_table);
+
+	if (assembly->journal)
+		storage_journal_close(assembly->journal);
+
 	g_free(assembly);
 }
 
+/*!
+ * Sets the maximum amount of memory incomplete messages may take, in bytes.
+ * Once exceeded the oldest ones are evicted.  A limit of 0 disables this.
+ */
+void sms_assembly_set_limit(struct sms_assembly *assembly, size_t limit)
+{
+	assembly->limit = limit;
+	sms_assembly_evict(assembly, NULL);
+}
+
 GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
@@ -2615,8 +2829,7 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 {
 	unsigned int offset = seq / 32;
 	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
+	struct sms_assembly_node lookup;
 	struct sms *newsms;
 	struct sms_assembly_node *node;
 	GSList *completed;
@@ -2624,66 +2837,52 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 	unsigned int i;
 	unsigned int j;
 
-	prev = NULL;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
+	memcpy(&lookup.addr, addr, sizeof(struct sms_address));
+	lookup.ref = ref;
 
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
-
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
-
-		/*
-		 * Message Reference and address the same, but max is not
-		 * ignore the SMS completely
-		 */
-		if (max != node->max_fragments)
-			return NULL;
+	node = g_hash_table_lookup(assembly->assembly_table, &lookup);
+	if (node == NULL) {
+		node = g_new0(struct sms_assembly_node, 1);
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
 
-		/* Now check if we already have this seq number */
-		if (node->bitmap[offset] & bit)
-			return NULL;
+		g_hash_table_insert(assembly->assembly_table, node, node);
+		assembly_heap_push(assembly->expiry_heap, node);
+		assembly->pending_bytes += assembly_node_size(node);
 
-		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
-		 */
 		position = 0;
-		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
-
 		goto out;
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
+	/*
+	 * Message Reference and address the same, but max is not
+	 * ignore the SMS completely
+	 */
+	if (max != node->max_fragments)
+		return NULL;
 
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+	/* Now check if we already have this seq number */
+	if (node->bitmap[offset] & bit)
+		return NULL;
 
-	prev = NULL;
-	l = assembly->assembly_list;
+	/*
+	 * Iterate over the bitmap to find in which position
+	 * should the fragment be inserted -- basically we
+	 * walk each bit in the bitmap until the bit we care
+	 * about (offset:bit) and count which are stored --
+	 * that gives us in which position we have to insert.
+	 */
 	position = 0;
+	for (i = 0; i < offset; i++)
+		for (j = 0; j < 32; j++)
+			if (node->bitmap[i] & (1 << j))
+				position += 1;
+
+	for (j = 1; j < bit; j = j << 1)
+		if (node->bitmap[offset] & j)
+			position += 1;
 
 out:
 	newsms = g_new(struct sms, 1);
@@ -2693,25 +2892,32 @@ out:
 						newsms, position);
 	node->bitmap[offset] |= bit;
 	node->num_fragments += 1;
+	assembly->pending_bytes += sizeof(struct sms) + sizeof(GSList);
 
 	if (node->num_fragments < node->max_fragments) {
 		if (backup)
-			sms_assembly_store(assembly, node, sms, seq);
+			sms_assembly_store(assembly, node, sms, seq, ts);
 
+		sms_assembly_evict(assembly, node);
 		return NULL;
 	}
 
 	completed = node->fragment_list;
 
-	sms_assembly_backup_free(assembly, node);
+	assembly->stats.completed += 1;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+	if (ts > node->ts) {
+		unsigned long latency = ts - node->ts;
+
+		assembly->stats.latency_total += latency;
 
+		if (latency > assembly->stats.latency_max)
+			assembly->stats.latency_max = latency;
+	}
+
+	sms_assembly_unlink(assembly, node);
 	g_free(node);
-	g_slist_free_1(l);
+
 	return completed;
 }
 
@@ -2722,35 +2928,16 @@ out:
  */
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
-
-	prev = NULL;
-	cur = assembly->assembly_list;
-
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
-
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+	GPtrArray *heap = assembly->expiry_heap;
 
-		sms_assembly_backup_free(assembly, node);
+	while (heap->len > 0) {
+		struct sms_assembly_node *node = g_ptr_array_index(heap, 0);
 
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
+		if (node->ts > before)
+			break;
 
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		sms_assembly_drop(assembly, node);
+		assembly->stats.expired += 1;
 	}
 }
 
@@ -2838,6 +3025,29 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 	g_hash_table_insert(id_table, id_table_key, node);
 }
 
+/*
+ * A status report can overtake the submit response carrying its message
+ * reference when several submits are in flight.  Such reports are kept
+ * for a while, so that the fragment can still be matched once sent.
+ */
+#define SR_EARLY_REPORTS_MAX 16
+#define SR_EARLY_REPORT_TIMEOUT 60
+
+struct sr_early_report {
+	char *addr;
+	unsigned char mr;
+	gboolean delivered;
+	time_t received;
+};
+
+static void sr_early_report_free(gpointer data)
+{
+	struct sr_early_report *report = data;
+
+	g_free(report->addr);
+	g_free(report);
+}
+
 struct status_report_assembly *status_report_assembly_new(const char *imsi)
 {
 	char *path;
@@ -2848,6 +3058,7 @@ struct status_report_assembly *status_report_assembly_new(const char *imsi)
 
 	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
 				g_free, (GDestroyNotify) g_hash_table_destroy);
+	ret->early_reports = g_queue_new();
 
 	if (imsi) {
 		ret->imsi = imsi;
@@ -2933,6 +3144,7 @@ static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
+	g_queue_free_full(assembly->early_reports, sr_early_report_free);
 	g_hash_table_destroy(assembly->assembly_table);
 	g_free(assembly);
 }
@@ -2992,6 +3204,29 @@ static struct id_table_node *find_by_mr_and_mark(GHashTable *id_table,
  * addresses and received address. If address contains less than six digits,
  * compare only existing digits.
  */
+static gboolean sr_address_fuzzy_match(const char *s_addr, const char *r_addr)
+{
+	unsigned int len, r_len, s_len;
+	unsigned int i;
+
+	if (r_addr[0] == '+' && s_addr[0] == '+')
+		return FALSE;
+
+	if (r_addr[0] != '+' && s_addr[0] != '+')
+		return FALSE;
+
+	r_len = strlen(r_addr);
+	s_len = strlen(s_addr);
+
+	len = MIN(6, MIN(r_len, s_len));
+
+	for (i = 0; i < len; i++)
+		if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
+			return FALSE;
+
+	return TRUE;
+}
+
 static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
 						const struct sms *sr,
 						const char **out_addr,
@@ -3008,27 +3243,9 @@ static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
 	while (g_hash_table_iter_next(&iter_addr, &key, &value)) {
 		const char *s_addr = key;
 		GHashTable *id_table = value;
-		unsigned int len, r_len, s_len;
-		unsigned int i;
 		struct id_table_node *node;
 
-		if (r_addr[0] == '+' && s_addr[0] == '+')
-			continue;
-
-		if (r_addr[0] != '+' && s_addr[0] != '+')
-			continue;
-
-		r_len = strlen(r_addr);
-		s_len = strlen(s_addr);
-
-		len = MIN(6, MIN(r_len, s_len));
-
-		for (i = 0; i < len; i++)
-			if (s_addr[s_len - i - 1] != r_addr[r_len - i - 1])
-				break;
-
-		/* Not all digits matched. */
-		if (i < len)
+		if (!sr_address_fuzzy_match(s_addr, r_addr))
 			continue;
 
 		/* Address matched. Check message reference. */
@@ -3043,6 +3260,18 @@ static struct id_table_node *fuzzy_lookup(struct status_report_assembly *assy,
 	return NULL;
 }
 
+/* Whether there are still mr(s) with no status report */
+static gboolean sr_node_pending(const struct id_table_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(node->mrs); i++)
+		if (node->mrs[i] != 0)
+			return TRUE;
+
+	return FALSE;
+}
+
 gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					const struct sms *sr,
 					unsigned char *out_msgid,
@@ -3054,9 +3283,7 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	struct sms_address addr;
 	struct id_table_node *node;
 	gboolean delivered;
-	gboolean pending;
 	unsigned char *msgid = NULL;
-	int i;
 
 	/* We ignore temporary or tempfinal status reports */
 	if (sr_st_to_delivered(sr->status_report.st, &delivered) == FALSE)
@@ -3071,9 +3298,27 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	else
 		node = fuzzy_lookup(assembly, sr, &straddr, &iter, &msgid);
 
-	/* Unable to find a message reference belonging to this address */
-	if (node == NULL)
+	/*
+	 * Unable to find a message reference belonging to this address,
+	 * the submit of the fragment it belongs to may not have ended yet
+	 */
+	if (node == NULL) {
+		struct sr_early_report *report;
+
+		if (g_queue_get_length(assembly->early_reports) ==
+				SR_EARLY_REPORTS_MAX)
+			sr_early_report_free(
+				g_queue_pop_head(assembly->early_reports));
+
+		report = g_new0(struct sr_early_report, 1);
+		report->addr = g_strdup(straddr);
+		report->mr = sr->status_report.mr;
+		report->delivered = delivered;
+		report->received = time(NULL);
+		g_queue_push_tail(assembly->early_reports, report);
+
 		return FALSE;
+	}
 
 	node->deliverable = node->deliverable && delivered;
 
@@ -3081,18 +3326,10 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	if (node->sent_mrs < node->total_mrs)
 		return FALSE;
 
-	/* Figure out if we are expecting more status reports */
-	for (i = 0, pending = FALSE; i < 8; i++) {
-		/* There are still pending mr(s). */
-		if (node->mrs[i] != 0) {
-			pending = TRUE;
-			break;
-		}
-	}
-
 	sms_address_from_string(&addr, straddr);
 
-	if (pending == TRUE && node->deliverable == TRUE) {
+	/* More status reports expected, if all went fine so far */
+	if (sr_node_pending(node) && node->deliverable == TRUE) {
 		/*
 		 * More status reports expected, and already received
 		 * reports completed. Update backup file.
@@ -3119,29 +3356,70 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	return TRUE;
 }
 
-void status_report_assembly_add_fragment(
+/* Takes the report for @mr to @to out of the early reports, if there is one */
+static struct sr_early_report *sr_take_early_report(
+					struct status_report_assembly *assembly,
+					const char *straddr, unsigned char mr)
+{
+	time_t now = time(NULL);
+	GList *l;
+	GList *next;
+
+	for (l = assembly->early_reports->head; l; l = next) {
+		struct sr_early_report *report = l->data;
+
+		next = l->next;
+
+		if (report->received + SR_EARLY_REPORT_TIMEOUT < now) {
+			sr_early_report_free(report);
+			g_queue_delete_link(assembly->early_reports, l);
+			continue;
+		}
+
+		if (report->mr != mr)
+			continue;
+
+		if (strcmp(report->addr, straddr) &&
+				!sr_address_fuzzy_match(straddr, report->addr))
+			continue;
+
+		g_queue_delete_link(assembly->early_reports, l);
+		return report;
+	}
+
+	return NULL;
+}
+
+/*
+ * Records that fragment @mr of @msgid was sent.  Fragments may be added in
+ * any order, and a status report for @mr may already have come in, in which
+ * case this can complete the message: TRUE is returned and @out_delivered
+ * tells how it went, as with status_report_assembly_report().
+ */
+gboolean status_report_assembly_add_fragment(
 					struct status_report_assembly *assembly,
 					const unsigned char *msgid,
 					const struct sms_address *to,
 					unsigned char mr, time_t expiration,
-					unsigned char total_mrs)
+					unsigned char total_mrs,
+					gboolean *out_delivered)
 {
 	unsigned int offset = mr / 32;
 	unsigned int bit = 1 << (mr % 32);
+	const char *straddr = sms_address_to_string(to);
 	GHashTable *id_table;
 	struct id_table_node *node;
 	unsigned char *id_table_key;
+	struct sr_early_report *report;
 
-	id_table = g_hash_table_lookup(assembly->assembly_table,
-					sms_address_to_string(to));
+	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
 
 	/* Create hashtable keyed by the to address if required */
 	if (id_table == NULL) {
 		id_table = g_hash_table_new_full(sha1_hash, sha1_equal,
 								g_free, g_free);
 		g_hash_table_insert(assembly->assembly_table,
-					g_strdup(sms_address_to_string(to)),
-					id_table);
+					g_strdup(straddr), id_table);
 	}
 
 	node = g_hash_table_lookup(id_table, msgid);
@@ -3157,11 +3435,42 @@ void status_report_assembly_add_fragment(
 		g_hash_table_insert(id_table, id_table_key, node);
 	}
 
+	/* The same fragment reported twice must not count twice */
+	if (node->mrs[offset] & bit)
+		return FALSE;
+
 	/* id_table and node both exists */
-	node->mrs[offset] |= bit;
 	node->expiration = expiration;
 	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+
+	report = sr_take_early_report(assembly, straddr, mr);
+	if (report == NULL) {
+		node->mrs[offset] |= bit;
+		sr_assembly_add_fragment_backup(assembly->imsi, node, to,
+							msgid);
+		return FALSE;
+	}
+
+	node->deliverable = node->deliverable && report->delivered;
+	sr_early_report_free(report);
+
+	if (node->sent_mrs < node->total_mrs ||
+			(sr_node_pending(node) && node->deliverable == TRUE)) {
+		sr_assembly_add_fragment_backup(assembly->imsi, node, to,
+							msgid);
+		return FALSE;
+	}
+
+	if (out_delivered)
+		*out_delivered = node->deliverable;
+
+	sr_assembly_remove_fragment_backup(assembly->imsi, to, msgid);
+	g_hash_table_remove(id_table, msgid);
+
+	if (g_hash_table_size(id_table) == 0)
+		g_hash_table_remove(assembly->assembly_table, straddr);
+
+	return TRUE;
 }
 
 void status_report_assembly_expire(struct status_report_assembly *assembly,
@@ -3228,46 +3537,62 @@ static int sms_tx_load_filter(const struct dirent *dent)
 }
 
 /*
- * Each directory contains a file per pdu.
+ * Each directory contains a file per pdu, which is moved over to the
+ * journal.
  */
-static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
+static void sms_tx_import(struct storage_journal *journal, const char *imsi,
+				const struct dirent *dir)
 {
-	GSList *list = NULL;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	char key[SMS_JOURNAL_KEY_MAX];
+	unsigned long id;
+	unsigned long flags;
 	struct dirent **pdus;
 	char *path;
-	int len, r;
+	char *file;
+	int len, i;
 	unsigned char buf[177];
-	struct sms s;
+	char endc;
 
 	if (dir->d_type != DT_DIR)
-		return NULL;
+		return;
+
+	if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
+				&id, &flags, uuid, &endc) != 3)
+		return;
+
+	if (strlen(uuid) != 2 * SMS_MSGID_LEN)
+		return;
 
 	path = g_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
 	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	g_free(path);
 
 	if (len < 0)
-		return NULL;
+		goto done;
 
-	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
-
-		if (r < 0)
-			goto free_pdu;
+	for (i = 0; i < len; i++) {
+		unsigned char seq = strtol(pdus[i]->d_name, NULL, 10);
+		ssize_t size;
 
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
+		file = g_strdup_printf("%s/%s", path, pdus[i]->d_name);
+		size = read_file(buf, sizeof(buf), "%s", file);
 
-		list = g_slist_prepend(list, g_memdup2(&s, sizeof(s)));
+		if (size > 0) {
+			snprintf(key, sizeof(key), SMS_JOURNAL_TX_KEY,
+					uuid, flags, seq);
+			storage_journal_put(journal, key, buf, size);
+		}
 
-free_pdu:
-		g_free(pdus[len]);
+		unlink(file);
+		g_free(file);
+		g_free(pdus[i]);
 	}
 
 	g_free(pdus);
 
-	return list;
+	rmdir(path);
+done:
+	g_free(path);
 }
 
 static int sms_tx_queue_filter(const struct dirent *dirent)
@@ -3281,157 +3606,159 @@ static int sms_tx_queue_filter(const struct dirent *dirent)
 	return 1;
 }
 
+struct tx_queue_load_data {
+	GQueue *queue;
+	GHashTable *entries;
+};
+
+static void sms_tx_load_record(const char *key, const unsigned char *data,
+				size_t len, void *user_data)
+{
+	struct tx_queue_load_data *load = user_data;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	struct txq_backup_entry *entry;
+	unsigned long flags;
+	guint8 seq;
+	struct sms s;
+
+	if (sscanf(key, SMS_JOURNAL_TX SMS_MSGID_FMT "-%lu/%hhu",
+				uuid, &flags, &seq) != 3)
+		return;
+
+	if (strlen(uuid) != 2 * SMS_MSGID_LEN)
+		return;
+
+	if (sms_deserialize_outgoing(data, &s, len) == FALSE)
+		return;
+
+	entry = g_hash_table_lookup(load->entries, uuid);
+	if (entry == NULL) {
+		entry = g_new0(struct txq_backup_entry, 1);
+		entry->flags = flags;
+		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
+
+		g_hash_table_insert(load->entries, g_strdup(uuid), entry);
+		g_queue_push_tail(load->queue, entry);
+	}
+
+	entry->msg_list = g_slist_prepend(entry->msg_list,
+						g_memdup2(&s, sizeof(s)));
+}
+
 /*
  * populate the queue with tx_backup_entry from stored backup
  * data.
  */
 GQueue *sms_tx_queue_load(const char *imsi)
 {
-	GQueue *retq = 0;
+	struct storage_journal *journal;
+	struct tx_queue_load_data load;
 	char *path;
 	struct dirent **entries;
+	GList *l;
 	int len;
 	int i;
-	unsigned long id;
 
 	if (imsi == NULL)
 		return NULL;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+	journal = storage_journal_open(imsi, SMS_JOURNAL_STORE);
 
+	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
 	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
-	if (len < 0)
-		goto nodir_exit;
-
-	retq = g_queue_new();
-
-	for (i = 0, id = 0; i < len; i++) {
-		char uuid[SMS_MSGID_LEN * 2 + 1];
-		GSList *msg_list;
-		unsigned long oldid;
-		unsigned long flags;
-		char *oldpath, *newpath;
-		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
-		char endc;
-
-		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
-					&oldid, &flags, uuid, &endc) != 3)
-			continue;
-
-		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
 
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
-			continue;
+	if (len >= 0) {
+		for (i = 0; i < len; i++) {
+			sms_tx_import(journal, imsi, entries[i]);
+			g_free(entries[i]);
+		}
 
-		entry = g_new0(struct txq_backup_entry, 1);
-		entry->msg_list = msg_list;
-		entry->flags = flags;
-		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
+		g_free(entries);
+		rmdir(path);
+	}
 
-		g_queue_push_tail(retq, entry);
+	g_free(path);
 
-		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
-			continue;
-		}
+	/* Records of a message are stored together and in order */
+	load.queue = g_queue_new();
+	load.entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, NULL);
 
-		oldpath = g_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
+	storage_journal_foreach(journal, SMS_JOURNAL_TX,
+					sms_tx_load_record, &load);
 
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
+	for (l = load.queue->head; l; l = l->next) {
+		struct txq_backup_entry *entry = l->data;
 
-		g_free(newpath);
-		g_free(oldpath);
+		entry->msg_list = g_slist_reverse(entry->msg_list);
 	}
 
-	for (i = 0; i < len; i++)
-		g_free(entries[i]);
-
-	g_free(entries);
+	g_hash_table_destroy(load.entries);
+	storage_journal_close(journal);
 
-nodir_exit:
-	g_free(path);
-	return retq;
+	return load.queue;
 }
 
+/*
+ * The position in the queue is kept by the journal, so the id is no
+ * longer part of the stored key.
+ */
 gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq, const unsigned char *pdu,
 				int pdu_len, int tpdu_len)
 {
+	struct storage_journal *journal;
+	char key[SMS_JOURNAL_KEY_MAX];
 	unsigned char buf[177];
-	int len;
+	gboolean ret;
 
 	if (!imsi)
 		return FALSE;
 
 	memcpy(buf + 1, pdu, pdu_len);
 	buf[0] = tpdu_len;
-	len = pdu_len + 1;
 
-	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
-	 */
-	if (write_file(buf, len, SMS_BACKUP_MODE, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
-		return FALSE;
+	snprintf(key, sizeof(key), SMS_JOURNAL_TX_KEY, uuid, flags, seq);
 
-	return TRUE;
+	journal = storage_journal_open(imsi, SMS_JOURNAL_STORE);
+	ret = storage_journal_put(journal, key, buf, pdu_len + 1);
+	storage_journal_close(journal);
+
+	return ret;
 }
 
 void sms_tx_backup_free(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
-
-	len = scandir(path, &entries, NULL, versionsort);
+	struct storage_journal *journal;
+	char prefix[SMS_JOURNAL_KEY_MAX];
 
-	if (len < 0)
-		goto nodir_exit;
-
-	/* skip '..' and '.' entries */
-	while (len--) {
-		if (len > 1) {
-			struct dirent *dir = entries[len];
-			char *file = g_strdup_printf("%s/%s", path, dir->d_name);
-
-			unlink(file);
-			g_free(file);
-		}
-
-		g_free(entries[len]);
-	}
-
-	g_free(entries);
+	if (!imsi)
+		return;
 
-	rmdir(path);
+	snprintf(prefix, sizeof(prefix), SMS_JOURNAL_TX_ENTRY, uuid, flags);
 
-nodir_exit:
-	g_free(path);
+	journal = storage_journal_open(imsi, SMS_JOURNAL_STORE);
+	storage_journal_remove_prefix(journal, prefix);
+	storage_journal_close(journal);
 }
 
 void sms_tx_backup_remove(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq)
 {
-	char *path;
+	struct storage_journal *journal;
+	char key[SMS_JOURNAL_KEY_MAX];
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
+	if (!imsi)
+		return;
 
-	g_free(path);
+	snprintf(key, sizeof(key), SMS_JOURNAL_TX_KEY, uuid, flags, seq);
+
+	journal = storage_journal_open(imsi, SMS_JOURNAL_STORE);
+	storage_journal_remove(journal, key);
+	storage_journal_close(journal);
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -372,6 +372,9 @@ struct sms_udh_iter {
 	guint8 offset;
 };
 
+/* Default cap on memory held by incomplete concatenated messages */
+#define SMS_ASSEMBLY_DEFAULT_LIMIT (512 * 1024)
+
 struct sms_assembly_node {
 	struct sms_address addr;
 	time_t ts;
@@ -380,11 +383,30 @@ struct sms_assembly_node {
 	guint8 max_fragments;
 	guint8 num_fragments;
 	unsigned int bitmap[8];
+	unsigned int heap_index;
+};
+
+struct sms_assembly_stats {
+	unsigned int completed;
+	unsigned int expired;
+	unsigned int evicted;
+	/* Seconds from first to last fragment of completed messages */
+	unsigned long latency_total;
+	unsigned long latency_max;
 };
 
+struct storage_journal;
+
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	struct storage_journal *journal;
+	/* Incomplete messages, keyed by originator address and reference */
+	GHashTable *assembly_table;
+	/* Same nodes as a min-heap on the time of their first fragment */
+	GPtrArray *expiry_heap;
+	size_t pending_bytes;
+	size_t limit;
+	struct sms_assembly_stats stats;
 };
 
 struct id_table_node {
@@ -398,6 +420,8 @@ struct id_table_node {
 struct status_report_assembly {
 	const char *imsi;
 	GHashTable *assembly_table;
+	/* Reports that came in before the submit of their fragment ended */
+	GQueue *early_reports;
 };
 
 struct cbs {
@@ -531,6 +555,7 @@ GSList *sms_assembly_add_fragment(struct sms_assembly *assembly,
 					const struct sms_address *addr,
 					guint16 ref, guint8 max, guint8 seq);
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before);
+void sms_assembly_set_limit(struct sms_assembly *assembly, size_t limit);
 gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr);
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi);
@@ -539,11 +564,13 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 					const struct sms *status_report,
 					unsigned char *out_msgid,
 					gboolean *msg_delivered);
-void status_report_assembly_add_fragment(struct status_report_assembly
-					*assembly, const unsigned char *msgid,
+gboolean status_report_assembly_add_fragment(
+					struct status_report_assembly *assembly,
+					const unsigned char *msgid,
 					const struct sms_address *to,
 					unsigned char mr, time_t expiration,
-					unsigned char total_mrs);
+					unsigned char total_mrs,
+					gboolean *out_delivered);
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before);
 
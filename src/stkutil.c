@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -41,6 +42,7 @@ enum stk_data_object_flag {
 	DATAOBJ_FLAG_MINIMUM =		2,
 	DATAOBJ_FLAG_CR =		4,
 	DATAOBJ_FLAG_LIST =		8,
+	DATAOBJ_FLAG_LOCAL =		16,
 };
 
 struct stk_file_iter {
@@ -2292,61 +2294,52 @@ static dataobj_handler list_handler_for_type(enum stk_data_object_type type)
 	}
 }
 
-struct dataobj_handler_entry {
+/*
+ * Each command declares the data objects it expects, in the order they have
+ * to appear, in a table terminated by STK_DATA_OBJECT_TYPE_INVALID.  The
+ * destination is an offset into struct stk_command or, for objects flagged
+ * DATAOBJ_FLAG_LOCAL, into a structure of the parser's own.
+ */
+struct dataobj_spec {
 	enum stk_data_object_type type;
-	int flags;
-	void *data;
+	unsigned short flags;
+	unsigned short offset;
 };
 
-static enum stk_command_parse_result parse_dataobj(
+#define DATAOBJ(type, flags, member)					\
+	{ type, flags, offsetof(struct stk_command, member) }
+
+#define DATAOBJ_LOCAL(type, flags, locals, member)			\
+	{ type, (flags) | DATAOBJ_FLAG_LOCAL, offsetof(locals, member) }
+
+static enum stk_command_parse_result parse_dataobj_locals(
 					struct comprehension_tlv_iter *iter,
-					enum stk_data_object_type type, ...)
+					struct stk_command *command,
+					void *locals,
+					const struct dataobj_spec *spec)
 {
-	GSList *entries = NULL;
-	GSList *l;
-	va_list args;
-	bool minimum_set = true;
 	bool parse_error = false;
 
-	va_start(args, type);
-
-	while (type != STK_DATA_OBJECT_TYPE_INVALID) {
-		struct dataobj_handler_entry *entry;
-
-		entry = g_new0(struct dataobj_handler_entry, 1);
-
-		entry->type = type;
-		entry->flags = va_arg(args, int);
-		entry->data = va_arg(args, void *);
-
-		type = va_arg(args, int);
-		entries = g_slist_prepend(entries, entry);
-	}
-
-	va_end(args);
-
-	entries = g_slist_reverse(entries);
-
-	l = entries;
 	while (comprehension_tlv_iter_next(iter) == TRUE) {
+		unsigned short tag = comprehension_tlv_iter_get_tag(iter);
+		const struct dataobj_spec *entry;
 		dataobj_handler handler;
-		struct dataobj_handler_entry *entry;
-		GSList *l2;
-
-		for (l2 = l; l2; l2 = l2->next) {
-			entry = l2->data;
+		void *data;
 
-			if (comprehension_tlv_iter_get_tag(iter) == entry->type)
+		for (entry = spec; entry->type != STK_DATA_OBJECT_TYPE_INVALID;
+								entry++) {
+			if (tag == entry->type)
 				break;
 
 			/* Can't skip over mandatory objects */
 			if (entry->flags & DATAOBJ_FLAG_MANDATORY) {
-				l2 = NULL;
+				entry = NULL;
 				break;
 			}
 		}
 
-		if (l2 == NULL) {
+		if (entry == NULL ||
+				entry->type == STK_DATA_OBJECT_TYPE_INVALID) {
 			if (comprehension_tlv_get_cr(iter) == TRUE)
 				parse_error = true;
 
@@ -2358,34 +2351,54 @@ static enum stk_command_parse_result parse_dataobj(
 		else
 			handler = handler_for_type(entry->type);
 
-		if (!handler(iter, entry->data))
+		if (entry->flags & DATAOBJ_FLAG_LOCAL)
+			data = (uint8_t *) locals + entry->offset;
+		else
+			data = (uint8_t *) command + entry->offset;
+
+		if (!handler(iter, data))
 			parse_error = true;
 
-		l = l2->next;
+		spec = entry + 1;
 	}
 
-	for (; l; l = l->next) {
-		struct dataobj_handler_entry *entry = l->data;
-
-		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
-			minimum_set = false;
+	for (; spec->type != STK_DATA_OBJECT_TYPE_INVALID; spec++) {
+		if (spec->flags & DATAOBJ_FLAG_MANDATORY)
+			return STK_PARSE_RESULT_MISSING_VALUE;
 	}
 
-	g_slist_free_full(entries, g_free);
-
-	if (!minimum_set)
-		return STK_PARSE_RESULT_MISSING_VALUE;
 	if (parse_error)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	return STK_PARSE_RESULT_OK;
 }
 
+static enum stk_command_parse_result parse_dataobj(
+					struct comprehension_tlv_iter *iter,
+					struct stk_command *command,
+					const struct dataobj_spec *spec)
+{
+	return parse_dataobj_locals(iter, command, NULL, spec);
+}
+
 static void destroy_display_text(struct stk_command *command)
 {
 	l_free(command->display_text.text);
 }
 
+static const struct dataobj_spec display_text_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			display_text.text),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, display_text.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+			display_text.immediate_response),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DURATION, 0, display_text.duration),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, display_text.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, display_text.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_display_text(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2401,20 +2414,7 @@ static enum stk_command_parse_result parse_display_text(
 
 	command->destructor = destroy_display_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->immediate_response,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, display_text_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2426,6 +2426,17 @@ static void destroy_get_inkey(struct stk_command *command)
 	l_free(command->get_inkey.text);
 }
 
+static const struct dataobj_spec get_inkey_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			get_inkey.text),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, get_inkey.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DURATION, 0, get_inkey.duration),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, get_inkey.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, get_inkey.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_get_inkey(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2441,18 +2452,7 @@ static enum stk_command_parse_result parse_get_inkey(
 
 	command->destructor = destroy_get_inkey;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, get_inkey_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2465,6 +2465,20 @@ static void destroy_get_input(struct stk_command *command)
 	l_free(command->get_input.default_text);
 }
 
+static const struct dataobj_spec get_input_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			get_input.text),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			get_input.resp_len),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0, get_input.default_text),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, get_input.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, get_input.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, get_input.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_get_input(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2480,21 +2494,7 @@ static enum stk_command_parse_result parse_get_input(
 
 	command->destructor = destroy_get_input;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->resp_len,
-				STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
-				&obj->default_text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, get_input_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -2519,6 +2519,16 @@ static void destroy_play_tone(struct stk_command *command)
 	l_free(command->play_tone.alpha_id);
 }
 
+static const struct dataobj_spec play_tone_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, play_tone.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TONE, 0, play_tone.tone),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DURATION, 0, play_tone.duration),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, play_tone.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, play_tone.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, play_tone.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_play_tone(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2534,41 +2544,31 @@ static enum stk_command_parse_result parse_play_tone(
 
 	command->destructor = destroy_play_tone;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_TONE, 0,
-				&obj->tone,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, play_tone_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec poll_interval_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DURATION,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			poll_interval.duration),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_poll_interval(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_poll_interval *obj = &command->poll_interval;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_DURATION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, poll_interval_objs);
 }
 
 static void destroy_setup_menu(struct stk_command *command)
@@ -2577,6 +2577,25 @@ static void destroy_setup_menu(struct stk_command *command)
 	l_queue_destroy(command->setup_menu.items, destroy_stk_item);
 }
 
+static const struct dataobj_spec setup_menu_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			setup_menu.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+			setup_menu.items),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+			setup_menu.next_act),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, setup_menu.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+			setup_menu.item_icon_id_list),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, setup_menu.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+			setup_menu.item_text_attr_list),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_setup_menu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2592,24 +2611,7 @@ static enum stk_command_parse_result parse_setup_menu(
 
 	command->destructor = destroy_setup_menu;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_menu_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -2622,6 +2624,25 @@ static void destroy_select_item(struct stk_command *command)
 	l_queue_destroy(command->select_item.items, destroy_stk_item);
 }
 
+static const struct dataobj_spec select_item_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, select_item.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+			select_item.items),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+			select_item.next_act),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM_ID, 0, select_item.item_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, select_item.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+			select_item.item_icon_id_list),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, select_item.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+			select_item.item_text_attr_list),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, select_item.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_select_item(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2635,27 +2656,7 @@ static enum stk_command_parse_result parse_select_item(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
-			&obj->item_id,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-			&obj->frame_id,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, select_item_objs);
 
 	command->destructor = destroy_select_item;
 
@@ -2673,14 +2674,32 @@ static void destroy_send_sms(struct stk_command *command)
 	l_free(command->send_sms.cdma_sms.array);
 }
 
+/* Objects SEND SMS needs to look at before filling in the command */
+struct send_sms_locals {
+	struct stk_address sc_address;
+	struct gsm_sms_tpdu gsm_tpdu;
+};
+
+static const struct dataobj_spec send_sms_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, send_sms.alpha_id),
+	DATAOBJ_LOCAL(STK_DATA_OBJECT_TYPE_ADDRESS, 0,
+			struct send_sms_locals, sc_address),
+	DATAOBJ_LOCAL(STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
+			struct send_sms_locals, gsm_tpdu),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0, send_sms.cdma_sms),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, send_sms.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, send_sms.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, send_sms.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_send_sms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_send_sms *obj = &command->send_sms;
 	enum stk_command_parse_result status;
-	struct gsm_sms_tpdu gsm_tpdu;
-	struct stk_address sc_address = { 0, NULL };
+	struct send_sms_locals locals;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2688,22 +2707,8 @@ static enum stk_command_parse_result parse_send_sms(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	memset(&gsm_tpdu, 0, sizeof(gsm_tpdu));
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ADDRESS, 0,
-				&sc_address,
-				STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
-				&gsm_tpdu,
-				STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
-				&obj->cdma_sms,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	memset(&locals, 0, sizeof(locals));
+	status = parse_dataobj_locals(iter, command, &locals, send_sms_objs);
 
 	command->destructor = destroy_send_sms;
 
@@ -2715,12 +2720,12 @@ static enum stk_command_parse_result parse_send_sms(
 	if (status != STK_PARSE_RESULT_OK)
 		goto out;
 
-	if (gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
+	if (locals.gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	if (gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
+	if (locals.gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2731,7 +2736,8 @@ static enum stk_command_parse_result parse_send_sms(
 
 	/* packing is needed */
 	if (command->qualifier & 0x01) {
-		if (!sms_decode_unpacked_stk_pdu(gsm_tpdu.tpdu, gsm_tpdu.len,
+		if (!sms_decode_unpacked_stk_pdu(locals.gsm_tpdu.tpdu,
+							locals.gsm_tpdu.len,
 							&obj->gsm_sms)) {
 			status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 			goto out;
@@ -2740,8 +2746,8 @@ static enum stk_command_parse_result parse_send_sms(
 		goto set_addr;
 	}
 
-	if (sms_decode(gsm_tpdu.tpdu, gsm_tpdu.len, TRUE,
-				gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
+	if (sms_decode(locals.gsm_tpdu.tpdu, locals.gsm_tpdu.len, TRUE,
+				locals.gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2753,20 +2759,21 @@ static enum stk_command_parse_result parse_send_sms(
 	}
 
 set_addr:
-	if (sc_address.number == NULL)
+	if (locals.sc_address.number == NULL)
 		goto out;
 
-	if (strlen(sc_address.number) > 20) {
+	if (strlen(locals.sc_address.number) > 20) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	strcpy(obj->gsm_sms.sc_addr.address, sc_address.number);
-	obj->gsm_sms.sc_addr.numbering_plan = sc_address.ton_npi & 15;
-	obj->gsm_sms.sc_addr.number_type = (sc_address.ton_npi >> 4) & 7;
+	strcpy(obj->gsm_sms.sc_addr.address, locals.sc_address.number);
+	obj->gsm_sms.sc_addr.numbering_plan = locals.sc_address.ton_npi & 15;
+	obj->gsm_sms.sc_addr.number_type =
+				(locals.sc_address.ton_npi >> 4) & 7;
 
 out:
-	l_free(sc_address.number);
+	l_free(locals.sc_address.number);
 
 	return status;
 }
@@ -2777,11 +2784,20 @@ static void destroy_send_ss(struct stk_command *command)
 	l_free(command->send_ss.ss.ss);
 }
 
+static const struct dataobj_spec send_ss_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, send_ss.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_SS_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			send_ss.ss),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, send_ss.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, send_ss.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, send_ss.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ss *obj = &command->send_ss;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -2790,18 +2806,7 @@ static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 
 	command->destructor = destroy_send_ss;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_SS_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ss,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, send_ss_objs);
 }
 
 static void destroy_send_ussd(struct stk_command *command)
@@ -2809,12 +2814,21 @@ static void destroy_send_ussd(struct stk_command *command)
 	l_free(command->send_ussd.alpha_id);
 }
 
+static const struct dataobj_spec send_ussd_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, send_ussd.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_USSD_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			send_ussd.ussd_string),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, send_ussd.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, send_ussd.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, send_ussd.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_send_ussd(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_send_ussd *obj = &command->send_ussd;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -2823,18 +2837,7 @@ static enum stk_command_parse_result parse_send_ussd(
 
 	command->destructor = destroy_send_ussd;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_USSD_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ussd_string,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, send_ussd_objs);
 }
 
 static void destroy_setup_call(struct stk_command *command)
@@ -2844,6 +2847,26 @@ static void destroy_setup_call(struct stk_command *command)
 	l_free(command->setup_call.alpha_id_call_setup);
 }
 
+static const struct dataobj_spec setup_call_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, setup_call.alpha_id_usr_cfm),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ADDRESS,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			setup_call.addr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_CCP, 0, setup_call.ccp),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_SUBADDRESS, 0, setup_call.subaddr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DURATION, 0, setup_call.duration),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, setup_call.icon_id_usr_cfm),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+			setup_call.alpha_id_call_setup),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, setup_call.icon_id_call_setup),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			setup_call.text_attr_usr_cfm),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			setup_call.text_attr_call_setup),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, setup_call.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_setup_call(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2859,30 +2882,7 @@ static enum stk_command_parse_result parse_setup_call(
 
 	command->destructor = destroy_setup_call;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ADDRESS,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->addr,
-				STK_DATA_OBJECT_TYPE_CCP, 0,
-				&obj->ccp,
-				STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
-				&obj->subaddr,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_call_setup,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_call_setup,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_usr_cfm,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_call_setup,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_call_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id_usr_cfm, obj->icon_id_usr_cfm.id);
 	CHECK_TEXT_AND_ICON(obj->alpha_id_call_setup,
@@ -2897,6 +2897,16 @@ static void destroy_refresh(struct stk_command *command)
 	l_free(command->refresh.alpha_id);
 }
 
+static const struct dataobj_spec refresh_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FILE_LIST, 0, refresh.file_list),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_AID, 0, refresh.aid),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, refresh.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, refresh.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, refresh.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, refresh.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_refresh(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2912,19 +2922,7 @@ static enum stk_command_parse_result parse_refresh(
 
 	command->destructor = destroy_refresh;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
-				&obj->file_list,
-				STK_DATA_OBJECT_TYPE_AID, 0,
-				&obj->aid,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, refresh_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -2957,30 +2955,37 @@ static enum stk_command_parse_result parse_provide_local_info(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec setup_event_list_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_EVENT_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			setup_event_list.event_list),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_setup_event_list(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_setup_event_list *obj = &command->setup_event_list;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_EVENT_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->event_list,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, setup_event_list_objs);
 }
 
+static const struct dataobj_spec perform_card_apdu_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_C_APDU,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			perform_card_apdu.c_apdu),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_perform_card_apdu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_perform_card_apdu *obj = &command->perform_card_apdu;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -2988,10 +2993,7 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CARD_READER_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_C_APDU,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->c_apdu,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, perform_card_apdu_objs);
 }
 
 static enum stk_command_parse_result parse_power_off_card(
@@ -3047,13 +3049,27 @@ static enum stk_command_parse_result parse_get_reader_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_spec timer_start_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TIMER_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			timer_mgmt.timer_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TIMER_VALUE, DATAOBJ_FLAG_MANDATORY,
+			timer_mgmt.timer_value),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
+static const struct dataobj_spec timer_mgmt_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TIMER_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			timer_mgmt.timer_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TIMER_VALUE, 0, timer_mgmt.timer_value),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_timer_mgmt(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_timer_mgmt *obj = &command->timer_mgmt;
-	enum stk_data_object_flag value_flags = 0;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3061,14 +3077,9 @@ static enum stk_command_parse_result parse_timer_mgmt(
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if ((command->qualifier & 3) == 0) /* Start a timer */
-		value_flags = DATAOBJ_FLAG_MANDATORY;
+		return parse_dataobj(iter, command, timer_start_objs);
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TIMER_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->timer_id,
-				STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
-				&obj->timer_value,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, timer_mgmt_objs);
 }
 
 static void destroy_setup_idle_mode_text(struct stk_command *command)
@@ -3076,6 +3087,18 @@ static void destroy_setup_idle_mode_text(struct stk_command *command)
 	l_free(command->setup_idle_mode_text.text);
 }
 
+static const struct dataobj_spec setup_idle_mode_text_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			setup_idle_mode_text.text),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, setup_idle_mode_text.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			setup_idle_mode_text.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+			setup_idle_mode_text.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_setup_idle_mode_text(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3092,16 +3115,7 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 
 	command->destructor = destroy_setup_idle_mode_text;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, setup_idle_mode_text_objs);
 
 	CHECK_TEXT_AND_ICON(obj->text, obj->icon_id.id);
 
@@ -3114,6 +3128,18 @@ static void destroy_run_at_command(struct stk_command *command)
 	l_free(command->run_at_command.at_command);
 }
 
+static const struct dataobj_spec run_at_command_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, run_at_command.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_AT_COMMAND,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			run_at_command.at_command),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, run_at_command.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			run_at_command.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, run_at_command.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_run_at_command(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3129,18 +3155,7 @@ static enum stk_command_parse_result parse_run_at_command(
 
 	command->destructor = destroy_run_at_command;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_AT_COMMAND,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->at_command,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, run_at_command_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3153,6 +3168,17 @@ static void destroy_send_dtmf(struct stk_command *command)
 	l_free(command->send_dtmf.dtmf);
 }
 
+static const struct dataobj_spec send_dtmf_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, send_dtmf.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DTMF_STRING,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			send_dtmf.dtmf),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, send_dtmf.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, send_dtmf.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, send_dtmf.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_send_dtmf(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3168,40 +3194,30 @@ static enum stk_command_parse_result parse_send_dtmf(
 
 	command->destructor = destroy_send_dtmf;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_DTMF_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->dtmf,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, send_dtmf_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
 	return status;
 }
 
+static const struct dataobj_spec language_notification_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
+			language_notification.language),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_language_notification(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_language_notification *obj =
-					&command->language_notification;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
-				&obj->language,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, language_notification_objs);
 }
 
 static void destroy_launch_browser(struct stk_command *command)
@@ -3216,12 +3232,32 @@ static void destroy_launch_browser(struct stk_command *command)
 	l_free(command->launch_browser.text_passwd);
 }
 
+static const struct dataobj_spec launch_browser_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_BROWSER_ID, 0, launch_browser.browser_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_URL,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			launch_browser.url),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_BEARER, 0, launch_browser.bearer),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF, DATAOBJ_FLAG_LIST,
+			launch_browser.prov_file_refs),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT, 0,
+			launch_browser.text_gateway_proxy_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, launch_browser.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, launch_browser.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			launch_browser.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, launch_browser.frame_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
+			launch_browser.network_name),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT, 0, launch_browser.text_usr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT, 0, launch_browser.text_passwd),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_launch_browser(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_launch_browser *obj = &command->launch_browser;
-
 	if (command->qualifier > 3 || command->qualifier == 1)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3233,34 +3269,7 @@ static enum stk_command_parse_result parse_launch_browser(
 
 	command->destructor = destroy_launch_browser;
 
-	return parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
-				&obj->browser_id,
-				STK_DATA_OBJECT_TYPE_URL,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->url,
-				STK_DATA_OBJECT_TYPE_BEARER, 0,
-				&obj->bearer,
-				STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF,
-				DATAOBJ_FLAG_LIST,
-				&obj->prov_file_refs,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_gateway_proxy_id,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->network_name,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, launch_browser_objs);
 }
 
 static void destroy_open_channel(struct stk_command *command)
@@ -3271,6 +3280,27 @@ static void destroy_open_channel(struct stk_command *command)
 	l_free(command->open_channel.text_passwd);
 }
 
+static const struct dataobj_spec open_channel_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, open_channel.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, open_channel.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			open_channel.bearer_desc),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			open_channel.buf_size),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0, open_channel.apn),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0, open_channel.local_addr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT, 0, open_channel.text_usr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT, 0, open_channel.text_passwd),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0, open_channel.uti),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
+			open_channel.data_dest_addr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, open_channel.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, open_channel.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_open_channel(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3293,34 +3323,7 @@ static enum stk_command_parse_result parse_open_channel(
 	 * parse the Open Channel data objects related to packet data service
 	 * bearer
 	 */
-	status = parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->bearer_desc,
-				STK_DATA_OBJECT_TYPE_BUFFER_SIZE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->buf_size,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->apn,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->local_addr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->uti,
-				STK_DATA_OBJECT_TYPE_OTHER_ADDRESS, 0,
-				&obj->data_dest_addr,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, open_channel_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3332,6 +3335,15 @@ static void destroy_close_channel(struct stk_command *command)
 	l_free(command->close_channel.alpha_id);
 }
 
+static const struct dataobj_spec close_channel_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, close_channel.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, close_channel.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			close_channel.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, close_channel.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_close_channel(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3348,15 +3360,7 @@ static enum stk_command_parse_result parse_close_channel(
 
 	command->destructor = destroy_close_channel;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, close_channel_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3368,6 +3372,17 @@ static void destroy_receive_data(struct stk_command *command)
 	l_free(command->receive_data.alpha_id);
 }
 
+static const struct dataobj_spec receive_data_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, receive_data.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, receive_data.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			receive_data.data_len),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, receive_data.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, receive_data.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_receive_data(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3384,18 +3399,7 @@ static enum stk_command_parse_result parse_receive_data(
 
 	command->destructor = destroy_receive_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data_len,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, receive_data_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3408,6 +3412,17 @@ static void destroy_send_data(struct stk_command *command)
 	l_free(command->send_data.data.array);
 }
 
+static const struct dataobj_spec send_data_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, send_data.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, send_data.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			send_data.data),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, send_data.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, send_data.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_send_data(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3427,18 +3442,7 @@ static enum stk_command_parse_result parse_send_data(
 
 	command->destructor = destroy_send_data;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, send_data_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3465,12 +3469,24 @@ static void destroy_service_search(struct stk_command *command)
 	l_free(command->service_search.dev_filter.dev_filter);
 }
 
+static const struct dataobj_spec service_search_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, service_search.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, service_search.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			service_search.serv_search),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
+			service_search.dev_filter),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			service_search.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, service_search.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_service_search(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_service_search *obj = &command->service_search;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3479,20 +3495,7 @@ static enum stk_command_parse_result parse_service_search(
 
 	command->destructor = destroy_service_search;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_search,
-				STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
-				&obj->dev_filter,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, service_search_objs);
 }
 
 static void destroy_get_service_info(struct stk_command *command)
@@ -3501,12 +3504,22 @@ static void destroy_get_service_info(struct stk_command *command)
 	l_free(command->get_service_info.attr_info.attr_info);
 }
 
+static const struct dataobj_spec get_service_info_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, get_service_info.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, get_service_info.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			get_service_info.attr_info),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+			get_service_info.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, get_service_info.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_get_service_info(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_get_service_info *obj = &command->get_service_info;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3515,18 +3528,7 @@ static enum stk_command_parse_result parse_get_service_info(
 
 	command->destructor = destroy_get_service_info;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->attr_info,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, get_service_info_objs);
 }
 
 static void destroy_declare_service(struct stk_command *command)
@@ -3534,12 +3536,19 @@ static void destroy_declare_service(struct stk_command *command)
 	l_free(command->declare_service.serv_rec.serv_rec);
 }
 
+static const struct dataobj_spec declare_service_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			declare_service.serv_rec),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
+			declare_service.intf),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_declare_service(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_declare_service *obj = &command->declare_service;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3548,34 +3557,29 @@ static enum stk_command_parse_result parse_declare_service(
 
 	command->destructor = destroy_declare_service;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_rec,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->intf,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, declare_service_objs);
 }
 
+static const struct dataobj_spec set_frames_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			set_frames.frame_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0, set_frames.frame_layout),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, set_frames.frame_id_default),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_set_frames(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_set_frames *obj = &command->set_frames;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FRAME_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
-				&obj->frame_layout,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id_default,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, set_frames_objs);
 }
 
 static enum stk_command_parse_result parse_get_frames_status(
@@ -3597,6 +3601,24 @@ static void destroy_retrieve_mms(struct stk_command *command)
 	l_queue_destroy(command->retrieve_mms.mms_rec_files, l_free);
 }
 
+static const struct dataobj_spec retrieve_mms_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, retrieve_mms.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, retrieve_mms.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			retrieve_mms.mms_ref),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			retrieve_mms.mms_rec_files),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			retrieve_mms.mms_content_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_MMS_ID, 0, retrieve_mms.mms_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, retrieve_mms.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, retrieve_mms.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_retrieve_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3612,26 +3634,7 @@ static enum stk_command_parse_result parse_retrieve_mms(
 
 	command->destructor = destroy_retrieve_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_ref,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_rec_files,
-				STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_content_id,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, retrieve_mms_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3644,6 +3647,18 @@ static void destroy_submit_mms(struct stk_command *command)
 	l_queue_destroy(command->submit_mms.mms_subm_files, l_free);
 }
 
+static const struct dataobj_spec submit_mms_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ALPHA_ID, 0, submit_mms.alpha_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ICON_ID, 0, submit_mms.icon_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			submit_mms.mms_subm_files),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_MMS_ID, 0, submit_mms.mms_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0, submit_mms.text_attr),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, submit_mms.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_submit_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3659,20 +3674,7 @@ static enum stk_command_parse_result parse_submit_mms(
 
 	command->destructor = destroy_submit_mms;
 
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, command, submit_mms_objs);
 
 	CHECK_TEXT_AND_ICON(obj->alpha_id, obj->icon_id.id);
 
@@ -3684,12 +3686,23 @@ static void destroy_display_mms(struct stk_command *command)
 	l_queue_destroy(command->display_mms.mms_subm_files, l_free);
 }
 
+static const struct dataobj_spec display_mms_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FILE_LIST,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			display_mms.mms_subm_files),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_MMS_ID,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			display_mms.mms_id),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+			display_mms.imd_resp),
+	DATAOBJ(STK_DATA_OBJECT_TYPE_FRAME_ID, 0, display_mms.frame_id),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_display_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_display_mms *obj = &command->display_mms;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
@@ -3698,35 +3711,27 @@ static enum stk_command_parse_result parse_display_mms(
 
 	command->destructor = destroy_display_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->imd_resp,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, display_mms_objs);
 }
 
+static const struct dataobj_spec activate_objs[] = {
+	DATAOBJ(STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
+			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+			activate.actv_desc),
+	{ STK_DATA_OBJECT_TYPE_INVALID }
+};
+
 static enum stk_command_parse_result parse_activate(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
-	struct stk_command_activate *obj = &command->activate;
-
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->actv_desc,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, command, activate_objs);
 }
 
 static enum stk_command_parse_result parse_command_body(
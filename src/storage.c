@@ -25,6 +25,7 @@
 
 #include <ofono/storage.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <sys/types.h>
@@ -171,18 +172,93 @@ error_create_dirs:
 	return r;
 }
 
+/*
+ * storage_sync() only marks the file dirty, the keyfile is written out
+ * STORAGE_SYNC_DELAY seconds after the first sync no matter how many more
+ * follow.  Pending files are keyed by path and the last keyfile synced to
+ * a path is the one written, the same as if every sync had rewritten it.
+ */
+#define STORAGE_SYNC_DELAY	2
+
+struct storage_pending {
+	char *path;
+	GKeyFile *keyfile;
+};
+
+static GHashTable *pending_syncs;
+static guint pending_source;
+static struct storage_sync_stats sync_stats;
+
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+
+	return g_strdup_printf(STORAGEDIR "/%s", store);
+}
+
+static void storage_write(const char *path, GKeyFile *keyfile)
+{
+	char *data;
+	gsize length = 0;
+
+	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return;
+
+	data = g_key_file_to_data(keyfile, &length, NULL);
+
+	g_file_set_contents(path, data, length, NULL);
+	sync_stats.writes += 1;
+
+	g_free(data);
+}
+
+static void pending_free(gpointer data)
+{
+	struct storage_pending *pending = data;
+
+	g_free(pending->path);
+	g_free(pending);
+}
+
+static struct storage_pending *pending_lookup(const char *path)
+{
+	if (pending_syncs == NULL)
+		return NULL;
+
+	return g_hash_table_lookup(pending_syncs, path);
+}
+
+/* Writes out the pending keyfile, which is no longer pending afterwards */
+static void pending_write(struct storage_pending *pending)
+{
+	storage_write(pending->path, pending->keyfile);
+	g_hash_table_remove(pending_syncs, pending->path);
+}
+
+static gboolean pending_sync_cb(gpointer user_data)
+{
+	pending_source = 0;
+	storage_flush();
+
+	return FALSE;
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
+	struct storage_pending *pending;
 	GKeyFile *keyfile;
 	char *path;
 
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	path = storage_path(imsi, store);
+
+	/* What is about to be written is what should be read */
+	pending = pending_lookup(path);
+	if (pending)
+		pending_write(pending);
 
 	keyfile = g_key_file_new();
 
@@ -196,36 +272,584 @@ GKeyFile *storage_open(const char *imsi, const char *store)
 
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
+	struct storage_pending *pending;
 	char *path;
-	char *data;
-	gsize length = 0;
-
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
 
+	path = storage_path(imsi, store);
 	if (path == NULL)
 		return;
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
+	sync_stats.syncs += 1;
+
+	if (pending_syncs == NULL)
+		pending_syncs = g_hash_table_new_full(g_str_hash, g_str_equal,
+							NULL, pending_free);
+
+	pending = g_hash_table_lookup(pending_syncs, path);
+	if (pending) {
+		pending->keyfile = keyfile;
+		sync_stats.saved += 1;
 		g_free(path);
 		return;
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
-
-	g_file_set_contents(path, data, length, NULL);
+	pending = g_new0(struct storage_pending, 1);
+	pending->path = path;
+	pending->keyfile = keyfile;
+	g_hash_table_insert(pending_syncs, pending->path, pending);
 
-	g_free(data);
-	g_free(path);
+	if (pending_source == 0)
+		pending_source = g_timeout_add_seconds(STORAGE_SYNC_DELAY,
+							pending_sync_cb, NULL);
 }
 
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save)
 {
-	if (save == TRUE)
-		storage_sync(imsi, store, keyfile);
+	struct storage_pending *pending;
+	char *path;
+
+	path = storage_path(imsi, store);
+	pending = pending_lookup(path);
+
+	if (save == TRUE) {
+		/* Whatever was pending is superseded by this write */
+		if (pending) {
+			g_hash_table_remove(pending_syncs, path);
+			sync_stats.saved += 1;
+		}
 
+		storage_write(path, keyfile);
+	} else if (pending && pending->keyfile == keyfile)
+		pending_write(pending);
+
+	g_free(path);
 	g_key_file_free(keyfile);
 }
+
+/* Writes out every keyfile with syncs pending */
+void storage_flush(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (pending_source) {
+		g_source_remove(pending_source);
+		pending_source = 0;
+	}
+
+	if (pending_syncs == NULL)
+		return;
+
+	g_hash_table_iter_init(&iter, pending_syncs);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct storage_pending *pending = value;
+
+		storage_write(pending->path, pending->keyfile);
+		g_hash_table_iter_remove(&iter);
+	}
+}
+
+void storage_get_sync_stats(struct storage_sync_stats *stats)
+{
+	*stats = sync_stats;
+}
+
+/*
+ * Append-only record journal
+ *
+ * The file starts with JOURNAL_MAGIC followed by a sequence of records:
+ *
+ *	le32 crc32 of everything that follows, up to the end of the record
+ *	u8   operation, one of enum journal_op
+ *	u8   key length
+ *	le16 data length
+ *	key, then data
+ *
+ * Replaying the records in order yields the set of live key / data pairs.
+ * A torn or corrupted record ends the replay and is cut off, along with
+ * everything after it.  Once most of the file is made of superseded
+ * records the live ones are written out to a fresh file that replaces it.
+ */
+
+#define JOURNAL_MAGIC		"OFJ1"
+#define JOURNAL_MAGIC_LEN	4
+#define JOURNAL_HEADER_LEN	8
+#define JOURNAL_MODE		(S_IRUSR | S_IWUSR)
+#define JOURNAL_COMPACT_MIN	(16 * 1024)
+
+enum journal_op {
+	JOURNAL_OP_PUT = 1,
+	JOURNAL_OP_REMOVE = 2,
+	JOURNAL_OP_REMOVE_PREFIX = 3,
+};
+
+struct journal_record {
+	char *key;
+	unsigned char *data;
+	size_t len;
+};
+
+struct storage_journal {
+	int ref_count;
+	char *path;
+	int fd;
+	/* Live records in the order they were first written */
+	GQueue records;
+	/* Key to the GList link in records */
+	GHashTable *index;
+	size_t live_size;
+	size_t file_size;
+	gboolean dirty;
+	guint sync_source;
+};
+
+static GHashTable *journals;
+static uint32_t crc32_table[256];
+
+static uint32_t journal_crc32(const unsigned char *buf, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+
+	if (crc32_table[1] == 0) {
+		uint32_t i, j, c;
+
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+			crc32_table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = crc32_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static size_t journal_record_size(const char *key, size_t len)
+{
+	return JOURNAL_HEADER_LEN + strlen(key) + len;
+}
+
+static unsigned char *journal_encode(enum journal_op op, const char *key,
+					const void *data, size_t len,
+					size_t *out_size)
+{
+	size_t key_len = strlen(key);
+	size_t size = journal_record_size(key, len);
+	unsigned char *buf = g_malloc(size);
+
+	buf[4] = op;
+	buf[5] = key_len;
+	l_put_le16(len, buf + 6);
+	memcpy(buf + JOURNAL_HEADER_LEN, key, key_len);
+
+	if (len)
+		memcpy(buf + JOURNAL_HEADER_LEN + key_len, data, len);
+
+	l_put_le32(journal_crc32(buf + 4, size - 4), buf);
+	*out_size = size;
+
+	return buf;
+}
+
+static void journal_drop(struct storage_journal *journal, GList *link)
+{
+	struct journal_record *record = link->data;
+
+	g_hash_table_remove(journal->index, record->key);
+	g_queue_delete_link(&journal->records, link);
+
+	journal->live_size -= journal_record_size(record->key, record->len);
+	g_free(record);
+}
+
+/* Returns whether the record changed the set of live records */
+static gboolean journal_apply(struct storage_journal *journal,
+				enum journal_op op, const char *key,
+				const void *data, size_t len)
+{
+	struct journal_record *record;
+	size_t key_len = strlen(key);
+	gboolean changed = FALSE;
+	GList *link;
+	GList *next;
+
+	if (op == JOURNAL_OP_REMOVE_PREFIX) {
+		for (link = journal->records.head; link; link = next) {
+			next = link->next;
+			record = link->data;
+
+			if (strncmp(record->key, key, key_len))
+				continue;
+
+			journal_drop(journal, link);
+			changed = TRUE;
+		}
+
+		return changed;
+	}
+
+	link = g_hash_table_lookup(journal->index, key);
+
+	if (op == JOURNAL_OP_REMOVE) {
+		if (link == NULL)
+			return FALSE;
+
+		journal_drop(journal, link);
+		return TRUE;
+	}
+
+	/* Key and data share one allocation with the record itself */
+	record = g_malloc(sizeof(*record) + key_len + 1 + len);
+	record->key = (char *) (record + 1);
+	record->data = (unsigned char *) record->key + key_len + 1;
+	record->len = len;
+	memcpy(record->key, key, key_len + 1);
+	memcpy(record->data, data, len);
+
+	journal->live_size += journal_record_size(key, len);
+
+	/* Replacing a record keeps its original position */
+	if (link) {
+		struct journal_record *old = link->data;
+
+		journal->live_size -= journal_record_size(old->key, old->len);
+		g_hash_table_remove(journal->index, old->key);
+		g_free(old);
+		link->data = record;
+	} else {
+		g_queue_push_tail(&journal->records, record);
+		link = journal->records.tail;
+	}
+
+	g_hash_table_insert(journal->index, record->key, link);
+
+	return TRUE;
+}
+
+static size_t journal_replay(struct storage_journal *journal,
+				const unsigned char *buf, size_t len)
+{
+	size_t pos = JOURNAL_MAGIC_LEN;
+	char key[256];
+
+	if (len < JOURNAL_MAGIC_LEN || memcmp(buf, JOURNAL_MAGIC,
+						JOURNAL_MAGIC_LEN))
+		return 0;
+
+	while (pos + JOURNAL_HEADER_LEN <= len) {
+		const unsigned char *rec = buf + pos;
+		unsigned int op = rec[4];
+		size_t key_len = rec[5];
+		size_t data_len = l_get_le16(rec + 6);
+		size_t size = JOURNAL_HEADER_LEN + key_len + data_len;
+
+		if (pos + size > len)
+			break;
+
+		if (l_get_le32(rec) != journal_crc32(rec + 4, size - 4))
+			break;
+
+		if (op < JOURNAL_OP_PUT || op > JOURNAL_OP_REMOVE_PREFIX)
+			break;
+
+		memcpy(key, rec + JOURNAL_HEADER_LEN, key_len);
+		key[key_len] = '\0';
+
+		journal_apply(journal, op, key,
+				rec + JOURNAL_HEADER_LEN + key_len, data_len);
+		pos += size;
+	}
+
+	return pos;
+}
+
+static gboolean journal_write(int fd, const unsigned char *buf, size_t len)
+{
+	return L_TFR(write(fd, buf, len)) == (ssize_t) len;
+}
+
+/*
+ * Writes the live records out to a new file and atomically puts it in
+ * place of the current one.
+ */
+static void journal_compact(struct storage_journal *journal)
+{
+	char *tmp_path;
+	GList *link;
+	int fd;
+
+	tmp_path = g_strdup_printf("%s.tmp", journal->path);
+
+	fd = L_TFR(open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, JOURNAL_MODE));
+	if (fd < 0)
+		goto done;
+
+	if (!journal_write(fd, (const unsigned char *) JOURNAL_MAGIC,
+				JOURNAL_MAGIC_LEN))
+		goto error;
+
+	for (link = journal->records.head; link; link = link->next) {
+		struct journal_record *record = link->data;
+		unsigned char *buf;
+		size_t size;
+		gboolean ok;
+
+		buf = journal_encode(JOURNAL_OP_PUT, record->key,
+					record->data, record->len, &size);
+		ok = journal_write(fd, buf, size);
+		g_free(buf);
+
+		if (!ok)
+			goto error;
+	}
+
+	if (fdatasync(fd) < 0 || rename(tmp_path, journal->path) < 0)
+		goto error;
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	journal->fd = L_TFR(open(journal->path, O_WRONLY | O_APPEND));
+	journal->file_size = JOURNAL_MAGIC_LEN + journal->live_size;
+	journal->dirty = FALSE;
+
+	L_TFR(close(fd));
+	goto done;
+
+error:
+	L_TFR(close(fd));
+	unlink(tmp_path);
+done:
+	g_free(tmp_path);
+}
+
+static gboolean journal_sync_cb(gpointer user_data)
+{
+	struct storage_journal *journal = user_data;
+
+	journal->sync_source = 0;
+	storage_journal_sync(journal);
+
+	return FALSE;
+}
+
+static gboolean journal_append(struct storage_journal *journal,
+				enum journal_op op, const char *key,
+				const void *data, size_t len)
+{
+	unsigned char *buf;
+	size_t size;
+	gboolean ok;
+
+	if (strlen(key) > 255 || len > 65535)
+		return FALSE;
+
+	if (!journal_apply(journal, op, key, data, len))
+		return TRUE;
+
+	if (journal->fd < 0)
+		return FALSE;
+
+	buf = journal_encode(op, key, data, len, &size);
+	ok = journal_write(journal->fd, buf, size);
+	g_free(buf);
+
+	/* Don't leave a torn record for later ones to hide behind */
+	if (!ok) {
+		if (ftruncate(journal->fd, journal->file_size) < 0) {
+			L_TFR(close(journal->fd));
+			journal->fd = -1;
+		}
+
+		return FALSE;
+	}
+
+	journal->file_size += size;
+	journal->dirty = TRUE;
+
+	/* Everything written until the main loop idles shares one sync */
+	if (journal->sync_source == 0)
+		journal->sync_source = g_idle_add(journal_sync_cb, journal);
+
+	return TRUE;
+}
+
+/*
+ * Opens the journal named @store under the storage directory of @imsi and
+ * replays it.  A journal that is already open is shared, with each open
+ * to be matched by a storage_journal_close().
+ */
+struct storage_journal *storage_journal_open(const char *imsi,
+						const char *store)
+{
+	struct storage_journal *journal;
+	gchar *contents = NULL;
+	gsize len = 0;
+	size_t valid;
+	char *path;
+
+	path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+
+	if (journals == NULL)
+		journals = g_hash_table_new(g_str_hash, g_str_equal);
+
+	journal = g_hash_table_lookup(journals, path);
+	if (journal) {
+		g_free(path);
+		journal->ref_count += 1;
+		return journal;
+	}
+
+	journal = g_new0(struct storage_journal, 1);
+	journal->ref_count = 1;
+	journal->path = path;
+	journal->fd = -1;
+	journal->index = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&journal->records);
+
+	g_hash_table_insert(journals, journal->path, journal);
+
+	if (create_dirs(path, JOURNAL_MODE | S_IXUSR) != 0)
+		return journal;
+
+	g_file_get_contents(path, &contents, &len, NULL);
+	valid = journal_replay(journal, (unsigned char *) contents, len);
+	g_free(contents);
+
+	journal->fd = L_TFR(open(path, O_WRONLY | O_CREAT | O_APPEND,
+					JOURNAL_MODE));
+	if (journal->fd < 0)
+		return journal;
+
+	if (valid == 0) {
+		/* Missing or unrecognized, start over */
+		if (ftruncate(journal->fd, 0) < 0 ||
+				!journal_write(journal->fd,
+					(const unsigned char *) JOURNAL_MAGIC,
+					JOURNAL_MAGIC_LEN)) {
+			L_TFR(close(journal->fd));
+			journal->fd = -1;
+			return journal;
+		}
+
+		valid = JOURNAL_MAGIC_LEN;
+	} else if (valid < len && ftruncate(journal->fd, valid) < 0) {
+		L_TFR(close(journal->fd));
+		journal->fd = -1;
+		return journal;
+	}
+
+	journal->file_size = valid;
+	storage_journal_sync(journal);
+
+	return journal;
+}
+
+void storage_journal_close(struct storage_journal *journal)
+{
+	if (--journal->ref_count > 0)
+		return;
+
+	if (journal->sync_source) {
+		g_source_remove(journal->sync_source);
+		journal->sync_source = 0;
+	}
+
+	storage_journal_sync(journal);
+
+	if (journal->fd >= 0)
+		L_TFR(close(journal->fd));
+
+	g_hash_table_remove(journals, journal->path);
+
+	while (journal->records.head)
+		journal_drop(journal, journal->records.head);
+
+	g_hash_table_destroy(journal->index);
+	g_free(journal->path);
+	g_free(journal);
+}
+
+/*
+ * Makes everything written so far durable, compacting the journal if most
+ * of it is taken by records that have since been replaced or removed.
+ */
+void storage_journal_sync(struct storage_journal *journal)
+{
+	if (journal->fd < 0)
+		return;
+
+	if (journal->file_size > JOURNAL_COMPACT_MIN &&
+			journal->file_size > 2 * journal->live_size) {
+		journal_compact(journal);
+		return;
+	}
+
+	if (journal->dirty == FALSE)
+		return;
+
+	fdatasync(journal->fd);
+	journal->dirty = FALSE;
+}
+
+gboolean storage_journal_put(struct storage_journal *journal,
+				const char *key, const void *data, size_t len)
+{
+	return journal_append(journal, JOURNAL_OP_PUT, key, data, len);
+}
+
+void storage_journal_remove(struct storage_journal *journal, const char *key)
+{
+	journal_append(journal, JOURNAL_OP_REMOVE, key, NULL, 0);
+}
+
+void storage_journal_remove_prefix(struct storage_journal *journal,
+					const char *prefix)
+{
+	journal_append(journal, JOURNAL_OP_REMOVE_PREFIX, prefix, NULL, 0);
+}
+
+/*
+ * Calls @func for every live record whose key starts with @prefix, in the
+ * order they were first written.  The journal may be modified from @func.
+ */
+void storage_journal_foreach(struct storage_journal *journal,
+				const char *prefix,
+				storage_journal_func_t func, void *user_data)
+{
+	size_t prefix_len = strlen(prefix);
+	GSList *matches = NULL;
+	GSList *l;
+	GList *link;
+
+	for (link = journal->records.head; link; link = link->next) {
+		struct journal_record *record = link->data;
+		struct journal_record *copy;
+		size_t key_len;
+
+		if (strncmp(record->key, prefix, prefix_len))
+			continue;
+
+		key_len = strlen(record->key);
+		copy = g_memdup2(record, sizeof(*record) + key_len + 1 +
+						record->len);
+		copy->key = (char *) (copy + 1);
+		copy->data = (unsigned char *) copy->key + key_len + 1;
+		matches = g_slist_prepend(matches, copy);
+	}
+
+	matches = g_slist_reverse(matches);
+
+	for (l = matches; l; l = l->next) {
+		struct journal_record *record = l->data;
+
+		func(record->key, record->data, record->len, user_data);
+	}
+
+	g_slist_free_full(matches, g_free);
+}
@@ -36,3 +36,31 @@ GKeyFile *storage_open(const char *imsi, const char *store);
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
+void storage_flush(void);
+
+struct storage_sync_stats {
+	unsigned int syncs;	/* storage_sync() calls */
+	unsigned int writes;	/* keyfiles written out */
+	unsigned int saved;	/* writes merged into another one */
+};
+
+void storage_get_sync_stats(struct storage_sync_stats *stats);
+
+struct storage_journal;
+
+typedef void (*storage_journal_func_t)(const char *key,
+					const unsigned char *data, size_t len,
+					void *user_data);
+
+struct storage_journal *storage_journal_open(const char *imsi,
+						const char *store);
+void storage_journal_close(struct storage_journal *journal);
+void storage_journal_sync(struct storage_journal *journal);
+gboolean storage_journal_put(struct storage_journal *journal,
+				const char *key, const void *data, size_t len);
+void storage_journal_remove(struct storage_journal *journal, const char *key);
+void storage_journal_remove_prefix(struct storage_journal *journal,
+					const char *prefix);
+void storage_journal_foreach(struct storage_journal *journal,
+				const char *prefix,
+				storage_journal_func_t func, void *user_data);
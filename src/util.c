@@ -70,23 +70,51 @@ struct codepoint {
 	unsigned short to;
 };
 
-struct conversion_table {
-	/* To unicode locking shift table */
+struct dialect_tables {
+	/* To GSM locking shift table */
 	const struct codepoint *locking_u;
 	unsigned int locking_len_u;
 
-	/* To unicode single shift table */
+	/* To GSM single shift table */
 	const struct codepoint *single_u;
 	unsigned int single_len_u;
 
-	/* To GSM locking shift table, fixed size */
+	/* To unicode locking shift table, fixed size */
 	const unsigned short *locking_g;
 
-	/* To GSM single shift table */
+	/* To unicode single shift table */
 	const struct codepoint *single_g;
 	unsigned int single_len_g;
 };
 
+/*
+ * Direct lookup tables for a locking / single shift dialect pair, built
+ * from the sorted tables below the first time the pair is used.
+ */
+struct conversion_table {
+	/* To unicode locking shift table, fixed size */
+	const unsigned short *locking_g;
+
+	/* To unicode single shift table, by the octet following 0x1B */
+	unsigned short single_g[256];
+
+	/*
+	 * To GSM, locking shift entries taking precedence over single
+	 * shift ones, by the high and then the low byte of the codepoint.
+	 * Pages without any convertible codepoint are NULL.
+	 */
+	unsigned short *unicode[256];
+};
+
+/*
+ * Which dialects' locking and single shift tables contain a codepoint,
+ * bit n standing for enum gsm_dialect n
+ */
+struct dialect_masks {
+	unsigned short locking;
+	unsigned short single;
+};
+
 /* GSM to Unicode extension table, for GSM sequences starting with 0x1B */
 static const struct codepoint def_ext_gsm[] = {
 	{ 0x0A, 0x000C },		/* See NOTE 3 in 23.038 */
@@ -2640,54 +2668,30 @@ const struct codepoint urd_unicode[] = {
 	{ 0x06CC, 0x59 }, { 0x06D0, 0x5A }, { 0x06D2, 0x5B }, { 0x06D5, 0x55 }
 };
 
-static int compare_codepoints(const void *a, const void *b)
-{
-	const struct codepoint *ca = (const struct codepoint *) a;
-	const struct codepoint *cb = (const struct codepoint *) b;
-
-	return (ca->from > cb->from) - (ca->from < cb->from);
-}
-
-static unsigned short codepoint_lookup(struct codepoint *key,
-					const struct codepoint *table,
-					unsigned int len)
-{
-	struct codepoint *result = NULL;
-
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
-
-	return result ? result->to : GUND;
-}
-
-static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
-						unsigned char k)
+static unsigned short gsm_locking_shift_lookup(
+					const struct conversion_table *t,
+					unsigned char k)
 {
 	return t->locking_g[k];
 }
 
-static unsigned short gsm_single_shift_lookup(struct conversion_table *t,
-						unsigned char k)
+static unsigned short gsm_single_shift_lookup(
+					const struct conversion_table *t,
+					unsigned char k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_g, t->single_len_g);
+	return t->single_g[k];
 }
 
-static unsigned short unicode_locking_shift_lookup(struct conversion_table *t,
-							unsigned short k)
+/* Locking shift first, then single shift */
+static unsigned short unicode_lookup(const struct conversion_table *t,
+					unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->locking_u, t->locking_len_u);
-}
+	const unsigned short *page = t->unicode[k >> 8];
 
-static unsigned short unicode_single_shift_lookup(struct conversion_table *t,
-							unsigned short k)
-{
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_u, t->single_len_u);
+	return page ? page[k & 0xff] : GUND;
 }
 
-static bool populate_locking_shift(struct conversion_table *t,
+static bool populate_locking_shift(struct dialect_tables *t,
 					enum gsm_dialect lang)
 {
 	switch (lang) {
@@ -2774,7 +2778,7 @@ static bool populate_locking_shift(struct conversion_table *t,
 	return false;
 }
 
-static bool populate_single_shift(struct conversion_table *t,
+static bool populate_single_shift(struct dialect_tables *t,
 					enum gsm_dialect lang)
 {
 	switch (lang) {
@@ -2880,14 +2884,200 @@ static bool populate_single_shift(struct conversion_table *t,
 	return false;
 }
 
-static bool conversion_table_init(struct conversion_table *t,
-					enum gsm_dialect locking,
-					enum gsm_dialect single)
+static int compare_codepoints(const void *a, const void *b)
+{
+	const struct codepoint *ca = (const struct codepoint *) a;
+	const struct codepoint *cb = (const struct codepoint *) b;
+
+	return (ca->from > cb->from) - (ca->from < cb->from);
+}
+
+static void conversion_table_add_unicode(struct conversion_table *t,
+						const struct codepoint *table,
+						unsigned int len)
+{
+	const struct codepoint *entry;
+	unsigned short *page;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < len; i++) {
+		/*
+		 * Some tables list a codepoint twice, resolve those the
+		 * same way the binary search used to
+		 */
+		entry = bsearch(&table[i], table, len, sizeof(struct codepoint),
+							compare_codepoints);
+		page = t->unicode[entry->from >> 8];
+
+		if (page == NULL) {
+			page = l_new(unsigned short, 256);
+
+			for (j = 0; j < 256; j++)
+				page[j] = GUND;
+
+			t->unicode[entry->from >> 8] = page;
+		}
+
+		/* Locking shift entries are added first and take precedence */
+		if (page[entry->from & 0xff] == GUND)
+			page[entry->from & 0xff] = entry->to;
+	}
+}
+
+static const struct conversion_table *conversion_table_get(
+						enum gsm_dialect locking,
+						enum gsm_dialect single)
+{
+	static struct conversion_table *cache[GSM_DIALECT_COUNT]
+						[GSM_DIALECT_COUNT];
+	struct dialect_tables d;
+	struct conversion_table *t;
+	unsigned int i;
+
+	if ((unsigned int) locking >= GSM_DIALECT_COUNT ||
+			(unsigned int) single >= GSM_DIALECT_COUNT)
+		return NULL;
+
+	if (cache[locking][single])
+		return cache[locking][single];
+
+	memset(&d, 0, sizeof(d));
+
+	if (!populate_locking_shift(&d, locking) ||
+			!populate_single_shift(&d, single))
+		return NULL;
+
+	t = l_new(struct conversion_table, 1);
+	t->locking_g = d.locking_g;
+
+	for (i = 0; i < L_ARRAY_SIZE(t->single_g); i++)
+		t->single_g[i] = GUND;
+
+	for (i = 0; i < d.single_len_g; i++)
+		t->single_g[d.single_g[i].from] = d.single_g[i].to;
+
+	conversion_table_add_unicode(t, d.locking_u, d.locking_len_u);
+	conversion_table_add_unicode(t, d.single_u, d.single_len_u);
+
+	cache[locking][single] = t;
+
+	return t;
+}
+
+static struct dialect_masks *dialect_masks[256];
+
+static void dialect_masks_add(const struct codepoint *table, unsigned int len,
+					bool single, enum gsm_dialect dialect)
+{
+	struct dialect_masks *page;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		page = dialect_masks[table[i].from >> 8];
+
+		if (page == NULL) {
+			page = l_new(struct dialect_masks, 256);
+			dialect_masks[table[i].from >> 8] = page;
+		}
+
+		if (single)
+			page[table[i].from & 0xff].single |= 1 << dialect;
+		else
+			page[table[i].from & 0xff].locking |= 1 << dialect;
+	}
+}
+
+static void dialect_masks_init(void)
 {
-	memset(t, 0, sizeof(struct conversion_table));
+	static bool initialized;
+	struct dialect_tables d;
+	unsigned int i;
 
-	return populate_locking_shift(t, locking) &&
-			populate_single_shift(t, single);
+	if (initialized)
+		return;
+
+	for (i = 0; i < GSM_DIALECT_COUNT; i++) {
+		memset(&d, 0, sizeof(d));
+		populate_locking_shift(&d, i);
+		populate_single_shift(&d, i);
+
+		dialect_masks_add(d.locking_u, d.locking_len_u, false, i);
+		dialect_masks_add(d.single_u, d.single_len_u, true, i);
+	}
+
+	initialized = true;
+}
+
+/*!
+ * Works out in one pass over the text which locking shift / single shift
+ * table pairs it can be encoded with and how many septets each needs.
+ * Characters found in the locking shift table take one septet, those
+ * only in the single shift table two, exactly as the conversion
+ * routines encode them.
+ *
+ * Returns false if the text is not valid UTF-8.
+ */
+bool gsm_encoding_costs_from_utf8(const char *utf8, long len,
+					struct gsm_encoding_costs *costs)
+{
+	const unsigned short all = (1 << GSM_DIALECT_COUNT) - 1;
+	unsigned short unencodable[GSM_DIALECT_COUNT];
+	const struct dialect_masks *page;
+	struct dialect_masks m;
+	unsigned short missing;
+	const char *in = utf8;
+	long nchars = 0;
+	unsigned int l;
+
+	dialect_masks_init();
+
+	memset(unencodable, 0, sizeof(unencodable));
+	memset(costs, 0, sizeof(struct gsm_encoding_costs));
+
+	while ((len < 0 || utf8 + len - in > 0) && *in) {
+		long max = len < 0 ? 4 : utf8 + len - in;
+		wchar_t c;
+		int nread = l_utf8_get_codepoint(in, max, &c);
+
+		if (nread < 0)
+			return false;
+
+		m.locking = 0;
+		m.single = 0;
+
+		if (c <= 0xffff) {
+			page = dialect_masks[c >> 8];
+
+			if (page)
+				m = page[c & 0xff];
+		}
+
+		/*
+		 * Without the character in its locking shift table, a
+		 * dialect needs an escape and a single shift table that
+		 * has it.  Plain ASCII skips this entirely.
+		 */
+		missing = ~m.locking & all;
+
+		for (l = 0; missing; l++, missing >>= 1) {
+			if (!(missing & 1))
+				continue;
+
+			unencodable[l] |= ~m.single & all;
+			costs->septets[l] += 1;
+		}
+
+		in += nread;
+		nchars += 1;
+	}
+
+	for (l = 0; l < GSM_DIALECT_COUNT; l++) {
+		costs->encodable[l] = ~unencodable[l] & all;
+		costs->septets[l] += nchars;
+	}
+
+	return true;
 }
 
 /*!
@@ -2914,9 +3104,10 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 	long i = 0;
 	long res_length;
 
-	struct conversion_table t;
+	const struct conversion_table *t;
 
-	if (!conversion_table_init(&t, locking_lang, single_lang))
+	t = conversion_table_get(locking_lang, single_lang);
+	if (t == NULL)
 		return NULL;
 
 	if (len < 0 && !terminator)
@@ -2939,10 +3130,10 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 
 		if (text[i] == 0x1b) {
 			++i;
-			if (i >= len)
+			if (i >= len || text[i] > 0x7f)
 				goto error;
 
-			c = gsm_single_shift_lookup(&t, text[i]);
+			c = gsm_single_shift_lookup(t, text[i]);
 
 			/*
 			 * According to the comment in the table from
@@ -2957,9 +3148,9 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 			 * in subclause 6.2.1.2.3 is used."
 			 */
 			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
+				c = gsm_locking_shift_lookup(t, text[i]);
 		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
+			c = gsm_locking_shift_lookup(t, text[i]);
 
 		res_length += UTF8_LENGTH(c);
 	}
@@ -2972,12 +3163,12 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 		unsigned short c;
 
 		if (text[i] == 0x1b) {
-			c = gsm_single_shift_lookup(&t, text[++i]);
+			c = gsm_single_shift_lookup(t, text[++i]);
 
 			if (c == GUND)
-				c = gsm_locking_shift_lookup(&t, text[i]);
+				c = gsm_locking_shift_lookup(t, text[i]);
 		} else
-			c = gsm_locking_shift_lookup(&t, text[i]);
+			c = gsm_locking_shift_lookup(t, text[i]);
 
 		out += l_utf8_from_wchar(c, out);
 
@@ -3023,7 +3214,7 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 					enum gsm_dialect locking_lang,
 					enum gsm_dialect single_lang)
 {
-	struct conversion_table t;
+	const struct conversion_table *t;
 	long nchars = 0;
 	const char *in;
 	unsigned char *out;
@@ -3031,7 +3222,8 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	long res_len;
 	long i;
 
-	if (!conversion_table_init(&t, locking_lang, single_lang))
+	t = conversion_table_get(locking_lang, single_lang);
+	if (t == NULL)
 		return NULL;
 
 	in = text;
@@ -3049,10 +3241,7 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 		if (c > 0xffff)
 			goto err_out;
 
-		converted = unicode_locking_shift_lookup(&t, c);
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
+		converted = unicode_lookup(t, c);
 		if (converted == GUND)
 			goto err_out;
 
@@ -3074,9 +3263,7 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 		unsigned short converted;
 		int nread = l_utf8_get_codepoint(in, 4, &c);
 
-		converted = unicode_locking_shift_lookup(&t, c);
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
+		converted = unicode_lookup(t, c);
 
 		if (converted & 0x1b00) {
 			*out = 0x1b;
@@ -3137,37 +3324,47 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 {
 	enum gsm_dialect locking = GSM_DIALECT_DEFAULT;
 	enum gsm_dialect single = GSM_DIALECT_DEFAULT;
+	struct gsm_encoding_costs costs;
 	unsigned char *encoded;
 
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
+	/* Find out up front which of the candidates below will work */
+	if (!gsm_encoding_costs_from_utf8(utf8, len, &costs))
+		goto fail;
+
+	if (costs.encodable[locking] & (1 << single))
 		goto out;
 
-	if (hint == GSM_DIALECT_DEFAULT)
-		return NULL;
+	if (hint == GSM_DIALECT_DEFAULT ||
+			(unsigned int) hint >= GSM_DIALECT_COUNT)
+		goto fail;
 
 	single = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
+	if (costs.encodable[locking] & (1 << single))
 		goto out;
 
 	/* Spanish dialect uses the default locking shift table */
 	if (hint == GSM_DIALECT_SPANISH)
-		return NULL;
+		goto fail;
 
 	locking = hint;
+	if (costs.encodable[locking] & (1 << single))
+		goto out;
+
+fail:
+	/* Let the conversion report how far it got */
+	if (items_read)
+		convert_utf8_to_gsm_with_lang(utf8, len, items_read, NULL,
+						terminator, locking, single);
+
+	return NULL;
+
+out:
 	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
 						items_written, terminator,
 						locking, single);
-
 	if (encoded == NULL)
 		return NULL;
 
-out:
 	if (used_locking != NULL)
 		*used_locking = locking;
 
@@ -3277,6 +3474,73 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 	return buf;
 }
 
+/*
+ * Eight septets packed into seven octets form a 56 bit little endian
+ * value, septet n in bits 7n..7n+6.  These move the septets between that
+ * layout and one septet per octet in three shift and mask steps.
+ */
+static inline uint64_t septets_spread(uint64_t x)
+{
+	x = (x & 0x000000000fffffffULL) | ((x & 0x00fffffff0000000ULL) << 4);
+	x = (x & 0x00003fff00003fffULL) | ((x & 0x0fffc0000fffc000ULL) << 2);
+	x = (x & 0x007f007f007f007fULL) | ((x & 0x3f803f803f803f80ULL) << 1);
+
+	return x;
+}
+
+static inline uint64_t septets_gather(uint64_t x)
+{
+	x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+	x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+	x = (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+
+	return x;
+}
+
+/* Unpacks whole groups of 7 octets into 8 septets each */
+static void unpack_7bit_groups(const unsigned char *in, long groups,
+						unsigned char *out)
+{
+	uint64_t x;
+
+	for (; groups > 1; groups--, in += 7, out += 8)
+		l_put_le64(septets_spread(l_get_le64(in)), out);
+
+	/* Don't read past the end of the input for the last one */
+	x = l_get_le32(in) | (uint64_t) l_get_le16(in + 4) << 32 |
+					(uint64_t) in[6] << 48;
+	l_put_le64(septets_spread(x), out);
+}
+
+/*
+ * Packs whole groups of 8 septets into 7 octets each.  The septet loop
+ * lets the top bit of a septet spill into the first bit of the next one
+ * within a group, which is reproduced here so that the output stays the
+ * same for all input.
+ */
+static void pack_7bit_groups(const unsigned char *in, long groups,
+						unsigned char *out)
+{
+	uint64_t x;
+
+	for (; groups > 0; groups--, in += 8, out += 7) {
+		x = l_get_le64(in);
+		x = (x & 0x7f7f7f7f7f7f7f7fULL) |
+				((x & 0x0080808080808080ULL) << 1);
+		x = septets_gather(x);
+
+		/* The 8th octet is overwritten by the next group */
+		if (groups > 1) {
+			l_put_le64(x, out);
+			continue;
+		}
+
+		l_put_le32(x, out);
+		l_put_le16(x >> 32, out + 4);
+		out[6] = x >> 48;
+	}
+}
+
 unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 					int byte_offset, bool ussd,
 					long max_to_unpack, long *items_written,
@@ -3286,6 +3550,7 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	unsigned char rest = 0;
 	unsigned char *out = buf;
 	int bits = 7 - (byte_offset % 7);
+	long groups;
 	long i;
 
 	if (len <= 0)
@@ -3296,6 +3561,23 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 		max_to_unpack = len * 8 / 7;
 
 	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		/* On an octet boundary, do as many whole groups as we can */
+		if (bits == 7) {
+			groups = (len - i) / 7;
+
+			if (groups > (max_to_unpack - (out - buf)) / 8)
+				groups = (max_to_unpack - (out - buf)) / 8;
+
+			if (groups > 0) {
+				unpack_7bit_groups(in + i, groups, out);
+				i += groups * 7;
+				out += groups * 8;
+
+				if (i == len || (out - buf) == max_to_unpack)
+					break;
+			}
+		}
+
 		/* Grab what we have in the current octet */
 		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
 
@@ -3373,6 +3655,7 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 {
 	int bits = 7 - (byte_offset % 7);
 	unsigned char *out = buf;
+	long groups;
 	long i;
 	long total_bits;
 
@@ -3397,6 +3680,20 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	}
 
 	for (i = 0; i < len; i++) {
+		/* On a septet boundary, do as many whole groups as we can */
+		if (bits == 7) {
+			groups = (len - i) / 8;
+
+			if (groups > 0) {
+				pack_7bit_groups(in + i, groups, out);
+				i += groups * 8;
+				out += groups * 7;
+
+				if (i == len)
+					break;
+			}
+		}
+
 		if (bits != 7) {
 			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
 					(bits + 1);
@@ -3476,7 +3773,7 @@ unsigned char *pack_7bit(const unsigned char *in, long len, int byte_offset,
 
 char *sim_string_to_utf8(const unsigned char *buffer, int length)
 {
-	struct conversion_table t;
+	const struct conversion_table *t;
 	int i;
 	int j;
 	int num_chars;
@@ -3486,8 +3783,8 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 	char *utf8 = NULL;
 	char *out;
 
-	if (!conversion_table_init(&t, GSM_DIALECT_DEFAULT,
-					GSM_DIALECT_DEFAULT))
+	t = conversion_table_get(GSM_DIALECT_DEFAULT, GSM_DIALECT_DEFAULT);
+	if (t == NULL)
 		return NULL;
 
 	if (length < 1)
@@ -3570,14 +3867,14 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			if (i >= length)
 				return NULL;
 
-			c = gsm_single_shift_lookup(&t, buffer[i++]);
+			c = gsm_single_shift_lookup(t, buffer[i++]);
 
 			if (c == 0)
 				return NULL;
 
 			j += 2;
 		} else {
-			c = gsm_locking_shift_lookup(&t, buffer[i++]);
+			c = gsm_locking_shift_lookup(t, buffer[i++]);
 			j += 1;
 		}
 
@@ -3603,9 +3900,9 @@ char *sim_string_to_utf8(const unsigned char *buffer, int length)
 			c = (buffer[i++] & 0x7f) + ucs2_offset;
 		else if (buffer[i] == 0x1b) {
 			++i;
-			c = gsm_single_shift_lookup(&t, buffer[i++]);
+			c = gsm_single_shift_lookup(t, buffer[i++]);
 		} else
-			c = gsm_locking_shift_lookup(&t, buffer[i++]);
+			c = gsm_locking_shift_lookup(t, buffer[i++]);
 
 		out += l_utf8_from_wchar(c, out);
 	}
@@ -3673,7 +3970,7 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 					enum gsm_dialect locking_lang,
 					enum gsm_dialect single_lang)
 {
-	struct conversion_table t;
+	const struct conversion_table *t;
 	long nchars = 0;
 	const unsigned char *in;
 	unsigned char *out;
@@ -3681,7 +3978,8 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 	long res_len;
 	long i;
 
-	if (!conversion_table_init(&t, locking_lang, single_lang))
+	t = conversion_table_get(locking_lang, single_lang);
+	if (t == NULL)
 		return NULL;
 
 	if (len < 1 || len % 2)
@@ -3692,12 +3990,7 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 
 	for (i = 0; i < len; i += 2) {
 		uint16_t c = l_get_be16(in + i);
-		uint16_t converted = GUND;
-
-		converted = unicode_locking_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
+		uint16_t converted = unicode_lookup(t, c);
 
 		if (converted == GUND)
 			goto err_out;
@@ -3717,12 +4010,7 @@ unsigned char *convert_ucs2_to_gsm_with_lang(const unsigned char *text,
 
 	for (i = 0; i < len; i += 2) {
 		uint16_t c = l_get_be16(in + i);
-		uint16_t converted = GUND;
-
-		converted = unicode_locking_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
+		uint16_t converted = unicode_lookup(t, c);
 
 		if (converted & 0x1b00) {
 			*out = 0x1b;
@@ -38,6 +38,19 @@ enum gsm_dialect {
 	GSM_DIALECT_URDU,
 };
 
+#define GSM_DIALECT_COUNT (GSM_DIALECT_URDU + 1)
+
+/*
+ * How a text fares under every locking shift / single shift table pair,
+ * see gsm_encoding_costs_from_utf8()
+ */
+struct gsm_encoding_costs {
+	/* Bit s of encodable[l] is set if locking l + single s can do it */
+	unsigned short encodable[GSM_DIALECT_COUNT];
+	/* Septets needed with locking shift table l, if encodable at all */
+	long septets[GSM_DIALECT_COUNT];
+};
+
 enum ofono_interface {
 	MODEM_INTERFACE,
 	RADIO_SETTINGS_INTERFACE,
@@ -76,6 +89,9 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 					enum gsm_dialect locking_shift_lang,
 					enum gsm_dialect single_shift_lang);
 
+bool gsm_encoding_costs_from_utf8(const char *utf8, long len,
+					struct gsm_encoding_costs *costs);
+
 unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					long *items_read, long *items_written,
 					unsigned char terminator,
@@ -0,0 +1,386 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Compares the GSM 7 bit packing routines of src/util.c against the
+ * septet at a time versions they replaced, using the SMS and CBS data of
+ * unit/test-sms.c.  The output of both is checked to be identical before
+ * anything is timed.
+ *
+ * Usage: bench-7bit [-n iterations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <ell/ell.h>
+
+#include "util.h"
+
+#define CBS_HEADER_LEN	6
+#define MAX_UNPACKED	512
+
+struct corpus_entry {
+	unsigned char *packed;
+	long packed_len;
+	unsigned char *septets;
+	long septets_len;
+	int offset;
+	bool ussd;
+};
+
+typedef unsigned char *(*pack_func)(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf);
+
+typedef unsigned char *(*unpack_func)(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long max_to_unpack, long *items_written,
+					unsigned char terminator,
+					unsigned char *buf);
+
+/* From unit/test-sms.c */
+static const char *texts[] = {
+	"This is testing !",
+	"Shakespeare divided his time between London and Stratford during "
+	"his career. In 1596, the year before he bought New Place as his "
+	"family home in Stratford, Shakespeare was living in the parish of "
+	"St. Helen's, Bishopsgate, north of the River Thames.",
+};
+
+static const char *cbs_pages[] = {
+	"011000320111C2327BFC76BBCBEE46A3D168341A8D46A3D1683"
+	"41A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168"
+	"341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100",
+	"0110003201114679785E96371A8D46A3D168341A8D46A3D1683"
+	"41A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D168"
+	"341A8D46A3D168341A8D46A3D168341A8D46A3D168341A8D46A3D100",
+	"001000000111E280604028180E888462C168381E90886442A95"
+	"82E988C66C3E9783EA09068442A994EA8946AC56AB95EB0986C46ABD96EB89C6EC7EBF"
+	"97EC0A070482C1A8FC8A472C96C3A9FD0A8744AAD5AAFD8AC76CB05",
+};
+
+static gint iterations = 100000;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+				"Number of passes over the corpus" },
+	{ NULL },
+};
+
+/* The septet at a time implementations src/util.c used to have */
+static unsigned char *old_unpack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long max_to_unpack, long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	unsigned char rest = 0;
+	unsigned char *out = buf;
+	int bits = 7 - (byte_offset % 7);
+	long i;
+
+	if (len <= 0)
+		return NULL;
+
+	if (ussd)
+		max_to_unpack = len * 8 / 7;
+
+	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
+		*out |= rest;
+		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+
+		if (i != 0 || bits == 7)
+			out++;
+
+		if ((out-buf) == max_to_unpack)
+			break;
+
+		if (bits == 1) {
+			*out = rest;
+			out++;
+			bits = 7;
+			rest = 0;
+		} else {
+			bits = bits - 1;
+		}
+	}
+
+	if (ussd && (((out - buf) % 8) == 0) && (*(out - 1) == '\r'))
+		out = out - 1;
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static unsigned char *old_pack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	int bits = 7 - (byte_offset % 7);
+	unsigned char *out = buf;
+	long i;
+	long total_bits;
+
+	if (len == 0)
+		return NULL;
+
+	total_bits = len * 7;
+
+	if (bits != 7) {
+		total_bits += bits;
+		bits = bits - 1;
+		*out = 0;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (bits != 7) {
+			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
+					(bits + 1);
+			out++;
+		}
+
+		if (bits != 0)
+			*out = in[i] >> (7 - bits);
+
+		if (bits == 0)
+			bits = 7;
+		else
+			bits = bits - 1;
+	}
+
+	if (ussd && ((total_bits % 8) == 1))
+		*out |= '\r' << 1;
+
+	if (bits != 7)
+		out++;
+
+	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
+		*out = '\r';
+		out++;
+	}
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static void add_text(GPtrArray *corpus, const char *text, int offset,
+								bool ussd)
+{
+	struct corpus_entry *entry = g_new0(struct corpus_entry, 1);
+
+	entry->septets = convert_utf8_to_gsm(text, -1, NULL,
+						&entry->septets_len, 0);
+	g_assert(entry->septets != NULL);
+
+	entry->packed = g_malloc0(entry->septets_len + 2);
+	pack_7bit_own_buf(entry->septets, entry->septets_len, offset, ussd,
+				&entry->packed_len, 0, entry->packed);
+
+	entry->offset = offset;
+	entry->ussd = ussd;
+
+	g_ptr_array_add(corpus, entry);
+}
+
+static void add_cbs_page(GPtrArray *corpus, const char *hex)
+{
+	struct corpus_entry *entry = g_new0(struct corpus_entry, 1);
+	unsigned char *pdu;
+	size_t len;
+
+	pdu = l_util_from_hexstring(hex, &len);
+	g_assert(pdu != NULL && len > CBS_HEADER_LEN);
+
+	entry->packed_len = len - CBS_HEADER_LEN;
+	entry->packed = g_malloc(entry->packed_len);
+	memcpy(entry->packed, pdu + CBS_HEADER_LEN, entry->packed_len);
+	l_free(pdu);
+
+	entry->septets = l_new(unsigned char, MAX_UNPACKED);
+	unpack_7bit_own_buf(entry->packed, entry->packed_len, 0, true, 0,
+				&entry->septets_len, 0, entry->septets);
+
+	entry->ussd = true;
+
+	g_ptr_array_add(corpus, entry);
+}
+
+static void free_entry(gpointer data)
+{
+	struct corpus_entry *entry = data;
+
+	l_free(entry->septets);
+	g_free(entry->packed);
+	g_free(entry);
+}
+
+static gboolean check_entry(const struct corpus_entry *entry)
+{
+	unsigned char old_buf[MAX_UNPACKED];
+	unsigned char new_buf[MAX_UNPACKED];
+	long old_len;
+	long new_len;
+
+	memset(old_buf, 0, sizeof(old_buf));
+	memset(new_buf, 0, sizeof(new_buf));
+
+	old_pack_7bit(entry->septets, entry->septets_len, entry->offset,
+			entry->ussd, &old_len, 0, old_buf);
+	pack_7bit_own_buf(entry->septets, entry->septets_len, entry->offset,
+			entry->ussd, &new_len, 0, new_buf);
+
+	if (old_len != new_len || memcmp(old_buf, new_buf, old_len))
+		return FALSE;
+
+	old_unpack_7bit(entry->packed, entry->packed_len, entry->offset,
+			entry->ussd, entry->septets_len, &old_len, 0, old_buf);
+	unpack_7bit_own_buf(entry->packed, entry->packed_len, entry->offset,
+			entry->ussd, entry->septets_len, &new_len, 0, new_buf);
+
+	if (old_len != new_len || memcmp(old_buf, new_buf, old_len))
+		return FALSE;
+
+	return TRUE;
+}
+
+static void bench_pack(const char *name, GPtrArray *corpus, pack_func pack)
+{
+	unsigned char buf[MAX_UNPACKED];
+	guint64 bytes = 0;
+	GTimer *timer;
+	gdouble elapsed;
+	long written;
+	gint n;
+	guint i;
+
+	timer = g_timer_new();
+
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < corpus->len; i++) {
+			struct corpus_entry *entry = corpus->pdata[i];
+
+			pack(entry->septets, entry->septets_len, entry->offset,
+					entry->ussd, &written, 0, buf);
+			bytes += entry->septets_len;
+		}
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("%-12s %8.2f Mseptets/s\n", name, bytes / elapsed / 1e6);
+}
+
+static void bench_unpack(const char *name, GPtrArray *corpus,
+							unpack_func unpack)
+{
+	unsigned char buf[MAX_UNPACKED];
+	guint64 bytes = 0;
+	GTimer *timer;
+	gdouble elapsed;
+	long written;
+	gint n;
+	guint i;
+
+	timer = g_timer_new();
+
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < corpus->len; i++) {
+			struct corpus_entry *entry = corpus->pdata[i];
+
+			unpack(entry->packed, entry->packed_len, entry->offset,
+					entry->ussd, entry->septets_len,
+					&written, 0, buf);
+			bytes += written;
+		}
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("%-12s %8.2f Mseptets/s\n", name, bytes / elapsed / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GPtrArray *corpus;
+	guint i;
+	int offset;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	corpus = g_ptr_array_new_with_free_func(free_entry);
+
+	/* Every offset a user data header can leave, plain and USSD style */
+	for (i = 0; i < G_N_ELEMENTS(texts); i++) {
+		for (offset = 0; offset < 7; offset++)
+			add_text(corpus, texts[i], offset, false);
+
+		add_text(corpus, texts[i], 0, true);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS(cbs_pages); i++)
+		add_cbs_page(corpus, cbs_pages[i]);
+
+	for (i = 0; i < corpus->len; i++) {
+		if (check_entry(corpus->pdata[i]) == FALSE) {
+			g_printerr("Output differs for corpus entry %u\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bench_pack("pack old", corpus, old_pack_7bit);
+	bench_pack("pack new", corpus, pack_7bit_own_buf);
+	bench_unpack("unpack old", corpus, old_unpack_7bit);
+	bench_unpack("unpack new", corpus, unpack_7bit_own_buf);
+
+	g_ptr_array_free(corpus, TRUE);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Replays the received direction of one or more HDLC captures, as written
+ * by g_at_hdlc_set_recording(), through the GAtHDLC decoder and reports
+ * the achieved throughput.
+ *
+ * Usage: bench-hdlc [-n iterations] capture...
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gathdlc.h"
+
+#define RECORD_HEADER	8
+
+static GMainLoop *mainloop;
+static GByteArray *stream;
+static gsize stream_pos;
+static gint iterations = 100;
+static gint iteration;
+static guint64 frames;
+static guint64 frame_bytes;
+static int feed_fd = -1;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+				"Number of times each capture is replayed" },
+	{ NULL },
+};
+
+static gboolean load_capture(const char *filename)
+{
+	gchar *contents;
+	gsize len;
+	gsize pos = 0;
+
+	if (g_file_get_contents(filename, &contents, &len, NULL) == FALSE) {
+		g_printerr("Unable to read %s\n", filename);
+		return FALSE;
+	}
+
+	/* 0x07, 4 byte timestamp, direction, 2 byte length, data */
+	while (pos + RECORD_HEADER <= len) {
+		const unsigned char *rec = (unsigned char *) contents + pos;
+		guint16 size;
+
+		if (rec[0] != 0x07) {
+			g_printerr("%s: bad record at offset %" G_GSIZE_FORMAT
+							"\n", filename, pos);
+			break;
+		}
+
+		size = (rec[6] << 8) | rec[7];
+
+		if (pos + RECORD_HEADER + size > len)
+			break;
+
+		if (rec[5] == 0x02)
+			g_byte_array_append(stream, rec + RECORD_HEADER, size);
+
+		pos += RECORD_HEADER + size;
+	}
+
+	g_free(contents);
+
+	return TRUE;
+}
+
+static void receive_frame(const unsigned char *data, gsize size,
+							gpointer user_data)
+{
+	frames += 1;
+	frame_bytes += size;
+}
+
+static gboolean feed_data(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	ssize_t written;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	while (iteration < iterations) {
+		written = write(feed_fd, stream->data + stream_pos,
+						stream->len - stream_pos);
+		if (written < 0) {
+			if (errno == EAGAIN)
+				return TRUE;
+
+			break;
+		}
+
+		stream_pos += written;
+
+		if (stream_pos == stream->len) {
+			stream_pos = 0;
+			iteration += 1;
+		}
+	}
+
+	/* Let the decoder see EOF once it has drained everything */
+	shutdown(feed_fd, SHUT_WR);
+
+	return FALSE;
+}
+
+static void hdlc_disconnect(gpointer user_data)
+{
+	g_main_loop_quit(mainloop);
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GIOChannel *io;
+	GAtHDLC *hdlc;
+	GTimer *timer;
+	gdouble elapsed;
+	int sv[2];
+	int i;
+
+	context = g_option_context_new("capture...");
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (argc < 2) {
+		g_printerr("No capture files specified\n");
+		return EXIT_FAILURE;
+	}
+
+	stream = g_byte_array_new();
+
+	for (i = 1; i < argc; i++)
+		if (load_capture(argv[i]) == FALSE)
+			return EXIT_FAILURE;
+
+	if (stream->len == 0 || iterations <= 0) {
+		g_printerr("Nothing to replay\n");
+		return EXIT_FAILURE;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return EXIT_FAILURE;
+	}
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	hdlc = g_at_hdlc_new(io);
+	g_at_io_set_unix_fd(g_at_hdlc_get_io(hdlc), sv[1]);
+	g_io_channel_unref(io);
+
+	/* Captures are taken after LCP, accept whatever the peer sent */
+	g_at_hdlc_set_recv_accm(hdlc, 0);
+	g_at_hdlc_set_receive(hdlc, receive_frame, NULL);
+	g_at_io_set_disconnect_function(g_at_hdlc_get_io(hdlc),
+						hdlc_disconnect, NULL);
+
+	feed_fd = sv[0];
+	io = g_io_channel_unix_new(feed_fd);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+	g_io_add_watch(io, G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							feed_data, NULL);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timer = g_timer_new();
+
+	g_main_loop_run(mainloop);
+
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	g_print("replayed %d x %u bytes in %.3f s: %.2f MB/s, "
+			"%" G_GUINT64_FORMAT " frames "
+			"(%" G_GUINT64_FORMAT " payload bytes)\n",
+			iterations, stream->len, elapsed,
+			(gdouble) stream->len * iterations / elapsed / 1e6,
+			frames, frame_bytes);
+
+	g_timer_destroy(timer);
+	g_at_hdlc_unref(hdlc);
+	g_io_channel_shutdown(io, FALSE, NULL);
+	g_io_channel_unref(io);
+	g_main_loop_unref(mainloop);
+	g_byte_array_free(stream, TRUE);
+
+	return EXIT_SUCCESS;
+}
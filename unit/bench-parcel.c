@@ -0,0 +1,404 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Builds typical large RIL requests with the parcel code, comparing it with
+ * the previous implementation that grew parcels by exactly the bytes
+ * missing, and then sends them through GRil to the rilmodem test server,
+ * which checks every request byte by byte.
+ *
+ * Usage: bench-parcel [-n iterations] [-r round trips]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+
+#include <gril.h>
+
+#include "ril_constants.h"
+#include "rilmodem-test-server.h"
+
+#define PAD_SIZE(s) (((s)+3)&~3)
+
+static gint iterations = 100000;
+static gint round_trips = 200;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+				"Number of times each request is built" },
+	{ "round-trips", 'r', 0, G_OPTION_ARG_INT, &round_trips,
+				"Number of requests sent to the test server" },
+	{ NULL },
+};
+
+/* The parcel writers as they were before capacity doubling */
+struct ref_parcel {
+	char *data;
+	size_t offset;
+	size_t capacity;
+	size_t size;
+};
+
+static void ref_init(struct ref_parcel *p)
+{
+	p->data = g_malloc0(sizeof(int32_t));
+	p->size = 0;
+	p->capacity = sizeof(int32_t);
+	p->offset = 0;
+}
+
+static void ref_grow(struct ref_parcel *p, size_t size)
+{
+	p->data = g_realloc(p->data, p->capacity + size);
+	p->capacity += size;
+}
+
+static void ref_w_int32(struct ref_parcel *p, int32_t val)
+{
+	while (p->offset + sizeof(int32_t) >= p->capacity)
+		ref_grow(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+}
+
+static void ref_w_string(struct ref_parcel *p, const char *str)
+{
+	gunichar2 *gs16;
+	glong gs16_len;
+	size_t gs16_size;
+	size_t len;
+	size_t padded;
+
+	if (str == NULL) {
+		ref_w_int32(p, -1);
+		return;
+	}
+
+	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	ref_w_int32(p, gs16_len);
+
+	gs16_size = gs16_len * sizeof(gunichar2);
+	len = gs16_size + sizeof(gunichar2);
+	padded = PAD_SIZE(len);
+
+	while (p->offset + len >= p->capacity)
+		ref_grow(p, padded);
+
+	memcpy(p->data + p->offset, gs16, gs16_size);
+	memset(p->data + p->offset + gs16_size, 0, padded - gs16_size);
+	p->offset += padded;
+	p->size += padded;
+
+	g_free(gs16);
+}
+
+/* SEND_SMS with a full length TPDU */
+static char sms_hex[2 * 164 + 1];
+
+/* SIM_IO UPDATE BINARY of a 255 byte record */
+static char sim_data[2 * 255 + 1];
+
+static const char *apn =
+	"internet.operator.example.com.mnc001.mcc001.gprs";
+
+enum request_type {
+	REQUEST_SEND_SMS,
+	REQUEST_SIM_IO,
+	REQUEST_INITIAL_ATTACH_APN,
+	REQUEST_COUNT,
+};
+
+static const char *request_names[] = {
+	"SEND_SMS",
+	"SIM_IO",
+	"SET_INITIAL_ATTACH_APN",
+};
+
+static const int request_ids[] = {
+	RIL_REQUEST_SEND_SMS,
+	RIL_REQUEST_SIM_IO,
+	RIL_REQUEST_SET_INITIAL_ATTACH_APN,
+};
+
+static size_t request_size(enum request_type type)
+{
+	switch (type) {
+	case REQUEST_SEND_SMS:
+		return PARCEL_SIZE_INT32 + parcel_size_string(NULL) +
+			parcel_size_string(sms_hex);
+	case REQUEST_SIM_IO:
+		return 5 * PARCEL_SIZE_INT32 + parcel_size_string("3F007F20") +
+			parcel_size_string(sim_data) +
+			parcel_size_string(NULL) +
+			parcel_size_string("A0000000871002FF33FF018900000100");
+	case REQUEST_INITIAL_ATTACH_APN:
+		return 2 * PARCEL_SIZE_INT32 + parcel_size_string(apn) +
+			parcel_size_string("IPV4V6") +
+			parcel_size_string("username") +
+			parcel_size_string("password");
+	case REQUEST_COUNT:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Both parcel implementations are driven through the same sequence of
+ * writes, w_int32 and w_string stand for either one.
+ */
+#define BUILD_REQUEST(type, p, w_int32, w_string)			\
+	do {								\
+		switch (type) {						\
+		case REQUEST_SEND_SMS:					\
+			w_int32(p, 2);					\
+			w_string(p, NULL);				\
+			w_string(p, sms_hex);				\
+			break;						\
+		case REQUEST_SIM_IO:					\
+			w_int32(p, 0xD6);				\
+			w_int32(p, 0x6F3C);				\
+			w_string(p, "3F007F20");			\
+			w_int32(p, 1);					\
+			w_int32(p, 4);					\
+			w_int32(p, 255);				\
+			w_string(p, sim_data);				\
+			w_string(p, NULL);				\
+			w_string(p, "A0000000871002FF33FF018900000100"); \
+			break;						\
+		case REQUEST_INITIAL_ATTACH_APN:			\
+			w_int32(p, 5);					\
+			w_string(p, apn);				\
+			w_string(p, "IPV4V6");				\
+			w_int32(p, 3);					\
+			w_string(p, "username");			\
+			w_string(p, "password");			\
+			break;						\
+		case REQUEST_COUNT:					\
+			break;						\
+		}							\
+	} while (0)
+
+static void build_ref(enum request_type type, struct ref_parcel *p)
+{
+	ref_init(p);
+	BUILD_REQUEST(type, p, ref_w_int32, ref_w_string);
+}
+
+static void build(enum request_type type, struct parcel *p, gboolean sized)
+{
+	if (sized)
+		parcel_init_sized(p, request_size(type));
+	else
+		parcel_init(p);
+
+	BUILD_REQUEST(type, p, parcel_w_int32, parcel_w_string);
+}
+
+static void bench_build(enum request_type type)
+{
+	struct ref_parcel ref;
+	struct parcel rilp;
+	GTimer *timer;
+	gdouble t_ref, t_new, t_sized;
+	gint i;
+
+	/* Check that the output did not change first */
+	build_ref(type, &ref);
+	build(type, &rilp, FALSE);
+
+	if (ref.size != rilp.size || memcmp(ref.data, rilp.data, ref.size)) {
+		g_printerr("%s: parcel contents differ\n",
+						request_names[type]);
+		exit(EXIT_FAILURE);
+	}
+
+	g_free(ref.data);
+	parcel_free(&rilp);
+
+	timer = g_timer_new();
+
+	for (i = 0; i < iterations; i++) {
+		build_ref(type, &ref);
+		g_free(ref.data);
+	}
+
+	t_ref = g_timer_elapsed(timer, NULL);
+	g_timer_start(timer);
+
+	for (i = 0; i < iterations; i++) {
+		build(type, &rilp, FALSE);
+		parcel_free(&rilp);
+	}
+
+	t_new = g_timer_elapsed(timer, NULL);
+	g_timer_start(timer);
+
+	for (i = 0; i < iterations; i++) {
+		build(type, &rilp, TRUE);
+		parcel_free(&rilp);
+	}
+
+	t_sized = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("%-24s %5zu bytes: exact growth %7.1f ns, "
+			"doubling %7.1f ns, size hint %7.1f ns\n",
+			request_names[type], request_size(type),
+			t_ref * 1e9 / iterations, t_new * 1e9 / iterations,
+			t_sized * 1e9 / iterations);
+}
+
+static GMainLoop *mainloop;
+static GRil *ril;
+static enum request_type current;
+
+static void response_cb(struct ril_msg *message, gpointer user_data)
+{
+	g_main_loop_quit(mainloop);
+}
+
+static void server_connect_cb(gpointer data)
+{
+	struct parcel rilp;
+
+	build(current, &rilp, TRUE);
+
+	if (g_ril_send(ril, request_ids[current], &rilp,
+					response_cb, NULL, NULL) == 0) {
+		g_printerr("Unable to send request\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void bench_round_trip(enum request_type type)
+{
+	struct rilmodem_test_data *rtd;
+	struct server_data *sd;
+	unsigned char *req;
+	struct parcel rilp;
+	uint32_t header[3];
+	GTimer *timer;
+	gdouble elapsed;
+	gint i;
+
+	/* The request the server expects, the serial is not checked */
+	build(type, &rilp, FALSE);
+
+	header[0] = htonl(sizeof(header) - sizeof(header[0]) + rilp.size);
+	header[1] = request_ids[type];
+	header[2] = 0;
+
+	req = g_malloc(sizeof(header) + rilp.size);
+	memcpy(req, header, sizeof(header));
+	memcpy(req + sizeof(header), rilp.data, rilp.size);
+
+	{
+		struct rilmodem_test_data data = {
+			.req_data = req,
+			.req_size = sizeof(header) + rilp.size,
+			.rsp_error = RIL_E_SUCCESS,
+		};
+
+		rtd = g_memdup2(&data, sizeof(data));
+	}
+
+	parcel_free(&rilp);
+
+	current = type;
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timer = g_timer_new();
+
+	/* The test server answers a single request per connection */
+	for (i = 0; i < round_trips; i++) {
+		sd = rilmodem_test_server_create(server_connect_cb, rtd, NULL);
+		ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+
+		if (ril == NULL) {
+			g_printerr("Unable to connect to the test server\n");
+			exit(EXIT_FAILURE);
+		}
+
+		g_main_loop_run(mainloop);
+
+		g_ril_unref(ril);
+		rilmodem_test_server_close(sd);
+	}
+
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	g_print("%-24s %d round trips in %.3f s: %.1f us each\n",
+			request_names[type], round_trips, elapsed,
+			elapsed * 1e6 / round_trips);
+
+	g_timer_destroy(timer);
+	g_main_loop_unref(mainloop);
+	g_free(rtd);
+	g_free(req);
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	enum request_type type;
+	unsigned int i;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (iterations <= 0 || round_trips < 0) {
+		g_printerr("Nothing to do\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(sms_hex) - 1; i++)
+		sms_hex[i] = "0123456789ABCDEF"[(i * 7) % 16];
+
+	for (i = 0; i < sizeof(sim_data) - 1; i++)
+		sim_data[i] = "0123456789ABCDEF"[(i * 5) % 16];
+
+	for (type = 0; type < REQUEST_COUNT; type++)
+		bench_build(type);
+
+	for (type = 0; type < REQUEST_COUNT && round_trips; type++)
+		bench_round_trip(type);
+
+	return EXIT_SUCCESS;
+}
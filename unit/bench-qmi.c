@@ -0,0 +1,517 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Replays NAS traffic as a modem sends it while camping: every serving
+ * system query is answered after a burst of serving system and event
+ * report indications.  A window of queries is kept in flight and the
+ * responses come back newest first, so that matching them to their
+ * transactions is part of what gets measured.  The callbacks look up
+ * TLVs the way the network registration driver does.
+ *
+ * Usage: bench-qmi [-n queries] [-w window] [-i indications]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+#include "drivers/qmimodem/nas.h"
+
+#define NAS_CLIENT_ID	0x05
+#define MAX_WINDOW	64
+
+static gint queries = 20000;
+static gint window = 8;
+static gint indications = 4;
+
+static GOptionEntry options[] = {
+	{ "queries", 'n', 0, G_OPTION_ARG_INT, &queries,
+				"Number of serving system queries" },
+	{ "window", 'w', 0, G_OPTION_ARG_INT, &window,
+				"Number of queries kept in flight" },
+	{ "indications", 'i', 0, G_OPTION_ARG_INT, &indications,
+				"Number of indications before each response" },
+	{ NULL },
+};
+
+static GMainLoop *mainloop;
+static struct qmi_device *device;
+static struct qmi_service *nas;
+static int modem_fd;
+
+static guint sent;
+static guint answered;
+static guint notified;
+static guint messages;
+static guint64 callback_ns;
+static guint64 startup_ns;
+static guint64 found;
+
+static uint16_t held_tid[MAX_WINDOW];
+static guint held;
+
+static GByteArray *ss_info;
+static GByteArray *event_report;
+
+static guint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (guint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void append_tlv(GByteArray *array, uint8_t type, uint16_t length,
+							const void *value)
+{
+	uint8_t hdr[3] = { type, length & 0xff, length >> 8 };
+
+	g_byte_array_append(array, hdr, sizeof(hdr));
+	g_byte_array_append(array, value, length);
+}
+
+/* The TLVs of a serving system report from an LTE capable modem */
+static GByteArray *build_ss_info(void)
+{
+	static const uint8_t serving_system[] = { 0x01, 0x01, 0x01, 0x01,
+							0x01, 0x08 };
+	static const uint8_t data_capability[] = { 0x02, 0x05, 0x0b };
+	static const uint8_t plmn[] = { 0x06, 0x01, 0x01, 0x00, 0x0d,
+						'E', 'x', 'a', 'm', 'p', 'l',
+						'e', ' ', 'M', 'o', 'b', 'i',
+						'l' };
+	static const uint8_t time_3gpp[] = { 0xe2, 0x07, 0x0a, 0x10, 0x0c,
+						0x22, 0x08, 0x05, 0x08 };
+	static const uint8_t lac[] = { 0x34, 0x12 };
+	static const uint8_t cell_id[] = { 0x0a, 0x0b, 0x0c, 0x00 };
+	static const uint8_t filler[32];
+	static const struct {
+		uint8_t type;
+		uint16_t length;
+	} others[] = {
+		{ 0x13, 4 }, { 0x14, 1 }, { 0x15, 3 }, { 0x16, 2 },
+		{ 0x17, 1 }, { 0x18, 6 }, { 0x1a, 1 }, { 0x1f, 5 },
+		{ 0x21, 11 }, { 0x22, 2 }, { 0x23, 9 }, { 0x26, 1 },
+		{ 0x27, 4 },
+	};
+	GByteArray *array = g_byte_array_new();
+	uint8_t roaming = 0x01;
+	uint8_t dst = 0x00;
+	unsigned int i;
+
+	append_tlv(array, QMI_NAS_RESULT_SERVING_SYSTEM,
+				sizeof(serving_system), serving_system);
+	append_tlv(array, QMI_NAS_RESULT_ROAMING_STATUS, 1, &roaming);
+	append_tlv(array, QMI_NAS_RESULT_DATA_CAPABILITY_STATUS,
+				sizeof(data_capability), data_capability);
+	append_tlv(array, QMI_NAS_RESULT_CURRENT_PLMN, sizeof(plmn), plmn);
+
+	for (i = 0; i < G_N_ELEMENTS(others); i++)
+		append_tlv(array, others[i].type, others[i].length, filler);
+
+	append_tlv(array, QMI_NAS_RESULT_3GGP_DST, 1, &dst);
+	append_tlv(array, QMI_NAS_RESULT_3GPP_TIME, sizeof(time_3gpp),
+								time_3gpp);
+	append_tlv(array, QMI_NAS_RESULT_LOCATION_AREA_CODE, sizeof(lac), lac);
+	append_tlv(array, QMI_NAS_RESULT_CELL_ID, sizeof(cell_id), cell_id);
+
+	return array;
+}
+
+static GByteArray *build_event_report(void)
+{
+	static const uint8_t strength[] = { 0xb5, 0x08 };
+	static const uint8_t rf_info[] = { 0x01, 0x08, 0x78, 0x00, 0xe2,
+						0x18 };
+	GByteArray *array = g_byte_array_new();
+
+	append_tlv(array, QMI_NAS_NOTIFY_SIGNAL_STRENGTH, sizeof(strength),
+								strength);
+	append_tlv(array, QMI_NAS_NOTIFY_RF_INFO, sizeof(rf_info), rf_info);
+
+	return array;
+}
+
+static void modem_write(uint8_t service, uint8_t client, uint8_t type,
+			uint16_t tid, uint16_t message,
+			const void *tlvs, uint16_t tlvs_len)
+{
+	uint8_t buf[2048];
+	uint16_t len = 0;
+	uint16_t frame_len;
+
+	buf[len++] = 0x01;
+	len += 2;
+	buf[len++] = 0x80;
+	buf[len++] = service;
+	buf[len++] = client;
+	buf[len++] = type;
+	buf[len++] = tid & 0xff;
+
+	if (service != QMI_SERVICE_CONTROL)
+		buf[len++] = tid >> 8;
+
+	buf[len++] = message & 0xff;
+	buf[len++] = message >> 8;
+	buf[len++] = tlvs_len & 0xff;
+	buf[len++] = tlvs_len >> 8;
+
+	memcpy(buf + len, tlvs, tlvs_len);
+	len += tlvs_len;
+
+	frame_len = len - 1;
+	buf[1] = frame_len & 0xff;
+	buf[2] = frame_len >> 8;
+
+	if (write(modem_fd, buf, len) != len) {
+		g_printerr("Unable to write to the device\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void modem_control(uint8_t tid, uint16_t message)
+{
+	static const uint8_t version_info[] = {
+		0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, 0x10, 0x00, 0x03,
+			QMI_SERVICE_CONTROL, 0x01, 0x00, 0x05, 0x00,
+			QMI_SERVICE_NAS, 0x01, 0x00, 0x19, 0x00,
+			QMI_SERVICE_DMS, 0x01, 0x00, 0x0e, 0x00,
+	};
+	static const uint8_t client_id[] = {
+		0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x01, 0x02, 0x00, QMI_SERVICE_NAS, NAS_CLIENT_ID,
+	};
+	static const uint8_t released[] = {
+		0x02, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+
+	switch (message) {
+	case QMI_CTL_GET_VERSION_INFO:
+		modem_write(QMI_SERVICE_CONTROL, 0x00, 0x01, tid, message,
+					version_info, sizeof(version_info));
+		break;
+	case QMI_CTL_GET_CLIENT_ID:
+		modem_write(QMI_SERVICE_CONTROL, 0x00, 0x01, tid, message,
+					client_id, sizeof(client_id));
+		break;
+	default:
+		modem_write(QMI_SERVICE_CONTROL, 0x00, 0x01, tid, message,
+					released, sizeof(released));
+		break;
+	}
+}
+
+static void modem_answer(void)
+{
+	static const uint8_t success[] = { 0x02, 0x04, 0x00, 0x00, 0x00,
+						0x00, 0x00 };
+	GByteArray *response;
+	gint i, n;
+
+	/* Every query is answered with the full serving system report */
+	response = g_byte_array_new();
+	g_byte_array_append(response, success, sizeof(success));
+	g_byte_array_append(response, ss_info->data, ss_info->len);
+
+	for (i = held - 1; i >= 0; i--) {
+		for (n = 0; n < indications; n++) {
+			if (n % 2)
+				modem_write(QMI_SERVICE_NAS, NAS_CLIENT_ID,
+						0x04, 0, QMI_NAS_EVENT,
+						event_report->data,
+						event_report->len);
+			else
+				modem_write(QMI_SERVICE_NAS, NAS_CLIENT_ID,
+						0x04, 0, QMI_NAS_SS_INFO_IND,
+						ss_info->data, ss_info->len);
+		}
+
+		modem_write(QMI_SERVICE_NAS, NAS_CLIENT_ID, 0x02,
+					held_tid[i], QMI_NAS_GET_SS_INFO,
+					response->data, response->len);
+	}
+
+	held = 0;
+	g_byte_array_free(response, TRUE);
+}
+
+static gboolean modem_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	uint8_t buf[2048];
+	uint16_t message, tid;
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	/* Each request is a datagram of its own */
+	len = read(modem_fd, buf, sizeof(buf));
+	if (len < 12 || buf[0] != 0x01)
+		return TRUE;
+
+	if (buf[4] == QMI_SERVICE_CONTROL) {
+		tid = buf[7];
+		message = buf[8] | buf[9] << 8;
+		modem_control(tid, message);
+		return TRUE;
+	}
+
+	tid = buf[7] | buf[8] << 8;
+	message = buf[9] | buf[10] << 8;
+
+	if (message != QMI_NAS_GET_SS_INFO || held == MAX_WINDOW)
+		return TRUE;
+
+	held_tid[held++] = tid;
+
+	if (held == (guint) window || sent == (guint) queries)
+		modem_answer();
+
+	return TRUE;
+}
+
+static void lookup_ss_info(struct qmi_result *result)
+{
+	const struct qmi_nas_serving_system *ss;
+	const struct qmi_nas_current_plmn *plmn;
+	uint16_t len, lac;
+	uint32_t cell_id;
+	uint8_t roaming;
+
+	ss = qmi_result_get(result, QMI_NAS_RESULT_SERVING_SYSTEM, &len);
+	if (ss)
+		found += ss->radio_if_count;
+
+	if (qmi_result_get_uint8(result, QMI_NAS_RESULT_ROAMING_STATUS,
+								&roaming))
+		found += 1;
+
+	plmn = qmi_result_get(result, QMI_NAS_RESULT_CURRENT_PLMN, &len);
+	if (plmn)
+		found += plmn->desc_len;
+
+	if (qmi_result_get_uint16(result, QMI_NAS_RESULT_LOCATION_AREA_CODE,
+								&lac))
+		found += 1;
+
+	if (qmi_result_get_uint32(result, QMI_NAS_RESULT_CELL_ID, &cell_id))
+		found += 1;
+
+	if (qmi_result_get(result, QMI_NAS_RESULT_3GGP_DST, &len))
+		found += 1;
+
+	if (qmi_result_get(result, QMI_NAS_RESULT_3GPP_TIME, &len))
+		found += 1;
+
+	/* Only sent by CDMA networks */
+	if (qmi_result_get(result, 0x2a, &len))
+		found += 1;
+}
+
+static void ss_info_notify(struct qmi_result *result, void *user_data)
+{
+	guint64 start = now_ns();
+
+	lookup_ss_info(result);
+
+	callback_ns += now_ns() - start;
+	notified += 1;
+}
+
+static void event_notify(struct qmi_result *result, void *user_data)
+{
+	guint64 start = now_ns();
+	uint16_t len;
+
+	if (qmi_result_get(result, QMI_NAS_NOTIFY_SIGNAL_STRENGTH, &len))
+		found += 1;
+
+	if (qmi_result_get(result, QMI_NAS_NOTIFY_RF_INFO, &len))
+		found += 1;
+
+	/* Only sent with a registration reject */
+	if (qmi_result_get(result, 0x12, &len))
+		found += 1;
+
+	callback_ns += now_ns() - start;
+	notified += 1;
+}
+
+static void send_query(void);
+
+static void ss_info_cb(struct qmi_result *result, void *user_data)
+{
+	guint64 start = now_ns();
+
+	if (qmi_result_set_error(result, NULL)) {
+		g_printerr("Query failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	lookup_ss_info(result);
+
+	callback_ns += now_ns() - start;
+	answered += 1;
+
+	if (answered == (guint) queries) {
+		g_main_loop_quit(mainloop);
+		return;
+	}
+
+	send_query();
+}
+
+static void send_query(void)
+{
+	if (sent == (guint) queries)
+		return;
+
+	if (qmi_service_send(nas, QMI_NAS_GET_SS_INFO, NULL,
+					ss_info_cb, NULL, NULL) == 0) {
+		g_printerr("Unable to send query\n");
+		exit(EXIT_FAILURE);
+	}
+
+	sent += 1;
+}
+
+static void create_nas_cb(struct qmi_service *service, void *user_data)
+{
+	gint i;
+
+	if (!service) {
+		g_printerr("Unable to create NAS client\n");
+		exit(EXIT_FAILURE);
+	}
+
+	startup_ns = now_ns() - startup_ns;
+	nas = qmi_service_ref(service);
+
+	qmi_service_register(nas, QMI_NAS_SS_INFO_IND, ss_info_notify,
+								NULL, NULL);
+	qmi_service_register(nas, QMI_NAS_EVENT, event_notify, NULL, NULL);
+
+	for (i = 0; i < window; i++)
+		send_query();
+}
+
+static void discover_cb(void *user_data)
+{
+	if (!qmi_device_has_service(device, QMI_SERVICE_NAS)) {
+		g_printerr("Discovery failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	qmi_service_create(device, QMI_SERVICE_NAS, create_nas_cb,
+								NULL, NULL);
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GIOChannel *modem;
+	GTimer *timer;
+	gdouble elapsed;
+	int sv[2];
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (queries <= 0 || window <= 0 || window > MAX_WINDOW ||
+							indications < 0) {
+		g_printerr("Nothing to do\n");
+		return EXIT_FAILURE;
+	}
+
+	ss_info = build_ss_info();
+	event_report = build_event_report();
+
+	/* The QMI character device hands out one frame per read */
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+		perror("socketpair");
+		return EXIT_FAILURE;
+	}
+
+	modem_fd = sv[0];
+	modem = g_io_channel_unix_new(modem_fd);
+	g_io_add_watch(modem, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							modem_cb, NULL);
+
+	startup_ns = now_ns();
+
+	device = qmi_device_new(sv[1]);
+	qmi_device_set_close_on_unref(device, true);
+	qmi_device_set_window(device, QMI_SERVICE_NAS, window);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timer = g_timer_new();
+
+	qmi_device_discover(device, discover_cb, NULL, NULL);
+
+	g_main_loop_run(mainloop);
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	messages = answered + notified;
+
+	g_print("%u queries and %u indications, window %d, "
+			"NAS client ready after %.1f us\n",
+			answered, notified, window, startup_ns / 1e3);
+	g_print("%.3f s: %.2f us per message, %.1f ns in each callback "
+			"(%" G_GUINT64_FORMAT " TLVs found)\n",
+			elapsed, elapsed * 1e6 / messages,
+			(gdouble) callback_ns / messages, found);
+
+	g_timer_destroy(timer);
+	g_main_loop_unref(mainloop);
+
+	qmi_service_unref(nas);
+	qmi_device_unref(device);
+
+	g_io_channel_unref(modem);
+	close(modem_fd);
+
+	g_byte_array_free(event_report, TRUE);
+	g_byte_array_free(ss_info, TRUE);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,350 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Sends concatenated messages through the transmit queue of src/sms.c and
+ * the rilmodem SMS driver to a fake rild, which answers each
+ * RIL_REQUEST_SEND_SMS after a simulated network delay, slightly out of
+ * order.  The queue is run with each window size from one up to the given
+ * maximum, and every message has to be reported as sent exactly once.
+ *
+ * Usage: bench-rilmodem-sms [-m messages] [-s segments] [-l latency]
+ *				[-w window]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <gdbus.h>
+#include <gril.h>
+
+#include "ofono.h"
+
+#include "smsutil.h"
+#include "ril_constants.h"
+#include "rilmodem.h"
+#include "rilmodem-test-server.h"
+
+#define RECEIVER "+4915259911630"
+
+/* Septets per segment next to a 16 bit concatenation IE */
+#define SEGMENT_LEN 152
+
+static gint num_messages = 20;
+static gint num_segments = 3;
+static gint latency = 10;
+static gint max_window = 8;
+
+static GOptionEntry options[] = {
+	{ "messages", 'm', 0, G_OPTION_ARG_INT, &num_messages,
+				"Number of messages per run" },
+	{ "segments", 's', 0, G_OPTION_ARG_INT, &num_segments,
+				"Number of segments per message" },
+	{ "latency", 'l', 0, G_OPTION_ARG_INT, &latency,
+				"Network delay of a submit in ms" },
+	{ "window", 'w', 0, G_OPTION_ARG_INT, &max_window,
+				"Largest window of submits in flight" },
+	{ NULL },
+};
+
+static struct ofono_sms *sms;
+static DBusMessage *method_call;
+static GMainLoop *mainloop;
+static GRil *ril;
+
+static int listen_fd = -1;
+static int rild_fd = -1;
+static unsigned char next_mr;
+
+static guint16 next_ref;
+static unsigned int *notified;
+static unsigned int completed;
+
+struct rild_reply {
+	int32_t serial;
+	int32_t mr;
+};
+
+static gboolean rild_reply_cb(gpointer user_data)
+{
+	struct rild_reply *reply = user_data;
+	int32_t data[6];
+	uint32_t plen = htonl(sizeof(data));
+
+	data[0] = 0;			/* Solicited response */
+	data[1] = reply->serial;
+	data[2] = 0;			/* RIL_E_SUCCESS */
+	data[3] = reply->mr;
+	data[4] = -1;			/* No ackPDU */
+	data[5] = -1;			/* No error code */
+
+	g_assert(write(rild_fd, &plen, sizeof(plen)) == sizeof(plen));
+	g_assert(write(rild_fd, data, sizeof(data)) == sizeof(data));
+
+	g_free(reply);
+
+	return FALSE;
+}
+
+static void read_full(void *buf, size_t len)
+{
+	unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(rild_fd, p, len);
+		g_assert(n > 0);
+
+		p += n;
+		len -= n;
+	}
+}
+
+static gboolean rild_read_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct rild_reply *reply;
+	uint32_t plen;
+	int32_t hdr[2];
+	unsigned char *payload;
+	guint delay;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	read_full(&plen, sizeof(plen));
+	plen = ntohl(plen);
+	g_assert(plen >= sizeof(hdr));
+
+	read_full(hdr, sizeof(hdr));
+
+	payload = g_malloc(plen - sizeof(hdr) + 1);
+	read_full(payload, plen - sizeof(hdr));
+	g_free(payload);
+
+	g_assert(hdr[0] == RIL_REQUEST_SEND_SMS);
+
+	reply = g_new0(struct rild_reply, 1);
+	reply->serial = hdr[1];
+	reply->mr = next_mr++;
+
+	/* Some jitter, so that the responses come back out of order */
+	delay = latency + (reply->serial * 7) % 5;
+	g_timeout_add(delay, rild_reply_cb, reply);
+
+	return TRUE;
+}
+
+static gboolean rild_accept_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	GIOChannel *io;
+
+	rild_fd = accept(listen_fd, NULL, NULL);
+	g_assert(rild_fd >= 0);
+
+	io = g_io_channel_unix_new(rild_fd);
+	g_io_add_watch(io, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							rild_read_cb, NULL);
+	g_io_channel_unref(io);
+
+	return FALSE;
+}
+
+static void rild_listen(void)
+{
+	struct sockaddr_un addr;
+	GIOChannel *io;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	g_assert(listen_fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, RIL_SERVER_SOCK_PATH, sizeof(addr.sun_path) - 1);
+	unlink(addr.sun_path);
+
+	g_assert(bind(listen_fd, (struct sockaddr *) &addr,
+							sizeof(addr)) == 0);
+	g_assert(listen(listen_fd, 0) == 0);
+
+	io = g_io_channel_unix_new(listen_fd);
+	g_io_add_watch(io, G_IO_IN, rild_accept_cb, NULL);
+	g_io_channel_unref(io);
+}
+
+static void message_sent(gboolean ok, void *data)
+{
+	unsigned int *count = data;
+
+	g_assert(ok);
+
+	*count += 1;
+	completed += 1;
+
+	if (completed == (unsigned int) num_messages)
+		g_main_loop_quit(mainloop);
+}
+
+static void send_message(unsigned int *count)
+{
+	struct ofono_uuid uuid;
+	GSList *list;
+	gsize len;
+	char *text;
+
+	len = num_segments > 1 ? SEGMENT_LEN * num_segments : 1;
+	text = g_strnfill(len, 'a');
+	list = sms_text_prepare(RECEIVER, text, next_ref++, TRUE, FALSE);
+	g_free(text);
+
+	g_assert(g_slist_length(list) == (guint) num_segments);
+
+	g_assert(__ofono_sms_txq_submit(sms, list, 0, &uuid, NULL,
+							method_call) == 0);
+	g_assert(__ofono_sms_txq_set_submit_notify(sms, &uuid, message_sent,
+							count, NULL) == 0);
+
+	g_slist_free_full(list, g_free);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static gdouble run(unsigned int w)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	guint timeout;
+	gint i;
+
+	ofono_sms_set_tx_window(sms, w);
+
+	notified = g_new0(unsigned int, num_messages);
+	completed = 0;
+
+	timer = g_timer_new();
+
+	for (i = 0; i < num_messages; i++)
+		send_message(&notified[i]);
+
+	timeout = g_timeout_add_seconds(60, timeout_cb, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	for (i = 0; i < num_messages; i++)
+		g_assert(notified[i] == 1);
+
+	g_free(notified);
+
+	return elapsed;
+}
+
+static gboolean registered_cb(gpointer user_data)
+{
+	g_main_loop_quit(mainloop);
+
+	return FALSE;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	gdouble elapsed;
+	gint w;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (num_messages <= 0 || num_segments <= 0 || num_segments > 255 ||
+			latency < 0 || max_window <= 0) {
+		g_printerr("Nothing to do\n");
+		return EXIT_FAILURE;
+	}
+
+	ril_sms_init();
+	rild_listen();
+
+	ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+	g_assert(ril != NULL);
+
+	method_call = dbus_message_new_method_call("org.ofono", "/bench",
+					OFONO_MESSAGE_MANAGER_INTERFACE,
+					"SendMessage");
+	dbus_message_set_serial(method_call, 1);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+
+	sms = ofono_sms_create(NULL, OFONO_RIL_VENDOR_AOSP, RILMODEM, ril);
+	g_assert(sms != NULL);
+
+	/* Let the driver finish its delayed registration first */
+	g_idle_add(registered_cb, NULL);
+	g_main_loop_run(mainloop);
+
+	g_print("%d messages of %d segments, %d ms per submit\n",
+				num_messages, num_segments, latency);
+
+	for (w = 1; w <= max_window; w *= 2) {
+		elapsed = run(w);
+
+		g_print("window %2d: %8.1f ms, %7.1f segments/s\n", w,
+				elapsed * 1e3,
+				num_messages * num_segments / elapsed);
+	}
+
+	ofono_sms_remove(sms);
+	g_main_loop_unref(mainloop);
+
+	g_ril_unref(ril);
+	dbus_message_unref(method_call);
+	close(rild_fd);
+	close(listen_fd);
+	unlink(RIL_SERVER_SOCK_PATH);
+
+	ril_sms_exit();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Runs the proactive commands of the test-stkutil corpus through the
+ * command parser, first only parsing and freeing each PDU, then running
+ * the corpus checks themselves, and prints the time spent per command.
+ *
+ * Usage: bench-stkutil [-n iterations]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#define MAX_CORPUS 1024
+
+struct corpus_entry {
+	gconstpointer data;
+	GTestDataFunc func;
+};
+
+static struct corpus_entry corpus[MAX_CORPUS];
+static unsigned int corpus_len;
+
+static void corpus_add(gconstpointer data, GTestDataFunc func)
+{
+	if (corpus_len == MAX_CORPUS) {
+		g_printerr("Corpus too large\n");
+		exit(EXIT_FAILURE);
+	}
+
+	corpus[corpus_len].data = data;
+	corpus[corpus_len].func = func;
+	corpus_len += 1;
+}
+
+/* Collect the test cases instead of registering them with g_test */
+#define main test_stkutil_main
+#define g_test_init(argc, argv, ...)
+#define g_test_add_data_func(path, data, func) corpus_add(data, func)
+#define g_test_run() 0
+
+int test_stkutil_main(int argc, char **argv);
+
+#include "test-stkutil.c"
+
+#undef main
+
+/* All proactive command tests start with the PDU */
+struct command_test {
+	const unsigned char *pdu;
+	unsigned int pdu_len;
+};
+
+static gint iterations = 2000;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+				"Number of passes over the corpus" },
+	{ NULL },
+};
+
+static gboolean is_command_test(const struct corpus_entry *entry)
+{
+	if (entry->func == test_terminal_response_encoding ||
+			entry->func == test_envelope_encoding ||
+			entry->func == test_html_attr ||
+			entry->func == test_img_to_xpm)
+		return FALSE;
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	const struct command_test *test;
+	struct stk_command *command;
+	unsigned int commands = 0;
+	unsigned int i;
+	GTimer *timer;
+	gdouble t_parse, t_corpus;
+	gint n;
+
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, options, NULL);
+
+	if (g_option_context_parse(context, &argc, &argv, &error) == FALSE) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free(context);
+
+	if (iterations <= 0) {
+		g_printerr("Nothing to do\n");
+		return EXIT_FAILURE;
+	}
+
+	test_stkutil_main(argc, argv);
+
+	for (i = 0; i < corpus_len; i++)
+		if (is_command_test(&corpus[i]))
+			commands += 1;
+
+	timer = g_timer_new();
+
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < corpus_len; i++) {
+			if (!is_command_test(&corpus[i]))
+				continue;
+
+			test = corpus[i].data;
+			command = stk_command_new_from_pdu(test->pdu,
+								test->pdu_len);
+			stk_command_free(command);
+		}
+	}
+
+	t_parse = g_timer_elapsed(timer, NULL);
+	g_timer_start(timer);
+
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < corpus_len; i++) {
+			if (is_command_test(&corpus[i]))
+				corpus[i].func(corpus[i].data);
+		}
+	}
+
+	t_corpus = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_print("%u proactive commands, %d passes\n", commands, iterations);
+	g_print("parse and free: %7.1f ns per command\n",
+			t_parse * 1e9 / iterations / commands);
+	g_print("corpus checks:  %7.1f ns per command\n",
+			t_corpus * 1e9 / iterations / commands);
+
+	return EXIT_SUCCESS;
+}
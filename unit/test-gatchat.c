@@ -0,0 +1,330 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+static const char unsolicited[] =
+	"\r\n+CREG: 1\r\n"
+	"\r\n+CGREG: 1\r\n"
+	"\r\n+CSQ: 10,99\r\n"
+	"\r\nRING\r\n"
+	"\r\n+CREG: 5\r\n"
+	"\r\nRING\r\n"
+	"\r\n+CMT: ,23\r\n"
+	"0791447758100650040C914477581006500000111011316142400BD4F29C0E9A9"
+	"BE7A06C\r\n";
+
+#define NUM_ENTRIES	200
+#define SPLIT_OFFSET	8000
+
+static GMainLoop *mainloop;
+static GAtChat *chat;
+static guint ring_id;
+static guint creg_count;
+static guint cgreg_count;
+static guint cs_count;
+static guint ring_count;
+static guint cmt_count;
+static int modem_fd;
+
+static void ring_notify(GAtResult *result, gpointer user_data)
+{
+	ring_count += 1;
+
+	/* Removal is deferred until the dispatch loop is done */
+	g_assert(g_at_chat_unregister(chat, ring_id));
+}
+
+static void creg_notify(GAtResult *result, gpointer user_data)
+{
+	creg_count += 1;
+
+	/* Adding a prefix from a handler must not disturb the dispatch */
+	if (creg_count == 1)
+		ring_id = g_at_chat_register(chat, "RING", ring_notify,
+						FALSE, NULL, NULL);
+}
+
+static void cgreg_notify(GAtResult *result, gpointer user_data)
+{
+	cgreg_count += 1;
+}
+
+static void cs_notify(GAtResult *result, gpointer user_data)
+{
+	cs_count += 1;
+}
+
+static void cmt_notify(GAtResult *result, gpointer user_data)
+{
+	GAtResultIter iter;
+
+	g_at_result_iter_init(&iter, result);
+	g_assert(g_at_result_iter_next(&iter, "+CMT:"));
+	g_assert(g_at_result_pdu(result) != NULL);
+
+	cmt_count += 1;
+	g_main_loop_quit(mainloop);
+}
+
+static char *build_entry(guint n)
+{
+	/* Vary the length so that lines end up split across the wrap */
+	return g_strdup_printf("+CPBR: %u,\"%0*u\",129,\"Entry %u\"",
+					n + 1, 3 + n % 37, n * 7919, n);
+}
+
+static gboolean write_rest(gpointer user_data)
+{
+	GString *rest = user_data;
+
+	g_assert(write(modem_fd, rest->str, rest->len) == (ssize_t) rest->len);
+	g_string_free(rest, TRUE);
+
+	return FALSE;
+}
+
+static gboolean modem_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	int fd = g_io_channel_unix_get_fd(channel);
+	GString *reply;
+	char cmd[64];
+	ssize_t len;
+	guint n;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	len = read(fd, cmd, sizeof(cmd) - 1);
+	if (len <= 0)
+		return FALSE;
+
+	cmd[len] = '\0';
+	g_assert(cmd[len - 1] == '\r');
+
+	reply = g_string_new(NULL);
+
+	for (n = 0; n < NUM_ENTRIES; n++) {
+		char *entry = build_entry(n);
+
+		g_string_append_printf(reply, "\r\n%s\r\n", entry);
+		g_free(entry);
+	}
+
+	g_string_append(reply, "\r\nOK\r\n");
+
+	/*
+	 * Hold back everything past the first SPLIT_OFFSET bytes until the
+	 * chat has consumed what it could, so that the rest lands on both
+	 * sides of the end of the ring buffer.
+	 */
+	g_assert(reply->len > SPLIT_OFFSET);
+	g_assert(write(fd, reply->str, SPLIT_OFFSET) == SPLIT_OFFSET);
+
+	g_string_erase(reply, 0, SPLIT_OFFSET);
+	g_idle_add(write_rest, reply);
+
+	return TRUE;
+}
+
+static void listing_notify(GAtResult *result, gpointer user_data)
+{
+	guint *count = user_data;
+	GAtResultIter iter;
+	char *entry = build_entry(*count);
+
+	g_at_result_iter_init(&iter, result);
+	g_assert(g_at_result_iter_next(&iter, NULL));
+	g_assert_cmpstr(g_at_result_iter_raw_line(&iter), ==, entry);
+
+	g_free(entry);
+	*count += 1;
+}
+
+static void listing_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	guint *count = user_data;
+
+	g_assert(ok);
+	g_assert(*count == NUM_ENTRIES);
+	g_assert(g_at_result_num_response_lines(result) == 0);
+}
+
+static void response_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	GAtResultIter iter;
+	const char *line;
+	char *entry;
+	guint n = 0;
+
+	g_assert(ok);
+	g_assert_cmpstr(g_at_result_final_response(result), ==, "OK");
+	g_assert(g_at_result_num_response_lines(result) == NUM_ENTRIES);
+
+	g_at_result_iter_init(&iter, result);
+
+	while (g_at_result_iter_next(&iter, NULL)) {
+		line = g_at_result_iter_raw_line(&iter);
+		entry = build_entry(n);
+
+		g_assert_cmpstr(line, ==, entry);
+
+		g_free(entry);
+		n += 1;
+	}
+
+	g_assert(n == NUM_ENTRIES);
+
+	g_main_loop_quit(mainloop);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static void test_notify(void)
+{
+	GIOChannel *io;
+	GAtSyntax *syntax;
+	guint timeout;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	syntax = g_at_syntax_new_gsmv1();
+	chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+
+	g_assert(chat != NULL);
+
+	g_assert(g_at_chat_register(chat, "+CREG:", creg_notify,
+					FALSE, NULL, NULL) > 0);
+	g_assert(g_at_chat_register(chat, "+CGREG:", cgreg_notify,
+					FALSE, NULL, NULL) > 0);
+	g_assert(g_at_chat_register(chat, "+CS", cs_notify,
+					FALSE, NULL, NULL) > 0);
+	g_assert(g_at_chat_register(chat, "+CMT:", cmt_notify,
+					TRUE, NULL, NULL) > 0);
+
+	/* A prefix can't be registered for both PDU and non-PDU lines */
+	g_assert(g_at_chat_register(chat, "+CMT:", cs_notify,
+					FALSE, NULL, NULL) == 0);
+
+	g_assert(write(sv[0], unsolicited, sizeof(unsolicited) - 1) ==
+						sizeof(unsolicited) - 1);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	g_assert(creg_count == 2);
+	g_assert(cgreg_count == 1);
+	g_assert(cs_count == 1);
+	g_assert(ring_count == 1);
+	g_assert(cmt_count == 1);
+
+	g_assert(g_at_chat_get_notify_hits(chat, "+CREG:") == 2);
+	g_assert(g_at_chat_get_notify_hits(chat, "+CGREG:") == 1);
+	g_assert(g_at_chat_get_notify_hits(chat, "+CS") == 1);
+	g_assert(g_at_chat_get_notify_hits(chat, "+CMT:") == 1);
+
+	/* RING was unregistered after its first line */
+	g_assert(g_at_chat_get_notify_hits(chat, "RING") == 0);
+	g_assert(g_at_chat_get_notify_hits(chat, "+CSQ:") == 0);
+
+	g_at_chat_unref(chat);
+	close(sv[0]);
+}
+
+static void test_response(void)
+{
+	GIOChannel *io;
+	GIOChannel *modem;
+	GAtSyntax *syntax;
+	guint timeout;
+	guint count = 0;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	syntax = g_at_syntax_new_gsmv1();
+	chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+
+	g_assert(chat != NULL);
+
+	modem_fd = sv[0];
+	modem = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(modem, TRUE);
+	g_io_add_watch(modem, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							modem_cb, NULL);
+
+	g_assert(g_at_chat_send_listing(chat, "AT+CPBR=1,200", NULL,
+					listing_notify, listing_cb,
+					&count, NULL) > 0);
+	g_assert(g_at_chat_send(chat, "AT+CPBR=1,200", NULL,
+					response_cb, NULL, NULL) > 0);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	g_assert(count == NUM_ENTRIES);
+
+	g_at_chat_unref(chat);
+	g_io_channel_unref(modem);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgatchat/notify", test_notify);
+	g_test_add_func("/testgatchat/response", test_response);
+
+	return g_test_run();
+}
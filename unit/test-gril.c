@@ -0,0 +1,352 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+
+#include <gril.h>
+
+#include "ril_constants.h"
+#include "rilmodem-test-server.h"
+
+#define NUM_RECORDS	300
+#define LARGE_EVERY	25
+#define LARGE_INTS	6000
+#define OVERSIZED_AT	150
+#define OVERSIZED_SIZE	(300 * 1024)
+#define NUM_REQUESTS	8
+
+static GMainLoop *mainloop;
+static GRil *ril;
+static struct server_data *server;
+static GByteArray *stream;
+static guint written;
+static guint chunk;
+static guint received;
+
+static const struct rilmodem_test_data unsol_data = {
+	.unsol_test = TRUE,
+};
+
+static guint record_ints(guint n)
+{
+	if (n % LARGE_EVERY == LARGE_EVERY - 1)
+		return LARGE_INTS;
+
+	return (n * 97) % 600 + 1;
+}
+
+static void append_record(GByteArray *array, int32_t req,
+					const int32_t *data, guint count)
+{
+	uint32_t plen = htonl((2 + count) * sizeof(int32_t));
+	int32_t header[2] = { 1, req };
+
+	g_byte_array_append(array, (guint8 *) &plen, sizeof(plen));
+	g_byte_array_append(array, (guint8 *) header, sizeof(header));
+	g_byte_array_append(array, (guint8 *) data, count * sizeof(int32_t));
+}
+
+static GByteArray *build_stream(void)
+{
+	GByteArray *array = g_byte_array_new();
+	int32_t *data = g_new(int32_t, OVERSIZED_SIZE / sizeof(int32_t));
+	guint n, i, count;
+
+	for (n = 0; n < NUM_RECORDS; n++) {
+		/* rild sending more than we are willing to buffer */
+		if (n == OVERSIZED_AT) {
+			memset(data, 0, OVERSIZED_SIZE);
+			append_record(array, RIL_UNSOL_CELL_INFO_LIST, data,
+					OVERSIZED_SIZE / sizeof(int32_t));
+		}
+
+		count = record_ints(n);
+
+		for (i = 0; i < count; i++)
+			data[i] = n + i;
+
+		append_record(array, RIL_UNSOL_SIGNAL_STRENGTH, data, count);
+	}
+
+	g_free(data);
+
+	return array;
+}
+
+static void signal_strength_notify(struct ril_msg *message,
+							gpointer user_data)
+{
+	struct parcel rilp;
+	guint count = record_ints(received);
+	guint i;
+
+	g_assert(message->unsolicited);
+	g_assert(message->req == RIL_UNSOL_SIGNAL_STRENGTH);
+	g_assert(message->buf_len == count * sizeof(int32_t));
+
+	g_ril_init_parcel(message, &rilp);
+
+	for (i = 0; i < count; i++)
+		g_assert(parcel_r_int32(&rilp) == (int32_t) (received + i));
+
+	g_assert(rilp.malformed == 0);
+
+	received += 1;
+
+	if (received == NUM_RECORDS)
+		g_main_loop_quit(mainloop);
+}
+
+static void cell_info_notify(struct ril_msg *message, gpointer user_data)
+{
+	g_assert_not_reached();
+}
+
+static gboolean write_chunk(gpointer user_data)
+{
+	guint len = MIN(chunk, stream->len - written);
+
+	rilmodem_test_server_write(server, stream->data + written, len);
+	written += len;
+
+	/* Odd sizes, so that headers end up split across reads and wraps */
+	chunk = chunk * 7 % 9973 + 1;
+
+	return written < stream->len;
+}
+
+static void server_connect_cb(gpointer data)
+{
+	g_idle_add(write_chunk, NULL);
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static void test_unsol_stream(void)
+{
+	guint timeout;
+
+	stream = build_stream();
+	written = 0;
+	chunk = 4099;
+	received = 0;
+
+	server = rilmodem_test_server_create(server_connect_cb,
+							&unsol_data, NULL);
+
+	ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+	g_assert(ril != NULL);
+
+	g_assert(g_ril_register(ril, RIL_UNSOL_SIGNAL_STRENGTH,
+				signal_strength_notify, NULL) > 0);
+	g_assert(g_ril_register(ril, RIL_UNSOL_CELL_INFO_LIST,
+				cell_info_notify, NULL) > 0);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	g_assert(received == NUM_RECORDS);
+	g_assert(written == stream->len);
+
+	g_ril_unref(ril);
+	rilmodem_test_server_close(server);
+	g_byte_array_free(stream, TRUE);
+}
+
+struct request_hdr {
+	uint32_t length;
+	int32_t req;
+	int32_t serial;
+};
+
+static int listen_fd;
+static int rild_fd;
+static struct request_hdr requests[NUM_REQUESTS];
+static guint requests_read;
+static guint replies;
+static gint serials[NUM_REQUESTS];
+
+static void reply_cb(struct ril_msg *message, gpointer user_data)
+{
+	guint n = GPOINTER_TO_UINT(user_data);
+	struct parcel rilp;
+
+	/* Replies come back in reverse, each must reach its own request */
+	g_assert(n == NUM_REQUESTS - 1 - replies);
+	g_assert(message->unsolicited == FALSE);
+	g_assert(message->serial_no == serials[n]);
+	g_assert(message->req == RIL_REQUEST_GET_IMSI + (int) n);
+
+	g_ril_init_parcel(message, &rilp);
+	g_assert(parcel_r_int32(&rilp) == (int32_t) n);
+
+	replies += 1;
+
+	if (replies == NUM_REQUESTS)
+		g_main_loop_quit(mainloop);
+}
+
+static void send_request(guint n)
+{
+	struct parcel rilp;
+
+	parcel_init(&rilp);
+	parcel_w_int32(&rilp, n);
+
+	serials[n] = g_ril_send(ril, RIL_REQUEST_GET_IMSI + n, &rilp,
+					reply_cb, GUINT_TO_POINTER(n), NULL);
+	g_assert(serials[n] > 0);
+}
+
+static void send_replies(void)
+{
+	int32_t reply[4];
+	uint32_t plen = htonl(sizeof(reply));
+	int i;
+
+	for (i = NUM_REQUESTS - 1; i >= 0; i--) {
+		reply[0] = 0;
+		reply[1] = requests[i].serial;
+		reply[2] = 0;
+		reply[3] = i;
+
+		g_assert(write(rild_fd, &plen, sizeof(plen)) == sizeof(plen));
+		g_assert(write(rild_fd, reply, sizeof(reply)) ==
+							sizeof(reply));
+	}
+}
+
+static gboolean rild_read_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct request_hdr *hdr = &requests[requests_read];
+	int32_t value;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	g_assert(read(rild_fd, hdr, sizeof(*hdr)) == sizeof(*hdr));
+	g_assert(ntohl(hdr->length) == sizeof(*hdr) - sizeof(hdr->length) +
+							sizeof(value));
+	g_assert(read(rild_fd, &value, sizeof(value)) == sizeof(value));
+	g_assert(value == (int32_t) requests_read);
+	g_assert(hdr->serial == serials[requests_read]);
+
+	requests_read += 1;
+
+	/* Keep every request in flight until the last one arrived */
+	if (requests_read < NUM_REQUESTS)
+		send_request(requests_read);
+	else
+		send_replies();
+
+	return requests_read < NUM_REQUESTS;
+}
+
+static gboolean rild_accept_cb(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	GIOChannel *io;
+
+	rild_fd = accept(listen_fd, NULL, NULL);
+	g_assert(rild_fd >= 0);
+
+	io = g_io_channel_unix_new(rild_fd);
+	g_io_add_watch(io, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+							rild_read_cb, NULL);
+	g_io_channel_unref(io);
+
+	return FALSE;
+}
+
+static void test_out_of_order(void)
+{
+	struct sockaddr_un addr;
+	GIOChannel *io;
+	guint timeout;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	g_assert(listen_fd >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, RIL_SERVER_SOCK_PATH, sizeof(addr.sun_path) - 1);
+	unlink(addr.sun_path);
+
+	g_assert(bind(listen_fd, (struct sockaddr *) &addr,
+							sizeof(addr)) == 0);
+	g_assert(listen(listen_fd, 0) == 0);
+
+	io = g_io_channel_unix_new(listen_fd);
+	g_io_add_watch(io, G_IO_IN, rild_accept_cb, NULL);
+	g_io_channel_unref(io);
+
+	ril = g_ril_new(RIL_SERVER_SOCK_PATH, OFONO_RIL_VENDOR_AOSP);
+	g_assert(ril != NULL);
+
+	requests_read = 0;
+	replies = 0;
+	send_request(0);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	g_assert(replies == NUM_REQUESTS);
+
+	g_ril_unref(ril);
+	close(rild_fd);
+	close(listen_fd);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgril/unsolicited stream", test_unsol_stream);
+	g_test_add_func("/testgril/out of order replies", test_out_of_order);
+
+	return g_test_run();
+}
@@ -0,0 +1,183 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "crc-ccitt.h"
+#include "gathdlc.h"
+
+#define NUM_FRAMES	256
+#define BURST_FRAMES	48
+#define MAX_PAYLOAD	1600
+
+static GMainLoop *mainloop;
+static GAtHDLC *hdlc_tx;
+static GAtHDLC *hdlc_rx;
+static unsigned char payload[MAX_PAYLOAD];
+static guint frames_sent;
+static guint frames_received;
+static guint frames_expected;
+
+static gsize build_payload(guint n)
+{
+	gsize size = (n * 37) % MAX_PAYLOAD + 1;
+	gsize i;
+
+	/* Make sure flags, escapes and control characters show up */
+	for (i = 0; i < size; i++)
+		payload[i] = (i * 7 + n) & 0xff;
+
+	return size;
+}
+
+static void test_crc(void)
+{
+	unsigned char data[256];
+	guint16 expected;
+	gsize len;
+	gsize i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i * 31 + 5) & 0xff;
+
+	for (len = 0; len <= sizeof(data); len++) {
+		expected = 0xffff;
+
+		for (i = 0; i < len; i++)
+			expected = crc_ccitt_byte(expected, data[i]);
+
+		g_assert(crc_ccitt(0xffff, data, len) == expected);
+	}
+}
+
+static void send_next_frame(void)
+{
+	gsize size = build_payload(frames_sent);
+
+	g_assert(g_at_hdlc_send(hdlc_tx, payload, size));
+	frames_sent += 1;
+}
+
+static void receive_frame(const unsigned char *data, gsize size,
+							gpointer user_data)
+{
+	gsize expected = build_payload(frames_received);
+
+	g_assert(size == expected);
+	g_assert(memcmp(data, payload, size) == 0);
+
+	frames_received += 1;
+
+	if (frames_received == frames_expected) {
+		g_main_loop_quit(mainloop);
+		return;
+	}
+
+	/* Unless everything was queued up front, send the next one */
+	if (frames_sent < frames_expected)
+		send_next_frame();
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static void run_roundtrip(guint32 accm, guint burst, guint total)
+{
+	GIOChannel *io;
+	int sv[2];
+	guint timeout;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	hdlc_tx = g_at_hdlc_new(io);
+	g_at_io_set_unix_fd(g_at_hdlc_get_io(hdlc_tx), sv[0]);
+	g_io_channel_unref(io);
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	hdlc_rx = g_at_hdlc_new(io);
+	g_at_io_set_unix_fd(g_at_hdlc_get_io(hdlc_rx), sv[1]);
+	g_io_channel_unref(io);
+
+	g_assert(hdlc_tx != NULL);
+	g_assert(hdlc_rx != NULL);
+
+	g_at_hdlc_set_xmit_accm(hdlc_tx, accm);
+	g_at_hdlc_set_recv_accm(hdlc_rx, accm);
+	g_at_hdlc_set_receive(hdlc_rx, receive_frame, NULL);
+
+	frames_sent = 0;
+	frames_received = 0;
+	frames_expected = total;
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+
+	while (frames_sent < burst)
+		send_next_frame();
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	g_assert(frames_received == total);
+
+	g_at_hdlc_unref(hdlc_rx);
+	g_at_hdlc_unref(hdlc_tx);
+}
+
+static void test_roundtrip(gconstpointer data)
+{
+	run_roundtrip(GPOINTER_TO_UINT(data), 1, NUM_FRAMES);
+}
+
+static void test_burst(void)
+{
+	/* Queue many frames at once so that several buffers get flushed */
+	run_roundtrip(~0U, BURST_FRAMES, BURST_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhdlc/crc", test_crc);
+	g_test_add_data_func("/testhdlc/roundtrip default accm",
+					GUINT_TO_POINTER(~0U), test_roundtrip);
+	g_test_add_data_func("/testhdlc/roundtrip no accm",
+					GUINT_TO_POINTER(0U), test_roundtrip);
+	g_test_add_func("/testhdlc/burst", test_burst);
+
+	return g_test_run();
+}
@@ -0,0 +1,298 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+static FILE *dump;
+
+static void dump_start(void)
+{
+	dump = tmpfile();
+	g_assert(dump != NULL);
+
+	__ofono_log_trace_dump(fileno(dump));
+	rewind(dump);
+}
+
+/* Returns the next dumped message and the ring it came from */
+static char *dump_next(char *ring, size_t size)
+{
+	static char line[2048];
+	char *text;
+	char *space;
+
+	if (fgets(line, sizeof(line), dump) == NULL)
+		return NULL;
+
+	g_assert(line[0] == '[');
+
+	space = strchr(line, ' ');
+	text = strstr(line, "] ");
+	g_assert(space != NULL && text != NULL && space < text);
+
+	if (ring)
+		g_strlcpy(ring, line + 1, MIN(size, (size_t) (space - line)));
+
+	line[strlen(line) - 1] = '\0';
+
+	return text + 2;
+}
+
+static void dump_end(void)
+{
+	g_assert(dump_next(NULL, 0) == NULL);
+	fclose(dump);
+}
+
+#define CHECK_FORMAT(fmt, arg...) do {					\
+	char expected[1024];						\
+									\
+	snprintf(expected, sizeof(expected), fmt, ## arg);		\
+	ofono_debug(fmt, ## arg);					\
+	g_ptr_array_add(messages, g_strdup(expected));			\
+} while (0)
+
+static void test_format(void)
+{
+	GPtrArray *messages = g_ptr_array_new_with_free_func(g_free);
+	char buf[32] = "not terminated";
+	char long_string[400];
+	char *null_string = g_strdup(NULL);
+	char *text;
+	unsigned int i;
+
+	memset(long_string, 'x', sizeof(long_string) - 1);
+	long_string[sizeof(long_string) - 1] = '\0';
+
+	__ofono_log_trace_enable();
+
+	CHECK_FORMAT("plain text");
+	CHECK_FORMAT("%d %i %5d %-5d| %05d %+d", -1, 2, 3, 4, 5, 6);
+	CHECK_FORMAT("%hhd %hhu %hd %hu", 300, 300, 70000, 70000);
+	CHECK_FORMAT("%ld %lu %lld %llu", -7L, 8UL, -9LL, 10ULL);
+	CHECK_FORMAT("%zu %zd %jd %td", (size_t) 11, (ssize_t) -12,
+				(intmax_t) 13, (ptrdiff_t) -14);
+	CHECK_FORMAT("%x %X %#x %o %08x", 255, 255, 255, 8, 0xbeef);
+	CHECK_FORMAT("%c%c%c", 'a', 'b', 'c');
+	CHECK_FORMAT("%f %.2f %e %g %10.3f", 1.5, 2.25, 1e10, 0.1, 3.14159);
+	CHECK_FORMAT("%s|%10s|%-10s|%.3s", "one", "two", "three", "four");
+	CHECK_FORMAT("%*d|%-*d|%.*d", 6, 1, 6, 2, 3, 4);
+	CHECK_FORMAT("%.*s|%*s", 3, buf, -6, "neg");
+	CHECK_FORMAT("%.*s", -1, "negative precision");
+	CHECK_FORMAT("%p %p", (void *) buf, NULL);
+	ofono_debug("%s", null_string);
+	g_ptr_array_add(messages, g_strdup("(null)"));
+	CHECK_FORMAT("100%% %s", "done");
+	CHECK_FORMAT("%d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+				1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14);
+	CHECK_FORMAT("%2$s %1$s", "world", "hello");
+	CHECK_FORMAT("%Lf", (long double) 1.25);
+
+	errno = ENOENT;
+	CHECK_FORMAT("failed: %m");
+
+	/* Records keep only so much of the strings */
+	ofono_debug("%s %s", long_string, "after");
+	g_ptr_array_add(messages, NULL);
+
+	/* Only what the string was when it was logged counts */
+	strcpy(buf, "before");
+	ofono_debug("copy %s", buf);
+	strcpy(buf, "after");
+	g_ptr_array_add(messages, g_strdup("copy before"));
+
+	dump_start();
+
+	for (i = 0; i < messages->len; i++) {
+		const char *expected = g_ptr_array_index(messages, i);
+
+		text = dump_next(NULL, 0);
+		g_assert(text != NULL);
+
+		if (expected == NULL) {
+			g_assert(strlen(text) > 100);
+			g_assert(strlen(text) < strlen(long_string));
+			g_assert(strncmp(text, long_string, 100) == 0);
+			continue;
+		}
+
+		g_assert_cmpstr(text, ==, expected);
+	}
+
+	dump_end();
+
+	__ofono_log_trace_disable();
+	g_ptr_array_free(messages, TRUE);
+}
+
+static void test_wrap(void)
+{
+	char *text;
+	int first = -1;
+	int last = -1;
+	int n;
+
+	__ofono_log_trace_enable();
+
+	for (n = 0; n < 5000; n++)
+		ofono_debug("record %d", n);
+
+	dump_start();
+
+	while ((text = dump_next(NULL, 0)) != NULL) {
+		g_assert(sscanf(text, "record %d", &n) == 1);
+
+		/* Oldest first, nothing missing after the wrap */
+		if (first < 0)
+			first = n;
+		else
+			g_assert(n == last + 1);
+
+		last = n;
+	}
+
+	g_assert(last == 4999);
+	g_assert(first > 0);
+
+	fclose(dump);
+	__ofono_log_trace_disable();
+}
+
+static struct ofono_debug_desc sim_desc = {
+	.file = "drivers/atmodem/sim.c",
+	.flags = OFONO_DEBUG_FLAG_PRINT,
+};
+
+static struct ofono_debug_desc sms_desc = {
+	.file = "src/sms.c",
+	.flags = OFONO_DEBUG_FLAG_PRINT,
+};
+
+static void test_subsystems(void)
+{
+	char ring[64];
+	char *text;
+	int n;
+
+	__ofono_log_trace_enable();
+
+	for (n = 0; n < 30; n++) {
+		switch (n % 3) {
+		case 0:
+			ofono_debug_trace(&sim_desc, "%s:%s() %d",
+						sim_desc.file, __func__, n);
+			break;
+		case 1:
+			ofono_debug_trace(&sms_desc, "%s:%s() %d",
+						sms_desc.file, __func__, n);
+			break;
+		case 2:
+			ofono_debug("general %d", n);
+			break;
+		}
+	}
+
+	/* Each ring has its records, the dump interleaves them in order */
+	dump_start();
+
+	for (n = 0; n < 30; n++) {
+		char expected[128];
+		const char *expected_ring;
+
+		text = dump_next(ring, sizeof(ring));
+		g_assert(text != NULL);
+
+		switch (n % 3) {
+		case 0:
+			snprintf(expected, sizeof(expected), "%s:%s() %d",
+					sim_desc.file, "test_subsystems", n);
+			expected_ring = "drivers/atmodem";
+			break;
+		case 1:
+			snprintf(expected, sizeof(expected), "%s:%s() %d",
+					sms_desc.file, "test_subsystems", n);
+			expected_ring = "src";
+			break;
+		default:
+			snprintf(expected, sizeof(expected), "general %d", n);
+			expected_ring = "ofonod";
+			break;
+		}
+
+		g_assert_cmpstr(text, ==, expected);
+		g_assert_cmpstr(ring, ==, expected_ring);
+	}
+
+	dump_end();
+
+	__ofono_log_trace_disable();
+}
+
+static void test_reenable(void)
+{
+	char ring[64];
+	char *text;
+
+	__ofono_log_trace_enable();
+	ofono_debug_trace(&sim_desc, "%s:%s() first", sim_desc.file, __func__);
+	__ofono_log_trace_disable();
+
+	/* The rings come back in a different order, sim_desc looks again */
+	__ofono_log_trace_enable();
+	ofono_debug_trace(&sms_desc, "%s:%s() sms", sms_desc.file, __func__);
+	ofono_debug_trace(&sim_desc, "%s:%s() sim", sim_desc.file, __func__);
+
+	dump_start();
+
+	text = dump_next(ring, sizeof(ring));
+	g_assert(text != NULL);
+	g_assert_cmpstr(ring, ==, "src");
+
+	text = dump_next(ring, sizeof(ring));
+	g_assert(text != NULL);
+	g_assert_cmpstr(ring, ==, "drivers/atmodem");
+	g_assert(g_str_has_suffix(text, "sim"));
+
+	dump_end();
+
+	__ofono_log_trace_disable();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testlog/format", test_format);
+	g_test_add_func("/testlog/wrap", test_wrap);
+	g_test_add_func("/testlog/subsystems", test_subsystems);
+	g_test_add_func("/testlog/reenable", test_reenable);
+
+	return g_test_run();
+}
@@ -556,6 +556,168 @@ static void test_extract_advanced(void)
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+#define DEMUX_CHANNELS	3
+#define DEMUX_FRAMES	2000
+
+static GAtMux *demux;
+static GByteArray *demux_stream;
+static GByteArray *demux_expected[DEMUX_CHANNELS];
+static GByteArray *demux_received[DEMUX_CHANNELS];
+static guint demux_written;
+static guint demux_chunk;
+static guint demux_pending;
+static int demux_fd;
+
+static guint demux_frame_len(guint n)
+{
+	/* Both length encodings, and lengths that straddle the ring end */
+	return (n * 37) % 300 + 1;
+}
+
+static void demux_build(void)
+{
+	guint8 frame[512];
+	guint8 data[300];
+	guint n, i, len;
+	int size;
+
+	demux_stream = g_byte_array_new();
+
+	for (i = 0; i < DEMUX_CHANNELS; i++)
+		demux_expected[i] = g_byte_array_new();
+
+	for (n = 0; n < DEMUX_FRAMES; n++) {
+		guint dlc = n % DEMUX_CHANNELS;
+
+		len = demux_frame_len(n);
+
+		for (i = 0; i < len; i++)
+			data[i] = n + i;
+
+		size = gsm0710_basic_fill_frame(frame, dlc + 1, GSM0710_DATA,
+								data, len);
+
+		/* Share the closing flag with the next frame every so often */
+		if (n % 5 == 0)
+			size -= 1;
+
+		g_byte_array_append(demux_stream, frame, size);
+		g_byte_array_append(demux_expected[dlc], data, len);
+		demux_pending += len;
+	}
+
+	frame[0] = 0xF9;
+	g_byte_array_append(demux_stream, frame, 1);
+}
+
+static gboolean demux_write(gpointer user_data)
+{
+	guint len = MIN(demux_chunk, demux_stream->len - demux_written);
+
+	g_assert(write(demux_fd, demux_stream->data + demux_written, len) ==
+								(ssize_t) len);
+	demux_written += len;
+
+	/* Odd sizes, so that frames end up split across reads and wraps */
+	demux_chunk = demux_chunk * 7 % 4093 + 1;
+
+	return demux_written < demux_stream->len;
+}
+
+static gboolean demux_read(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	GByteArray *received = user_data;
+	gchar buf[1024];
+	gsize bytes_read;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	while (g_io_channel_read_chars(channel, buf, sizeof(buf), &bytes_read,
+					NULL) == G_IO_STATUS_NORMAL) {
+		g_byte_array_append(received, (guint8 *) buf, bytes_read);
+		demux_pending -= bytes_read;
+	}
+
+	if (demux_pending == 0)
+		g_main_loop_quit(mainloop);
+
+	return TRUE;
+}
+
+static gboolean demux_timeout(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static void test_demux(void)
+{
+	GIOChannel *io;
+	GIOChannel *dlcs[DEMUX_CHANNELS];
+	guint timeout;
+	int sv[2];
+	int i;
+
+	demux_pending = 0;
+	demux_build();
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	demux_fd = sv[0];
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+
+	demux = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(demux != NULL);
+	g_assert(g_at_mux_start(demux));
+
+	for (i = 0; i < DEMUX_CHANNELS; i++) {
+		demux_received[i] = g_byte_array_new();
+
+		dlcs[i] = g_at_mux_create_channel(demux);
+		g_assert(dlcs[i] != NULL);
+
+		g_io_channel_set_encoding(dlcs[i], NULL, NULL);
+		g_io_channel_set_buffered(dlcs[i], FALSE);
+		g_io_add_watch(dlcs[i], G_IO_IN, demux_read,
+							demux_received[i]);
+	}
+
+	demux_written = 0;
+	demux_chunk = 1021;
+	g_idle_add(demux_write, NULL);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(10, demux_timeout, NULL);
+
+	g_main_loop_run(mainloop);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(mainloop);
+
+	for (i = 0; i < DEMUX_CHANNELS; i++) {
+		g_assert(demux_received[i]->len == demux_expected[i]->len);
+		g_assert(memcmp(demux_received[i]->data,
+					demux_expected[i]->data,
+					demux_expected[i]->len) == 0);
+
+		g_io_channel_unref(dlcs[i]);
+		g_byte_array_free(demux_received[i], TRUE);
+		g_byte_array_free(demux_expected[i], TRUE);
+	}
+
+	g_at_mux_unref(demux);
+	g_byte_array_free(demux_stream, TRUE);
+	close(demux_fd);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -565,6 +727,7 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
 	g_test_add_func("/testmux/basic", test_basic);
+	g_test_add_func("/testmux/demux", test_demux);
 
 	return g_test_run();
 }
@@ -0,0 +1,240 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatrawip.h"
+
+#define MAX_PACKET	1600
+#define STREAM_PACKETS	64
+
+/*
+ * The modem side is a stream socket, like a tty.  The tun side is a
+ * seqpacket socket, so that each write to it is read back on its own.
+ */
+static GAtRawIP *rawip;
+static int modem_fd;
+static int tun_fd;
+
+static gsize build_packet(unsigned char *buf, guint n)
+{
+	gsize size;
+	gsize i;
+
+	/* Alternate between IPv4 and IPv6, of lengths not aligned to much */
+	if (n % 2 == 0) {
+		size = 20 + (n * 97) % (MAX_PACKET - 20);
+		buf[0] = 0x45;
+		buf[1] = 0;
+		buf[2] = size >> 8;
+		buf[3] = size & 0xff;
+		i = 4;
+	} else {
+		gsize payload = (n * 89) % (MAX_PACKET - 40);
+
+		size = 40 + payload;
+		buf[0] = 0x60;
+		buf[1] = 0;
+		buf[2] = 0;
+		buf[3] = 0;
+		buf[4] = payload >> 8;
+		buf[5] = payload & 0xff;
+		i = 6;
+	}
+
+	for (; i < size; i++)
+		buf[i] = (i * 7 + n) & 0xff;
+
+	return size;
+}
+
+static gboolean timeout_cb(gpointer user_data)
+{
+	g_assert_not_reached();
+
+	return FALSE;
+}
+
+static void setup(void)
+{
+	GIOChannel *channel;
+	GAtIO *io;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	channel = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	io = g_at_io_new(channel);
+	g_at_io_set_unix_fd(io, sv[0]);
+	g_io_channel_unref(channel);
+
+	rawip = g_at_rawip_new_from_io(io);
+	g_at_io_unref(io);
+	modem_fd = sv[1];
+
+	g_assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+
+	channel = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	io = g_at_io_new(channel);
+	g_at_io_set_unix_fd(io, sv[0]);
+	g_io_channel_unref(channel);
+
+	g_at_rawip_open_from_io(rawip, io);
+	g_at_io_unref(io);
+	tun_fd = sv[1];
+}
+
+static void teardown(void)
+{
+	g_at_rawip_unref(rawip);
+	close(modem_fd);
+	close(tun_fd);
+}
+
+static void modem_send(const unsigned char *buf, gsize len)
+{
+	g_assert(write(modem_fd, buf, len) == (ssize_t) len);
+}
+
+/* Runs the main loop until the next write to the tun device */
+static gsize tun_receive(unsigned char *buf)
+{
+	guint timeout = g_timeout_add_seconds(10, timeout_cb, NULL);
+	ssize_t len;
+
+	while ((len = recv(tun_fd, buf, MAX_PACKET + 1,
+						MSG_DONTWAIT)) < 0) {
+		g_assert(errno == EAGAIN);
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	g_source_remove(timeout);
+
+	return len;
+}
+
+static void tun_check_empty(void)
+{
+	unsigned char buf[MAX_PACKET + 1];
+
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+
+	g_assert(recv(tun_fd, buf, sizeof(buf), MSG_DONTWAIT) < 0);
+	g_assert(errno == EAGAIN);
+}
+
+static void check_packet(guint n)
+{
+	unsigned char expected[MAX_PACKET];
+	unsigned char buf[MAX_PACKET + 1];
+	gsize size = build_packet(expected, n);
+
+	g_assert(tun_receive(buf) == size);
+	g_assert(memcmp(buf, expected, size) == 0);
+}
+
+static void test_split(void)
+{
+	unsigned char buf[MAX_PACKET];
+	gsize size = build_packet(buf, 4);
+
+	setup();
+
+	/* Not even the whole header */
+	modem_send(buf, 3);
+	tun_check_empty();
+
+	/* The header, but not the whole packet */
+	modem_send(buf + 3, 100);
+	tun_check_empty();
+
+	modem_send(buf + 103, size - 103);
+	check_packet(4);
+
+	tun_check_empty();
+	teardown();
+}
+
+static void test_several(void)
+{
+	unsigned char buf[MAX_PACKET * 4];
+	gsize len = 0;
+	guint n;
+
+	setup();
+
+	/* Three packets and the start of a fourth one in one read */
+	for (n = 0; n < 3; n++)
+		len += build_packet(buf + len, n);
+
+	build_packet(buf + len, n);
+	modem_send(buf, len + 10);
+
+	for (n = 0; n < 3; n++)
+		check_packet(n);
+
+	tun_check_empty();
+
+	modem_send(buf + len + 10, build_packet(buf + len, 3) - 10);
+	check_packet(3);
+
+	tun_check_empty();
+	teardown();
+}
+
+static void test_stream(void)
+{
+	unsigned char buf[MAX_PACKET];
+	guint n;
+
+	setup();
+
+	/* Enough to wrap around the read buffer of the modem several times */
+	for (n = 0; n < STREAM_PACKETS; n++)
+		modem_send(buf, build_packet(buf, n));
+
+	for (n = 0; n < STREAM_PACKETS; n++)
+		check_packet(n);
+
+	tun_check_empty();
+	teardown();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testrawip/split", test_split);
+	g_test_add_func("/testrawip/several", test_several);
+	g_test_add_func("/testrawip/stream", test_stream);
+
+	return g_test_run();
+}
@@ -407,6 +407,228 @@ static void test_eons(void)
 	sim_eons_free(eons_info);
 }
 
+/* OPL records in file order, 'b' being a wildcard digit */
+struct opl_test_record {
+	const char *mcc;
+	const char *mnc;
+	guint16 lac_low;
+	guint16 lac_high;
+	guint8 id;
+};
+
+static const struct opl_test_record opl_test_records[] = {
+	{ "234", "10", 0x0100, 0x01ff, 1 },
+	{ "234", "10", 0x0180, 0x0280, 2 },
+	{ "234", "10", 0x0000, 0xfffe, 3 },
+	{ "234", "10", 0x0050, 0x0060, 4 },
+	{ "234", "1b", 0x0300, 0x0400, 5 },
+	{ "234", "1b", 0x0000, 0xfffe, 6 },
+	{ "23b", "20", 0x0000, 0xfffe, 7 },
+	{ "234", "20", 0x0010, 0x0020, 0 },
+	{ "310", "260", 0x1000, 0x0fff, 8 },
+	{ "310", "260", 0xfff0, 0xffff, 9 },
+	{ "310", "2b0", 0x0000, 0x2000, 10 },
+};
+
+static const char *opl_test_plmns[][2] = {
+	{ "234", "10" }, { "234", "11" }, { "234", "20" }, { "235", "20" },
+	{ "310", "260" }, { "310", "250" }, { "310", "26" }, { "999", "99" },
+};
+
+static const guint16 opl_test_lacs[] = {
+	0x0000, 0x0010, 0x0050, 0x0100, 0x017f, 0x0180, 0x01ff, 0x0200,
+	0x0280, 0x0281, 0x0300, 0x0400, 0x0fff, 0x1000, 0x2000, 0xfff0,
+	0xfffe, 0xffff,
+};
+
+static guint8 opl_test_digit(const char *digits, int i, int len)
+{
+	if (i >= len || digits[i] == '\0')
+		return 0xf;
+
+	if (digits[i] == 'b')
+		return 0xd;
+
+	return digits[i] - '0';
+}
+
+static void opl_test_encode(const struct opl_test_record *record,
+					guint8 *out)
+{
+	const char *mcc = record->mcc;
+	const char *mnc = record->mnc;
+
+	out[0] = opl_test_digit(mcc, 0, 3) | opl_test_digit(mcc, 1, 3) << 4;
+	out[1] = opl_test_digit(mcc, 2, 3) | opl_test_digit(mnc, 2, 3) << 4;
+	out[2] = opl_test_digit(mnc, 0, 3) | opl_test_digit(mnc, 1, 3) << 4;
+	out[3] = record->lac_low >> 8;
+	out[4] = record->lac_low & 0xff;
+	out[5] = record->lac_high >> 8;
+	out[6] = record->lac_high & 0xff;
+	out[7] = record->id;
+}
+
+static gboolean opl_test_digits_match(const char *pattern, const char *digits)
+{
+	unsigned int i;
+
+	if (strlen(pattern) != strlen(digits))
+		return FALSE;
+
+	for (i = 0; pattern[i]; i++)
+		if (pattern[i] != digits[i] && pattern[i] != 'b')
+			return FALSE;
+
+	return TRUE;
+}
+
+/* The first record in file order matching the PLMN and the LAC, if any */
+static int opl_test_expected(const struct opl_test_record *records,
+				unsigned int count, const char *mcc,
+				const char *mnc, gboolean have_lac,
+				guint16 lac)
+{
+	const struct opl_test_record *record;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		record = &records[i];
+
+		if (!opl_test_digits_match(record->mcc, mcc) ||
+				!opl_test_digits_match(record->mnc, mnc))
+			continue;
+
+		if (record->lac_low == 0 && record->lac_high == 0xfffe)
+			return record->id;
+
+		if (have_lac && lac >= record->lac_low &&
+				lac <= record->lac_high)
+			return record->id;
+	}
+
+	return 0;
+}
+
+static int opl_test_pnn_id(const struct sim_eons_operator_info *info)
+{
+	if (info == NULL)
+		return 0;
+
+	return info->longname[0] - 'A' + 1;
+}
+
+static struct sim_eons *opl_test_eons(const struct opl_test_record *records,
+					unsigned int count, int pnn_records)
+{
+	struct sim_eons *eons = sim_eons_new(pnn_records);
+	guint8 pnn[] = { 0x43, 0x03, 0x90, 0x00, 0x00 };
+	guint8 opl[8];
+	unsigned int i;
+
+	/* Names in UCS2, 'A' for the first record, 'B' for the second... */
+	for (i = 0; i < (unsigned int) pnn_records; i++) {
+		pnn[4] = 'A' + i;
+		sim_eons_add_pnn_record(eons, i + 1, pnn, sizeof(pnn));
+	}
+
+	for (i = 0; i < count; i++) {
+		opl_test_encode(&records[i], opl);
+		sim_eons_add_opl_record(eons, opl, sizeof(opl));
+	}
+
+	sim_eons_optimize(eons);
+
+	return eons;
+}
+
+static void opl_test_check(struct sim_eons *eons,
+				const struct opl_test_record *records,
+				unsigned int count, const char *mcc,
+				const char *mnc)
+{
+	const struct sim_eons_operator_info *info;
+	unsigned int i;
+	int pass;
+
+	/* The second pass is answered from the memoized lookups */
+	for (pass = 0; pass < 2; pass++) {
+		info = sim_eons_lookup(eons, mcc, mnc);
+		g_assert_cmpint(opl_test_pnn_id(info), ==,
+				opl_test_expected(records, count, mcc, mnc,
+							FALSE, 0));
+
+		for (i = 0; i < G_N_ELEMENTS(opl_test_lacs); i++) {
+			guint16 lac = opl_test_lacs[i];
+
+			info = sim_eons_lookup_with_lac(eons, mcc, mnc, lac);
+			g_assert_cmpint(opl_test_pnn_id(info), ==,
+					opl_test_expected(records, count,
+							mcc, mnc, TRUE, lac));
+		}
+	}
+}
+
+static void test_eons_opl_index(void)
+{
+	struct opl_test_record random_records[400];
+	static const char *mccs[] = { "234", "23b", "310" };
+	static const char *mncs[] = { "10", "1b", "20", "260", "2b0" };
+	struct sim_eons *eons;
+	unsigned int i;
+	guint16 a, b;
+
+	eons = opl_test_eons(opl_test_records,
+				G_N_ELEMENTS(opl_test_records), 10);
+
+	for (i = 0; i < G_N_ELEMENTS(opl_test_plmns); i++)
+		opl_test_check(eons, opl_test_records,
+				G_N_ELEMENTS(opl_test_records),
+				opl_test_plmns[i][0], opl_test_plmns[i][1]);
+
+	sim_eons_free(eons);
+
+	/* Many overlapping ranges, the first in file order has to win */
+	for (i = 0; i < G_N_ELEMENTS(random_records); i++) {
+		struct opl_test_record *record = &random_records[i];
+
+		a = g_test_rand_int_range(0, 0x2100);
+		b = g_test_rand_int_range(0, 0x2100);
+
+		record->mcc = mccs[g_test_rand_int_range(0, 3)];
+		record->mnc = mncs[g_test_rand_int_range(0, 5)];
+		record->lac_low = MIN(a, b);
+		record->lac_high = MAX(a, b);
+		record->id = g_test_rand_int_range(0, 21);
+
+		if (g_test_rand_int_range(0, 50) == 0) {
+			record->lac_low = 0;
+			record->lac_high = 0xfffe;
+		}
+	}
+
+	eons = opl_test_eons(random_records, G_N_ELEMENTS(random_records), 20);
+
+	for (i = 0; i < G_N_ELEMENTS(opl_test_plmns); i++)
+		opl_test_check(eons, random_records,
+				G_N_ELEMENTS(random_records),
+				opl_test_plmns[i][0], opl_test_plmns[i][1]);
+
+	for (i = 0; i < 2000; i++) {
+		const char *mcc = opl_test_plmns[i % 8][0];
+		const char *mnc = opl_test_plmns[i % 8][1];
+		guint16 lac = g_test_rand_int_range(0, 0x2200);
+		const struct sim_eons_operator_info *info;
+
+		info = sim_eons_lookup_with_lac(eons, mcc, mnc, lac);
+		g_assert_cmpint(opl_test_pnn_id(info), ==,
+				opl_test_expected(random_records,
+						G_N_ELEMENTS(random_records),
+						mcc, mnc, TRUE, lac));
+	}
+
+	sim_eons_free(eons);
+}
+
 static void test_ef_db(void)
 {
 	struct sim_ef_info *info;
@@ -708,6 +930,7 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/ber tlv encode 3G Status response",
 			test_ber_tlv_builder_3g_status);
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
+	g_test_add_func("/testsimutil/EONS OPL index", test_eons_opl_index);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
 	g_test_add_func("/testsimutil/Application entries decoding",
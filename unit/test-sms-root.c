@@ -25,12 +25,14 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <glib.h>
 
 #include "util.h"
+#include "../src/storage.h"
 #include "smsutil.h"
 
 static const bool VERBOSE = false;
@@ -89,7 +91,7 @@ static void test_serialize_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -116,12 +118,180 @@ static void test_serialize_assembly(void)
 	sms_assembly_free(assembly);
 }
 
+#define TX_IMSI "5678"
+#define TX_JOURNAL STORAGEDIR "/" TX_IMSI "/sms_journal"
+
+static const char *tx_uuid1 = "0123456789ABCDEF0123456789ABCDEF01234567";
+static const char *tx_uuid2 = "89ABCDEF0123456789ABCDEF0123456789ABCDEF";
+
+static void store_tx(const char *uuid, unsigned long id,
+			unsigned long flags, GSList *msg_list)
+{
+	unsigned char pdu[176];
+	int pdu_len;
+	int tpdu_len;
+	guint8 seq;
+	GSList *l;
+
+	for (l = msg_list, seq = 0; l; l = l->next, seq++) {
+		g_assert(sms_encode(l->data, &pdu_len, &tpdu_len, pdu));
+		g_assert(sms_tx_backup_store(TX_IMSI, id, flags, uuid, seq,
+						pdu, pdu_len, tpdu_len));
+	}
+}
+
+static void check_tx_entry(struct txq_backup_entry *entry, const char *uuid,
+				unsigned long flags, guint num_pdus)
+{
+	unsigned char msgid[SMS_MSGID_LEN];
+
+	decode_hex_own_buf(uuid, -1, NULL, 0, msgid);
+
+	g_assert(entry != NULL);
+	g_assert(memcmp(entry->uuid, msgid, SMS_MSGID_LEN) == 0);
+	g_assert(entry->flags == flags);
+	g_assert(g_slist_length(entry->msg_list) == num_pdus);
+}
+
+static void free_tx_queue(GQueue *queue)
+{
+	struct txq_backup_entry *entry;
+
+	while ((entry = g_queue_pop_head(queue))) {
+		g_slist_free_full(entry->msg_list, g_free);
+		g_free(entry);
+	}
+
+	g_queue_free(queue);
+}
+
+static void test_tx_queue_backup(void)
+{
+	static const char garbage[] = "\x12\x34\x56\x78\x01\x05\x00";
+	struct txq_backup_entry *entry;
+	GSList *msg_list;
+	GQueue *queue;
+	struct stat st;
+	char *text;
+	FILE *fp;
+	int i;
+
+	unlink(TX_JOURNAL);
+
+	text = g_strnfill(400, 'x');
+	msg_list = sms_text_prepare("555", text, 42, FALSE, FALSE);
+	g_free(text);
+	g_assert(g_slist_length(msg_list) == 3);
+
+	store_tx(tx_uuid1, 0, 5, msg_list);
+	store_tx(tx_uuid2, 1, 7, msg_list->next->next);
+
+	/* The first fragment made it out */
+	sms_tx_backup_remove(TX_IMSI, 0, 5, tx_uuid1, 0);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 2);
+	check_tx_entry(g_queue_peek_nth(queue, 0), tx_uuid1, 5, 2);
+	check_tx_entry(g_queue_peek_nth(queue, 1), tx_uuid2, 7, 1);
+
+	entry = g_queue_peek_head(queue);
+	g_assert(memcmp(entry->msg_list->data, msg_list->next->data,
+						sizeof(struct sms)) == 0);
+	free_tx_queue(queue);
+
+	sms_tx_backup_free(TX_IMSI, 0, 5, tx_uuid1);
+
+	/* A torn record at the end is dropped, not the ones before it */
+	fp = fopen(TX_JOURNAL, "a");
+	g_assert(fp);
+	g_assert(fwrite(garbage, 1, sizeof(garbage), fp) == sizeof(garbage));
+	fclose(fp);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 1);
+	check_tx_entry(g_queue_peek_head(queue), tx_uuid2, 7, 1);
+	free_tx_queue(queue);
+
+	store_tx(tx_uuid1, 1, 5, msg_list);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 2);
+	check_tx_entry(g_queue_peek_nth(queue, 0), tx_uuid2, 7, 1);
+	check_tx_entry(g_queue_peek_nth(queue, 1), tx_uuid1, 5, 3);
+	free_tx_queue(queue);
+
+	sms_tx_backup_free(TX_IMSI, 0, 7, tx_uuid2);
+	sms_tx_backup_free(TX_IMSI, 1, 5, tx_uuid1);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 0);
+	g_queue_free(queue);
+
+	/* Superseded records get compacted away */
+	for (i = 0; i < 100; i++) {
+		store_tx(tx_uuid1, i, 5, msg_list);
+		sms_tx_backup_free(TX_IMSI, i, 5, tx_uuid1);
+	}
+
+	store_tx(tx_uuid2, 0, 7, msg_list);
+
+	g_assert(stat(TX_JOURNAL, &st) == 0);
+	g_assert(st.st_size < 16 * 1024);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 1);
+	check_tx_entry(g_queue_peek_head(queue), tx_uuid2, 7, 3);
+	free_tx_queue(queue);
+
+	sms_tx_backup_free(TX_IMSI, 0, 7, tx_uuid2);
+	g_slist_free_full(msg_list, g_free);
+}
+
+static void test_tx_queue_import(void)
+{
+	unsigned char buf[177];
+	GSList *msg_list;
+	GQueue *queue;
+	int pdu_len;
+	int tpdu_len;
+	struct stat st;
+
+	unlink(TX_JOURNAL);
+
+	msg_list = sms_text_prepare("555", "Hello", 0, FALSE, FALSE);
+	g_assert(sms_encode(msg_list->data, &pdu_len, &tpdu_len, buf + 1));
+	buf[0] = tpdu_len;
+
+	/* The layout used before backups went into the journal */
+	g_assert(write_file(buf, pdu_len + 1, 0600,
+				STORAGEDIR "/%s/tx_queue/%lu-%lu-%s/%03i",
+				TX_IMSI, 3UL, 1UL, tx_uuid1, 0) == pdu_len + 1);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 1);
+	check_tx_entry(g_queue_peek_head(queue), tx_uuid1, 1, 1);
+	free_tx_queue(queue);
+
+	g_assert(stat(STORAGEDIR "/" TX_IMSI "/tx_queue", &st) < 0);
+
+	queue = sms_tx_queue_load(TX_IMSI);
+	g_assert(g_queue_get_length(queue) == 1);
+	free_tx_queue(queue);
+
+	sms_tx_backup_free(TX_IMSI, 0, 1, tx_uuid1);
+	g_slist_free_full(msg_list, g_free);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test TX Queue Backup",
+			test_tx_queue_backup);
+	g_test_add_func("/testsms/Test TX Queue Import",
+			test_tx_queue_import);
 
 	return g_test_run();
 }
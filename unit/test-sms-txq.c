@@ -0,0 +1,513 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Drives the transmit queue of src/sms.c through a fake driver which
+ * keeps every submit in flight until the test answers it, in whatever
+ * order the test chooses.  The rest of the core comes from
+ * unit/sms-test-core.c.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+
+#include "smsutil.h"
+
+#define TEST_DRIVER "testdriver"
+#define TEST_RECEIVER "+4915259911630"
+
+struct test_submit {
+	guint16 ref;
+	guint8 seq;
+	int mms;
+	ofono_sms_submit_cb_t cb;
+	void *data;
+};
+
+struct test_write {
+	ofono_sms_write_to_sim_cb_t cb;
+	void *data;
+};
+
+struct test_message {
+	struct ofono_uuid uuid;
+	unsigned int notified;
+	gboolean ok;
+};
+
+static GQueue *submits;
+static GQueue *writes;
+static DBusMessage *method_call;
+static unsigned char next_mr;
+
+static int test_probe(struct ofono_sms *sms, unsigned int vendor, void *data)
+{
+	return 0;
+}
+
+static void test_remove(struct ofono_sms *sms)
+{
+	/* Whatever is still in flight is never answered */
+	while (!g_queue_is_empty(submits))
+		g_free(g_queue_pop_head(submits));
+
+	while (!g_queue_is_empty(writes))
+		g_free(g_queue_pop_head(writes));
+}
+
+static void test_submit(struct ofono_sms *sms, const unsigned char *pdu,
+			int pdu_len, int tpdu_len, int mms,
+			ofono_sms_submit_cb_t cb, void *data)
+{
+	struct test_submit *submit;
+	struct sms s;
+	guint8 max;
+
+	submit = g_new0(struct test_submit, 1);
+
+	g_assert(sms_decode(pdu, pdu_len, TRUE, tpdu_len, &s));
+	g_assert(sms_extract_concatenation(&s, &submit->ref, &max,
+						&submit->seq));
+
+	submit->mms = mms;
+	submit->cb = cb;
+	submit->data = data;
+
+	g_queue_push_tail(submits, submit);
+}
+
+static void test_write_to_sim(struct ofono_sms *sms,
+				const unsigned char *pdu, int pdu_len,
+				int tpdu_len, int mms,
+				ofono_sms_write_to_sim_cb_t cb, void *data)
+{
+	struct test_write *write = g_new0(struct test_write, 1);
+
+	write->cb = cb;
+	write->data = data;
+
+	g_queue_push_tail(writes, write);
+}
+
+static const struct ofono_sms_driver test_driver = {
+	.name		= TEST_DRIVER,
+	.probe		= test_probe,
+	.remove		= test_remove,
+	.submit		= test_submit,
+	.sms_write_to_sim = test_write_to_sim,
+};
+
+static void run_queue(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void message_notify(gboolean ok, void *data)
+{
+	struct test_message *message = data;
+
+	message->notified += 1;
+	message->ok = ok;
+}
+
+static void send_message(struct ofono_sms *sms, guint16 ref, int segments,
+				unsigned int flags, struct test_message *message)
+{
+	GSList *list;
+	char *text;
+
+	/* 153 septets fit into a segment next to the concatenation IE */
+	text = g_strnfill(153 * segments, 'a');
+	list = sms_text_prepare(TEST_RECEIVER, text, ref, FALSE, FALSE);
+	g_free(text);
+
+	g_assert(g_slist_length(list) == (guint) segments);
+
+	memset(message, 0, sizeof(*message));
+	g_assert(__ofono_sms_txq_submit(sms, list, flags, &message->uuid,
+						NULL, method_call) == 0);
+	g_assert(__ofono_sms_txq_set_submit_notify(sms, &message->uuid,
+						message_notify, message,
+						NULL) == 0);
+
+	g_slist_free_full(list, g_free);
+}
+
+static void store_message(struct ofono_sms *sms, guint16 ref, int segments)
+{
+	char date[] = "240101120000";
+	struct ofono_uuid uuid;
+	GSList *list;
+	char *text;
+
+	text = g_strnfill(153 * segments, 'b');
+	list = sms_text_prepare(TEST_RECEIVER, text, ref, FALSE, FALSE);
+	g_free(text);
+
+	g_assert(g_slist_length(list) == (guint) segments);
+
+	g_assert(__ofono_sms_txq_write_to_sim(sms, list, 0, &uuid, date,
+						SMS_TYPE_SUBMIT, NULL,
+						NULL) == 0);
+
+	g_slist_free_full(list, g_free);
+}
+
+static void answer_write(gboolean ok)
+{
+	struct test_write *write = g_queue_pop_head(writes);
+	struct ofono_error error;
+
+	g_assert(write != NULL);
+
+	error.type = ok ? OFONO_ERROR_TYPE_NO_ERROR : OFONO_ERROR_TYPE_FAILURE;
+	error.error = 0;
+
+	write->cb(&error, write->data);
+	g_free(write);
+
+	run_queue();
+}
+
+static void answer_submit(guint16 ref, guint8 seq, gboolean ok)
+{
+	struct ofono_error error;
+	struct test_submit *submit = NULL;
+	GList *l;
+
+	for (l = submits->head; l; l = l->next) {
+		struct test_submit *s = l->data;
+
+		if (s->ref == ref && s->seq == seq) {
+			submit = s;
+			break;
+		}
+	}
+
+	g_assert(submit != NULL);
+	g_queue_delete_link(submits, l);
+
+	error.type = ok ? OFONO_ERROR_TYPE_NO_ERROR : OFONO_ERROR_TYPE_FAILURE;
+	error.error = 0;
+
+	submit->cb(&error, next_mr++, submit->data);
+	g_free(submit);
+
+	run_queue();
+}
+
+static void assert_in_flight(guint16 ref, guint8 seq)
+{
+	GList *l;
+
+	for (l = submits->head; l; l = l->next) {
+		struct test_submit *s = l->data;
+
+		if (s->ref == ref && s->seq == seq)
+			return;
+	}
+
+	g_assert_not_reached();
+}
+
+static struct ofono_sms *create_sms(unsigned int window)
+{
+	struct ofono_sms *sms;
+
+	submits = g_queue_new();
+	writes = g_queue_new();
+	method_call = dbus_message_new_method_call("org.ofono", "/test",
+					OFONO_MESSAGE_MANAGER_INTERFACE,
+					"SendMessage");
+	dbus_message_set_serial(method_call, 1);
+
+	sms = ofono_sms_create(NULL, 0, TEST_DRIVER, NULL);
+	g_assert(sms != NULL);
+
+	ofono_sms_set_tx_window(sms, window);
+
+	return sms;
+}
+
+static void remove_sms(struct ofono_sms *sms)
+{
+	ofono_sms_remove(sms);
+	run_queue();
+
+	g_assert(g_queue_is_empty(submits));
+	g_queue_free(submits);
+	submits = NULL;
+
+	g_assert(g_queue_is_empty(writes));
+	g_queue_free(writes);
+	writes = NULL;
+
+	dbus_message_unref(method_call);
+	method_call = NULL;
+}
+
+static void test_window(void)
+{
+	struct ofono_sms *sms = create_sms(3);
+	struct test_message a, b;
+	struct test_submit *submit;
+
+	send_message(sms, 1, 2, 0, &a);
+	send_message(sms, 2, 3, 0, &b);
+	run_queue();
+
+	/* Both segments of the first message and one of the second */
+	g_assert(g_queue_get_length(submits) == 3);
+	assert_in_flight(1, 1);
+	assert_in_flight(1, 2);
+	assert_in_flight(2, 1);
+
+	submit = g_queue_peek_head(submits);
+	g_assert(submit->mms == 1);
+
+	/* Out of order, the first message isn't done until both are in */
+	answer_submit(2, 1, TRUE);
+	answer_submit(1, 2, TRUE);
+	g_assert(a.notified == 0);
+
+	g_assert(g_queue_get_length(submits) == 3);
+	assert_in_flight(2, 2);
+	assert_in_flight(2, 3);
+
+	/* Nothing is left behind the last segment */
+	submit = g_queue_peek_tail(submits);
+	g_assert(submit->ref == 2 && submit->seq == 3);
+	g_assert(submit->mms == 0);
+
+	answer_submit(1, 1, TRUE);
+	g_assert(a.notified == 1 && a.ok == TRUE);
+
+	answer_submit(2, 3, TRUE);
+	answer_submit(2, 2, TRUE);
+	g_assert(b.notified == 1 && b.ok == TRUE);
+
+	g_assert(g_queue_is_empty(submits));
+
+	remove_sms(sms);
+}
+
+static void test_retry(void)
+{
+	struct ofono_sms *sms = create_sms(2);
+	struct test_message a;
+	struct test_submit *submit;
+
+	send_message(sms, 3, 3, OFONO_SMS_SUBMIT_FLAG_RETRY, &a);
+	run_queue();
+
+	g_assert(g_queue_get_length(submits) == 2);
+
+	/* The failed segment is queued again, nothing goes out until then */
+	answer_submit(3, 1, FALSE);
+	answer_submit(3, 2, TRUE);
+	g_assert(g_queue_is_empty(submits));
+	g_assert(a.notified == 0);
+
+	while (g_queue_is_empty(submits))
+		g_main_context_iteration(NULL, TRUE);
+
+	run_queue();
+
+	/* The retried segment first, the window is filled up behind it */
+	g_assert(g_queue_get_length(submits) == 2);
+	submit = g_queue_peek_head(submits);
+	g_assert(submit->ref == 3 && submit->seq == 1);
+	assert_in_flight(3, 3);
+
+	answer_submit(3, 3, TRUE);
+	answer_submit(3, 1, TRUE);
+	g_assert(a.notified == 1 && a.ok == TRUE);
+
+	remove_sms(sms);
+}
+
+static void test_fail_with_pending(void)
+{
+	struct ofono_sms *sms = create_sms(3);
+	struct test_message a, b;
+
+	send_message(sms, 4, 3, 0, &a);
+	send_message(sms, 5, 2, 0, &b);
+	run_queue();
+
+	g_assert(g_queue_get_length(submits) == 3);
+
+	/* The failure is only reported once the other segments are back */
+	answer_submit(4, 2, FALSE);
+	g_assert(a.notified == 0);
+
+	answer_submit(4, 1, TRUE);
+	g_assert(a.notified == 0);
+	g_assert(g_queue_get_length(submits) == 1);
+
+	answer_submit(4, 3, TRUE);
+	g_assert(a.notified == 1 && a.ok == FALSE);
+
+	/* The next message goes ahead as usual */
+	g_assert(g_queue_get_length(submits) == 2);
+	assert_in_flight(5, 1);
+	assert_in_flight(5, 2);
+
+	answer_submit(5, 2, TRUE);
+	answer_submit(5, 1, TRUE);
+	g_assert(b.notified == 1 && b.ok == TRUE);
+
+	remove_sms(sms);
+}
+
+static void test_cancel(void)
+{
+	struct ofono_sms *sms = create_sms(2);
+	struct test_message a, b, c;
+
+	send_message(sms, 6, 2, 0, &a);
+	send_message(sms, 7, 2, 0, &b);
+	send_message(sms, 8, 2, 0, &c);
+	run_queue();
+
+	g_assert(g_queue_get_length(submits) == 2);
+	assert_in_flight(6, 1);
+	assert_in_flight(6, 2);
+
+	/* In flight, can't be taken back */
+	g_assert(__ofono_sms_txq_cancel(sms, &a.uuid) == -EPERM);
+
+	g_assert(__ofono_sms_txq_cancel(sms, &b.uuid) == 0);
+	g_assert(b.notified == 1 && b.ok == FALSE);
+	g_assert(__ofono_sms_txq_cancel(sms, &b.uuid) == -ENOENT);
+
+	/* Partly sent and partly in flight */
+	answer_submit(6, 1, TRUE);
+	g_assert(__ofono_sms_txq_cancel(sms, &a.uuid) == -EPERM);
+	assert_in_flight(8, 1);
+
+	answer_submit(6, 2, TRUE);
+	g_assert(a.notified == 1 && a.ok == TRUE);
+	assert_in_flight(8, 2);
+
+	g_assert(__ofono_sms_txq_cancel(sms, &c.uuid) == -EPERM);
+
+	answer_submit(8, 1, TRUE);
+	answer_submit(8, 2, TRUE);
+	g_assert(c.notified == 1 && c.ok == TRUE);
+	g_assert(g_queue_is_empty(submits));
+
+	remove_sms(sms);
+}
+
+static void test_write_to_sim_mixed(void)
+{
+	struct ofono_sms *sms = create_sms(2);
+	struct test_message a, c;
+
+	send_message(sms, 10, 2, 0, &a);
+	store_message(sms, 11, 2);
+	send_message(sms, 12, 2, 0, &c);
+	run_queue();
+
+	/* The stored message is written, one PDU at a time, never sent */
+	g_assert(g_queue_get_length(submits) == 2);
+	assert_in_flight(10, 1);
+	assert_in_flight(10, 2);
+	g_assert(g_queue_get_length(writes) == 1);
+
+	answer_write(TRUE);
+	g_assert(g_queue_get_length(writes) == 1);
+
+	answer_submit(10, 1, TRUE);
+	answer_submit(10, 2, TRUE);
+	g_assert(a.notified == 1 && a.ok == TRUE);
+
+	g_assert(g_queue_get_length(submits) == 2);
+	assert_in_flight(12, 1);
+	assert_in_flight(12, 2);
+
+	/* Done with the entry, the next one starts over */
+	answer_write(TRUE);
+	g_assert(g_queue_is_empty(writes));
+
+	store_message(sms, 13, 2);
+	run_queue();
+	g_assert(g_queue_get_length(writes) == 1);
+
+	/* A failed write drops the rest of the message */
+	answer_write(FALSE);
+	g_assert(g_queue_is_empty(writes));
+
+	answer_submit(12, 2, TRUE);
+	answer_submit(12, 1, TRUE);
+	g_assert(c.notified == 1 && c.ok == TRUE);
+	g_assert(g_queue_is_empty(submits));
+
+	remove_sms(sms);
+}
+
+static void test_remove_in_flight(void)
+{
+	struct ofono_sms *sms = create_sms(4);
+	struct test_message a;
+
+	send_message(sms, 9, 3, 0, &a);
+	run_queue();
+
+	g_assert(g_queue_get_length(submits) == 3);
+
+	/* The driver goes away with the submits still outstanding */
+	remove_sms(sms);
+	g_assert(a.notified == 0);
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	ofono_sms_driver_register(&test_driver);
+
+	g_test_add_func("/testsmstxq/window", test_window);
+	g_test_add_func("/testsmstxq/retry", test_retry);
+	g_test_add_func("/testsmstxq/fail with pending",
+						test_fail_with_pending);
+	g_test_add_func("/testsmstxq/cancel", test_cancel);
+	g_test_add_func("/testsmstxq/write to sim", test_write_to_sim_mixed);
+	g_test_add_func("/testsmstxq/remove in flight",
+						test_remove_in_flight);
+
+	ret = g_test_run();
+
+	ofono_sms_driver_unregister(&test_driver);
+
+	return ret;
+}
@@ -1040,17 +1040,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1096,6 +1096,99 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+#define NUM_SENDERS 50
+
+static void test_assembly_limit(void)
+{
+	unsigned char pdu[176];
+	long pdu_len;
+	struct sms sms;
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	struct sms_address addr;
+	time_t base = time(NULL);
+	size_t node_size;
+	guint16 ref;
+	guint8 max;
+	guint8 seq;
+	GSList *l;
+	int i;
+
+	decode_hex_own_buf(assembly_pdu1, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len1, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+
+	/* The first fragment of the same message from many senders */
+	for (i = 0; i < NUM_SENDERS; i++) {
+		memcpy(&addr, &sms.deliver.oaddr, sizeof(addr));
+		sprintf(addr.address, "555%04d", i);
+
+		l = sms_assembly_add_fragment(assembly, &sms, base + i,
+						&addr, ref, max, seq);
+		g_assert(l == NULL);
+	}
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == NUM_SENDERS);
+	g_assert(assembly->expiry_heap->len == NUM_SENDERS);
+
+	/* Resending a fragment must not take more memory */
+	node_size = assembly->pending_bytes / NUM_SENDERS;
+	l = sms_assembly_add_fragment(assembly, &sms, base, &addr,
+					ref, max, seq);
+	g_assert(l == NULL);
+	g_assert(assembly->pending_bytes == node_size * NUM_SENDERS);
+
+	sms_assembly_expire(assembly, base + 9);
+	g_assert(g_hash_table_size(assembly->assembly_table) ==
+							NUM_SENDERS - 10);
+	g_assert(assembly->stats.expired == 10);
+
+	/* The messages pending the longest are evicted first */
+	sms_assembly_set_limit(assembly, node_size * 5);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 5);
+	g_assert(assembly->stats.evicted == NUM_SENDERS - 15);
+
+	sms_assembly_expire(assembly, base + NUM_SENDERS - 6);
+	g_assert(assembly->stats.expired == 10);
+	sms_assembly_expire(assembly, base + NUM_SENDERS - 5);
+	g_assert(assembly->stats.expired == 11);
+
+	/* The message being assembled is never the one evicted */
+	sms_assembly_set_limit(assembly, node_size);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	l = sms_assembly_add_fragment(assembly, &sms, base,
+					&sms.deliver.oaddr, ref, max, seq);
+	g_assert(l == NULL);
+
+	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len2, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+
+	l = sms_assembly_add_fragment(assembly, &sms, base + 10,
+					&sms.deliver.oaddr, ref, max, seq);
+	g_assert(l == NULL);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+	g_assert(assembly->stats.evicted == NUM_SENDERS - 11);
+
+	decode_hex_own_buf(assembly_pdu3, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len3, &sms);
+	sms_extract_concatenation(&sms, &ref, &max, &seq);
+
+	l = sms_assembly_add_fragment(assembly, &sms, base + 30,
+					&sms.deliver.oaddr, ref, max, seq);
+	g_assert(l != NULL);
+	g_assert(g_slist_length(l) == 3);
+	g_slist_free_full(l, g_free);
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+	g_assert(assembly->expiry_heap->len == 0);
+	g_assert(assembly->pending_bytes == 0);
+	g_assert(assembly->stats.completed == 1);
+	g_assert(assembly->stats.latency_max == 30);
+
+	sms_assembly_free(assembly);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1607,14 +1700,18 @@ static void test_sr_assembly(void)
 
 	sra = status_report_assembly_new(NULL);
 
-	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2);
-	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2,
+								NULL);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2,
+								NULL);
 
 	status_report_assembly_expire(sra, time(NULL) + 40);
 	g_assert(g_hash_table_size(sra->assembly_table) == 0);
 
-	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2);
-	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2,
+								NULL);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2,
+								NULL);
 
 	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
 	g_assert(status_report_assembly_report(sra, &sr2, id, &delivered));
@@ -1627,8 +1724,10 @@ static void test_sr_assembly(void)
 	 * but receive in the international address-format.
 	 */
 	sms_address_from_string(&addr, "9911630");
-	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2);
-	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 4, time(NULL), 2,
+								NULL);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 5, time(NULL), 2,
+								NULL);
 
 	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
 	g_assert(status_report_assembly_report(sra, &sr2, id, &delivered));
@@ -1642,7 +1741,8 @@ static void test_sr_assembly(void)
 	 * but receive in the national address-format.
 	 */
 	sms_address_from_string(&addr, "+358123456789");
-	status_report_assembly_add_fragment(sra, sha1, &addr, 6, time(NULL), 1);
+	status_report_assembly_add_fragment(sra, sha1, &addr, 6, time(NULL), 1,
+								NULL);
 
 	g_assert(status_report_assembly_report(sra, &sr3, id, &delivered));
 
@@ -1653,6 +1753,86 @@ static void test_sr_assembly(void)
 	status_report_assembly_free(sra);
 }
 
+/*
+ * With several submits in flight, reports and submit responses can come
+ * in any order; the message must complete exactly once either way.
+ */
+static void test_sr_assembly_out_of_order(void)
+{
+	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
+				"940A00";
+	const char *sr_pdu2 = "06050D91945152991136F00160124130640A0160124130"
+				"450A00";
+	struct sms sr1;
+	struct sms sr2;
+	unsigned char pdu[176];
+	long pdu_len;
+	struct status_report_assembly *sra;
+	gboolean delivered;
+	struct sms_address addr;
+	unsigned char sha1[SMS_MSGID_LEN] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+						10, 11, 12, 13, 14, 15,
+						16, 17, 18, 19 };
+	unsigned char id[SMS_MSGID_LEN];
+
+	decode_hex_own_buf(sr_pdu1, -1, &pdu_len, 0, pdu);
+	g_assert(sms_decode(pdu, pdu_len, FALSE, 26, &sr1) == TRUE);
+
+	decode_hex_own_buf(sr_pdu2, -1, &pdu_len, 0, pdu);
+	g_assert(sms_decode(pdu, pdu_len, FALSE, 26, &sr2) == TRUE);
+
+	sms_address_from_string(&addr, "+4915259911630");
+	sra = status_report_assembly_new(NULL);
+
+	/* Fragments sent out of order, reports in order */
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 5,
+						time(NULL), 2, &delivered));
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 4,
+						time(NULL), 2, &delivered));
+	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
+	g_assert(status_report_assembly_report(sra, &sr2, id, &delivered));
+	g_assert(memcmp(id, sha1, SMS_MSGID_LEN) == 0);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	/* A fragment added twice only counts once */
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 4,
+						time(NULL), 2, &delivered));
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 4,
+						time(NULL), 2, &delivered));
+	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 5,
+						time(NULL), 2, &delivered));
+	g_assert(status_report_assembly_report(sra, &sr2, id, &delivered));
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	/* Report for mr 5 overtakes the submit response carrying mr 5 */
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 4,
+						time(NULL), 2, &delivered));
+	g_assert(!status_report_assembly_report(sra, &sr2, id, &delivered));
+	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
+
+	delivered = FALSE;
+	g_assert(status_report_assembly_add_fragment(sra, sha1, &addr, 5,
+						time(NULL), 2, &delivered));
+	g_assert(delivered == TRUE);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	/* Both reports overtake both responses */
+	g_assert(!status_report_assembly_report(sra, &sr2, id, &delivered));
+	g_assert(!status_report_assembly_report(sra, &sr1, id, &delivered));
+	g_assert(!status_report_assembly_add_fragment(sra, sha1, &addr, 4,
+						time(NULL), 2, &delivered));
+
+	delivered = FALSE;
+	g_assert(status_report_assembly_add_fragment(sra, sha1, &addr, 5,
+						time(NULL), 2, &delivered));
+	g_assert(delivered == TRUE);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+	g_assert(g_queue_get_length(sra->early_reports) == 0);
+
+	status_report_assembly_free(sra);
+}
+
 struct wap_push_data {
 	const char *pdu;
 	int len;
@@ -1781,6 +1961,7 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Limit", test_assembly_limit);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1810,6 +1991,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
+	g_test_add_func("/testsms/Status Report Assembly Out Of Order",
+					test_sr_assembly_out_of_order);
 
 	g_test_add_data_func("/testsms/Test WAP Push 1", &wap_push_1,
 				test_wap_push);
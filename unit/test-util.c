@@ -515,6 +515,47 @@ static void test_valid_turkish(void)
 	}
 }
 
+static void test_encoding_costs(void)
+{
+	struct gsm_encoding_costs costs;
+	unsigned char *res;
+	long nread;
+	long nwritten;
+
+	/* U+015F is only in the Turkish tables, '{' only as an escape */
+	g_assert(gsm_encoding_costs_from_utf8("\xc5\x9f{", -1, &costs));
+
+	g_assert(!(costs.encodable[GSM_DIALECT_DEFAULT] &
+					(1 << GSM_DIALECT_DEFAULT)));
+	g_assert(!(costs.encodable[GSM_DIALECT_DEFAULT] &
+					(1 << GSM_DIALECT_SPANISH)));
+	g_assert(costs.encodable[GSM_DIALECT_DEFAULT] &
+					(1 << GSM_DIALECT_TURKISH));
+	g_assert(costs.septets[GSM_DIALECT_DEFAULT] == 4);
+
+	g_assert(costs.encodable[GSM_DIALECT_TURKISH] &
+					(1 << GSM_DIALECT_DEFAULT));
+	g_assert(costs.encodable[GSM_DIALECT_TURKISH] &
+					(1 << GSM_DIALECT_TURKISH));
+	g_assert(costs.septets[GSM_DIALECT_TURKISH] == 3);
+
+	/* Fewer dialects are preferred over fewer septets */
+	res = convert_utf8_to_gsm_best_lang("\xc5\x9f{", -1, &nread,
+						&nwritten, 0,
+						GSM_DIALECT_TURKISH, NULL, NULL);
+	g_assert(res);
+	g_assert(nwritten == 4);
+	g_assert(res[0] == 0x1b && res[1] == 0x73);
+	l_free(res);
+
+	g_assert(gsm_encoding_costs_from_utf8("abc", -1, &costs));
+	g_assert(costs.encodable[GSM_DIALECT_DEFAULT] ==
+					(1 << GSM_DIALECT_COUNT) - 1);
+	g_assert(costs.septets[GSM_DIALECT_DEFAULT] == 3);
+
+	g_assert(!gsm_encoding_costs_from_utf8("\xc5", -1, &costs));
+}
+
 static const char hex_packed_sms[] = "493A283D0795C3F33C88FE06C9CB6132885EC6D34"
 					"1EDF27C1E3E97E7207B3A0C0A5241E377BB1D"
 					"7693E72E";
@@ -785,6 +826,46 @@ static void test_sms_handling(void)
 	l_free(packed);
 }
 
+static void test_pack_lengths(void)
+{
+	unsigned char septets[64];
+	unsigned char *packed;
+	unsigned char *unpacked;
+	long packed_size;
+	long unpacked_size;
+	long len;
+	int offset;
+
+	for (len = 0; len < (long) sizeof(septets); len++)
+		septets[len] = (len * 37 + 11) & 0x7f;
+
+	/*
+	 * Whole groups of eight septets are handled separately from the
+	 * rest, cover every split between the two at every offset
+	 */
+	for (offset = 0; offset < 7; offset++) {
+		for (len = 1; len <= (long) sizeof(septets); len++) {
+			packed = pack_7bit(septets, len, offset, false,
+						&packed_size, 0);
+			g_assert(packed != NULL);
+			g_assert(packed_size ==
+					((offset ? 7 - offset : 0) +
+					len * 7 + 7) / 8);
+
+			unpacked = unpack_7bit(packed, packed_size, offset,
+						false, len, &unpacked_size,
+						0xff);
+			g_assert(unpacked != NULL);
+			g_assert(unpacked_size == len);
+			g_assert(memcmp(unpacked, septets, len) == 0);
+			g_assert(unpacked[len] == 0xff);
+
+			l_free(unpacked);
+			l_free(packed);
+		}
+	}
+}
+
 static void test_offset_handling(void)
 {
 	unsigned char c7[] = { 'a', 'b', 'c', 'd', 'e', 'f', 'g' };
@@ -1008,11 +1089,13 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/Valid Conversions", test_valid);
 	g_test_add_func("/testutil/Valid Turkish National Variant Conversions",
 			test_valid_turkish);
+	g_test_add_func("/testutil/Encoding Costs", test_encoding_costs);
 	g_test_add_func("/testutil/Decode Encode", test_decode_encode);
 	g_test_add_func("/testutil/Pack Size", test_pack_size);
 	g_test_add_func("/testutil/CBS CR Handling", test_cr_handling);
 	g_test_add_func("/testutil/SMS Handling", test_sms_handling);
 	g_test_add_func("/testutil/Offset Handling", test_offset_handling);
+	g_test_add_func("/testutil/Pack Lengths", test_pack_lengths);
 	g_test_add_func("/testutil/SIM conversions", test_sim);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);